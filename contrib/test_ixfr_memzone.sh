@@ -0,0 +1,77 @@
+#!/bin/bash
+#
+# Check that a memzone slave already holding a zone applies a change on the
+# master as an IXFR delta rather than transferring the whole zone again.
+#
+# Needs nsupdate, a master for the zone that keeps IXFR history (mydns with
+# the journal enabled, or BIND with ixfr-from-differences) and NOTIFYs the
+# slave, and the slave's log (syslog or its -l file) readable here.
+#
+#   ZONE=example.com. SLAVE=192.0.2.53 LOGFILE=/var/log/syslog ./test_ixfr_memzone.sh
+
+MASTER=${MASTER:-127.0.0.1}
+ZONE=${ZONE:-example.com.}
+SLAVE=${SLAVE:?set SLAVE to the address of a memzone slave for $ZONE}
+LOGFILE=${LOGFILE:?set LOGFILE to the log the slave writes to}
+KEYFILE=${KEYFILE:-}            # nsupdate -k key file, if updates need TSIG
+WAIT=${WAIT:-30}                # seconds to wait for the slave to catch up
+NAME="ixfr-test.$ZONE"
+VALUE="ixfr $(date +%s)"
+
+echo "=== Testing IXFR into memzone for $ZONE ==="
+echo "Master $MASTER, slave $SLAVE, slave log $LOGFILE"
+echo ""
+
+serial() {
+    dig @"$1" "$ZONE" SOA +short +tries=1 +time=2 | awk '{print $3}'
+}
+
+before=$(serial "$SLAVE")
+if [ -z "$before" ]; then
+    echo "✗ Slave does not answer for $ZONE; load the zone with a first transfer."
+    exit 1
+fi
+echo "Slave serial before the update: $before"
+
+# Only log lines written from here on count
+lines=$(wc -l < "$LOGFILE")
+
+echo "Updating $NAME on the master..."
+nsupdate ${KEYFILE:+-k "$KEYFILE"} <<EOF
+server $MASTER
+zone $ZONE
+update delete $NAME TXT
+update add $NAME 60 TXT "$VALUE"
+send
+EOF
+
+echo "Waiting up to $WAIT seconds for the slave..."
+for ((i = 0; i < WAIT; i++)); do
+    answer=$(dig @"$SLAVE" "$NAME" TXT +short +tries=1 +time=1)
+    [ "$answer" = "\"$VALUE\"" ] && break
+    sleep 1
+done
+after=$(serial "$SLAVE")
+log=$(tail -n +$((lines + 1)) "$LOGFILE")
+
+echo ""
+echo "=== Test Results ==="
+echo "Slave serial after the update: $after"
+echo "Slave answer for $NAME: ${answer:-none}"
+echo "$log" | grep -E "IXFR|AXFR|Zone transfer" | sed 's/^/  /'
+echo ""
+
+if [ "$answer" != "\"$VALUE\"" ]; then
+    echo "✗ The slave never served the updated record."
+    exit 1
+fi
+if ! echo "$log" | grep -q "Applied IXFR changes to zone ${ZONE%.}"; then
+    echo "✗ The slave did not apply the change as an IXFR delta."
+    exit 1
+fi
+if echo "$log" | grep -q "requesting AXFR\|Requesting AXFR\|applying full transfer"; then
+    echo "✗ The slave fell back to a full transfer."
+    exit 1
+fi
+echo "✓ The memzone slave applied the IXFR delta and serves the new record."
+exit 0
@@ -0,0 +1,74 @@
+#!/bin/bash
+#
+# Check that two updates to a zone inside notify-interval send one NOTIFY,
+# and that the second goes out only once the interval has passed.
+#
+# Needs root (tcpdump), nsupdate, and a slave for the zone that answers NOTIFY,
+# so the first NOTIFY task finishes before the second update arrives.
+#
+#   ZONE=example.com. SLAVE=192.0.2.53 ./test_notify_interval.sh
+
+SERVER=${SERVER:-127.0.0.1}
+ZONE=${ZONE:-example.com.}
+SLAVE=${SLAVE:?set SLAVE to the address of a slave for $ZONE}
+INTERVAL=${INTERVAL:-5}         # notify-interval in mydns.conf
+KEYFILE=${KEYFILE:-}            # nsupdate -k key file, if updates need TSIG
+CAPTURE=$(mktemp)
+
+echo "=== Testing NOTIFY rate limiting for $ZONE ==="
+echo "notify-interval is $INTERVAL seconds; NOTIFYs to $SLAVE are counted"
+echo ""
+
+# Send one update to the zone
+send_update() {
+    local name="notify-test-$1.$ZONE"
+    nsupdate ${KEYFILE:+-k "$KEYFILE"} <<EOF
+server $SERVER
+zone $ZONE
+update delete $name TXT
+update add $name 60 TXT "update $1 at $(date +%s)"
+send
+EOF
+}
+
+# Count the packets captured so far; the filter keeps only NOTIFY requests
+count_notifies() {
+    tcpdump -nr "$CAPTURE" 2>/dev/null | wc -l
+}
+
+# Opcode 4 with QR clear: NOTIFY requests, not replies
+tcpdump -ni any -U -w "$CAPTURE" \
+    "udp and dst host $SLAVE and dst port 53 and (udp[10] & 0xf8) = 0x20" 2>/dev/null &
+TCPDUMP=$!
+sleep 1
+
+echo "Sending first update..."
+send_update 1
+sleep 1
+echo "Sending second update inside the interval..."
+send_update 2
+
+# Wait until just before the interval ends
+sleep $((INTERVAL - 2))
+inside=$(count_notifies)
+
+# Then past it, for the merged NOTIFY
+sleep 3
+after=$(count_notifies)
+
+kill $TCPDUMP 2>/dev/null
+wait $TCPDUMP 2>/dev/null
+rm -f "$CAPTURE"
+
+echo ""
+echo "=== Test Results ==="
+echo "NOTIFYs inside the interval: $inside"
+echo "NOTIFYs once it had passed: $after"
+echo ""
+
+if [ "$inside" -eq 1 ] && [ "$after" -eq 2 ]; then
+    echo "✓ One NOTIFY per notify-interval; the second update was announced after it."
+    exit 0
+fi
+echo "✗ Expected 1 NOTIFY inside the interval and 2 after it."
+exit 1
@@ -337,6 +337,55 @@ Errx(const char *fmt, ...) {
 /*--- Errx() ------------------------------------------------------------------------------------*/
 
 
+/**************************************************************************************************
+	_LOG
+	Outputs a message at syslog priority `priority'.  Called through the Log() and LogLimit()
+	macros, which have already decided it should be output.
+**************************************************************************************************/
+void
+_Log(int priority, const char *fmt, ...) {
+  char *msg = NULL;
+  va_list ap;
+
+  /* Construct output string */
+  va_start(ap, fmt);
+  VASPRINTF(&msg, fmt, ap);
+  va_end(ap);
+
+  _error_out(priority, 0, 0, msg);
+
+  RELEASE(msg);
+}
+/*--- _Log() ------------------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	_LOG_LIMIT
+	Counts a message from the call site at `file':`line' against its limit `l'.  Returns 1 if
+	it should be output, 0 if it should be dropped.  When a new window begins, reports how many
+	were dropped in the last.
+**************************************************************************************************/
+int
+_log_limit(LOG_LIMIT *l, int priority, const char *file, int line) {
+  time_t now = time(NULL);
+
+  if (now - l->window >= LOG_LIMIT_SECONDS) {
+    if (l->suppressed)
+      _Log(priority, _("%s:%d: %u similar messages suppressed in the last %d seconds"),
+	   file, line, l->suppressed, (int)(now - l->window));
+    l->window = now;
+    l->count = l->suppressed = 0;
+  }
+  if (l->count < LOG_LIMIT_BURST) {
+    l->count++;
+    return (1);
+  }
+  l->suppressed++;
+  return (0);
+}
+/*--- _log_limit() ------------------------------------------------------------------------------*/
+
+
 /**************************************************************************************************
 	WARNSQL
 	Outputs a warning caused by an SQL query failure.
@@ -23,6 +23,372 @@ __mydns_arenaname(arena_t arena) {
   return "SHARED";
 }
 
+#if MEMMAN_SLAB
+/*
+ * Slab allocator for small objects
+ *
+ * Requests up to SLAB_MAX_OBJECT bytes are served from size-classed slabs
+ * carved out of a single reserved address range, so a release can tell
+ * slab objects from malloc'd ones with a range check and find the size
+ * class in the slab header.  Each thread keeps a magazine of free objects
+ * per size class; the shared depot behind them is only locked to refill
+ * or drain a magazine.  Anything larger, or anything that does not fit
+ * once the region is used up, goes to the C library as before.
+ */
+#include <pthread.h>
+#include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS		MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE		0
+#endif
+
+#define SLAB_SIZE		(64 * 1024)		/* Bytes per slab (also its alignment) */
+#define SLAB_MAGIC		0x534c4142		/* "SLAB" */
+#define SLAB_HEADER_SIZE	64			/* Space reserved at the start of each slab */
+#define SLAB_MAGAZINE_SIZE	32			/* Objects held per thread per size class */
+#define SLAB_CLASSES		10
+#define SLAB_MAX_OBJECT		512
+#if UINTPTR_MAX == 0xffffffff
+#define SLAB_REGION_SIZE	((size_t)64 * 1024 * 1024)
+#else
+#define SLAB_REGION_SIZE	((size_t)1024 * 1024 * 1024)
+#endif
+
+static const size_t slab_class_size[SLAB_CLASSES] = {
+  16, 32, 48, 64, 96, 128, 192, 256, 384, 512
+};
+
+typedef struct _slab_object {
+  struct _slab_object	*next;
+} SLAB_OBJECT;
+
+typedef struct _slab_header {
+  uint32_t		magic;
+  uint32_t		class;			/* Index into slab_class_size */
+} SLAB_HEADER;
+
+typedef struct _slab_depot {
+  SLAB_OBJECT		*free;			/* Objects returned by drained magazines */
+  char			*carve;			/* Next never-used object in the newest slab */
+  char			*carve_end;
+  unsigned long		slabs;			/* Slabs assigned to this class */
+} SLAB_DEPOT;
+
+typedef struct _slab_magazine {
+  int			count;
+  void			*objects[SLAB_MAGAZINE_SIZE];
+} SLAB_MAGAZINE;
+
+typedef struct _memman_thread {
+  SLAB_MAGAZINE		magazine[SLAB_CLASSES];
+  MEMMAN_STATS		stats[ARENA_COUNT];
+  struct _memman_thread	*next;
+} MEMMAN_THREAD;
+
+static pthread_once_t	slab_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t	slab_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t	slab_key;
+static char		*slab_region = NULL;		/* Reserved address range */
+static char		*slab_region_next = NULL;	/* Next unassigned slab */
+static char		*slab_region_end = NULL;
+static SLAB_DEPOT	slab_depot[SLAB_CLASSES];
+static MEMMAN_THREAD	*slab_threads = NULL;		/* All live thread caches */
+static MEMMAN_STATS	slab_retired[ARENA_COUNT];	/* Counters from exited threads */
+static uint8_t		slab_class_index[(SLAB_MAX_OBJECT >> 4) + 1];
+static __thread MEMMAN_THREAD *slab_self = NULL;
+
+#define ARENA_INDEX(A)		(((unsigned)(A) < ARENA_COUNT) ? (A) : ARENA_GLOBAL)
+#define SLAB_OWNS(P)		((char *)(P) >= slab_region && (char *)(P) < slab_region_end)
+#define SLAB_OF(P)		((SLAB_HEADER *)((uintptr_t)(P) & ~((uintptr_t)SLAB_SIZE - 1)))
+
+
+/*
+**  slab_stats_add
+**  Folds one set of counters into another.
+*/
+static void
+slab_stats_add(MEMMAN_STATS *to, MEMMAN_STATS *from) {
+  to->slab_allocs += from->slab_allocs;
+  to->slab_releases += from->slab_releases;
+  to->slab_bytes += from->slab_bytes;
+  to->large_allocs += from->large_allocs;
+  to->large_releases += from->large_releases;
+}
+
+/*
+**  slab_drain
+**  Returns up to `count' objects from a magazine to the depot.  Caller holds slab_lock.
+*/
+static void
+slab_drain(SLAB_MAGAZINE *mag, int class, int count) {
+  SLAB_DEPOT *depot = &slab_depot[class];
+
+  while (count-- > 0 && mag->count > 0) {
+    SLAB_OBJECT *obj = (SLAB_OBJECT *)mag->objects[--mag->count];
+    obj->next = depot->free;
+    depot->free = obj;
+  }
+}
+
+/*
+**  slab_thread_exit
+**  pthread key destructor: hand a dying thread's magazines and counters back.
+*/
+static void
+slab_thread_exit(void *arg) {
+  MEMMAN_THREAD *self = (MEMMAN_THREAD *)arg, **tp;
+  int n;
+
+  pthread_mutex_lock(&slab_lock);
+  for (n = 0; n < SLAB_CLASSES; n++)
+    slab_drain(&self->magazine[n], n, SLAB_MAGAZINE_SIZE);
+  for (n = 0; n < ARENA_COUNT; n++)
+    slab_stats_add(&slab_retired[n], &self->stats[n]);
+  for (tp = &slab_threads; *tp; tp = &(*tp)->next)
+    if (*tp == self) {
+      *tp = self->next;
+      break;
+    }
+  pthread_mutex_unlock(&slab_lock);
+  free(self);
+  slab_self = NULL;
+}
+
+static void slab_fork_prepare(void) { pthread_mutex_lock(&slab_lock); }
+static void slab_fork_parent(void) { pthread_mutex_unlock(&slab_lock); }
+static void slab_fork_child(void) { pthread_mutex_unlock(&slab_lock); }
+
+/*
+**  slab_init
+**  Reserves the slab address range.  Pages are only committed as slabs are handed out.
+*/
+static void
+slab_init(void) {
+  size_t n, class = 0;
+  void *region;
+
+  for (n = 0; n < NUM_ENTRIES(slab_class_index); n++) {
+    while (slab_class_size[class] < (n << 4)) class++;
+    slab_class_index[n] = (uint8_t)class;
+  }
+
+  if (pthread_key_create(&slab_key, slab_thread_exit))
+    return;
+  pthread_atfork(slab_fork_prepare, slab_fork_parent, slab_fork_child);
+
+  region = mmap(NULL, SLAB_REGION_SIZE + SLAB_SIZE, PROT_NONE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (region == MAP_FAILED)
+    return;
+
+  /* Align to SLAB_SIZE so SLAB_OF() can find the header of any object */
+  slab_region = (char *)(((uintptr_t)region + SLAB_SIZE - 1) & ~((uintptr_t)SLAB_SIZE - 1));
+  slab_region_next = slab_region;
+  slab_region_end = slab_region + SLAB_REGION_SIZE;
+}
+
+/*
+**  slab_thread
+**  Returns the calling thread's cache, creating it on first use.
+*/
+static MEMMAN_THREAD *
+slab_thread(void) {
+  MEMMAN_THREAD *self;
+
+  if ((self = slab_self))
+    return (self);
+
+  pthread_once(&slab_once, slab_init);
+  if (!slab_region || !(self = calloc(1, sizeof(MEMMAN_THREAD))))
+    return (NULL);
+
+  pthread_mutex_lock(&slab_lock);
+  self->next = slab_threads;
+  slab_threads = self;
+  pthread_mutex_unlock(&slab_lock);
+  pthread_setspecific(slab_key, self);
+
+  return (slab_self = self);
+}
+
+/*
+**  slab_refill
+**  Fills half a magazine from the depot, assigning a fresh slab to the class if needed.
+**  Returns the number of objects now in the magazine.
+*/
+static int
+slab_refill(SLAB_MAGAZINE *mag, int class) {
+  SLAB_DEPOT *depot = &slab_depot[class];
+  size_t objsize = slab_class_size[class];
+
+  pthread_mutex_lock(&slab_lock);
+  while (mag->count < SLAB_MAGAZINE_SIZE / 2) {
+    if (depot->free) {
+      mag->objects[mag->count++] = depot->free;
+      depot->free = depot->free->next;
+    } else if (depot->carve + objsize <= depot->carve_end) {
+      mag->objects[mag->count++] = depot->carve;
+      depot->carve += objsize;
+    } else {
+      SLAB_HEADER *slab = (SLAB_HEADER *)slab_region_next;
+
+      if (slab_region_next >= slab_region_end
+	  || mprotect(slab, SLAB_SIZE, PROT_READ | PROT_WRITE))
+	break;
+      slab_region_next += SLAB_SIZE;
+      slab->magic = SLAB_MAGIC;
+      slab->class = class;
+      depot->carve = (char *)slab + SLAB_HEADER_SIZE;
+      depot->carve_end = (char *)slab + SLAB_SIZE;
+      depot->slabs++;
+    }
+  }
+  pthread_mutex_unlock(&slab_lock);
+
+  return (mag->count);
+}
+
+/*
+**  slab_allocate
+**  Returns a zeroed object of at least `size' bytes, or NULL if the caller should use malloc.
+*/
+static void *
+slab_allocate(size_t size, arena_t arena) {
+  MEMMAN_THREAD *self = slab_thread();
+  SLAB_MAGAZINE *mag;
+  int class;
+  void *obj;
+
+  if (!self)
+    return (NULL);
+
+  class = slab_class_index[(size + 15) >> 4];
+  mag = &self->magazine[class];
+  if (!mag->count && !slab_refill(mag, class))
+    return (NULL);
+
+  obj = mag->objects[--mag->count];
+  memset(obj, 0, size);
+  self->stats[ARENA_INDEX(arena)].slab_allocs++;
+  self->stats[ARENA_INDEX(arena)].slab_bytes += slab_class_size[class];
+
+  return (obj);
+}
+
+/*
+**  slab_release
+**  Puts a slab object back on the calling thread's magazine.
+*/
+static void
+slab_release(void *object, arena_t arena) {
+  MEMMAN_THREAD *self = slab_thread();
+  SLAB_HEADER *slab = SLAB_OF(object);
+  SLAB_MAGAZINE *mag;
+
+  if (slab->magic != SLAB_MAGIC)
+    Errx("memoryman: release of %p which is not a slab object", object);
+
+  if (!self) {
+    SLAB_OBJECT *obj = (SLAB_OBJECT *)object;
+
+    pthread_mutex_lock(&slab_lock);
+    obj->next = slab_depot[slab->class].free;
+    slab_depot[slab->class].free = obj;
+    pthread_mutex_unlock(&slab_lock);
+    return;
+  }
+
+  mag = &self->magazine[slab->class];
+  if (mag->count == SLAB_MAGAZINE_SIZE) {
+    pthread_mutex_lock(&slab_lock);
+    slab_drain(mag, slab->class, SLAB_MAGAZINE_SIZE / 2);
+    pthread_mutex_unlock(&slab_lock);
+  }
+  mag->objects[mag->count++] = object;
+  self->stats[ARENA_INDEX(arena)].slab_releases++;
+  self->stats[ARENA_INDEX(arena)].slab_bytes -= slab_class_size[slab->class];
+}
+
+/*
+**  memman_stats
+**  Sums the allocation counters of every thread for one arena.
+*/
+void
+memman_stats(arena_t arena, MEMMAN_STATS *stats) {
+  MEMMAN_THREAD *t;
+
+  memset(stats, 0, sizeof(MEMMAN_STATS));
+  if (!slab_region)
+    return;
+
+  pthread_mutex_lock(&slab_lock);
+  slab_stats_add(stats, &slab_retired[ARENA_INDEX(arena)]);
+  for (t = slab_threads; t; t = t->next)
+    slab_stats_add(stats, &t->stats[ARENA_INDEX(arena)]);
+  pthread_mutex_unlock(&slab_lock);
+}
+
+/*
+**  memman_status
+**  Logs allocator statistics per arena and per size class.
+*/
+void
+memman_status(void) {
+  MEMMAN_STATS stats;
+  int n;
+
+  if (!slab_region)
+    return;
+
+  for (n = 0; n < ARENA_COUNT; n++) {
+    memman_stats((arena_t)n, &stats);
+    Notice(_("memory arena %s: %lu slab allocs, %lu slab releases, %ld slab bytes in use,"
+	     " %lu large allocs, %lu large releases"),
+	   __mydns_arenaname((arena_t)n), stats.slab_allocs, stats.slab_releases,
+	   stats.slab_bytes, stats.large_allocs, stats.large_releases);
+  }
+
+  pthread_mutex_lock(&slab_lock);
+  for (n = 0; n < SLAB_CLASSES; n++)
+    if (slab_depot[n].slabs)
+      Notice(_("memory slab class %u bytes: %lu slabs (%lu KB)"),
+	     (unsigned)slab_class_size[n], slab_depot[n].slabs,
+	     slab_depot[n].slabs * (SLAB_SIZE / 1024));
+  pthread_mutex_unlock(&slab_lock);
+}
+#else	/* !MEMMAN_SLAB */
+
+void
+memman_stats(arena_t arena, MEMMAN_STATS *stats) {
+  memset(stats, 0, sizeof(MEMMAN_STATS));
+}
+
+void
+memman_status(void) {
+}
+#endif	/* !MEMMAN_SLAB */
+
+/*
+**  memman_count_large
+**  Counts an allocation or release that went to the C library.
+*/
+static inline void
+memman_count_large(arena_t arena, int release) {
+#if MEMMAN_SLAB
+  MEMMAN_THREAD *self = slab_thread();
+
+  if (self) {
+    if (release)
+      self->stats[ARENA_INDEX(arena)].large_releases++;
+    else
+      self->stats[ARENA_INDEX(arena)].large_allocs++;
+  }
+#endif
+}
+
 int
 _mydns_asprintf(char **strp, const char *fmt, ...) {
   int reslength;
@@ -33,6 +399,7 @@ _mydns_asprintf(char **strp, const char *fmt, ...) {
   va_end(ap);
 
   if (reslength<0) Out_Of_Memory();
+  memman_count_large(ARENA_GLOBAL, 0);
 
   return (reslength);
 }
@@ -44,6 +411,7 @@ _mydns_vasprintf(char **strp, const char *fmt, va_list ap) {
   reslength = vasprintf(strp, fmt, ap);
 
   if (reslength<0) Out_Of_Memory();
+  memman_count_large(ARENA_GLOBAL, 0);
 
   return (reslength);
 }
@@ -55,6 +423,7 @@ _mydns_strdup(const char *s, arena_t arena, const char *file, int line) {
 #if HAVE_STRDUP
   news = strdup(s);
   if (!news) Out_Of_Memory();
+  memman_count_large(arena, 0);
 #else
   int slen = strlen(s);
   news = _mydns_allocate(slen+1, 1, arena, "##char []##", file, line);
@@ -73,6 +442,7 @@ _mydns_strndup(const char *s, size_t size, arena_t arena, const char *file, int
 #if HAVE_STRNDUP
   news = strndup(s, size);
   if (!news) Out_Of_Memory();
+  memman_count_large(arena, 0);
 #else
   news = _mydns_allocate(size+1, 1, arena, "##char []##", file, line);
   if (!news) Out_Of_Memory();
@@ -87,11 +457,20 @@ void *
 _mydns_allocate(size_t size, size_t count, arena_t arena, const char *type, const char *file, int line) {
 
   void *newobject = NULL;
-  /* We currently ignore arena which is there to allow shared memory or local allocation */
+  /* Arena only selects the statistics bucket; shared memory allocation is not implemented */
+
+  if (count && size > (size_t)-1 / count) Out_Of_Memory();
+
+#if MEMMAN_SLAB
+  if (count && size && count * size <= SLAB_MAX_OBJECT
+      && (newobject = slab_allocate(count * size, arena)))
+    return (newobject);
+#endif
 
   newobject = calloc(count, size);
 
   if (!newobject) Out_Of_Memory();
+  memman_count_large(arena, 0);
 
   return (newobject);
 }
@@ -100,7 +479,26 @@ void *
 _mydns_reallocate(void *oldobject, size_t size, size_t count, arena_t arena, const char *type, const char *file, int line) {
   void *newobject = NULL;
 
-  /* We currently ignore arena which is there to allow shared memory or local allocation */
+  /* Arena only selects the statistics bucket; shared memory allocation is not implemented */
+
+  if (count && size > (size_t)-1 / count) Out_Of_Memory();
+
+#if MEMMAN_SLAB
+  if (!oldobject)
+    return (_mydns_allocate(size, count, arena, type, file, line));
+
+  /* Slab objects cannot be resized in place beyond their class, so move them */
+  if (SLAB_OWNS(oldobject)) {
+    size_t oldsize = slab_class_size[SLAB_OF(oldobject)->class];
+
+    if (count * size != 0 && count * size <= oldsize)
+      return (oldobject);
+    newobject = _mydns_allocate(size, count, arena, type, file, line);
+    memcpy(newobject, oldobject, MIN(oldsize, count * size));
+    slab_release(oldobject, arena);
+    return (newobject);
+  }
+#endif
 
   newobject = realloc(oldobject, count * size);
 
@@ -112,9 +510,17 @@ _mydns_reallocate(void *oldobject, size_t size, size_t count, arena_t arena, con
 void
 _mydns_release(void *object, size_t count, arena_t arena, const char *file, int line) {
 
-  /* We currently ignore arena which is there to allow shared memory or local allocation */
+  if (!object) return;
+
+#if MEMMAN_SLAB
+  if (SLAB_OWNS(object)) {
+    slab_release(object, arena);
+    return;
+  }
+#endif
 
-  if (object) free(object); /* Use the system free directly - do not rely on the if NULL behaviour */
+  memman_count_large(arena, 1);
+  free(object); /* Use the system free directly - do not rely on the if NULL behaviour */
 
 }
 
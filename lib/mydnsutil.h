@@ -411,6 +411,11 @@ extern void		conf_load(MYDNS_CONFIG **, const char *);
 
 #define MEMMAN 1
 
+/* Serve small ALLOCATE requests from per-thread slab magazines (see memoryman.c) */
+#ifndef MEMMAN_SLAB
+#define MEMMAN_SLAB 1
+#endif
+
 #if MEMMAN == 0
 #define __ALLOCATE__(SIZE, THING, COUNT, ARENA) calloc(COUNT, SIZE)
 #define __REALLOCATE__(OBJECT, SIZE, THING, COUNT, ARENA) realloc(OBJECT, (COUNT)*(SIZE))
@@ -443,6 +448,16 @@ typedef enum _arena_t {
   ARENA_LOCAL		= 1,
   ARENA_SHARED0		= 2,
 } arena_t;
+#define ARENA_COUNT	3
+
+/* Allocation counters for one arena, summed over all threads */
+typedef struct _memman_stats {
+  unsigned long		slab_allocs;		/* Objects handed out from slabs */
+  unsigned long		slab_releases;
+  long			slab_bytes;		/* Slab bytes currently in use */
+  unsigned long		large_allocs;		/* Allocations passed to the C library */
+  unsigned long		large_releases;
+} MEMMAN_STATS;
 
 extern int	_mydns_asprintf(char **strp, const char *fmt, ...);
 extern int	_mydns_vasprintf(char **strp, const char *fmt, va_list ap);
@@ -451,6 +466,8 @@ extern char *	_mydns_strndup(const char *, size_t, arena_t, const char *, int);
 extern void *	_mydns_allocate(size_t, size_t, arena_t, const char *, const char *, int);
 extern void *	_mydns_reallocate(void *, size_t, size_t, arena_t, const char *, const char *, int);
 extern void	_mydns_release(void *, size_t, arena_t, const char *, int);
+extern void	memman_stats(arena_t, MEMMAN_STATS *);
+extern void	memman_status(void);
 
 #define ALLOCATE_GLOBAL(SIZE, THING) \
   __ALLOCATE__(SIZE, THING, 1, ARENA_GLOBAL)
@@ -521,6 +538,54 @@ extern void		Err(const char *, ...) __printflike(1,2);
 extern void		Errx(const char *, ...) __printflike(1,2);
 extern void		Out_Of_Memory(void);
 
+/*
+**  Leveled logging.  `Log(level, fmt, ...)' takes a syslog priority and tests it before any
+**  argument is evaluated or anything is formatted.  LOG_INFO is output when err_verbose is set
+**  and LOG_DEBUG when err_debug is; anything more severe always is.  Calls less severe than
+**  LOG_COMPILED_LEVEL are removed by the compiler -- without --enable-debug that is every
+**  LOG_DEBUG call, and it may be lowered further with CPPFLAGS="-DLOG_COMPILED_LEVEL=LOG_NOTICE".
+**
+**  `LogLimit(level, fmt, ...)' also limits its call site to LOG_LIMIT_BURST messages every
+**  LOG_LIMIT_SECONDS seconds.  The number dropped is reported with the next message the site
+**  outputs.  Use it for anything that can fail once per query.
+*/
+#ifndef LOG_COMPILED_LEVEL
+#if DEBUG_ENABLED
+#define LOG_COMPILED_LEVEL	LOG_DEBUG
+#else
+#define LOG_COMPILED_LEVEL	LOG_INFO
+#endif
+#endif
+
+#define LOG_LIMIT_BURST		5
+#define LOG_LIMIT_SECONDS	60
+
+typedef struct _log_limit {					/* Rate limit for one call site */
+  time_t	window;						/* When the current window began */
+  uint32_t	count;						/* Messages output in it */
+  uint32_t	suppressed;					/* Messages dropped in it */
+} LOG_LIMIT;
+
+#if DEBUG_ENABLED
+#define LOG_WANTED(level) \
+  ((level) <= LOG_COMPILED_LEVEL && ((level) < LOG_INFO || ((level) == LOG_INFO ? err_verbose : err_debug)))
+#else
+#define LOG_WANTED(level) \
+  ((level) <= LOG_COMPILED_LEVEL && ((level) < LOG_INFO || ((level) == LOG_INFO && err_verbose)))
+#endif
+
+#define Log(level, ...) \
+  do { if (LOG_WANTED(level)) _Log((level), __VA_ARGS__); } while (0)
+#define LogLimit(level, ...) \
+  do { \
+    static LOG_LIMIT __log_limit; \
+    if (LOG_WANTED(level) && _log_limit(&__log_limit, (level), __FILE__, __LINE__)) \
+      _Log((level), __VA_ARGS__); \
+  } while (0)
+
+extern void		_Log(int, const char *, ...) __printflike(2,3);
+extern int		_log_limit(LOG_LIMIT *, int, const char *, int);
+
 #if USE_PGSQL
 extern int		WarnSQL(PGconn *, const char *, ...) __printflike(2,3);
 extern void		ErrSQL(PGconn *, const char *, ...) __printflike(2,3);
@@ -0,0 +1,443 @@
+/**************************************************************************************************
+	Copyright (C) 2002-2005  Don Moore <bboy@bboy.net>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at Your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+**************************************************************************************************/
+
+/*
+**  Audit log writer.
+**
+**  Rows for the audit tables are queued in memory, up to `audit-queue' of them in each
+**  process, and written by a thread of that process over a database connection of its own,
+**  every `audit-flush-interval' seconds or when the queue is half full.  Consecutive rows for
+**  the same table go in one multi-row INSERT; if that fails on a connection that is still up,
+**  the rows are tried one at a time so that one bad row loses only itself.
+**
+**  When the queue is full, or the database can't be reached, rows are dropped and counted, or,
+**  if `audit-overflow' names a file, appended to it as INSERT statements that can be replayed
+**  later.  Nothing that adds a row ever waits for the database.
+**
+**  The thread is started by the first row a process adds, so each server has its own; a
+**  process forked while one ran leaves the rows it inherited to its parent.
+*/
+
+#include "mydns.h"
+
+#include <pthread.h>
+
+#define AUDIT_STATEMENT_MAX	(64 * 1024)			/* Longest INSERT the writer builds */
+
+/* Each row ends with the time it was added, so rows written late or replayed keep it */
+#if USE_PGSQL
+#define AUDIT_TIME		"to_timestamp(%lu)"
+#else
+#define AUDIT_TIME		"FROM_UNIXTIME(%lu)"
+#endif
+
+typedef struct _audit_row {
+  audit_table_t	table;
+  char		*values;					/* The row's "(...)" */
+} AUDIT_ROW;
+
+static const char *audit_insert[AUDIT_TABLES] = {
+  "INSERT INTO access_control_log "
+  "(source_ip, country_code, access_type, zone_id, query_name, action, rule_matched, "
+  "date_created) VALUES ",
+  "INSERT INTO dnsmanager_logs (action, details, ip_address, created_at) VALUES ",
+  "INSERT INTO update_log (zone, source_ip, key_name, operation_type, "
+  "record_name, record_type, record_data, success, rcode, new_serial, created_at) VALUES ",
+  "INSERT INTO zone_transfer_log "
+  "(zone_id, master_host, status, records_received, records_added, "
+  "records_updated, records_deleted, transfer_time, error_message, created_at) VALUES ",
+  "INSERT INTO tsig_usage_log (key_id, operation, source_ip, success, created_at) VALUES ",
+  "INSERT INTO dnssec_log (zone_id, operation, success, details, timestamp) VALUES "
+};
+
+static pthread_mutex_t	audit_lock = PTHREAD_MUTEX_INITIALIZER;	/* Guards everything below */
+static pthread_cond_t	audit_wake = PTHREAD_COND_INITIALIZER;
+static pthread_once_t	audit_once = PTHREAD_ONCE_INIT;
+static pthread_t	audit_thread;
+
+static int		Running = 0;				/* Writer started in this process */
+static int		Stopping = 0;				/* auditlog_close() was called */
+static char		*WriterHost = NULL;			/* Host the writer connects to */
+static int		WriterConnected = 0;
+
+static AUDIT_ROW	*Queue = NULL;				/* Ring of `audit_queue' rows */
+static int		QueueHead = 0, QueueCount = 0;
+static FILE		*Spill = NULL;				/* Open `audit-overflow' file */
+
+static uint32_t		Queued = 0, Written = 0, Spilled = 0, Dropped = 0, Failed = 0;
+static uint32_t		Reported = 0;				/* Dropped + Failed when last warned */
+
+
+/**************************************************************************************************
+	AUDITLOG_ATFORK_*
+	Keep the lock usable across fork().  The child has no writer, so it starts its own; the
+	parent's writer may have been waiting on `audit_wake', so the child gets a fresh one.
+**************************************************************************************************/
+static void auditlog_atfork_prepare(void) { pthread_mutex_lock(&audit_lock); }
+static void auditlog_atfork_parent(void) { pthread_mutex_unlock(&audit_lock); }
+static void
+auditlog_atfork_child(void) {
+  Running = 0;
+  pthread_cond_init(&audit_wake, NULL);
+  pthread_mutex_unlock(&audit_lock);
+}
+
+static void
+auditlog_atfork(void) {
+  pthread_atfork(auditlog_atfork_prepare, auditlog_atfork_parent, auditlog_atfork_child);
+}
+/*--- auditlog_atfork() -------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	AUDITLOG_OVERFLOW
+	Disposes of a row that can't be written: appends it to the overflow file if one is open,
+	otherwise drops it.  Called with the lock held.  Frees the row's values.
+**************************************************************************************************/
+static void
+auditlog_overflow(AUDIT_ROW *row) {
+  if (Spill && fprintf(Spill, "%s%s;\n", audit_insert[row->table], row->values) > 0 && !fflush(Spill))
+    Spilled++;
+  else
+    Dropped++;
+  RELEASE(row->values);
+}
+/*--- auditlog_overflow() -----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	AUDITLOG_EXEC
+	Runs `query' on the writer's connection without outputting anything.  Returns 0 on success.
+**************************************************************************************************/
+static int
+auditlog_exec(SQL *conn, const char *query, size_t querylen) {
+#if USE_PGSQL
+  PGresult *res = PQexec(conn, query);
+  int rv = (PQresultStatus(res) == PGRES_COMMAND_OK) ? 0 : -1;
+
+  PQclear(res);
+  return (rv);
+#else
+  return (mysql_real_query(conn, query, querylen) ? -1 : 0);
+#endif
+}
+
+static int
+auditlog_connection_ok(SQL *conn) {
+#if USE_PGSQL
+  return (PQstatus(conn) == CONNECTION_OK);
+#else
+  return (!mysql_ping(conn));
+#endif
+}
+/*--- auditlog_exec() ---------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	AUDITLOG_WRITE
+	Writes `count' rows over `*conn', freeing them.  If the connection is lost, closes it and
+	hands the rows not yet written to auditlog_overflow().
+**************************************************************************************************/
+static void
+auditlog_write(SQL **conn, AUDIT_ROW *rows, int count) {
+  int		first = 0, last = 0, n = 0;
+  uint32_t	written = 0, failed = 0;
+  size_t	querylen = 0;
+  char		*query = NULL, *dest = NULL;
+
+  for (first = 0; first < count; first = last) {
+    /* As many rows for the same table as fit in one statement */
+    querylen = strlen(audit_insert[rows[first].table]) + strlen(rows[first].values);
+    for (last = first + 1; last < count && rows[last].table == rows[first].table; last++) {
+      if (querylen + 1 + strlen(rows[last].values) > AUDIT_STATEMENT_MAX)
+	break;
+      querylen += 1 + strlen(rows[last].values);
+    }
+    dest = query = ALLOCATE(querylen + 1, char[]);
+    dest = stpcpy(dest, audit_insert[rows[first].table]);
+    for (n = first; n < last; n++) {
+      if (n > first)
+	*dest++ = ',';
+      dest = stpcpy(dest, rows[n].values);
+    }
+
+    if (!auditlog_exec(*conn, query, querylen)) {
+      written += last - first;
+    } else if (!auditlog_connection_ok(*conn)) {
+      RELEASE(query);
+      sql_close(*conn);
+      pthread_mutex_lock(&audit_lock);
+      for (n = first; n < count; n++)
+	auditlog_overflow(&rows[n]);
+      pthread_mutex_unlock(&audit_lock);
+      count = first;
+      break;
+    } else if (last - first > 1) {
+      /* One of the rows is bad; try them one at a time */
+      for (n = first; n < last; n++) {
+	RELEASE(query);
+	querylen = ASPRINTF(&query, "%s%s", audit_insert[rows[n].table], rows[n].values);
+	if (!auditlog_exec(*conn, query, querylen))
+	  written++;
+	else
+	  failed++;
+      }
+    } else
+      failed++;
+    RELEASE(query);
+  }
+
+  for (n = 0; n < count; n++)
+    RELEASE(rows[n].values);
+
+  pthread_mutex_lock(&audit_lock);
+  Written += written;
+  Failed += failed;
+  pthread_mutex_unlock(&audit_lock);
+}
+/*--- auditlog_write() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	AUDITLOG_WRITER
+	The writer thread.  Waits for rows, takes all that are queued and writes them.
+**************************************************************************************************/
+static void *
+auditlog_writer(void *unused) {
+  SQL		*conn = NULL;
+  AUDIT_ROW	*batch = ALLOCATE(audit_queue * sizeof(AUDIT_ROW), AUDIT_ROW[]);
+  struct timespec until;
+  int		count = 0, backoff = 0, wake = MAX(audit_queue / 2, 1);
+
+#if !USE_PGSQL
+  mysql_thread_init();
+#endif
+
+  pthread_mutex_lock(&audit_lock);
+  for (;;) {
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += audit_flush_interval;
+    while (!Stopping && (backoff || QueueCount < wake))
+      if (pthread_cond_timedwait(&audit_wake, &audit_lock, &until) == ETIMEDOUT)
+	break;
+    backoff = 0;
+
+    if (!QueueCount) {
+      if (Stopping)
+	break;
+      continue;
+    }
+
+    /* Connect with the lock released; rows queue up meanwhile, or overflow */
+    if (!conn) {
+      char *host = WriterHost ? STRDUP(WriterHost) : NULL;
+
+      pthread_mutex_unlock(&audit_lock);
+      conn = sql_connect(host);
+      RELEASE(host);
+      pthread_mutex_lock(&audit_lock);
+      WriterConnected = (conn != NULL);
+      if (!conn) {
+	if (Stopping)
+	  break;
+	backoff = 1;					/* Try again in a while */
+	continue;
+      }
+    }
+
+    for (count = 0; QueueCount; count++, QueueCount--) {
+      batch[count] = Queue[QueueHead];
+      QueueHead = (QueueHead + 1) % audit_queue;
+    }
+    pthread_mutex_unlock(&audit_lock);
+
+    auditlog_write(&conn, batch, count);
+
+    pthread_mutex_lock(&audit_lock);
+    WriterConnected = (conn != NULL);
+  }
+
+  /* Stopping without a database: keep what is left the only way there is */
+  while (QueueCount) {
+    auditlog_overflow(&Queue[QueueHead]);
+    QueueHead = (QueueHead + 1) % audit_queue;
+    QueueCount--;
+  }
+  pthread_mutex_unlock(&audit_lock);
+
+  sql_close(conn);
+  RELEASE(batch);
+#if !USE_PGSQL
+  mysql_thread_end();
+#endif
+  return (NULL);
+}
+/*--- auditlog_writer() -------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	AUDITLOG_START
+	Starts the writer for this process.  Called with the lock held.  Returns 0 on success.
+**************************************************************************************************/
+static int
+auditlog_start(void) {
+  int err = 0;
+
+  pthread_once(&audit_once, auditlog_atfork);
+
+  /* Rows inherited from a parent are the parent's to write */
+  while (QueueCount) {
+    RELEASE(Queue[QueueHead].values);
+    QueueHead = (QueueHead + 1) % audit_queue;
+    QueueCount--;
+  }
+  if (!Queue)
+    Queue = ALLOCATE(audit_queue * sizeof(AUDIT_ROW), AUDIT_ROW[]);
+  QueueHead = 0;
+  Stopping = 0;
+  WriterConnected = 0;
+  RELEASE(WriterHost);
+  WriterHost = sql_active_host() ? STRDUP(sql_active_host()) : NULL;
+  if (!Spill && audit_overflow && *audit_overflow && strcasecmp(audit_overflow, "drop")
+      && !(Spill = fopen(audit_overflow, "a")))
+    Warn("%s: %s", audit_overflow, _("error opening audit overflow file"));
+
+  if ((err = pthread_create(&audit_thread, NULL, auditlog_writer, NULL))) {
+    LogLimit(LOG_WARNING, "%s: %s", _("error starting audit log writer"), strerror(err));
+    return (-1);
+  }
+  Running = 1;
+  return (0);
+}
+/*--- auditlog_start() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	AUDITLOG_ADD
+	Adds a row to an audit table.  `fmt' and its arguments give the row's values, already
+	escaped, without their parentheses or the time column, which is set here to the time of
+	the call.  The row is queued for the writer unless `audit-queue' is 0
+	or there is no writer, in which case it is written at once over `db'.  Does nothing
+	without a database.
+**************************************************************************************************/
+void
+auditlog_add(SQL *db, audit_table_t table, const char *fmt, ...) {
+  char		*fields = NULL, *values = NULL, *query = NULL;
+  size_t	querylen = 0;
+  time_t	now = time(NULL);
+  uint32_t	dropped = 0, failed = 0;
+  int		queued = 0, report = 0;
+  va_list	ap;
+
+  if (!db || (unsigned int)table >= AUDIT_TABLES)
+    return;
+
+  va_start(ap, fmt);
+  VASPRINTF(&fields, fmt, ap);
+  va_end(ap);
+  ASPRINTF(&values, "(%s, " AUDIT_TIME ")", fields, (unsigned long)now);
+  RELEASE(fields);
+
+  if (audit_queue > 0) {
+    pthread_mutex_lock(&audit_lock);
+    if (!Stopping && (Running || !auditlog_start())) {
+      AUDIT_ROW row = { table, values };
+
+      if (QueueCount < audit_queue) {
+	Queue[(QueueHead + QueueCount++) % audit_queue] = row;
+	Queued++;
+	if (QueueCount >= audit_queue / 2)
+	  pthread_cond_signal(&audit_wake);
+      } else
+	auditlog_overflow(&row);
+      queued = 1;
+
+      /* Follow the server connection to another host while the writer has none */
+      if (!WriterConnected && sql_active_host()
+	  && (!WriterHost || strcmp(WriterHost, sql_active_host()))) {
+	RELEASE(WriterHost);
+	WriterHost = STRDUP(sql_active_host());
+      }
+    }
+    dropped = Dropped;
+    failed = Failed;
+    if ((report = (dropped + failed != Reported)))
+      Reported = dropped + failed;
+    pthread_mutex_unlock(&audit_lock);
+
+    if (report)
+      LogLimit(LOG_WARNING, _("audit log: %u rows dropped, %u failed"), dropped, failed);
+    if (queued)
+      return;
+  }
+
+  /* Written at once */
+  querylen = ASPRINTF(&query, "%s%s", audit_insert[table], values);
+  if (sql_nrquery(db, query, querylen))
+    LogLimit(LOG_WARNING, _("audit log: error writing row: %s"), query);
+  RELEASE(query);
+  RELEASE(values);
+}
+/*--- auditlog_add() ----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	AUDITLOG_CLOSE
+	Writes what is queued and stops this process's writer.  Called at shutdown.
+**************************************************************************************************/
+void
+auditlog_close(void) {
+  pthread_mutex_lock(&audit_lock);
+  if (!Running) {
+    pthread_mutex_unlock(&audit_lock);
+    return;
+  }
+  Stopping = 1;
+  pthread_cond_signal(&audit_wake);
+  pthread_mutex_unlock(&audit_lock);
+
+  pthread_join(audit_thread, NULL);
+
+  pthread_mutex_lock(&audit_lock);
+  Running = 0;
+  if (Spill) {
+    fclose(Spill);
+    Spill = NULL;
+  }
+  pthread_mutex_unlock(&audit_lock);
+}
+/*--- auditlog_close() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	AUDITLOG_STATUS
+	Outputs the writer's counters, if this process has one.
+**************************************************************************************************/
+void
+auditlog_status(void) {
+  pthread_mutex_lock(&audit_lock);
+  if (Running)
+    Notice(_("audit log: %u rows queued, %u written, %u waiting, %u spilled, %u dropped, %u failed%s"),
+	   Queued, Written, QueueCount, Spilled, Dropped, Failed,
+	   WriterConnected ? "" : _(" (not connected)"));
+  pthread_mutex_unlock(&audit_lock);
+}
+/*--- auditlog_status() -------------------------------------------------------------------------*/
+
+/* vi:set ts=3: */
+/* NEED_PO */
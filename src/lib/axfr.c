@@ -18,6 +18,8 @@
 #include <poll.h>
 #include <errno.h>
 #include <string.h>
+#include <fcntl.h>
+#include <time.h>
 
 /* Global memzone context (for zone transfer updates) */
 extern memzone_ctx_t *Memzone;
@@ -40,9 +42,22 @@ typedef struct {
 } dns_question_t;
 
 /* Maximum AXFR response size */
-#define AXFR_MAX_RESPONSE_SIZE (65536 * 100)  /* 100 DNS messages max */
 #define AXFR_BUFFER_SIZE 65536
 #define AXFR_TIMEOUT 300  /* 5 minutes timeout */
+#define AXFR_BATCH_RECORDS 500  /* Records written to the database at a time */
+#define AXFR_POLL_WINDOW 1024   /* SOA queries in flight at once */
+#define AXFR_POLL_TIMEOUT 2000  /* Milliseconds to wait for each SOA reply */
+#define AXFR_POLL_TRIES 3       /* SOA queries sent per zone before giving up */
+#define AXFR_INSERT_ROWS 500    /* Rows per multi-row INSERT into the staging table */
+#define AXFR_INSERT_SIZE 65536  /* Flush a multi-row INSERT once it grows past this */
+#define AXFR_SOA_ONLY_WAIT 3    /* Seconds to wait for more after an IXFR's lone newer SOA */
+
+/* Compares text byte for byte, so a change of case is a change (PostgreSQL text already is) */
+#if USE_PGSQL
+#define AXFR_BINARY ""
+#else
+#define AXFR_BINARY "BINARY "
+#endif
 
 /**
  * Initialize AXFR module
@@ -256,35 +271,32 @@ void axfr_free_zone(axfr_zone_t *zone) {
 }
 
 /**
- * Parse SOA record from DNS response and extract serial
+ * Parse SERIAL, REFRESH, RETRY and EXPIRE from SOA RDATA into fields[0..3]
  */
-static uint32_t parse_soa_serial(const unsigned char *rdata, size_t rdlen) {
+static void parse_soa_fields(const unsigned char *rdata, size_t rdlen, uint32_t fields[4]) {
     const unsigned char *p = rdata;
     const unsigned char *end = rdata + rdlen;
-    uint32_t serial = 0;
 
-    /* Skip MNAME (primary nameserver) */
-    while (p < end && *p) {
-        int label_len = *p;
-        if (label_len > 63) break;  /* Invalid label */
-        p += label_len + 1;
-    }
-    if (p < end) p++;  /* Skip final zero */
+    memset(fields, 0, 4 * sizeof(uint32_t));
 
-    /* Skip RNAME (admin email) */
-    while (p < end && *p) {
-        int label_len = *p;
-        if (label_len > 63) break;
-        p += label_len + 1;
+    /* Skip MNAME (primary nameserver) and RNAME (admin email) */
+    for (int i = 0; i < 2; i++) {
+        while (p < end && *p) {
+            int label_len = *p;
+            if ((label_len & 0xC0) == 0xC0) {
+                p++;        /* Compression pointer ends the name */
+                break;
+            }
+            if (label_len > 63) break;  /* Invalid label */
+            p += label_len + 1;
+        }
+        if (p < end) p++;  /* Skip final zero or second pointer octet */
     }
-    if (p < end) p++;  /* Skip final zero */
 
-    /* Read serial (32-bit unsigned) */
-    if (p + 4 <= end) {
-        serial = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    /* Read the 32-bit values that follow */
+    for (int i = 0; i < 4 && p + 4 <= end; i++, p += 4) {
+        fields[i] = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
     }
-
-    return serial;
 }
 
 /**
@@ -297,149 +309,14 @@ static uint32_t parse_soa_serial(const unsigned char *rdata, size_t rdlen) {
  *  -1: Error (couldn't query master)
  */
 int axfr_check_serial(axfr_zone_t *zone) {
-    int sockfd = -1;
-    unsigned char query[512];
-    unsigned char response[4096];
-    int query_size;
-    ssize_t response_size;
-    struct sockaddr_in server_addr;
-    struct hostent *host;
-    dns_header_t *header;
-    const unsigned char *p;
-    uint16_t qdcount, ancount;
-    int ret = -1;
+    int result = -1;
 
     if (!zone || !zone->zone_name || !zone->master_host) {
         return -1;
     }
 
-    /* Resolve master hostname */
-    host = gethostbyname(zone->master_host);
-    if (!host) {
-        Warnx(_("axfr_check_serial: Cannot resolve master %s"), zone->master_host);
-        return -1;
-    }
-
-    /* Create UDP socket */
-    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0) {
-        Warnx(_("axfr_check_serial: socket() failed"));
-        return -1;
-    }
-
-    /* Set timeout */
-    struct timeval tv;
-    tv.tv_sec = 5;
-    tv.tv_usec = 0;
-    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-
-    /* Build server address */
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(zone->master_port);
-    memcpy(&server_addr.sin_addr, host->h_addr_list[0], host->h_length);
-
-    /* Create DNS query for SOA */
-    query_size = axfr_create_query(zone->zone_name, 0x1234, query, sizeof(query));
-    if (query_size < 0) {
-        Warnx(_("axfr_check_serial: Failed to create SOA query"));
-        goto cleanup;
-    }
-
-    /* Change QTYPE from AXFR (252) to SOA (6) */
-    /* Query format: header + qname + qtype + qclass */
-    /* QTYPE is 2 bytes before QCLASS at the end */
-    query[query_size - 4] = 0;
-    query[query_size - 3] = 6;  /* QTYPE = SOA */
-
-    /* Send query */
-    if (sendto(sockfd, query, query_size, 0,
-               (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        Warnx(_("axfr_check_serial: sendto() failed for zone %s"), zone->zone_name);
-        goto cleanup;
-    }
-
-    /* Receive response */
-    response_size = recvfrom(sockfd, response, sizeof(response), 0, NULL, NULL);
-    if (response_size < (ssize_t)sizeof(dns_header_t)) {
-        Warnx(_("axfr_check_serial: No response or timeout for zone %s"), zone->zone_name);
-        goto cleanup;
-    }
-
-    /* Parse response header */
-    header = (dns_header_t *)response;
-    qdcount = ntohs(header->qdcount);
-    ancount = ntohs(header->ancount);
-
-    if (ancount == 0) {
-        Warnx(_("axfr_check_serial: No SOA record in response for zone %s"), zone->zone_name);
-        goto cleanup;
-    }
-
-    /* Skip question section */
-    p = response + sizeof(dns_header_t);
-    for (int i = 0; i < qdcount; i++) {
-        /* Skip QNAME */
-        while (p < response + response_size && *p) {
-            if ((*p & 0xC0) == 0xC0) {  /* Compression pointer */
-                p += 2;
-                break;
-            }
-            p += *p + 1;
-        }
-        if (*p == 0) p++;  /* Skip final zero */
-        p += 4;  /* Skip QTYPE + QCLASS */
-    }
-
-    /* Parse first answer (should be SOA) */
-    /* Skip NAME */
-    while (p < response + response_size && *p) {
-        if ((*p & 0xC0) == 0xC0) {  /* Compression pointer */
-            p += 2;
-            break;
-        }
-        p += *p + 1;
-    }
-    if (*p == 0) p++;
-
-    /* Read TYPE, CLASS, TTL, RDLENGTH */
-    if (p + 10 > response + response_size) {
-        Warnx(_("axfr_check_serial: Truncated response for zone %s"), zone->zone_name);
-        goto cleanup;
-    }
-
-    uint16_t rtype = (p[0] << 8) | p[1];
-    p += 2;  /* Skip TYPE */
-    p += 2;  /* Skip CLASS */
-    p += 4;  /* Skip TTL */
-    uint16_t rdlength = (p[0] << 8) | p[1];
-    p += 2;
-
-    if (rtype != 6) {  /* Not SOA */
-        Warnx(_("axfr_check_serial: Response is not SOA for zone %s"), zone->zone_name);
-        goto cleanup;
-    }
-
-    /* Parse SOA RDATA and extract serial */
-    zone->master_serial = parse_soa_serial(p, rdlength);
-
-    Notice(_("Zone %s: local serial=%u, master serial=%u"),
-           zone->zone_name, zone->current_serial, zone->master_serial);
-
-    /* Compare serials */
-    if (zone->master_serial > zone->current_serial) {
-        Notice(_("Zone %s needs transfer (master serial %u > local serial %u)"),
-               zone->zone_name, zone->master_serial, zone->current_serial);
-        ret = 0;  /* Transfer needed */
-    } else {
-        Notice(_("Zone %s is up to date (master serial %u <= local serial %u)"),
-               zone->zone_name, zone->master_serial, zone->current_serial);
-        ret = 1;  /* No transfer needed */
-    }
-
-cleanup:
-    if (sockfd >= 0) close(sockfd);
-    return ret;
+    axfr_check_serials(zone, 1, &result);
+    return result;
 }
 
 /**
@@ -712,167 +589,1089 @@ static int dns_name_from_wire(const unsigned char *wire, size_t wire_len, size_t
         p += label_len + 1;
     }
 
-    return -1;
+    return -1;
+}
+
+/**
+ * Parse the answer records of one DNS message
+ * Records are appended to the list at *head / *tail.
+ * Returns number of records parsed, -1 on error
+ */
+static int axfr_parse_message(const unsigned char *msg_start, size_t msg_len,
+                              axfr_record_t **head, axfr_record_t **tail) {
+    const unsigned char *p = msg_start;
+    const unsigned char *msg_end = msg_start + msg_len;
+    int record_count = 0;
+
+    /* Skip DNS header */
+    if (msg_len < 12) {
+        return 0;
+    }
+
+    dns_header_t *header = (dns_header_t *)p;
+    uint16_t qdcount = ntohs(header->qdcount);
+    uint16_t ancount = ntohs(header->ancount);
+    p += 12;
+
+    /* Skip questions */
+    for (int i = 0; i < qdcount && p < msg_end; i++) {
+        char qname[256];
+        size_t offset = p - msg_start;
+        if (dns_name_from_wire(msg_start, msg_len, &offset, qname, sizeof(qname)) < 0) {
+            break;
+        }
+        p = msg_start + offset + 4;  /* Skip QTYPE and QCLASS */
+    }
+
+    /* Parse answer records */
+    for (int i = 0; i < ancount && p < msg_end; i++) {
+        axfr_record_t *rec = (axfr_record_t *)calloc(1, sizeof(axfr_record_t));
+        if (!rec) {
+            return -1;
+        }
+
+        /* Parse name */
+        char name[256];
+        size_t offset = p - msg_start;
+        if (dns_name_from_wire(msg_start, msg_len, &offset, name, sizeof(name)) < 0) {
+            free(rec);
+            break;
+        }
+        rec->name = strdup(name);
+        p = msg_start + offset;
+
+        /* Parse TYPE, CLASS, TTL, RDLENGTH */
+        if (p + 10 > msg_end) {
+            free(rec->name);
+            free(rec);
+            return -1;
+        }
+
+        uint16_t rtype = (p[0] << 8) | p[1];
+        uint32_t ttl = (p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+        uint16_t rdlength = (p[8] << 8) | p[9];
+        p += 10;
+
+        if (p + rdlength > msg_end) {
+            free(rec->name);
+            free(rec);
+            return -1;
+        }
+
+        rec->ttl = ttl;
+        rec->type = strdup(mydns_qtype_str(rtype));
+        if (rtype == DNS_QTYPE_SOA) {
+            uint32_t fields[4];
+
+            parse_soa_fields(p, rdlength, fields);
+            rec->serial = fields[0];
+            rec->refresh = fields[1];
+            rec->retry = fields[2];
+            rec->expire = fields[3];
+        }
+
+        /* Parse RDATA (simplified - just store as hex for now) */
+        char *rdata = (char *)malloc(rdlength * 2 + 1);
+        if (rdata) {
+            for (int j = 0; j < rdlength; j++) {
+                sprintf(rdata + j * 2, "%02x", p[j]);
+            }
+            rdata[rdlength * 2] = '\0';
+            rec->data = rdata;
+        }
+
+        p += rdlength;
+
+        /* Add to list */
+        if (*tail) {
+            (*tail)->next = rec;
+        } else {
+            *head = rec;
+        }
+        *tail = rec;
+        record_count++;
+    }
+
+    return record_count;
+}
+
+/**
+ * Parse a buffer of length-prefixed TCP DNS messages
+ * Returns number of records parsed, -1 on error
+ */
+static int axfr_parse_messages(const unsigned char *response, size_t length, axfr_record_t **records) {
+    const unsigned char *p = response;
+    const unsigned char *end = response + length;
+    axfr_record_t *record_list = NULL;
+    axfr_record_t *last_record = NULL;
+    int record_count = 0;
+
+    *records = NULL;
+
+    /* Parse multiple TCP DNS messages */
+    while (p + 2 < end) {
+        /* Read message length */
+        uint16_t msg_len = (p[0] << 8) | p[1];
+        p += 2;
+
+        if (p + msg_len > end) {
+            Warnx(_("Invalid message length in AXFR response"));
+            axfr_free_records(record_list);
+            return -1;
+        }
+
+        int n = axfr_parse_message(p, msg_len, &record_list, &last_record);
+        if (n < 0) {
+            axfr_free_records(record_list);
+            return -1;
+        }
+        record_count += n;
+
+        p += msg_len;
+    }
+
+    *records = record_list;
+    return record_count;
+}
+
+/**
+ * Parse AXFR response
+ */
+int axfr_parse_response(const unsigned char *response, size_t length, axfr_record_t **records) {
+    axfr_record_t *record_list = NULL;
+    axfr_record_t *rec;
+    int record_count;
+    int soa_count = 0;
+
+    *records = NULL;
+
+    record_count = axfr_parse_messages(response, length, &record_list);
+    if (record_count < 0) {
+        return -1;
+    }
+
+    /* Count SOA records (should be 2: start and end) */
+    for (rec = record_list; rec; rec = rec->next) {
+        if (strcmp(rec->type, "SOA") == 0) {
+            soa_count++;
+        }
+    }
+
+    /* Validate AXFR (should have 2 SOA records) */
+    if (soa_count != 2) {
+        Warnx(_("Invalid AXFR response: expected 2 SOA records, got %d"), soa_count);
+        axfr_free_records(record_list);
+        return -1;
+    }
+
+    *records = record_list;
+    return record_count;
+}
+
+/**
+ * Read exactly len bytes from a socket, waiting up to timeout seconds for each read
+ * Returns 0 on success, -1 on error, timeout or closed connection
+ */
+static int axfr_read_full(int sockfd, unsigned char *buf, size_t len, int timeout) {
+    struct pollfd pfd;
+    size_t got = 0;
+
+    pfd.fd = sockfd;
+    pfd.events = POLLIN;
+
+    while (got < len) {
+        int poll_ret = poll(&pfd, 1, timeout * 1000);
+        if (poll_ret < 0) {
+            if (errno == EINTR) continue;
+            Warnx(_("poll() failed: %s"), strerror(errno));
+            return -1;
+        } else if (poll_ret == 0) {
+            Warnx(_("Timeout reading AXFR response"));
+            return -1;
+        }
+
+        ssize_t received = recv(sockfd, buf + got, len - got, 0);
+        if (received < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            Warnx(_("Failed to receive AXFR response: %s"), strerror(errno));
+            return -1;
+        } else if (received == 0) {
+            Warnx(_("Connection closed before end of AXFR"));
+            return -1;
+        }
+        got += received;
+    }
+
+    return 0;
+}
+
+/**
+ * Wait up to timeout seconds for more of a response
+ * Returns 1 if data arrived, 0 if the master closed the connection or sent
+ * nothing more, -1 on error
+ */
+static int axfr_stream_more(int sockfd, int timeout) {
+    struct pollfd pfd;
+    unsigned char c;
+
+    pfd.fd = sockfd;
+    pfd.events = POLLIN;
+
+    for (;;) {
+        int poll_ret = poll(&pfd, 1, timeout * 1000);
+        if (poll_ret < 0) {
+            if (errno == EINTR) continue;
+            Warnx(_("poll() failed: %s"), strerror(errno));
+            return -1;
+        } else if (poll_ret == 0) {
+            return 0;
+        }
+
+        ssize_t received = recv(sockfd, &c, 1, MSG_PEEK);
+        if (received < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            Warnx(_("Failed to receive AXFR response: %s"), strerror(errno));
+            return -1;
+        }
+        return received > 0;
+    }
+}
+
+/**
+ * Start reading an AXFR response
+ */
+void axfr_stream_init(axfr_stream_t *stream, int sockfd, int timeout) {
+    memset(stream, 0, sizeof(axfr_stream_t));
+    stream->sockfd = sockfd;
+    stream->timeout = timeout;
+}
+
+/**
+ * Read and parse the next message of an AXFR response
+ */
+int axfr_stream_next(axfr_stream_t *stream, axfr_record_t **records) {
+    unsigned char length_prefix[2];
+    unsigned char *msg = NULL;
+    uint16_t msg_len;
+    axfr_record_t *head = NULL, *tail = NULL, *rec;
+    int n, first = stream->records;
+
+    *records = NULL;
+    if (stream->done) {
+        return 0;
+    }
+
+    /*
+     * A newer SOA alone means the master can't send the zone incrementally
+     * (RFC 1995 section 4), but only if nothing follows: the changes may
+     * come in later messages of their own
+     */
+    if (stream->soa_only) {
+        n = axfr_stream_more(stream->sockfd, AXFR_SOA_ONLY_WAIT);
+        if (n < 0) {
+            return -1;
+        }
+        stream->soa_only = 0;
+        if (n == 0) {
+            stream->need_axfr = 1;
+            stream->done = 1;
+            return 0;
+        }
+    }
+
+    /* Each message is preceded by its length */
+    if (axfr_read_full(stream->sockfd, length_prefix, 2, stream->timeout) < 0) {
+        return -1;
+    }
+    msg_len = (length_prefix[0] << 8) | length_prefix[1];
+    if (msg_len < 12) {
+        Warnx(_("Invalid message length in AXFR response"));
+        return -1;
+    }
+
+    msg = (unsigned char *)malloc(msg_len);
+    if (!msg) {
+        return -1;
+    }
+    if (axfr_read_full(stream->sockfd, msg, msg_len, stream->timeout) < 0) {
+        free(msg);
+        return -1;
+    }
+    stream->messages++;
+
+    /* Check response code */
+    if ((msg[2] & 0x80) == 0 || (msg[3] & 0x0F) != 0) {
+        Warnx(_("AXFR query returned error code: %d"), msg[3] & 0x0F);
+        free(msg);
+        return -1;
+    }
+
+    n = axfr_parse_message(msg, msg_len, &head, &tail);
+    free(msg);
+    if (n < 0) {
+        axfr_free_records(head);
+        return -1;
+    }
+
+    /*
+     * The transfer starts with the zone's SOA and ends when it appears again,
+     * so there is no need to wait for the master to close the connection
+     */
+    for (rec = head; rec; rec = rec->next) {
+        int is_soa = strcmp(rec->type, "SOA") == 0;
+
+        stream->records++;
+        if (stream->records == 1) {
+            if (!is_soa) {
+                Warnx(_("Invalid AXFR response: first record is not SOA"));
+                axfr_free_records(head);
+                return -1;
+            }
+            stream->serial = rec->serial;
+            continue;
+        }
+
+        /* An IXFR whose second record is not an SOA is a full zone */
+        if (stream->ixfr && stream->records == 2 && !is_soa) {
+            stream->axfr = 1;
+        }
+        if (!is_soa) {
+            continue;
+        }
+
+        if (!stream->ixfr || stream->axfr) {
+            if (rec->serial != stream->serial) {
+                continue;
+            }
+        } else {
+            /*
+             * IXFR sections alternate: odd SOAs carry the old serial and start
+             * deletions, even SOAs start additions.  The closing SOA comes
+             * where the next deletion section would start.
+             */
+            if (++stream->soas % 2 == 0 || rec->serial != stream->serial) {
+                continue;
+            }
+        }
+
+        /* Closing SOA; anything after it is not part of the zone */
+        axfr_free_records(rec->next);
+        rec->next = NULL;
+        stream->done = 1;
+        break;
+    }
+
+    /*
+     * A zone with no changes is answered with its SOA alone.  A newer serial
+     * with nothing after it yet is settled by the next call.
+     */
+    if (!stream->done && stream->ixfr && stream->records == 1) {
+        if ((int32_t)(stream->serial - stream->ixfr_serial) > 0) {
+            stream->soa_only = 1;
+        } else {
+            stream->done = 1;
+        }
+    }
+
+    *records = head;
+    return stream->records - first;
+}
+
+/* One zone in a batch SOA poll */
+typedef struct {
+    struct sockaddr_storage addr;   /* Master address */
+    socklen_t addrlen;
+    int sockfd;                     /* UDP socket for the address family */
+    int tries;                      /* Queries sent so far */
+    int in_flight;                  /* Waiting for a reply to query `id' */
+    uint16_t id;
+} axfr_poll_t;
+
+/* Timeout entry; every query waits the same time so entries expire in order */
+typedef struct {
+    int zone;
+    int try;
+    long long deadline;
+} axfr_poll_timer_t;
+
+/* Resolved master, so each distinct master is looked up only once per batch */
+typedef struct {
+    const char *host;
+    int port;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    int ok;
+} axfr_poll_master_t;
+
+/**
+ * Current monotonic time in microseconds
+ */
+static long long axfr_now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Current monotonic time in milliseconds
+ */
+static long long axfr_now_ms(void) {
+    return axfr_now_us() / 1000;
+}
+
+/**
+ * Are two socket addresses the same address and port?
+ */
+static int axfr_poll_same_addr(const struct sockaddr_storage *a, const struct sockaddr_storage *b) {
+    if (a->ss_family != b->ss_family) {
+        return 0;
+    }
+    if (a->ss_family == AF_INET) {
+        const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+        const struct sockaddr_in *b4 = (const struct sockaddr_in *)b;
+        return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+    }
+    if (a->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+        const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+        return a6->sin6_port == b6->sin6_port
+            && !memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(struct in6_addr));
+    }
+    return 0;
+}
+
+/**
+ * Build an SOA query for a zone
+ * Returns the query length, -1 on error
+ */
+static int axfr_poll_query(const char *zone_name, uint16_t id, unsigned char *query, size_t size) {
+    int query_size = axfr_create_query(zone_name, id, query, size);
+
+    if (query_size < 0) {
+        return -1;
+    }
+    /* Change QTYPE from AXFR (252) to SOA (6); QTYPE is just before the 2-byte QCLASS */
+    query[query_size - 4] = 0;
+    query[query_size - 3] = 6;
+    return query_size;
+}
+
+/**
+ * Extract the serial from an SOA response, and the SOA timers into the zone
+ * Returns 0 on success, -1 if the response holds no SOA answer
+ */
+static int axfr_poll_serial(const unsigned char *response, size_t len, axfr_zone_t *zone, uint32_t *serial) {
+    axfr_record_t *head = NULL, *tail = NULL, *rec;
+    int ret = -1;
+
+    if (len < sizeof(dns_header_t) || (response[3] & 0x0F) != 0) {
+        return -1;
+    }
+    if (axfr_parse_message(response, len, &head, &tail) < 0) {
+        axfr_free_records(head);
+        return -1;
+    }
+    for (rec = head; rec; rec = rec->next) {
+        if (strcmp(rec->type, "SOA") == 0) {
+            *serial = rec->serial;
+            zone->refresh = rec->refresh;
+            zone->retry = rec->retry;
+            zone->expire = rec->expire;
+            ret = 0;
+            break;
+        }
+    }
+    axfr_free_records(head);
+    return ret;
+}
+
+/**
+ * Ask a master for a zone's SOA over TCP, after a truncated UDP reply
+ * Returns 0 on success, -1 on error
+ */
+static int axfr_poll_tcp(axfr_zone_t *zone, uint32_t *serial) {
+    unsigned char query[512];
+    unsigned char length_prefix[2];
+    unsigned char *response = NULL;
+    uint16_t response_len;
+    int query_size, sockfd, ret = -1;
+
+    query_size = axfr_poll_query(zone->zone_name, (uint16_t)random(), query, sizeof(query));
+    if (query_size < 0) {
+        return -1;
+    }
+
+    sockfd = axfr_connect_master(zone->master_host, zone->master_port, AXFR_POLL_TIMEOUT / 1000);
+    if (sockfd < 0) {
+        return -1;
+    }
+
+    if (axfr_send_query(sockfd, query, query_size) == 0
+        && axfr_read_full(sockfd, length_prefix, 2, AXFR_POLL_TIMEOUT / 1000) == 0) {
+        response_len = (length_prefix[0] << 8) | length_prefix[1];
+        response = (unsigned char *)malloc(response_len);
+        if (response && axfr_read_full(sockfd, response, response_len, AXFR_POLL_TIMEOUT / 1000) == 0) {
+            ret = axfr_poll_serial(response, response_len, zone, serial);
+        }
+        free(response);
+    }
+
+    close(sockfd);
+    return ret;
+}
+
+/**
+ * Record the outcome of a zone's serial check
+ */
+static void axfr_poll_result(axfr_zone_t *zone, int *result, uint32_t serial) {
+    zone->master_serial = serial;
+
+    /* RFC 1982 serial number arithmetic */
+    if ((int32_t)(serial - zone->current_serial) > 0) {
+        Notice(_("Zone %s needs transfer (master serial %u > local serial %u)"),
+               zone->zone_name, serial, zone->current_serial);
+        *result = 0;
+    } else {
+        Verbose(_("Zone %s is up to date (master serial %u <= local serial %u)"),
+                zone->zone_name, serial, zone->current_serial);
+        *result = 1;
+    }
+}
+
+/**
+ * Check the SOA serial of many zones at once
+ *
+ * Queries go out over one non-blocking UDP socket per address family, up to
+ * AXFR_POLL_WINDOW at a time.  Replies are matched to zones by query ID and
+ * source address, and truncated replies are retried over TCP.  A zone whose
+ * master does not answer within AXFR_POLL_TIMEOUT is queried again, up to
+ * AXFR_POLL_TRIES times.
+ */
+int axfr_check_serials(axfr_zone_t *zones, int count, int *results) {
+    axfr_poll_t *poll_state = NULL;
+    axfr_poll_timer_t *timers = NULL;
+    axfr_poll_master_t *masters = NULL;
+    int *id_map = NULL;                 /* Query ID -> zone index + 1 */
+    int *retries = NULL;                /* Zones waiting to be queried again */
+    int timer_head = 0, timer_tail = 0;
+    int retry_head = 0, retry_tail = 0;
+    int master_count = 0;
+    int next_zone = 0, in_flight = 0, finished = 0, answered = 0;
+    int sock4 = -1, sock6 = -1;
+    uint16_t next_id = (uint16_t)random();
+    unsigned char query[512];
+    unsigned char response[4096];
+    int i, j;
+
+    if (!zones || count <= 0 || !results) {
+        return -1;
+    }
+
+    poll_state = (axfr_poll_t *)calloc(count, sizeof(axfr_poll_t));
+    timers = (axfr_poll_timer_t *)calloc((size_t)count * AXFR_POLL_TRIES, sizeof(axfr_poll_timer_t));
+    masters = (axfr_poll_master_t *)calloc(count, sizeof(axfr_poll_master_t));
+    id_map = (int *)calloc(65536, sizeof(int));
+    retries = (int *)calloc((size_t)count * AXFR_POLL_TRIES, sizeof(int));
+    if (!poll_state || !timers || !masters || !id_map || !retries) {
+        Warnx(_("axfr_check_serials: out of memory"));
+        free(poll_state);
+        free(timers);
+        free(masters);
+        free(id_map);
+        free(retries);
+        return -1;
+    }
+
+    /* Resolve each master once and pick a socket for its address family */
+    for (i = 0; i < count; i++) {
+        axfr_poll_master_t *m = NULL;
+
+        results[i] = -1;
+        poll_state[i].sockfd = -1;
+        if (!zones[i].zone_name || !zones[i].master_host) {
+            finished++;
+            continue;
+        }
+
+        for (j = 0; j < master_count; j++) {
+            if (masters[j].port == zones[i].master_port && !strcmp(masters[j].host, zones[i].master_host)) {
+                m = &masters[j];
+                break;
+            }
+        }
+        if (!m) {
+            struct addrinfo hints, *res = NULL;
+            char port_str[16];
+
+            m = &masters[master_count++];
+            m->host = zones[i].master_host;
+            m->port = zones[i].master_port;
+
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_DGRAM;
+            snprintf(port_str, sizeof(port_str), "%d", zones[i].master_port);
+            if (getaddrinfo(zones[i].master_host, port_str, &hints, &res) == 0 && res) {
+                memcpy(&m->addr, res->ai_addr, res->ai_addrlen);
+                m->addrlen = res->ai_addrlen;
+                m->ok = 1;
+            } else {
+                Warnx(_("axfr_check_serials: Cannot resolve master %s"), zones[i].master_host);
+            }
+            if (res) freeaddrinfo(res);
+        }
+        if (!m->ok) {
+            finished++;
+            continue;
+        }
+
+        memcpy(&poll_state[i].addr, &m->addr, m->addrlen);
+        poll_state[i].addrlen = m->addrlen;
+        if (m->addr.ss_family == AF_INET6) {
+            if (sock6 < 0 && (sock6 = socket(AF_INET6, SOCK_DGRAM, 0)) >= 0) {
+                fcntl(sock6, F_SETFL, fcntl(sock6, F_GETFL, 0) | O_NONBLOCK);
+            }
+            poll_state[i].sockfd = sock6;
+        } else {
+            if (sock4 < 0 && (sock4 = socket(AF_INET, SOCK_DGRAM, 0)) >= 0) {
+                fcntl(sock4, F_SETFL, fcntl(sock4, F_GETFL, 0) | O_NONBLOCK);
+            }
+            poll_state[i].sockfd = sock4;
+        }
+        if (poll_state[i].sockfd < 0) {
+            Warnx(_("axfr_check_serials: socket() failed: %s"), strerror(errno));
+            finished++;
+        }
+    }
+
+    while (finished < count) {
+        struct pollfd pfds[2];
+        int nfds = 0, wait_ms = -1;
+        long long now = axfr_now_ms();
+
+        /* Expire queries that have not been answered; entries are in deadline order */
+        while (timer_head < timer_tail && timers[timer_head].deadline <= now) {
+            axfr_poll_timer_t *tm = &timers[timer_head++];
+            axfr_poll_t *ps = &poll_state[tm->zone];
+
+            if (!ps->in_flight || ps->tries != tm->try) {
+                continue;
+            }
+            ps->in_flight = 0;
+            in_flight--;
+            id_map[ps->id] = 0;
+            if (ps->tries >= AXFR_POLL_TRIES) {
+                Warnx(_("axfr_check_serials: No response or timeout for zone %s"), zones[tm->zone].zone_name);
+                finished++;
+            } else {
+                retries[retry_tail++] = tm->zone;
+            }
+        }
+
+        /* Send queries while the window allows: timed-out retries first, then new zones */
+        while (in_flight < AXFR_POLL_WINDOW) {
+            axfr_poll_t *ps;
+            int query_size;
+
+            if (retry_head < retry_tail) {
+                i = retries[retry_head++];
+            } else if (next_zone < count) {
+                i = next_zone++;
+            } else {
+                break;
+            }
+            ps = &poll_state[i];
+            if (ps->sockfd < 0) {
+                continue;
+            }
+
+            while (id_map[next_id]) {
+                next_id++;
+            }
+            query_size = axfr_poll_query(zones[i].zone_name, next_id, query, sizeof(query));
+            if (query_size < 0
+                || (sendto(ps->sockfd, query, query_size, 0, (struct sockaddr *)&ps->addr, ps->addrlen) < 0
+                    && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                Warnx(_("axfr_check_serials: sendto() failed for zone %s"), zones[i].zone_name);
+                ps->sockfd = -1;
+                finished++;
+                continue;
+            }
+
+            /* A query dropped by a full socket buffer is simply retried on timeout */
+            ps->id = next_id++;
+            ps->tries++;
+            ps->in_flight = 1;
+            id_map[ps->id] = i + 1;
+            in_flight++;
+            timers[timer_tail].zone = i;
+            timers[timer_tail].try = ps->tries;
+            timers[timer_tail].deadline = axfr_now_ms() + AXFR_POLL_TIMEOUT;
+            timer_tail++;
+        }
+
+        if (finished >= count) {
+            break;
+        }
+
+        /* Wait for replies until the oldest query times out */
+        if (in_flight == 0) {
+            break;
+        }
+        while (timer_head < timer_tail && !poll_state[timers[timer_head].zone].in_flight) {
+            timer_head++;
+        }
+        if (timer_head < timer_tail) {
+            wait_ms = (int)(timers[timer_head].deadline - axfr_now_ms());
+            if (wait_ms < 0) wait_ms = 0;
+        }
+        if (sock4 >= 0) {
+            pfds[nfds].fd = sock4;
+            pfds[nfds++].events = POLLIN;
+        }
+        if (sock6 >= 0) {
+            pfds[nfds].fd = sock6;
+            pfds[nfds++].events = POLLIN;
+        }
+        if (poll(pfds, nfds, wait_ms) < 0) {
+            if (errno == EINTR) continue;
+            Warnx(_("poll() failed: %s"), strerror(errno));
+            break;
+        }
+
+        /* Read every reply that is waiting */
+        for (j = 0; j < nfds; j++) {
+            if (!(pfds[j].revents & POLLIN)) {
+                continue;
+            }
+            for (;;) {
+                struct sockaddr_storage from;
+                socklen_t fromlen = sizeof(from);
+                ssize_t len;
+                axfr_poll_t *ps;
+                uint32_t serial;
+                int z;
+
+                len = recvfrom(pfds[j].fd, response, sizeof(response), 0, (struct sockaddr *)&from, &fromlen);
+                if (len < 0) {
+                    break;
+                }
+                if (len < (ssize_t)sizeof(dns_header_t) || !(response[2] & 0x80)) {
+                    continue;
+                }
+
+                /* Match by query ID and source */
+                z = id_map[(response[0] << 8) | response[1]] - 1;
+                if (z < 0) {
+                    continue;
+                }
+                ps = &poll_state[z];
+                if (!ps->in_flight || !axfr_poll_same_addr(&from, &ps->addr)) {
+                    continue;
+                }
+                ps->in_flight = 0;
+                in_flight--;
+                id_map[ps->id] = 0;
+                finished++;
+
+                if (response[2] & 0x02) {
+                    /* Truncated: ask again over TCP */
+                    if (axfr_poll_tcp(&zones[z], &serial) < 0) {
+                        Warnx(_("axfr_check_serials: TCP SOA query failed for zone %s"), zones[z].zone_name);
+                        continue;
+                    }
+                } else if (axfr_poll_serial(response, len, &zones[z], &serial) < 0) {
+                    Warnx(_("axfr_check_serials: No SOA record in response for zone %s"), zones[z].zone_name);
+                    continue;
+                }
+                axfr_poll_result(&zones[z], &results[z], serial);
+                answered++;
+            }
+        }
+    }
+
+    if (sock4 >= 0) close(sock4);
+    if (sock6 >= 0) close(sock6);
+    free(poll_state);
+    free(timers);
+    free(masters);
+    free(id_map);
+    free(retries);
+
+    return answered;
+}
+
+/**
+ * Free record list
+ */
+void axfr_free_records(axfr_record_t *records) {
+    axfr_record_t *rec = records;
+    axfr_record_t *next;
+
+    while (rec) {
+        next = rec->next;
+        if (rec->name) free(rec->name);
+        if (rec->type) free(rec->type);
+        if (rec->data) free(rec->data);
+        free(rec);
+        rec = next;
+    }
+}
+
+/* A zone being loaded into the database */
+typedef struct {
+    long long start;             /* When staging started (ms) */
+    int staged;                  /* Rows written to the staging table */
+} axfr_db_load_t;
+
+/**
+ * Drop the staging table
+ * pg_temp names this session's own temporary schema, so a permanent table
+ * with the same name is never touched.
+ */
+static void axfr_db_abort(SQL *db) {
+#if USE_PGSQL
+    const char *drop = "DROP TABLE IF EXISTS pg_temp.rr_xfer";
+#else
+    const char *drop = "DROP TEMPORARY TABLE IF EXISTS rr_xfer";
+#endif
+    sql_nrquery(db, drop, strlen(drop));
+}
+
+/**
+ * Write the condition for rows `a' and `b' holding the same record into `buf'
+ * The columns are joined with plain "=" so the indexes on rr and rr_xfer are
+ * used; on MySQL that compares under the collation, so name and data are then
+ * compared byte for byte among the joined rows.
+ * Only active rows of rr count as present when the active column is in use.
+ */
+static void axfr_db_match(char *buf, size_t size, const char *a, const char *b) {
+    int n;
+
+    n = snprintf(buf, size,
+        "%s.name = %s.name AND %s.type = %s.type AND %s.data = %s.data "
+        "AND %s.ttl = %s.ttl AND %s.aux = %s.aux",
+        a, b, a, b, a, b, a, b, a, b);
+#if !USE_PGSQL
+    if (n > 0 && (size_t)n < size) {
+        n += snprintf(buf + n, size - n, " AND BINARY %s.name = %s.name AND BINARY %s.data = %s.data",
+                      a, b, a, b);
+    }
+#endif
+    if (mydns_rr_use_active && n > 0 && (size_t)n < size) {
+        snprintf(buf + n, size - n, " AND %s.active = '%s'", b, mydns_rr_active_types[0]);
+    }
+}
+
+/**
+ * Start loading a zone into the database
+ *
+ * Records are first written to a per-connection temporary table that
+ * nothing else reads, so no locks are held on rr while the zone arrives.
+ * Returns 0 on success, -1 on error
+ */
+static int axfr_db_begin(SQL *db, axfr_db_load_t *load) {
+    const char *create = "CREATE TEMPORARY TABLE rr_xfer AS "
+                         "SELECT name, type, data, ttl, aux FROM rr WHERE 1 = 0";
+
+    memset(load, 0, sizeof(axfr_db_load_t));
+    load->start = axfr_now_ms();
+
+    axfr_db_abort(db);
+    if (sql_nrquery(db, create, strlen(create)) < 0) {
+        return -1;
+    }
+    return 0;
 }
 
 /**
- * Parse AXFR response
+ * Send a multi-row INSERT built by axfr_db_add()
+ * Returns 0 on success, -1 on error
  */
-int axfr_parse_response(const unsigned char *response, size_t length, axfr_record_t **records) {
-    const unsigned char *p = response;
-    const unsigned char *end = response + length;
-    axfr_record_t *record_list = NULL;
-    axfr_record_t *last_record = NULL;
-    int record_count = 0;
-    int soa_count = 0;
+static int axfr_db_flush(SQL *db, char *query, size_t *len, int *rows) {
+    int rv = 0;
 
-    *records = NULL;
-
-    /* Parse multiple TCP DNS messages */
-    while (p + 2 < end) {
-        /* Read message length */
-        uint16_t msg_len = (p[0] << 8) | p[1];
-        p += 2;
+    if (*rows) {
+        rv = sql_nrquery(db, query, *len);
+    }
+    *len = 0;
+    *rows = 0;
+    return rv;
+}
 
-        if (p + msg_len > end) {
-            Warnx(_("Invalid message length in AXFR response"));
-            axfr_free_records(record_list);
-            return -1;
-        }
+/**
+ * Write transferred records to the staging table, many rows per INSERT
+ * SOA records are skipped; the zone's SOA lives in the soa table.
+ * Drops the staging table and returns -1 on error.
+ */
+static int axfr_db_add(SQL *db, axfr_record_t *records, axfr_db_load_t *load) {
+    static const char head[] = "INSERT INTO rr_xfer (name, type, data, ttl, aux) VALUES ";
+    axfr_record_t *rec;
+    char *query = NULL;
+    size_t len = 0, size = 0;
+    int rows = 0;
 
-        const unsigned char *msg_start = p;
-        const unsigned char *msg_end = p + msg_len;
+    for (rec = records; rec != NULL; rec = rec->next) {
+        char *escaped_name, *escaped_data;
+        size_t need;
 
-        /* Skip DNS header */
-        if (msg_end - p < 12) {
-            p = msg_end;
+        if (strcmp(rec->type, "SOA") == 0) {
             continue;
         }
 
-        dns_header_t *header = (dns_header_t *)p;
-        uint16_t qdcount = ntohs(header->qdcount);
-        uint16_t ancount = ntohs(header->ancount);
-        p += 12;
-
-        /* Skip questions */
-        for (int i = 0; i < qdcount && p < msg_end; i++) {
-            char qname[256];
-            size_t offset = p - msg_start;
-            if (dns_name_from_wire(msg_start, msg_len, &offset, qname, sizeof(qname)) < 0) {
-                break;
-            }
-            p = msg_start + offset + 4;  /* Skip QTYPE and QCLASS */
-        }
-
-        /* Parse answer records */
-        for (int i = 0; i < ancount && p < msg_end; i++) {
-            axfr_record_t *rec = (axfr_record_t *)calloc(1, sizeof(axfr_record_t));
-            if (!rec) {
-                axfr_free_records(record_list);
-                return -1;
-            }
-
-            /* Parse name */
-            char name[256];
-            size_t offset = p - msg_start;
-            if (dns_name_from_wire(msg_start, msg_len, &offset, name, sizeof(name)) < 0) {
-                free(rec);
-                break;
-            }
-            rec->name = strdup(name);
-            p = msg_start + offset;
-
-            /* Parse TYPE, CLASS, TTL, RDLENGTH */
-            if (p + 10 > msg_end) {
-                axfr_free_records(record_list);
-                free(rec->name);
-                free(rec);
-                return -1;
-            }
-
-            uint16_t rtype = (p[0] << 8) | p[1];
-            uint16_t rclass = (p[2] << 8) | p[3];
-            uint32_t ttl = (p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
-            uint16_t rdlength = (p[8] << 8) | p[9];
-            p += 10;
-
-            if (p + rdlength > msg_end) {
-                axfr_free_records(record_list);
-                free(rec->name);
-                free(rec);
+        escaped_name = sql_escstr(db, rec->name);
+        escaped_data = sql_escstr(db, rec->data);
+
+        need = len + sizeof(head) + strlen(escaped_name) + strlen(rec->type) + strlen(escaped_data) + 64;
+        if (need > size) {
+            size = need * 2;
+            query = (char *)realloc(query, size);
+            if (!query) {
+                RELEASE(escaped_name);
+                RELEASE(escaped_data);
+                axfr_db_abort(db);
                 return -1;
             }
+        }
+        if (!rows) {
+            memcpy(query, head, sizeof(head) - 1);
+            len = sizeof(head) - 1;
+        } else {
+            query[len++] = ',';
+        }
+        len += snprintf(query + len, size - len, "('%s','%s','%s',%u,%u)",
+                        escaped_name, rec->type, escaped_data, rec->ttl, rec->aux);
+        rows++;
+        load->staged++;
 
-            rec->ttl = ttl;
-            rec->type = strdup(mydns_qtype_str(rtype));
-
-            /* Count SOA records (should be 2: start and end) */
-            if (rtype == DNS_QTYPE_SOA) {
-                soa_count++;
-            }
-
-            /* Parse RDATA (simplified - just store as hex for now) */
-            char *rdata = (char *)malloc(rdlength * 2 + 1);
-            if (rdata) {
-                for (int j = 0; j < rdlength; j++) {
-                    sprintf(rdata + j * 2, "%02x", p[j]);
-                }
-                rec->data = rdata;
-            }
-
-            p += rdlength;
+        RELEASE(escaped_name);
+        RELEASE(escaped_data);
 
-            /* Add to list */
-            if (last_record) {
-                last_record->next = rec;
-            } else {
-                record_list = rec;
-            }
-            last_record = rec;
-            record_count++;
+        if ((rows >= AXFR_INSERT_ROWS || len >= AXFR_INSERT_SIZE)
+            && axfr_db_flush(db, query, &len, &rows) < 0) {
+            free(query);
+            axfr_db_abort(db);
+            return -1;
         }
-
-        p = msg_end;
     }
 
-    /* Validate AXFR (should have 2 SOA records) */
-    if (soa_count != 2) {
-        Warnx(_("Invalid AXFR response: expected 2 SOA records, got %d"), soa_count);
-        axfr_free_records(record_list);
+    if (axfr_db_flush(db, query, &len, &rows) < 0) {
+        free(query);
+        axfr_db_abort(db);
         return -1;
     }
-
-    *records = record_list;
-    return record_count;
+    free(query);
+    return 0;
 }
 
 /**
- * Free record list
+ * Replace the zone's rows in rr with the staged ones and set the new serial
+ *
+ * Only rows that differ are touched: rows no longer in the zone and inactive
+ * rows are deleted, and new rows inserted once each, in one short transaction.
+ * rr's unique key already keeps out duplicate rows.
+ * Drops the staging table; returns 0 on success, -1 on error.
  */
-void axfr_free_records(axfr_record_t *records) {
-    axfr_record_t *rec = records;
-    axfr_record_t *next;
+static int axfr_db_commit(SQL *db, axfr_zone_t *zone, uint32_t serial, axfr_db_load_t *load,
+                          axfr_result_t *result) {
+    char match[512], gone[1024], query[2048];
+    long to_delete, to_add;
+    long long staged_ms, lock_start, lock_ms;
+    const char *create_index = "CREATE INDEX rr_xfer_name ON rr_xfer (name)";
+
+    staged_ms = axfr_now_ms() - load->start;
+    sql_nrquery(db, create_index, strlen(create_index));
+
+    axfr_db_match(match, sizeof(match), "x", "rr");
+    snprintf(gone, sizeof(gone),
+        "rr.zone = %d AND NOT EXISTS (SELECT 1 FROM rr_xfer x WHERE %s)",
+        zone->zone_id, match);
+
+    /* Work out the difference before taking any locks */
+    to_delete = sql_count(db, "SELECT COUNT(*) FROM rr WHERE %s", gone);
+    to_add = sql_count(db,
+        "SELECT COUNT(*) FROM (SELECT 1 AS n FROM rr_xfer x "
+        "WHERE NOT EXISTS (SELECT 1 FROM rr WHERE rr.zone = %d AND %s) "
+        "GROUP BY x.name, x.type, x.data, x.ttl, x.aux) d",
+        zone->zone_id, match);
+    if (to_delete < 0 || to_add < 0) {
+        axfr_db_abort(db);
+        return -1;
+    }
 
-    while (rec) {
-        next = rec->next;
-        if (rec->name) free(rec->name);
-        if (rec->type) free(rec->type);
-        if (rec->data) free(rec->data);
-        free(rec);
-        rec = next;
+    lock_start = axfr_now_ms();
+    if (sql_nrquery(db, "START TRANSACTION", strlen("START TRANSACTION")) < 0) {
+        axfr_db_abort(db);
+        return -1;
+    }
+
+    if (to_delete > 0) {
+        snprintf(query, sizeof(query), "DELETE FROM rr WHERE %s", gone);
+        if (sql_nrquery(db, query, strlen(query)) < 0) {
+            goto rollback;
+        }
+    }
+    if (to_add > 0) {
+        /* A record the master sent twice is still added once */
+        snprintf(query, sizeof(query),
+            "INSERT INTO rr (zone, name, type, data, ttl, aux%s) "
+            "SELECT %d, MIN(x.name), x.type, MIN(x.data), x.ttl, x.aux%s%s%s FROM rr_xfer x "
+            "WHERE NOT EXISTS (SELECT 1 FROM rr WHERE rr.zone = %d AND %s) "
+            "GROUP BY x.name, x.type, x.data, x.ttl, x.aux",
+            mydns_rr_use_active ? ", active" : "", zone->zone_id,
+            mydns_rr_use_active ? ", '" : "",
+            mydns_rr_use_active ? mydns_rr_active_types[0] : "",
+            mydns_rr_use_active ? "'" : "",
+            zone->zone_id, match);
+        if (sql_nrquery(db, query, strlen(query)) < 0) {
+            goto rollback;
+        }
     }
+
+    snprintf(query, sizeof(query),
+        "UPDATE soa SET serial = %u WHERE id = %d",
+        serial, zone->zone_id);
+    if (sql_nrquery(db, query, strlen(query)) < 0
+        || sql_nrquery(db, "COMMIT", strlen("COMMIT")) < 0) {
+        goto rollback;
+    }
+    lock_ms = axfr_now_ms() - lock_start;
+    axfr_db_abort(db);
+
+    result->records_added += to_add;
+    result->records_deleted += to_delete;
+    Notice(_("Zone %s: staged %d rows in %lld ms (%lld rows/s); %ld added, %ld deleted, "
+             "rr locked for %lld ms"),
+           zone->zone_name, load->staged, staged_ms,
+           staged_ms > 0 ? (long long)load->staged * 1000 / staged_ms : (long long)load->staged,
+           to_add, to_delete, lock_ms);
+    return 0;
+
+rollback:
+    sql_nrquery(db, "ROLLBACK", strlen("ROLLBACK"));
+    axfr_db_abort(db);
+    return -1;
 }
 
 /**
  * Perform AXFR transfer from master server
+ *
+ * The response is read one message at a time and written to the database in
+ * batches as it arrives, so memory use no longer grows with the zone and the
+ * transfer finishes as soon as the closing SOA is seen.
  */
 int axfr_transfer_zone(SQL *db, axfr_zone_t *zone, axfr_result_t *result) {
     int sockfd = -1;
     unsigned char query[512];
-    unsigned char *response = NULL;
     int query_size;
-    int response_size;
-    axfr_record_t *records = NULL;
+    axfr_stream_t stream;
+    axfr_record_t *msg_records = NULL;
+    axfr_record_t *batch = NULL, *batch_tail = NULL;
+    axfr_record_t *records = NULL, *records_tail = NULL;
+    int batch_count = 0;
+    int db_open = 0;
+    axfr_db_load_t load;
     int ret = -1;
     time_t start_time = time(NULL);
 
@@ -883,13 +1682,6 @@ int axfr_transfer_zone(SQL *db, axfr_zone_t *zone, axfr_result_t *result) {
     memset(result, 0, sizeof(axfr_result_t));
     result->status = AXFR_ERROR;
 
-    /* Allocate response buffer */
-    response = (unsigned char *)malloc(AXFR_MAX_RESPONSE_SIZE);
-    if (!response) {
-        result->error_message = strdup("Out of memory");
-        return -1;
-    }
-
     /* Connect to master */
     sockfd = axfr_connect_master(zone->master_host, zone->master_port, 30);
     if (sockfd < 0) {
@@ -913,46 +1705,87 @@ int axfr_transfer_zone(SQL *db, axfr_zone_t *zone, axfr_result_t *result) {
         goto cleanup;
     }
 
-    /* Receive response */
-    response_size = axfr_receive_response(sockfd, response, AXFR_MAX_RESPONSE_SIZE, AXFR_TIMEOUT);
-    if (response_size < 0) {
-        result->status = AXFR_TIMEOUT;
-        result->error_message = strdup("Timeout receiving AXFR response");
+    if (axfr_db_begin(db, &load) < 0) {
+        result->status = AXFR_DATABASE_ERROR;
+        result->error_message = strdup("Failed to update database");
         goto cleanup;
     }
+    db_open = 1;
+    Notice(_("Updating database for zone %s"), zone->zone_name);
 
-    /* Parse response */
-    result->records_received = axfr_parse_response(response, response_size, &records);
-    if (result->records_received < 0) {
-        result->status = AXFR_PARSE_ERROR;
-        result->error_message = strdup("Failed to parse AXFR response");
-        goto cleanup;
-    }
+    /* Read the response message by message until the closing SOA */
+    axfr_stream_init(&stream, sockfd, AXFR_TIMEOUT);
+    while (!stream.done) {
+        int n = axfr_stream_next(&stream, &msg_records);
+        if (n < 0) {
+            result->status = AXFR_PARSE_ERROR;
+            result->error_message = strdup("Failed to read AXFR response");
+            goto cleanup;
+        }
+        if (!msg_records) {
+            continue;
+        }
 
-    /* Update memzone (if available) */
-    if (Memzone) {
-        Notice(_("Updating memzone for zone %s"), zone->zone_name);
-        if (axfr_update_memzone(Memzone, zone, records, result) < 0) {
-            Warnx(_("Failed to update memzone for zone %s"), zone->zone_name);
-            /* Continue anyway - try database update */
+        /* Append this message's records to the pending batch */
+        if (batch_tail) {
+            batch_tail->next = msg_records;
+        } else {
+            batch = msg_records;
         }
-    }
+        for (batch_tail = msg_records; batch_tail->next; batch_tail = batch_tail->next)
+            ;
+        msg_records = NULL;
+        batch_count += n;
 
-    /* Update database (if db is provided) */
-    if (db) {
-        Notice(_("Updating database for zone %s"), zone->zone_name);
-        /* Reset records_added counter for database update */
-        int memzone_records = result->records_added;
-        result->records_added = 0;
+        if (batch_count < AXFR_BATCH_RECORDS && !stream.done) {
+            continue;
+        }
 
-        if (axfr_update_database(db, zone, records, result) < 0) {
+        if (axfr_db_add(db, batch, &load) < 0) {
+            db_open = 0;
             result->status = AXFR_DATABASE_ERROR;
             result->error_message = strdup("Failed to update database");
             goto cleanup;
         }
 
-        /* Restore total (memzone + database) */
-        result->records_added += memzone_records;
+        /* Memzone is replaced in one go once the whole zone is here; keep the records */
+        if (Memzone) {
+            if (records_tail) {
+                records_tail->next = batch;
+            } else {
+                records = batch;
+            }
+            records_tail = batch_tail;
+        } else {
+            axfr_free_records(batch);
+        }
+        batch = batch_tail = NULL;
+        batch_count = 0;
+    }
+
+    result->records_received = stream.records;
+    result->new_serial = stream.serial;
+
+    if (axfr_db_commit(db, zone, stream.serial, &load, result) < 0) {
+        db_open = 0;
+        result->status = AXFR_DATABASE_ERROR;
+        result->error_message = strdup("Failed to update database");
+        goto cleanup;
+    }
+    db_open = 0;
+
+    /* Update memzone (if available) */
+    if (Memzone && records) {
+        int db_records = result->records_added;
+
+        Notice(_("Updating memzone for zone %s"), zone->zone_name);
+        result->records_added = 0;
+        if (axfr_update_memzone(Memzone, zone, records, result) < 0) {
+            Warnx(_("Failed to update memzone for zone %s"), zone->zone_name);
+        }
+
+        /* Report total (memzone + database) */
+        result->records_added += db_records;
     }
 
     result->status = AXFR_SUCCESS;
@@ -960,8 +1793,12 @@ int axfr_transfer_zone(SQL *db, axfr_zone_t *zone, axfr_result_t *result) {
     ret = 0;
 
 cleanup:
+    if (db_open) {
+        axfr_db_abort(db);
+    }
     if (sockfd >= 0) close(sockfd);
-    if (response) free(response);
+    if (msg_records) axfr_free_records(msg_records);
+    if (batch) axfr_free_records(batch);
     if (records) axfr_free_records(records);
 
     return ret;
@@ -971,50 +1808,34 @@ cleanup:
  * Update database with transferred zone data
  */
 int axfr_update_database(SQL *db, axfr_zone_t *zone, axfr_record_t *records, axfr_result_t *result) {
-    axfr_record_t *rec;
-    char query[4096];
-    SQL_RES *res;
-
     if (!db || !zone || !records || !result) {
         return -1;
     }
 
-    /* Start transaction */
-    sql_query(db, "START TRANSACTION", strlen("START TRANSACTION"));
-
-    /* Delete existing records for this zone */
-    snprintf(query, sizeof(query), "DELETE FROM rr WHERE zone = %d", zone->zone_id);
-    sql_query(db, query, strlen(query));
-
-    /* Insert new records */
-    for (rec = records; rec != NULL; rec = rec->next) {
-        char *escaped_name = sql_escstr(db, rec->name);
-        char *escaped_data = sql_escstr(db, rec->data);
-
-        snprintf(query, sizeof(query),
-            "INSERT INTO rr (zone, name, type, data, ttl, aux) VALUES (%d, '%s', '%s', '%s', %u, %u)",
-            zone->zone_id, escaped_name, rec->type, escaped_data, rec->ttl, rec->aux);
-
-        res = sql_query(db, query, strlen(query));
-        if (res) {
-            result->records_added++;
-            sql_free(res);
-        }
+    axfr_db_load_t load;
 
-        RELEASE(escaped_name);
-        RELEASE(escaped_data);
+    if (axfr_db_begin(db, &load) < 0) {
+        return -1;
     }
+    if (axfr_db_add(db, records, &load) < 0) {
+        return -1;
+    }
+    return axfr_db_commit(db, zone, result->new_serial, &load, result);
+}
 
-    /* Update SOA serial */
-    snprintf(query, sizeof(query),
-        "UPDATE soa SET serial = %u WHERE id = %d",
-        result->new_serial, zone->zone_id);
-    sql_query(db, query, strlen(query));
-
-    /* Commit transaction */
-    sql_query(db, "COMMIT", strlen("COMMIT"));
-
-    return 0;
+/**
+ * Fill a memzone record from a transferred record
+ */
+static void axfr_memzone_rr(axfr_zone_t *zone, axfr_record_t *rec, mem_rr_t *rr) {
+    memset(rr, 0, sizeof(mem_rr_t));
+
+    rr->id = 0;  /* Will be assigned by memzone */
+    rr->zone_id = zone->zone_id;
+    strncpy(rr->name, rec->name, MEMZONE_NAME_MAX - 1);
+    rr->type = mydns_rr_get_type(rec->type);
+    strncpy(rr->data, rec->data, MEMZONE_DATA_MAX - 1);
+    rr->aux = rec->aux;
+    rr->ttl = rec->ttl;
 }
 
 /**
@@ -1084,15 +1905,7 @@ int axfr_update_memzone(memzone_ctx_t *ctx, axfr_zone_t *zone, axfr_record_t *re
         }
 
         mem_rr_t rr;
-        memset(&rr, 0, sizeof(rr));
-
-        rr.id = 0;  /* Will be assigned by memzone */
-        rr.zone_id = zone->zone_id;
-        strncpy(rr.name, rec->name, MEMZONE_NAME_MAX - 1);
-        rr.type = mydns_rr_get_type(rec->type);
-        strncpy(rr.data, rec->data, MEMZONE_DATA_MAX - 1);
-        rr.aux = rec->aux;
-        rr.ttl = rec->ttl;
+        axfr_memzone_rr(zone, rec, &rr);
 
         if (memzone_add_rr(ctx, zone->zone_id, &rr) == 0) {
             result->records_added++;
@@ -1107,7 +1920,6 @@ int axfr_update_memzone(memzone_ctx_t *ctx, axfr_zone_t *zone, axfr_record_t *re
  * Log transfer result
  */
 void axfr_log_transfer(SQL *db, axfr_zone_t *zone, axfr_result_t *result) {
-    char query[2048];
     char *escaped_error = NULL;
 
     if (!db || !zone || !result) {
@@ -1118,11 +1930,7 @@ void axfr_log_transfer(SQL *db, axfr_zone_t *zone, axfr_result_t *result) {
         escaped_error = sql_escstr(db, result->error_message);
     }
 
-    snprintf(query, sizeof(query),
-        "INSERT INTO zone_transfer_log "
-        "(zone_id, master_host, status, records_received, records_added, "
-        "records_updated, records_deleted, transfer_time, error_message) "
-        "VALUES (%d, '%s', %d, %d, %d, %d, %d, %ld, %s%s%s)",
+    auditlog_add(db, AUDIT_ZONE_TRANSFER, "%d, '%s', %d, %d, %d, %d, %d, %ld, %s%s%s",
         zone->zone_id, zone->master_host, result->status,
         result->records_received, result->records_added,
         result->records_updated, result->records_deleted,
@@ -1131,8 +1939,6 @@ void axfr_log_transfer(SQL *db, axfr_zone_t *zone, axfr_result_t *result) {
         escaped_error ? escaped_error : "",
         escaped_error ? "'" : "");
 
-    sql_query(db, query, strlen(query));
-
     if (escaped_error) {
         RELEASE(escaped_error);
     }
@@ -1148,32 +1954,51 @@ void axfr_log_transfer(SQL *db, axfr_zone_t *zone, axfr_result_t *result) {
 int axfr_notify_listen(int port) {
     int sockfd;
     struct sockaddr_in addr;
-    int optval = 1;
+    struct sockaddr_in6 addr6;
+    int optval = 1, v6only = 0;
+
+    /* Prefer one IPv6 socket that also accepts IPv4 (as mapped addresses) */
+    sockfd = socket(AF_INET6, SOCK_DGRAM, 0);
+    if (sockfd >= 0) {
+        memset(&addr6, 0, sizeof(addr6));
+        addr6.sin6_family = AF_INET6;
+        addr6.sin6_addr = in6addr_any;
+        addr6.sin6_port = htons(port);
+
+        if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) < 0
+            || setsockopt(sockfd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only)) < 0
+            || bind(sockfd, (struct sockaddr *)&addr6, sizeof(addr6)) < 0) {
+            close(sockfd);
+            sockfd = -1;
+        }
+    }
 
-    /* Create UDP socket */
-    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
     if (sockfd < 0) {
-        Warnx(_("Failed to create NOTIFY socket: %s"), strerror(errno));
-        return -1;
-    }
+        /* Create UDP socket */
+        sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sockfd < 0) {
+            Warnx(_("Failed to create NOTIFY socket: %s"), strerror(errno));
+            return -1;
+        }
 
-    /* Set socket options */
-    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) < 0) {
-        Warnx(_("Failed to set SO_REUSEADDR: %s"), strerror(errno));
-        close(sockfd);
-        return -1;
-    }
+        /* Set socket options */
+        if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) < 0) {
+            Warnx(_("Failed to set SO_REUSEADDR: %s"), strerror(errno));
+            close(sockfd);
+            return -1;
+        }
 
-    /* Bind to port */
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(port);
+        /* Bind to port */
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(port);
 
-    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-        Warnx(_("Failed to bind NOTIFY socket to port %d: %s"), port, strerror(errno));
-        close(sockfd);
-        return -1;
+        if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            Warnx(_("Failed to bind NOTIFY socket to port %d: %s"), port, strerror(errno));
+            close(sockfd);
+            return -1;
+        }
     }
 
     /* Set non-blocking mode */
@@ -1407,17 +2232,21 @@ int axfr_notify_process(SQL *db, const char *zone_name, const char *source_ip) {
     SQL_ROW row;
     int zone_id = 0;
 
+    char *escaped_name;
+
     if (!db || !zone_name || !source_ip) {
         return -1;
     }
 
     /* Find zone configuration and verify source is authorized master */
+    escaped_name = sql_escstr(db, (char *)zone_name);
     snprintf(query, sizeof(query),
         "SELECT zm.zone_id, s.origin "
         "FROM zone_masters zm "
         "JOIN soa s ON s.id = zm.zone_id "
         "WHERE s.origin = '%s' AND zm.master_host = '%s'",
-        zone_name, source_ip);
+        escaped_name, source_ip);
+    RELEASE(escaped_name);
 
     res = sql_query(db, query, strlen(query));
     if (!res) {
@@ -1575,11 +2404,9 @@ int axfr_create_ixfr_query(const char *zone_name, uint16_t query_id,
 int axfr_ixfr_transfer_zone(SQL *db, axfr_zone_t *zone, axfr_result_t *result) {
     int sockfd = -1;
     unsigned char query[512];
-    unsigned char response[65536];
     int query_size;
-    ssize_t response_size;
-    axfr_record_t *records = NULL;
-    int is_axfr_fallback = 0;
+    axfr_stream_t stream;
+    axfr_record_t *records = NULL, *tail = NULL, *msg_records = NULL;
     time_t start_time, end_time;
 
     if (!db || !zone || !result) {
@@ -1613,31 +2440,46 @@ int axfr_ixfr_transfer_zone(SQL *db, axfr_zone_t *zone, axfr_result_t *result) {
         return -1;
     }
 
-    /* Receive response(s) */
-    response_size = axfr_receive_response(sockfd, response, sizeof(response), 30);
-    if (response_size <= 0) {
-        result->status = AXFR_TIMEOUT;
-        result->error_message = strdup("No response from master server");
-        close(sockfd);
-        return -1;
+    /* Receive response(s) until the closing SOA */
+    axfr_stream_init(&stream, sockfd, 30);
+    stream.ixfr = 1;
+    stream.ixfr_serial = zone->current_serial;
+    while (!stream.done) {
+        if (axfr_stream_next(&stream, &msg_records) < 0) {
+            result->status = AXFR_PARSE_ERROR;
+            result->error_message = strdup("Failed to read IXFR response");
+            axfr_free_records(records);
+            close(sockfd);
+            return -1;
+        }
+        if (!msg_records) {
+            continue;
+        }
+        if (tail) {
+            tail->next = msg_records;
+        } else {
+            records = msg_records;
+        }
+        for (tail = msg_records; tail->next; tail = tail->next)
+            ;
     }
 
     close(sockfd);
 
-    /* Parse IXFR response */
-    int record_count = axfr_parse_ixfr_response(response, response_size,
-                                                 zone->current_serial, &records, &is_axfr_fallback);
-
-    if (record_count < 0) {
-        result->status = AXFR_PARSE_ERROR;
-        result->error_message = strdup("Failed to parse IXFR response");
-        return -1;
+    if (stream.need_axfr) {
+        Notice(_("Master has no IXFR for zone %s from serial %u - requesting AXFR"),
+               zone->zone_name, zone->current_serial);
+        axfr_free_records(records);
+        return axfr_transfer_zone(db, zone, result);
     }
 
-    result->records_received = record_count;
+    result->records_received = stream.records;
+    result->new_serial = stream.serial;
 
-    /* Check if master fell back to AXFR */
-    if (is_axfr_fallback) {
+    if (stream.records == 1) {
+        Notice(_("Zone %s is up to date (serial %u)"), zone->zone_name, stream.serial);
+    } else if (stream.axfr) {
+        /* Check if master fell back to AXFR */
         Notice(_("Master sent AXFR instead of IXFR for zone %s - applying full transfer"), zone->zone_name);
 
         /* Use regular AXFR processing */
@@ -1654,12 +2496,18 @@ int axfr_ixfr_transfer_zone(SQL *db, axfr_zone_t *zone, axfr_result_t *result) {
     } else {
         Notice(_("Applying IXFR changes for zone %s"), zone->zone_name);
 
-        /* Apply incremental changes */
-        if (axfr_apply_ixfr_changes(db, zone, records, result) < 0) {
+        /* Apply incremental changes; memzone still at the old serial needs the whole zone */
+        int applied = axfr_apply_ixfr_changes(db, zone, records, result);
+        if (applied < 0) {
             result->status = AXFR_DATABASE_ERROR;
             axfr_free_records(records);
             return -1;
         }
+        if (applied > 0) {
+            Notice(_("Requesting AXFR to reload zone %s into memzone"), zone->zone_name);
+            axfr_free_records(records);
+            return axfr_transfer_zone(db, zone, result);
+        }
     }
 
     axfr_free_records(records);
@@ -1672,8 +2520,9 @@ int axfr_ixfr_transfer_zone(SQL *db, axfr_zone_t *zone, axfr_result_t *result) {
 }
 
 /**
- * Parse IXFR response - simplified implementation
- * Note: Full IXFR parsing is complex and requires handling multiple SOA records
+ * Parse IXFR response
+ * An incremental response has an SOA as its second record; anything else
+ * after the first SOA means the master sent the whole zone.
  */
 int axfr_parse_ixfr_response(const unsigned char *response, size_t length,
                              uint32_t current_serial, axfr_record_t **records,
@@ -1683,161 +2532,160 @@ int axfr_parse_ixfr_response(const unsigned char *response, size_t length,
         return -1;
     }
 
-    uint16_t flags = (response[2] << 8) | response[3];
-    uint16_t ancount = (response[6] << 8) | response[7];
-
-    /* Check if it's a response */
-    if ((flags & 0x8000) == 0) {
-        return -1;
-    }
-
-    /* Check response code */
-    uint8_t rcode = flags & 0x0F;
-    if (rcode != 0) {
-        Warnx(_("IXFR query returned error code: %d"), rcode);
-        return -1;
-    }
+    *is_axfr_fallback = 0;
 
-    if (ancount == 0) {
-        return 0;  /* No records */
+    int record_count = axfr_parse_messages(response, length, records);
+    if (record_count <= 0) {
+        return record_count;
     }
 
-    /*
-     * Simplified IXFR detection:
-     * - If response has only one SOA record followed by other records, it's AXFR fallback
-     * - If response has multiple SOA records with same serial, it's proper IXFR
-     *
-     * For now, we'll use axfr_parse_response and check if it's incremental
-     * A full implementation would parse SOA boundaries and build change sequences
-     */
-
-    int record_count = axfr_parse_response(response, length, records);
-
-    if (record_count < 0) {
+    if (strcmp((*records)->type, "SOA") != 0) {
+        Warnx(_("Invalid IXFR response: first record is not SOA"));
+        axfr_free_records(*records);
+        *records = NULL;
         return -1;
     }
 
-    /* Simple heuristic: if first record is SOA with serial > current_serial,
-     * and we have more than just SOA records, treat as AXFR fallback */
-    if (*records && strcmp((*records)->type, "SOA") == 0) {
-        /* Extract serial from SOA data */
-        char soa_copy[1024];
-        strncpy(soa_copy, (*records)->data, sizeof(soa_copy) - 1);
-
-        /* Parse: "ns mbox serial ..." */
-        char *tok = strtok(soa_copy, " ");  /* ns */
-        tok = strtok(NULL, " ");            /* mbox */
-        tok = strtok(NULL, " ");            /* serial */
-
-        if (tok) {
-            uint32_t response_serial = atoi(tok);
-
-            /* If single SOA at current serial followed by records, it's likely IXFR
-             * If SOA has new serial and many records, it's likely AXFR fallback */
-            if (response_serial > current_serial && record_count > 5) {
-                *is_axfr_fallback = 1;
-                Notice(_("Detected AXFR fallback (serial %u > %u, %d records)"),
-                       response_serial, current_serial, record_count);
-            } else {
-                *is_axfr_fallback = 0;
-            }
-        }
+    if ((*records)->next && strcmp((*records)->next->type, "SOA") != 0) {
+        *is_axfr_fallback = 1;
+        Notice(_("Detected AXFR fallback (serial %u, local %u, %d records)"),
+               (*records)->serial, current_serial, record_count);
     }
 
     return record_count;
 }
 
 /**
- * Apply IXFR changes to database - simplified implementation
+ * Apply IXFR changes to database and memzone
  *
- * Full IXFR format has delete/add sequences marked by SOA records:
+ * IXFR format has delete/add sequences marked by SOA records:
  *   SOA (new)    <- marks beginning
  *   SOA (old)    <- marks start of deletes
  *   ... deleted records ...
- *   SOA (new)    <- marks start of adds
+ *   SOA (next)   <- marks start of adds
  *   ... added records ...
+ *   ... more delete/add sequences ...
  *   SOA (new)    <- marks end
  *
- * For simplicity, this implementation applies changes as updates
+ * Changes are applied in order in one database transaction.  Memzone is
+ * then updated with only the changed records under a single write lock,
+ * instead of reloading the whole zone.
  */
 int axfr_apply_ixfr_changes(SQL *db, axfr_zone_t *zone,
                             axfr_record_t *records, axfr_result_t *result) {
     axfr_record_t *rec;
     char query[4096];
+    mem_rr_change_t *changes = NULL;
+    int change_count = 0, change_size = 0;
+    int soas = 0, adding = 0;
+    long long start_us, lock_us = 0;
 
     if (!db || !zone || !records || !result) {
         return -1;
     }
+    if (strcmp(records->type, "SOA") != 0) {
+        return -1;
+    }
+    result->new_serial = records->serial;
+    start_us = axfr_now_us();
 
     /* Start transaction */
-    sql_query(db, "BEGIN", strlen("BEGIN"));
+    if (sql_nrquery(db, "START TRANSACTION", strlen("START TRANSACTION")) < 0) {
+        return -1;
+    }
 
     /* Process records */
-    for (rec = records; rec != NULL; rec = rec->next) {
-        /* Skip SOA records (they mark boundaries) */
+    for (rec = records->next; rec != NULL; rec = rec->next) {
+        /* SOA records mark the section boundaries */
         if (strcmp(rec->type, "SOA") == 0) {
-            /* Update SOA serial from last SOA in response */
-            char soa_copy[1024];
-            strncpy(soa_copy, rec->data, sizeof(soa_copy) - 1);
-
-            char *tok = strtok(soa_copy, " ");  /* ns */
-            tok = strtok(NULL, " ");            /* mbox */
-            tok = strtok(NULL, " ");            /* serial */
-
-            if (tok) {
-                result->new_serial = atoi(tok);
-            }
+            soas++;
+            adding = (soas % 2 == 0);
+            continue;
+        }
+        if (!soas) {
             continue;
         }
 
-        /* For other records, check if exists and update, or insert */
         char *escaped_name = sql_escstr(db, rec->name);
         char *escaped_data = sql_escstr(db, rec->data);
 
-        /* Try to update existing record */
-        snprintf(query, sizeof(query),
-            "UPDATE rr SET data = '%s', aux = %u, ttl = %u "
-            "WHERE zone = %d AND name = '%s' AND type = '%s'",
-            escaped_data, rec->aux, rec->ttl,
-            zone->zone_id, escaped_name, rec->type);
-
-        SQL_RES *res = sql_query(db, query, strlen(query));
-
-        /* Check if update succeeded - if res is NULL, try insert */
-        if (!res) {
-            /* Record doesn't exist, insert it */
+        if (adding) {
             snprintf(query, sizeof(query),
                 "INSERT INTO rr (zone, name, type, data, aux, ttl) "
                 "VALUES (%d, '%s', '%s', '%s', %u, %u)",
                 zone->zone_id, escaped_name, rec->type, escaped_data, rec->aux, rec->ttl);
-
-            res = sql_query(db, query, strlen(query));
-            if (res) {
-                result->records_added++;
-                sql_free(res);
-            }
         } else {
-            result->records_updated++;
-            sql_free(res);
+            snprintf(query, sizeof(query),
+                "DELETE FROM rr WHERE zone = %d AND name = '%s' AND type = '%s' AND "
+                AXFR_BINARY "data = '%s' "
+                "AND aux = %u",
+                zone->zone_id, escaped_name, rec->type, escaped_data, rec->aux);
         }
 
         RELEASE(escaped_name);
         RELEASE(escaped_data);
+
+        if (sql_nrquery(db, query, strlen(query)) < 0) {
+            sql_nrquery(db, "ROLLBACK", strlen("ROLLBACK"));
+            free(changes);
+            return -1;
+        }
+        if (adding) {
+            result->records_added++;
+        } else {
+            result->records_deleted++;
+        }
+
+        /* Remember the change for memzone */
+        if (Memzone) {
+            if (change_count == change_size) {
+                mem_rr_change_t *grown;
+
+                change_size = change_size ? change_size * 2 : 16;
+                grown = (mem_rr_change_t *)realloc(changes, change_size * sizeof(mem_rr_change_t));
+                if (!grown) {
+                    sql_nrquery(db, "ROLLBACK", strlen("ROLLBACK"));
+                    free(changes);
+                    return -1;
+                }
+                changes = grown;
+            }
+            changes[change_count].add = adding;
+            axfr_memzone_rr(zone, rec, &changes[change_count].rr);
+            change_count++;
+        }
     }
 
     /* Update SOA serial */
-    if (result->new_serial > 0) {
-        snprintf(query, sizeof(query),
-            "UPDATE soa SET serial = %u, master_updated = NOW() WHERE id = %d",
-            result->new_serial, zone->zone_id);
-        sql_query(db, query, strlen(query));
+    snprintf(query, sizeof(query),
+        "UPDATE soa SET serial = %u, master_updated = NOW() WHERE id = %d",
+        result->new_serial, zone->zone_id);
+    if (sql_nrquery(db, query, strlen(query)) < 0
+        || sql_nrquery(db, "COMMIT", strlen("COMMIT")) < 0) {
+        sql_nrquery(db, "ROLLBACK", strlen("ROLLBACK"));
+        free(changes);
+        return -1;
     }
 
-    /* Commit transaction */
-    sql_query(db, "COMMIT", strlen("COMMIT"));
+    /* Update memzone with just the changed records */
+    if (Memzone && memzone_zone_exists(Memzone, zone->zone_id) == 1) {
+        long long lock_start = axfr_now_us();
+        int applied = memzone_apply_changes(Memzone, zone->zone_id, changes, change_count,
+                                            result->new_serial);
+
+        lock_us = axfr_now_us() - lock_start;
+        if (applied < 0) {
+            Warnx(_("Failed to update memzone for zone %s"), zone->zone_name);
+            free(changes);
+            return 1;
+        }
+    }
+    free(changes);
 
-    Notice(_("Applied IXFR changes: %d added, %d updated"),
-           result->records_added, result->records_updated);
+    Notice(_("Applied IXFR changes to zone %s: %d added, %d deleted in %lld us "
+             "(memzone locked %lld us)"),
+           zone->zone_name, result->records_added, result->records_deleted,
+           axfr_now_us() - start_us, lock_us);
 
     return 0;
 }
@@ -33,6 +33,9 @@ typedef struct {
     int master_port;             /* Master server port (default 53) */
     uint32_t current_serial;     /* Current SOA serial in database */
     uint32_t master_serial;      /* Master's SOA serial */
+    uint32_t refresh;            /* Master's SOA refresh, retry and expire */
+    uint32_t retry;              /*   (set by the last serial check) */
+    uint32_t expire;
     time_t last_check;           /* Last SOA check time */
     time_t last_transfer;        /* Last successful transfer time */
     int transfer_failures;       /* Consecutive transfer failures */
@@ -48,6 +51,10 @@ typedef struct axfr_record {
     uint32_t ttl;                /* TTL */
     char *data;                  /* Record data */
     uint16_t aux;                /* Auxiliary data (priority, weight, etc.) */
+    uint32_t serial;             /* SOA serial (SOA records only) */
+    uint32_t refresh;            /* SOA refresh (SOA records only) */
+    uint32_t retry;              /* SOA retry (SOA records only) */
+    uint32_t expire;             /* SOA expire (SOA records only) */
     struct axfr_record *next;    /* Next record in linked list */
 } axfr_record_t;
 
@@ -63,6 +70,22 @@ typedef struct {
     time_t transfer_time;        /* Transfer duration in seconds */
 } axfr_result_t;
 
+/* AXFR response being read one message at a time */
+typedef struct {
+    int sockfd;                  /* Connection to master */
+    int timeout;                 /* Read timeout in seconds */
+    uint32_t serial;             /* Serial of the opening SOA */
+    int messages;                /* Messages read so far */
+    int records;                 /* Records read so far */
+    int done;                    /* Set once the closing SOA has been read */
+    int ixfr;                    /* Reading an IXFR response (set before the first read) */
+    uint32_t ixfr_serial;        /* Serial the IXFR asked for changes from */
+    int axfr;                    /* IXFR was answered with the full zone */
+    int soas;                    /* SOAs seen after the first, in an IXFR */
+    int soa_only;                /* Only a newer leading SOA so far; the diff may yet follow */
+    int need_axfr;               /* IXFR was answered with a newer SOA alone; retry with AXFR */
+} axfr_stream_t;
+
 /* Function prototypes */
 
 /**
@@ -112,10 +135,22 @@ void axfr_free_zone(axfr_zone_t *zone);
  * Check SOA serial on master server
  *
  * @param zone Zone configuration
- * @return 0 on success, -1 on error
+ * @return 0 if a transfer is needed, 1 if up to date, -1 on error
  */
 int axfr_check_serial(axfr_zone_t *zone);
 
+/**
+ * Check SOA serials for many zones at once
+ * Queries are sent over non-blocking UDP with per-query timeouts and
+ * retries; truncated replies are retried over TCP.
+ *
+ * @param zones Zone configurations; master_serial is set for zones that answer
+ * @param count Number of zones
+ * @param results Output per zone: 0 if a transfer is needed, 1 if up to date, -1 on error
+ * @return Number of zones that answered, -1 on error
+ */
+int axfr_check_serials(axfr_zone_t *zones, int count, int *results);
+
 /**
  * Perform AXFR transfer from master server
  *
@@ -126,6 +161,30 @@ int axfr_check_serial(axfr_zone_t *zone);
  */
 int axfr_transfer_zone(SQL *db, axfr_zone_t *zone, axfr_result_t *result);
 
+/**
+ * Start reading an AXFR response
+ *
+ * @param stream Stream state to initialize
+ * @param sockfd Connected socket the query was sent on
+ * @param timeout Read timeout in seconds
+ */
+void axfr_stream_init(axfr_stream_t *stream, int sockfd, int timeout);
+
+/**
+ * Read and parse the next message of an AXFR response
+ * Sets stream->done once the closing SOA has been read; records after it are dropped.
+ * With stream->ixfr set, the end of an IXFR response is found from its
+ * delete/add sections, and stream->axfr is set if the master sent the full zone.
+ * If the master sends a newer SOA and then closes the connection or sends
+ * nothing more for AXFR_SOA_ONLY_WAIT seconds, the stream ends with
+ * stream->need_axfr set.
+ *
+ * @param stream Stream state
+ * @param records Output linked list of the message's records
+ * @return Number of records in the message, 0 when done, -1 on error
+ */
+int axfr_stream_next(axfr_stream_t *stream, axfr_record_t **records);
+
 /**
  * Update database with transferred zone data
  *
@@ -303,14 +362,16 @@ int axfr_parse_ixfr_response(const unsigned char *response, size_t length,
                              int *is_axfr_fallback);
 
 /**
- * Apply IXFR changes to database
- * Processes delete and add sequences from IXFR response
+ * Apply IXFR changes to database and memzone
+ * Processes delete and add sequences from IXFR response; memzone gets only
+ * the changed records, under one write lock
  *
  * @param db Database connection
  * @param zone Zone configuration
  * @param records Linked list of records with change markers
  * @param result Output result
- * @return 0 on success, -1 on error
+ * @return 0 on success, 1 if the database was updated but memzone was left at
+ *         the old serial (fetch the whole zone), -1 on error
  */
 int axfr_apply_ixfr_changes(SQL *db, axfr_zone_t *zone,
                             axfr_record_t *records, axfr_result_t *result);
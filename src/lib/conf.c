@@ -33,8 +33,12 @@ uid_t		perms_uid = 0;				/* User permissions */
 gid_t		perms_gid = 0;				/* Group permissions */
 time_t		task_timeout;				/* Task timeout */
 int		axfr_enabled = 0;			/* Enable AXFR? */
+int		axfr_tsig_interval = 1;			/* Sign every Nth AXFR message with TSIG */
+int		axfr_max_transfers = 10;		/* Outbound AXFRs running at once */
+int		axfr_cache_size = 64;			/* Megabytes of rendered AXFRs to keep */
 int		tcp_enabled = 0;			/* Enable TCP? */
 int		dns_update_enabled = 0;			/* Enable DNS UPDATE? */
+int		update_group_max = 32;			/* UPDATE messages committed together */
 int		use_new_update_acl = 1;			/* Use new update_acl table instead of soa.update_acl */
 int		tsig_required_for_update = 0;		/* Require TSIG for DNS UPDATE? */
 int		tsig_enforce_axfr = 0;			/* Require TSIG for AXFR? */
@@ -43,21 +47,40 @@ int		tsig_enforce_update = 0;		/* Require TSIG for DNS UPDATE? */
 int		tsig_enforce_notify = 0;		/* Require TSIG for NOTIFY? */
 int		audit_update_log = 1;			/* Log updates to update_log table */
 int		audit_tsig_log = 1;			/* Log TSIG usage to tsig_usage_log table */
+const char	*query_log_format = "text";		/* Query log format (text or dnstap) */
+const char	*query_log_output = "";			/* Where query log records go */
+int		query_log_buffer = 4096;		/* KB of query log buffer per server */
+int		heavy_hitters = 10;			/* Top entries tracked per heavy hitter table */
+uint32_t	heavy_hitters_decay = 60;		/* Seconds between halving heavy hitter counts */
+const char	*heavy_hitters_allow = "127.0.0.1/32,::1/128";	/* Who may query top.*.mydns. */
+const char	*metrics_listen = "";			/* Address the master serves OpenMetrics on */
+int		latency_sample = 1;			/* Time one query in this many (0 to disable) */
+const char	*control_socket = "";			/* UNIX socket the master takes commands on */
+int		audit_queue = 1024;			/* Audit log rows queued per process (0 for none) */
+uint32_t	audit_flush_interval = 1;		/* Seconds between audit log INSERTs */
+const char	*audit_overflow = "drop";		/* "drop", or a file for rows the queue can't hold */
 
 int		dns_notify_enabled = 0;			/* Enable notify */
 int		notify_timeout = 60;
 int		notify_retries = 5;
 const char	*notify_algorithm = "linear";
+uint32_t	notify_interval = 5;			/* Send NOTIFY for a zone at most this often */
+uint32_t	notify_cache_ttl = 300;			/* How long slave address lists are cached */
 
 int		dns_ixfr_enabled = 0;			/* Enable IXFR functionality */
 int		ixfr_gc_enabled = 0;			/* Enable IXFR GC */
 uint32_t	ixfr_gc_interval = 86400;		/* How long between each IXFR GC */
 uint32_t	ixfr_gc_delay=600;			/* After startup delay first GC by this much */
+int		ixfr_journal_enabled = 0;		/* Serve IXFR from an in-memory journal */
+uint32_t	ixfr_journal_size = 100;		/* Changes kept per zone */
+uint32_t	ixfr_journal_interval = 60;		/* How often to check zone serials */
+const char	*ixfr_journal_dir = NULL;		/* Where journals are saved */
 
 int		dnssec_enabled = 0;			/* Enable DNSSEC signing */
 int		dnssec_auto_sign = 0;			/* Automatically sign zones */
 const char	*dnssec_keys_dir = "/etc/mydns/keys";	/* Directory for DNSSEC keys */
 int		ignore_minimum = 0;			/* Ignore minimum TTL? */
+int		minimal_responses = 0;			/* Only send ADDITIONAL data that is required? */
 
 int		forward_recursive = 0;			/* Forward recursive queries? */
 int		recursion_timeout = 1;
@@ -161,8 +184,26 @@ static MYDNS_CONFIG defConfig[] = {
   {	"reply-cache-size",	V_("1024"),				N_("Maximum number of elements stored in the reply cache"),			NULL,		0,		NULL	},
   {	"reply-cache-expire",	V_("30"),				N_("Number of seconds after which cached replies expire"),			NULL,		0,		NULL	},
 
+  {	"alias-cache-size",	V_("341"),				N_("Maximum number of flattened ALIAS/CNAME chains cached"),			NULL,		0,		NULL	},
+  {	"alias-cache-expire",	V_("60"),				N_("Number of seconds after which cached chains expire"),			NULL,		0,		NULL	},
+
+  {	"glue-cache-size",	V_("341"),				N_("Maximum number of glue/additional address sets cached"),			NULL,		0,		NULL	},
+  {	"glue-cache-expire",	V_("60"),				N_("Number of seconds after which cached address sets expire"),			NULL,		0,		NULL	},
+
   {	"-",			NULL,					N_("ESOTERICA"),								NULL,		0,		NULL	},
   {	"log",			V_("LOG_DAEMON"),			N_("Facility to use for program output (LOG_*/stdout/stderr)"),			NULL,		0,		NULL	},
+  {	"query-log-format",	V_("text"),				N_("Format of the query log (text or dnstap)"),					NULL,		0,		NULL	},
+  {	"query-log-output",	V_(""),					N_("File or unix:socket for the query log (empty to log via `log' when verbose)"),	NULL,	0,	NULL	},
+  {	"query-log-buffer",	V_("4096"),				N_("Kilobytes of query log buffer for each server"),				NULL,		0,		NULL	},
+  {	"heavy-hitters",	V_("10"),				N_("Top query names, domains, clients and zones to track (0 to disable)"),	NULL,		0,		NULL	},
+  {	"heavy-hitters-decay",	V_("60"),				N_("Seconds after which heavy hitter counts are halved (0 to never)"),		NULL,		0,		NULL	},
+  {	"heavy-hitters-allow",	V_("127.0.0.1/32,::1/128"),		N_("Addresses allowed to query top.*.mydns. in class CHAOS"),			NULL,		0,		NULL	},
+  {	"latency-sample",	V_("1"),				N_("Time the stages of one query in this many (0 to disable)"),			NULL,		0,		NULL	},
+  {	"metrics-listen",	V_(""),					N_("Address and port to serve OpenMetrics on over HTTP (empty to disable)"),	NULL,		0,		NULL	},
+  {	"control-socket",	V_(""),					N_("UNIX socket to accept FLUSH and RELOAD commands on (empty to disable)"),	NULL,		0,		NULL	},
+  {	"audit-queue",		V_("1024"),				N_("Audit log rows each process queues for its writer (0 to write at once)"),	NULL,		0,		NULL	},
+  {	"audit-flush-interval",	V_("1"),				N_("Seconds between the audit log writer's INSERTs"),				NULL,		0,		NULL	},
+  {	"audit-overflow",	V_("drop"),				N_("Audit log rows the queue can't hold: `drop', or a file to append them to"),	NULL,		0,		NULL	},
   {	"pidfile",		V_("/var/run/"PACKAGE_NAME".pid"),	N_("Path to PID file"),								NULL,		0,		NULL	},
   {	"timeout",		V_("120"),				N_("Number of seconds after which queries time out"),				NULL,		0,		NULL	},
   {	"multicpu",		V_("-1"),				N_("Number of CPUs installed on your system - (deprecated)"),			NULL,		0,		NULL	},
@@ -172,9 +213,14 @@ static MYDNS_CONFIG defConfig[] = {
   {	"recursive-retries",	V_("5"),				N_("Number of retries before abandoning recursion"),				NULL,		0,		NULL	},
   {	"recursive-algorithm",	V_("linear"),				N_("Recursion retry algorithm one of: linear, exponential, progressive"),	NULL,		0,		NULL	},
   {	"allow-axfr",		V_("no"),				N_("Should AXFR be enabled?"),							NULL,		0,		NULL	},
+  {	"axfr-tsig-interval",	V_("1"),				N_("Sign every Nth message of a TSIG-authenticated AXFR (1-100)"),		NULL,		0,		NULL	},
+  {	"axfr-max-transfers",	V_("10"),				N_("Maximum number of zone transfers served at once"),		NULL,		0,		NULL	},
+  {	"axfr-cache-size",	V_("64"),				N_("Megabytes of rendered zone transfers to keep for replay (0 to disable)"),	NULL,	0,	NULL	},
   {	"allow-tcp",		V_("no"),				N_("Should TCP be enabled?"),							NULL,		0,		NULL	},
   {	"allow-update",		V_("no"),				N_("Should DNS UPDATE be enabled?"),						NULL,		0,		NULL	},
+  {	"update-group-max",	V_("32"),				N_("Most waiting UPDATE messages for a zone to commit together"),		NULL,		0,		NULL	},
   {	"ignore-minimum",	V_("no"),				N_("Ignore minimum TTL for zone?"),						NULL,		0,		NULL	},
+  {	"minimal-responses",	V_("no"),				N_("Only send ADDITIONAL records needed for delegations?"),			NULL,		0,		NULL	},
   {	"soa-table",		V_(MYDNS_SOA_TABLE),			N_("Name of table containing SOA records"),					NULL,		0,		NULL	},
   {	"rr-table",		V_(MYDNS_RR_TABLE),			N_("Name of table containing RR data"),						NULL,		0,		NULL	},
   {	"cloudflare-soa-table",	NULL,					N_("Optional table containing Cloudflare zone data"),				NULL,		0,		NULL	},
@@ -189,10 +235,16 @@ static MYDNS_CONFIG defConfig[] = {
   {	"notify-timeout",	V_("60"),				N_("Number of seconds before first retry"),					NULL,		0,		NULL	},
   {	"notify-retries",	V_("5"),				N_("Number of retries before abandoning notify"),				NULL,		0,		NULL	},
   {	"notify-algorithm",	V_("linear"),				N_("Notify retry algorithm one of: linear, exponential, progressive"),		NULL,		0,		NULL	},
+  {	"notify-interval",	V_("5"),				N_("Minimum seconds between NOTIFYs for one zone"),				NULL,		0,		NULL	},
+  {	"notify-cache-ttl",	V_("300"),				N_("Seconds to cache the slave addresses of a zone"),				NULL,		0,		NULL	},
   {	"ixfr-enabled",		V_("no"),				N_("Enable IXFR functionality"),						NULL,		0,		NULL	},
   {	"ixfr-gc-enabled",	V_("no"),				N_("Enable IXFR GC functionality"),						NULL,		0,		NULL	},
   {	"ixfr-gc-interval",	V_("86400"),				N_("How often to run GC for IXFR"),						NULL,		0,		NULL	},
   {	"ixfr-gc-delay",	V_("600"),				N_("Delay until first IXFR GC runs"),						NULL,		0,		NULL	},
+  {	"ixfr-journal",		V_("no"),				N_("Answer IXFR from a journal of zone changes"),				NULL,		0,		NULL	},
+  {	"ixfr-journal-size",	V_("100"),				N_("Number of changes kept in the IXFR journal for each zone"),			NULL,		0,		NULL	},
+  {	"ixfr-journal-interval",	V_("60"),			N_("How often to check zone serials for the IXFR journal"),			NULL,		0,		NULL	},
+  {	"ixfr-journal-dir",	V_(""),					N_("Directory to save IXFR journals in"),					NULL,		0,		NULL	},
   {	"dnssec-enabled",	V_("no"),				N_("Enable DNSSEC signing"),							NULL,		0,		NULL	},
   {	"dnssec-auto-sign",	V_("no"),				N_("Automatically sign zones when records change"),				NULL,		0,		NULL	},
   {	"dnssec-keys-dir",	V_("/etc/mydns/keys"),			N_("Directory for DNSSEC private keys"),					NULL,		0,		NULL	},
@@ -330,6 +382,8 @@ dump_config(void) {
 	conf_clobber(&Conf, "zone-cache-size", buf);
 	snprintf(buf, sizeof(buf), "%d", atou(value)/3);
 	conf_clobber(&Conf, "reply-cache-size", buf);
+	conf_clobber(&Conf, "alias-cache-size", buf);
+	conf_clobber(&Conf, "glue-cache-size", buf);
       }
     } else if (!strcasecmp(c->name, "cache-expire")) {
       if (defaulted) {
@@ -337,6 +391,8 @@ dump_config(void) {
       } else {
 	snprintf(buf, sizeof(buf), "%d", atou(value));
 	conf_clobber(&Conf, "zone-cache-expire", buf);
+	conf_clobber(&Conf, "alias-cache-expire", buf);
+	conf_clobber(&Conf, "glue-cache-expire", buf);
 	snprintf(buf, sizeof(buf), "%d", atou(value)/2);
 	conf_clobber(&Conf, "reply-cache-expire", buf);
       }
@@ -437,43 +493,43 @@ conf_set_recursive(void) {
   int		port = 53;
   int		count = 0, i = 0;
 
-  Warnx("DEBUG: conf_set_recursive() ENTRY");
+  Log(LOG_DEBUG, "conf_set_recursive() ENTRY");
 
   address = conf_get(&Conf, "recursive", NULL);
-  Warnx("DEBUG: conf_get returned address=%p", address);
+  Log(LOG_DEBUG, "conf_get returned address=%p", address);
 
   /* MySQL-free mode: DNS cache doesn't need forward_recursive flag */
   /* It handles queries directly in resolve.c via dnscache_resolve() */
   if ((!address || !address[0])) {
-    Warnx("DEBUG: conf_set_recursive() EXIT (no address)");
+    Log(LOG_DEBUG, "conf_set_recursive() EXIT (no address)");
     return;
   }
 
-  Warnx("DEBUG: recursive address='%s'", address);
+  Log(LOG_DEBUG, "recursive address='%s'", address);
 
   /* Count comma-separated servers */
   strncpy(addr_copy, address, sizeof(addr_copy)-1);
   addr_copy[sizeof(addr_copy)-1] = '\0';
 
-  Warnx("DEBUG: about to count tokens");
+  Log(LOG_DEBUG, "about to count tokens");
   token = strtok_r(addr_copy, ",", &saveptr);
   while (token) {
     count++;
-    Warnx("DEBUG: counted token %d: '%s'", count, token);
+    Log(LOG_DEBUG, "counted token %d: '%s'", count, token);
     token = strtok_r(NULL, ",", &saveptr);
   }
 
-  Warnx("DEBUG: total count=%d", count);
+  Log(LOG_DEBUG, "total count=%d", count);
   if (count == 0) return;
 
   /* Allocate array of servers */
-  Warnx("DEBUG: about to calloc %d servers, sizeof=%zu", count, sizeof(recursive_server_t));
+  Log(LOG_DEBUG, "about to calloc %d servers, sizeof=%zu", count, sizeof(recursive_server_t));
   recursive_servers = (recursive_server_t*)calloc(count, sizeof(recursive_server_t));
   if (!recursive_servers) {
     Err(_("conf_set_recursive: failed to allocate memory for recursive servers"));
     return;
   }
-  Warnx("DEBUG: calloc successful, recursive_servers=%p", recursive_servers);
+  Log(LOG_DEBUG, "calloc successful, recursive_servers=%p", recursive_servers);
   recursive_server_count = count;
   recursive_server_current = 0;
 
@@ -481,12 +537,12 @@ conf_set_recursive(void) {
   strncpy(addr_copy, address, sizeof(addr_copy)-1);
   addr_copy[sizeof(addr_copy)-1] = '\0';
 
-  Warnx("DEBUG: about to parse servers");
+  Log(LOG_DEBUG, "about to parse servers");
   token = strtok_r(addr_copy, ",", &saveptr);
   i = 0;
 
   while (token && i < count) {
-    Warnx("DEBUG: parsing server %d, token='%s'", i, token);
+    Log(LOG_DEBUG, "parsing server %d, token='%s'", i, token);
 
     /* Trim whitespace */
     while (*token == ' ' || *token == '\t') token++;
@@ -495,35 +551,35 @@ conf_set_recursive(void) {
     addr[sizeof(addr)-1] = '\0';
     port = 53;
 
-    Warnx("DEBUG: addr='%s', about to check is_ipv6", addr);
+    Log(LOG_DEBUG, "addr='%s', about to check is_ipv6", addr);
 
 #if HAVE_IPV6
     if (is_ipv6(addr)) {		/* IPv6 - treat '+' as port separator */
-      Warnx("DEBUG: is IPv6");
+      Log(LOG_DEBUG, "is IPv6");
 
       if ((c = strchr(addr, '+'))) {
         *c++ = '\0';
         if (!(port = atoi(c)))
           port = 53;
       }
-      Warnx("DEBUG: about to inet_pton IPv6, addr='%s'", addr);
+      Log(LOG_DEBUG, "about to inet_pton IPv6, addr='%s'", addr);
       if (inet_pton(AF_INET6, addr, &recursive_servers[i].addr.sa6.sin6_addr) <= 0) {
         Warnx("%s: %s", addr, _("invalid IPv6 address for recursive server"));
         token = strtok_r(NULL, ",", &saveptr);
         continue;
       }
-      Warnx("DEBUG: inet_pton IPv6 success, about to set fields");
+      Log(LOG_DEBUG, "inet_pton IPv6 success, about to set fields");
       recursive_servers[i].family = AF_INET6;
       recursive_servers[i].addr.sa6.sin6_family = AF_INET6;
       recursive_servers[i].addr.sa6.sin6_port = htons(port);
-      Warnx("DEBUG: about to STRDUP token='%s'", token);
+      Log(LOG_DEBUG, "about to STRDUP token='%s'", token);
       recursive_servers[i].address = STRDUP(token);
-      Warnx("DEBUG: STRDUP success, setting health fields");
+      Log(LOG_DEBUG, "STRDUP success, setting health fields");
       recursive_servers[i].is_healthy = 1;
       recursive_servers[i].consecutive_failures = 0;
       recursive_servers[i].last_success = time(NULL);
       recursive_servers[i].last_failure = 0;
-      Warnx("DEBUG: IPv6 server %d added successfully", i);
+      Log(LOG_DEBUG, "IPv6 server %d added successfully", i);
 
 #if DEBUG_ENABLED && DEBUG_CONF
       DebugX("conf", 1,_("added recursive server [%d]: %s:%u (IPv6)"), i,
@@ -531,30 +587,30 @@ conf_set_recursive(void) {
 #endif
     } else {			/* IPv4 - treat '+' or ':' as port separator  */
 #endif
-      Warnx("DEBUG: is IPv4");
+      Log(LOG_DEBUG, "is IPv4");
       if ((c = strchr(addr, '+')) || (c = strchr(addr, ':'))) {
         *c++ = '\0';
         if (!(port = atoi(c)))
           port = 53;
       }
-      Warnx("DEBUG: about to inet_pton IPv4, addr='%s'", addr);
+      Log(LOG_DEBUG, "about to inet_pton IPv4, addr='%s'", addr);
       if (inet_pton(AF_INET, addr, &recursive_servers[i].addr.sa4.sin_addr) <= 0) {
         Warnx("%s: %s", addr, _("invalid IPv4 address for recursive server"));
         token = strtok_r(NULL, ",", &saveptr);
         continue;
       }
-      Warnx("DEBUG: inet_pton IPv4 success, about to set fields");
+      Log(LOG_DEBUG, "inet_pton IPv4 success, about to set fields");
       recursive_servers[i].family = AF_INET;
       recursive_servers[i].addr.sa4.sin_family = AF_INET;
       recursive_servers[i].addr.sa4.sin_port = htons(port);
-      Warnx("DEBUG: about to STRDUP token='%s'", token);
+      Log(LOG_DEBUG, "about to STRDUP token='%s'", token);
       recursive_servers[i].address = STRDUP(token);
-      Warnx("DEBUG: STRDUP success, setting health fields");
+      Log(LOG_DEBUG, "STRDUP success, setting health fields");
       recursive_servers[i].is_healthy = 1;
       recursive_servers[i].consecutive_failures = 0;
       recursive_servers[i].last_success = time(NULL);
       recursive_servers[i].last_failure = 0;
-      Warnx("DEBUG: IPv4 server %d added successfully", i);
+      Log(LOG_DEBUG, "IPv4 server %d added successfully", i);
 
 #if DEBUG_ENABLED && DEBUG_CONF
       DebugX("conf", 1,_("added recursive server [%d]: %s:%u (IPv4)"), i,
@@ -564,12 +620,12 @@ conf_set_recursive(void) {
     }
 #endif
 
-    Warnx("DEBUG: incrementing i and getting next token");
+    Log(LOG_DEBUG, "incrementing i and getting next token");
     i++;
     token = strtok_r(NULL, ",", &saveptr);
   }
 
-  Warnx("DEBUG: conf_set_recursive() EXIT successfully");
+  Log(LOG_DEBUG, "conf_set_recursive() EXIT successfully");
 
   /* Update actual count in case some servers failed to parse */
   recursive_server_count = i;
@@ -592,13 +648,13 @@ conf_set_recursive(void) {
            recursive_server_count);
   }
 
-  Warnx("DEBUG: forward_recursive=%d", forward_recursive);
+  Log(LOG_DEBUG, "forward_recursive=%d", forward_recursive);
   if (!forward_recursive) {
-    Warnx("DEBUG: conf_set_recursive() returning early (forward_recursive=0)");
+    Log(LOG_DEBUG, "conf_set_recursive() returning early (forward_recursive=0)");
     return;
   }
 
-  Warnx("DEBUG: about to get recursive config values");
+  Log(LOG_DEBUG, "about to get recursive config values");
   const char *timeout_val = conf_get(&Conf, "recursive-timeout", NULL);
   const char *connect_timeout_val = conf_get(&Conf, "recursive-connect-timeout", NULL);
   const char *retries_val = conf_get(&Conf, "recursive-retries", NULL);
@@ -613,8 +669,8 @@ conf_set_recursive(void) {
   }
   /* else keep the default "linear" value set at initialization */
 
-  Warnx("DEBUG: conf_set_recursive() returning normally (timeout=%u, connect_timeout=%u, retries=%u)",
-        recursion_timeout, recursion_connect_timeout, recursion_retries);
+  Log(LOG_DEBUG, "conf_set_recursive() returning normally (timeout=%u, connect_timeout=%u, retries=%u)",
+      recursion_timeout, recursion_connect_timeout, recursion_retries);
 
   /* Recursive ACL configuration note (CWE-284 mitigation) */
   const char *acl_val = conf_get(&Conf, "recursive-acl", NULL);
@@ -638,12 +694,12 @@ load_config(void) {
   struct passwd *pwd = NULL;
   struct group	*grp = NULL;
 
-  Warnx(_("DEBUG: load_config() ENTRY"));
+  Log(LOG_DEBUG, _("load_config() ENTRY"));
 
   /* Load config */
-  Warnx(_("DEBUG: load_config() about to call conf_load()"));
+  Log(LOG_DEBUG, _("load_config() about to call conf_load()"));
   conf_load(&Conf, opt_conf);
-  Warnx(_("DEBUG: load_config() after conf_load()"));
+  Log(LOG_DEBUG, _("load_config() after conf_load()"));
 
 
   /* Set defaults */
@@ -677,14 +733,14 @@ load_config(void) {
 #endif
 
   /* Load user/group perms */
-  Warnx(_("DEBUG: load_config() about to getpwnam()"));
+  Log(LOG_DEBUG, _("load_config() about to getpwnam()"));
   if (!(pwd = getpwnam(conf_get(&Conf, "user", NULL))))
     Err(_("error loading uid for user `%s'"), conf_get(&Conf, "user", NULL));
   perms_uid = pwd->pw_uid;
   perms_gid = pwd->pw_gid;
   memset(pwd, 0, sizeof(struct passwd));
 
-  Warnx(_("DEBUG: load_config() about to getgrnam()"));
+  Log(LOG_DEBUG, _("load_config() about to getgrnam()"));
   if (!(grp = getgrnam(conf_get(&Conf, "group", NULL))) && !(grp = getgrnam("nobody"))) {
     Warnx(_("error loading gid for group `%s'"), conf_get(&Conf, "group", NULL));
     Warnx(_("using gid %lu from user `%s'"), (unsigned long)perms_gid, conf_get(&Conf, "user", NULL));
@@ -693,11 +749,11 @@ load_config(void) {
     memset(grp, 0, sizeof(struct group));
   }
 
-  Warnx(_("DEBUG: load_config() about to conf_set_logging()"));
+  Log(LOG_DEBUG, _("load_config() about to conf_set_logging()"));
   /* We call conf_set_logging() again after moving into background, but it's called here
      to report on errors. */
   conf_set_logging();
-  Warnx(_("DEBUG: load_config() after conf_set_logging()"));
+  Log(LOG_DEBUG, _("load_config() after conf_set_logging()"));
 
 
   /* Set global options */
@@ -711,6 +767,9 @@ load_config(void) {
 
   dns_update_enabled = GETBOOL(conf_get(&Conf, "allow-update", NULL));
   Verbose(_("DNS UPDATE is %senabled"), (dns_update_enabled)?"":_("not "));
+  update_group_max = atou(conf_get(&Conf, "update-group-max", NULL));
+  if (update_group_max < 1)
+    update_group_max = 1;
 
   use_new_update_acl = GETBOOL(conf_get(&Conf, "use-new-update-acl", NULL));
   if (use_new_update_acl)
@@ -724,6 +783,16 @@ load_config(void) {
   if (tsig_enforce_axfr)
     Verbose(_("TSIG enforcement enabled for AXFR"));
 
+  axfr_tsig_interval = atou(conf_get(&Conf, "axfr-tsig-interval", NULL));
+  if (axfr_tsig_interval < 1)
+    axfr_tsig_interval = 1;
+  else if (axfr_tsig_interval > 100)				/* RFC 8945: at least every 100th */
+    axfr_tsig_interval = 100;
+  axfr_max_transfers = atou(conf_get(&Conf, "axfr-max-transfers", NULL));
+  if (axfr_max_transfers < 1)
+    axfr_max_transfers = 1;
+  axfr_cache_size = atou(conf_get(&Conf, "axfr-cache-size", NULL));
+
   tsig_enforce_ixfr = GETBOOL(conf_get(&Conf, "tsig-enforce-ixfr", NULL));
   if (tsig_enforce_ixfr)
     Verbose(_("TSIG enforcement enabled for IXFR"));
@@ -741,6 +810,23 @@ load_config(void) {
   if (audit_update_log || audit_tsig_log)
     Verbose(_("Audit logging enabled"));
 
+  query_log_format = conf_get(&Conf, "query-log-format", NULL);
+  query_log_output = conf_get(&Conf, "query-log-output", NULL);
+  query_log_buffer = atou(conf_get(&Conf, "query-log-buffer", NULL));
+
+  heavy_hitters = atou(conf_get(&Conf, "heavy-hitters", NULL));
+  heavy_hitters_decay = atou(conf_get(&Conf, "heavy-hitters-decay", NULL));
+  heavy_hitters_allow = conf_get(&Conf, "heavy-hitters-allow", NULL);
+
+  metrics_listen = conf_get(&Conf, "metrics-listen", NULL);
+  latency_sample = atou(conf_get(&Conf, "latency-sample", NULL));
+  control_socket = conf_get(&Conf, "control-socket", NULL);
+  audit_queue = atou(conf_get(&Conf, "audit-queue", NULL));
+  audit_flush_interval = atou(conf_get(&Conf, "audit-flush-interval", NULL));
+  if (!audit_flush_interval)
+    audit_flush_interval = 1;
+  audit_overflow = conf_get(&Conf, "audit-overflow", NULL);
+
   mydns_soa_use_active = GETBOOL(conf_get(&Conf, "use-soa-active", NULL));
   mydns_rr_use_active = GETBOOL(conf_get(&Conf, "use-rr-active", NULL));
 
@@ -749,6 +835,8 @@ load_config(void) {
   notify_timeout = atou(conf_get(&Conf, "notify-timeout", NULL));
   notify_retries = atou(conf_get(&Conf, "notify-retries", NULL));
   notify_algorithm = conf_get(&Conf, "notify-algorithm", NULL);
+  notify_interval = atou(conf_get(&Conf, "notify-interval", NULL));
+  notify_cache_ttl = atou(conf_get(&Conf, "notify-cache-ttl", NULL));
 
   dns_ixfr_enabled = GETBOOL(conf_get(&Conf, "ixfr-enabled", NULL));
   Verbose(_("DNS IXFR is %senabled"), (dns_ixfr_enabled)?"":_("not "));
@@ -756,6 +844,13 @@ load_config(void) {
   ixfr_gc_interval = atou(conf_get(&Conf, "ixfr-gc-interval", NULL));
   ixfr_gc_delay = atou(conf_get(&Conf, "ixfr-gc-delay", NULL));
 
+  ixfr_journal_enabled = dns_ixfr_enabled && GETBOOL(conf_get(&Conf, "ixfr-journal", NULL));
+  ixfr_journal_size = atou(conf_get(&Conf, "ixfr-journal-size", NULL));
+  ixfr_journal_interval = atou(conf_get(&Conf, "ixfr-journal-interval", NULL));
+  if (ixfr_journal_interval < 1)
+    ixfr_journal_interval = 1;
+  ixfr_journal_dir = conf_get(&Conf, "ixfr-journal-dir", NULL);
+
   dnssec_enabled = GETBOOL(conf_get(&Conf, "dnssec-enabled", NULL));
   Verbose(_("DNSSEC signing is %senabled"), (dnssec_enabled)?"":_("not "));
   dnssec_auto_sign = GETBOOL(conf_get(&Conf, "dnssec-auto-sign", NULL));
@@ -769,17 +864,20 @@ load_config(void) {
 
   ignore_minimum = GETBOOL(conf_get(&Conf, "ignore-minimum", NULL));
 
+  minimal_responses = GETBOOL(conf_get(&Conf, "minimal-responses", NULL));
+  Verbose(_("Minimal responses are %senabled"), (minimal_responses)?"":_("not "));
+
   /* Set table names if provided */
-  Warnx(_("DEBUG: load_config() about to set table names"));
+  Log(LOG_DEBUG, _("load_config() about to set table names"));
   mydns_set_soa_table_name(conf_get(&Conf, "soa-table", NULL));
   mydns_set_rr_table_name(conf_get(&Conf, "rr-table", NULL));
   mydns_set_cf_soa_table_name(conf_get(&Conf, "cloudflare-soa-table", NULL));
   mydns_set_cf_rr_table_name(conf_get(&Conf, "cloudflare-rr-table", NULL));
   mydns_set_cf_default_ns(conf_get(&Conf, "cloudflare-default-ns", NULL));
   mydns_set_cf_default_mbox(conf_get(&Conf, "cloudflare-default-mbox", NULL));
-  Warnx(_("DEBUG: load_config() about to mydns_update_cloudflare_state()"));
+  Log(LOG_DEBUG, _("load_config() about to mydns_update_cloudflare_state()"));
   mydns_update_cloudflare_state();
-  Warnx(_("DEBUG: load_config() after mydns_update_cloudflare_state()"));
+  Log(LOG_DEBUG, _("load_config() after mydns_update_cloudflare_state()"));
 
 
   /* Set additional where clauses if provided */
@@ -787,13 +885,13 @@ load_config(void) {
   mydns_set_rr_where_clause(conf_get(&Conf, "rr-where", NULL));
 
   /* Set recursive server if specified */
-  Warnx(_("DEBUG: load_config() about to conf_set_recursive()"));
+  Log(LOG_DEBUG, _("load_config() about to conf_set_recursive()"));
   conf_set_recursive();
 
 #ifdef DN_COLUMN_NAMES
   dn_default_ns = conf_get(&Conf, "default-ns", NULL);
 #endif
-  Warnx(_("DEBUG: load_config() EXIT"));
+  Log(LOG_DEBUG, _("load_config() EXIT"));
 }
 /*--- load_config() -----------------------------------------------------------------------------*/
 
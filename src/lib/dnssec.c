@@ -729,24 +729,14 @@ int dnssec_db_queue_signing(SQL *db, uint32_t zone_id, const char *rrset_name,
  */
 int dnssec_db_log_operation(SQL *db, uint32_t zone_id, const char *operation,
                             int success, const char *details) {
-    char query[2048];
-    char escaped_details[1024] = "";
-    SQL_RES *res;
+    char *escaped_details = NULL;
 
-    if (details) {
-        /* TODO: Proper SQL escaping */
-        strncpy(escaped_details, details, sizeof(escaped_details) - 1);
-    }
-
-    snprintf(query, sizeof(query),
-             "INSERT INTO dnssec_log (zone_id, operation, success, details) "
-             "VALUES (%u, '%s', %d, '%s')",
-             zone_id, operation, success, escaped_details);
+    if (!db) return -1;
 
-    res = sql_query(db, query, NULL);
-    if (!res) return -1;
-
-    sql_free(res);
+    escaped_details = sql_escstr(db, (char *)(details ? details : ""));
+    auditlog_add(db, AUDIT_DNSSEC, "%u, '%s', %d, '%s'",
+                 zone_id, operation, success, escaped_details);
+    RELEASE(escaped_details);
     return 0;
 }
 
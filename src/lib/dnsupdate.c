@@ -844,14 +844,10 @@ void dnsupdate_free_response(update_response_t *response) {
 void dnsupdate_log(SQL *db, update_request_t *request, update_response_t *response) {
     if (!db || !request || !response) return;
 
-    char query[2048];
-    snprintf(query, sizeof(query),
-        "INSERT INTO dnsmanager_logs (action, details, ip_address, created_at) "
-        "VALUES ('DNS_UPDATE', 'Zone: %s, Records: %d, Result: %s', '%s', NOW())",
+    auditlog_add(db, AUDIT_DNSMANAGER,
+        "'DNS_UPDATE', 'Zone: %s, Records: %d, Result: %s', '%s'",
         request->zone_name ? request->zone_name : "unknown",
         request->update_count,
         response->rcode == UPDATE_NOERROR ? "SUCCESS" : "FAILED",
         request->source_ip ? request->source_ip : "unknown");
-
-    sql_query(db, query, strlen(query));
 }
@@ -95,7 +95,7 @@ int geoip_get_sensor_for_country(GEOIP_CTX *ctx, const char *country_code) {
         country_code);
 
     if (!(res = sql_query(ctx->db, query, strlen(query)))) {
-        Warnx(_("geoip_get_sensor_for_country: query failed: %s"), query);
+        LogLimit(LOG_WARNING, _("geoip_get_sensor_for_country: query failed: %s"), query);
         return -1;
     }
 
@@ -127,14 +127,14 @@ int geoip_get_default_sensor(GEOIP_CTX *ctx) {
         "SELECT id FROM geo_sensors WHERE is_default=1 AND is_active=1 LIMIT 1");
 
     if (!(res = sql_query(ctx->db, query, strlen(query)))) {
-        Warnx(_("geoip_get_default_sensor: query failed"));
+        LogLimit(LOG_WARNING, _("geoip_get_default_sensor: query failed"));
         return -1;
     }
 
     if ((row = sql_getrow(res, NULL))) {
         sensor_id = atoi(row[0]);
     } else {
-        Warnx(_("No default sensor configured"));
+        LogLimit(LOG_WARNING, _("No default sensor configured"));
     }
 
     sql_free(res);
@@ -159,7 +159,7 @@ int geoip_zone_enabled(GEOIP_CTX *ctx, int zone_id) {
         "SELECT use_geoip FROM soa WHERE id=%d LIMIT 1", zone_id);
 
     if (!(res = sql_query(ctx->db, query, strlen(query)))) {
-        Warnx(_("geoip_zone_enabled: query failed"));
+        LogLimit(LOG_WARNING, _("geoip_zone_enabled: query failed"));
         return -1;
     }
 
@@ -190,7 +190,7 @@ char* geoip_get_rr_data(GEOIP_CTX *ctx, int rr_id, int sensor_id) {
         rr_id, sensor_id);
 
     if (!(res = sql_query(ctx->db, query, strlen(query)))) {
-        Warnx(_("geoip_get_rr_data: query failed"));
+        LogLimit(LOG_WARNING, _("geoip_get_rr_data: query failed"));
         return NULL;
     }
 
@@ -284,7 +284,7 @@ ACCESS_ACTION geoip_check_access(GEOIP_CTX *ctx, const char *ip, int zone_id,
         access_type == ACCESS_DNS ? "dns" : "webui");
 
     if (!(res = sql_query(ctx->db, query, strlen(query)))) {
-        Warnx(_("geoip_check_access: query failed"));
+        LogLimit(LOG_WARNING, _("geoip_check_access: query failed"));
         return ACCESS_ERROR;
     }
 
@@ -378,12 +378,10 @@ ACCESS_ACTION geoip_check_access(GEOIP_CTX *ctx, const char *ip, int zone_id,
 int geoip_log_access(GEOIP_CTX *ctx, const char *ip, const char *country_code,
                      int zone_id, const char *query_name, ACCESS_TYPE access_type,
                      ACCESS_ACTION action, const char *rule_matched) {
-    char query[2048];
     char *escaped_ip;
     char *escaped_country;
     char *escaped_query;
     char *escaped_rule;
-    SQL_RES *res;
 
     if (!ctx || !ctx->db || !ip) {
         return -1;
@@ -395,11 +393,8 @@ int geoip_log_access(GEOIP_CTX *ctx, const char *ip, const char *country_code,
     escaped_query = sql_escstr(ctx->db, (char*)(query_name ? query_name : ""));
     escaped_rule = sql_escstr(ctx->db, (char*)(rule_matched ? rule_matched : ""));
 
-    /* Insert log entry */
-    snprintf(query, sizeof(query),
-        "INSERT INTO access_control_log "
-        "(source_ip, country_code, access_type, zone_id, query_name, action, rule_matched) "
-        "VALUES ('%s', '%s', '%s', %d, '%s', '%s', '%s')",
+    /* Queue log entry */
+    auditlog_add(ctx->db, AUDIT_ACCESS_CONTROL, "'%s', '%s', '%s', %d, '%s', '%s', '%s'",
         escaped_ip,
         escaped_country,
         access_type == ACCESS_DNS ? "dns" : "webui",
@@ -414,12 +409,6 @@ int geoip_log_access(GEOIP_CTX *ctx, const char *ip, const char *country_code,
     RELEASE(escaped_query);
     RELEASE(escaped_rule);
 
-    /* Execute INSERT - no result expected */
-    res = sql_query(ctx->db, query, strlen(query));
-    if (res) {
-        sql_free(res);
-    }
-
     return 0;
 }
 
@@ -445,7 +434,7 @@ int geoip_get_sensor_info(GEOIP_CTX *ctx, int sensor_id, char *location_name,
         sensor_id);
 
     if (!(res = sql_query(ctx->db, query, strlen(query)))) {
-        Warnx(_("geoip_get_sensor_info: query failed"));
+        LogLimit(LOG_WARNING, _("geoip_get_sensor_info: query failed"));
         return -1;
     }
 
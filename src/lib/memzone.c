@@ -114,6 +114,7 @@ memzone_ctx_t *memzone_init(int create) {
         ctx->rr_pool = (mem_rr_t *)((char *)shm_base + offset);
         offset += sizeof(mem_rr_t) * MEMZONE_MAX_RECORDS;
         ctx->rr_pool_used = 0;
+        ctx->rr_free = NULL;
 
         /* ACL pool */
         ctx->acl_pool = (mem_acl_t *)((char *)shm_base + offset);
@@ -309,6 +310,69 @@ zone_entry_t *memzone_find_zone_by_name(memzone_ctx_t *ctx, const char *origin)
     return NULL;
 }
 
+/**
+ * Take a free RR, from the free list or the pool; caller holds the write lock
+ */
+static mem_rr_t *memzone_alloc_rr(memzone_ctx_t *ctx) {
+    mem_rr_t *rr = ctx->rr_free;
+
+    if (rr) {
+        ctx->rr_free = rr->next;
+        return rr;
+    }
+    if (ctx->rr_pool_used >= MEMZONE_MAX_RECORDS) {
+        Warnx(_("RR pool exhausted"));
+        return NULL;
+    }
+    return &ctx->rr_pool[ctx->rr_pool_used++];
+}
+
+/**
+ * Link a record into a zone; caller holds the write lock
+ */
+static int memzone_link_rr(memzone_ctx_t *ctx, zone_entry_t *zone, uint32_t zone_id, const mem_rr_t *rr) {
+    mem_rr_t *new_rr = memzone_alloc_rr(ctx);
+    if (!new_rr) {
+        return -1;
+    }
+
+    memcpy(new_rr, rr, sizeof(mem_rr_t));
+    new_rr->zone_id = zone_id;
+
+    /* Add to zone's hash table */
+    uint32_t hash = memzone_hash_name(rr->name);
+    new_rr->next = zone->rr_hash[hash];
+    zone->rr_hash[hash] = new_rr;
+
+    zone->record_count++;
+    ctx->record_count++;
+    return 0;
+}
+
+/**
+ * Unlink a record matching name, type, data and aux from a zone; caller holds the write lock
+ * Returns 0 if a record was removed, -1 if none matched
+ */
+static int memzone_unlink_rr(memzone_ctx_t *ctx, zone_entry_t *zone, const mem_rr_t *rr) {
+    uint32_t hash = memzone_hash_name(rr->name);
+    mem_rr_t **prev = &zone->rr_hash[hash];
+
+    while (*prev) {
+        mem_rr_t *cur = *prev;
+        if (cur->type == rr->type && strcasecmp(cur->name, rr->name) == 0
+            && strcmp(cur->data, rr->data) == 0 && cur->aux == rr->aux) {
+            *prev = cur->next;
+            cur->next = ctx->rr_free;
+            ctx->rr_free = cur;
+            zone->record_count--;
+            ctx->record_count--;
+            return 0;
+        }
+        prev = &cur->next;
+    }
+    return -1;
+}
+
 /**
  * Add a resource record to a zone
  */
@@ -325,27 +389,76 @@ int memzone_add_rr(memzone_ctx_t *ctx, uint32_t zone_id, const mem_rr_t *rr) {
         return -1;
     }
 
-    /* Allocate new RR from pool */
-    if (ctx->rr_pool_used >= MEMZONE_MAX_RECORDS) {
-        Warnx(_("RR pool exhausted"));
+    int ret = memzone_link_rr(ctx, zone, zone_id, rr);
+
+    memzone_write_unlock(ctx);
+    return ret;
+}
+
+/**
+ * Apply incremental changes to a zone under a single write lock
+ * If a record can't be added, the changes made so far are undone in reverse
+ * order and the zone keeps its old serial.  Undoing never needs a new RR:
+ * each record relinked was freed by its own deletion, after later additions
+ * have been unlinked again.
+ */
+int memzone_apply_changes(memzone_ctx_t *ctx, uint32_t zone_id,
+                          const mem_rr_change_t *changes, int count, uint32_t serial) {
+    char *done = NULL;
+    int applied = 0, i;
+
+    if (!ctx || (count > 0 && !changes)) return -1;
+
+    /* Which changes took effect, for undoing them */
+    if (count > 0 && !(done = (char *)calloc(count, sizeof(char)))) {
+        return -1;
+    }
+
+    memzone_write_lock(ctx);
+
+    zone_entry_t *zone = memzone_find_zone(ctx, zone_id);
+    if (!zone) {
         memzone_write_unlock(ctx);
+        free(done);
         return -1;
     }
 
-    mem_rr_t *new_rr = &ctx->rr_pool[ctx->rr_pool_used++];
-    memcpy(new_rr, rr, sizeof(mem_rr_t));
-    new_rr->zone_id = zone_id;
+    for (i = 0; i < count; i++) {
+        if (changes[i].add) {
+            if (memzone_link_rr(ctx, zone, zone_id, &changes[i].rr) < 0) {
+                break;
+            }
+        } else if (memzone_unlink_rr(ctx, zone, &changes[i].rr) < 0) {
+            continue;
+        }
+        done[i] = 1;
+        applied++;
+    }
 
-    /* Add to zone's hash table */
-    uint32_t hash = memzone_hash_name(rr->name);
-    new_rr->next = zone->rr_hash[hash];
-    zone->rr_hash[hash] = new_rr;
+    if (i < count) {
+        while (--i >= 0) {
+            if (!done[i]) {
+                continue;
+            }
+            if (changes[i].add) {
+                memzone_unlink_rr(ctx, zone, &changes[i].rr);
+            } else {
+                memzone_link_rr(ctx, zone, zone_id, &changes[i].rr);
+            }
+        }
+        Warnx(_("Zone %u: could not apply %d changes; left at serial %u"),
+              zone_id, count, zone->soa->serial);
+        memzone_write_unlock(ctx);
+        free(done);
+        return -1;
+    }
+    free(done);
 
-    zone->record_count++;
-    ctx->record_count++;
+    zone->soa->serial = serial;
+    zone->soa->updated = time(NULL);
 
     memzone_write_unlock(ctx);
-    return 0;
+    return applied;
 }
 
 /**
@@ -362,7 +475,9 @@ int memzone_delete_all_rr(memzone_ctx_t *ctx, uint32_t zone_id) {
         mem_rr_t *rr = zone->rr_hash[i];
         while (rr) {
             mem_rr_t *next = rr->next;
-            /* Mark as free in pool (simple approach: just break the chain) */
+            /* Return to the free list for reuse */
+            rr->next = ctx->rr_free;
+            ctx->rr_free = rr;
             rr = next;
         }
         zone->rr_hash[i] = NULL;
@@ -418,6 +533,37 @@ int memzone_query(memzone_ctx_t *ctx, uint32_t zone_id, const char *name,
     return count;
 }
 
+/**
+ * Walk every record of a zone under one read lock
+ */
+int memzone_walk_zone(memzone_ctx_t *ctx, const char *origin, mem_soa_t *soa,
+                      int (*fn)(const mem_rr_t *rr, void *arg), void *arg) {
+    if (!ctx || !origin || !soa || !fn) return -1;
+
+    memzone_read_lock(ctx);
+
+    zone_entry_t *zone = memzone_find_zone_by_name(ctx, origin);
+    if (!zone || !zone->soa) {
+        memzone_read_unlock(ctx);
+        return -1;
+    }
+    memcpy(soa, zone->soa, sizeof(mem_soa_t));
+
+    int count = 0;
+    for (int i = 0; i < MEMZONE_HASH_SIZE; i++) {
+        for (mem_rr_t *rr = zone->rr_hash[i]; rr; rr = rr->next) {
+            if (fn(rr, arg) != 0) {
+                memzone_read_unlock(ctx);
+                return -1;
+            }
+            count++;
+        }
+    }
+
+    memzone_read_unlock(ctx);
+    return count;
+}
+
 /**
  * Get SOA record for a zone
  */
@@ -60,6 +60,12 @@ typedef struct mem_rr {
     struct mem_rr *next;               /* Hash table chaining */
 } mem_rr_t;
 
+/* One change in an incremental zone update */
+typedef struct mem_rr_change {
+    int add;                           /* 1 = add rr, 0 = delete rr */
+    mem_rr_t rr;                       /* Record to add or delete */
+} mem_rr_change_t;
+
 /* Access control rule types */
 typedef enum {
     ACL_TYPE_IP = 1,                   /* Single IP address */
@@ -118,6 +124,7 @@ typedef struct memzone_ctx {
     uint32_t soa_pool_used;            /* Number of SOAs allocated */
     uint32_t rr_pool_used;             /* Number of RRs allocated */
     uint32_t acl_pool_used;            /* Number of ACLs allocated */
+    mem_rr_t *rr_free;                 /* Deleted RRs, reused before the pool */
 
     /* Access control lists */
     mem_acl_t *acl_head;               /* Head of ACL linked list */
@@ -204,6 +211,23 @@ int memzone_add_rr(memzone_ctx_t *ctx, uint32_t zone_id, const mem_rr_t *rr);
  */
 int memzone_delete_all_rr(memzone_ctx_t *ctx, uint32_t zone_id);
 
+/**
+ * Apply incremental changes to a zone
+ * All changes, in order, and the new serial are made under one write lock,
+ * so readers see either the old or the new zone and are blocked only while
+ * the changes are linked in.  If the RR pool runs out part way, the changes
+ * are undone and the serial is left alone.
+ *
+ * @param ctx Memory zone context
+ * @param zone_id Zone ID
+ * @param changes Records to delete or add
+ * @param count Number of changes
+ * @param serial New SOA serial
+ * @return Number of changes applied, -1 on error (zone unchanged)
+ */
+int memzone_apply_changes(memzone_ctx_t *ctx, uint32_t zone_id,
+                          const mem_rr_change_t *changes, int count, uint32_t serial);
+
 /**
  * Query resource records for a name
  *
@@ -218,6 +242,21 @@ int memzone_delete_all_rr(memzone_ctx_t *ctx, uint32_t zone_id);
 int memzone_query(memzone_ctx_t *ctx, uint32_t zone_id, const char *name,
                   dns_qtype_t type, mem_rr_t **results, int max_results);
 
+/**
+ * Walk every record of a zone under one read lock
+ * The SOA and the records passed to fn are a consistent snapshot: no update
+ * can change the zone until the walk returns, so fn should copy and move on.
+ *
+ * @param ctx Memory zone context
+ * @param origin Zone name (e.g., "example.com.")
+ * @param soa Output: copy of the zone's SOA
+ * @param fn Called for each record; a nonzero return stops the walk
+ * @param arg Passed to fn
+ * @return Number of records walked, -1 if the zone is not in memory or fn stopped the walk
+ */
+int memzone_walk_zone(memzone_ctx_t *ctx, const char *origin, mem_soa_t *soa,
+                      int (*fn)(const mem_rr_t *rr, void *arg), void *arg);
+
 /**
  * Get SOA record for a zone
  *
@@ -26,6 +26,7 @@
 #include "mydnsutil.h"
 #include "bits.h"
 #include "header.h"
+#include "probes.h"
 
 /* Table names */
 #define	MYDNS_SOA_TABLE	"soa"
@@ -41,24 +42,47 @@ extern time_t		task_timeout;			/* Task timeout */
 extern int		axfr_enabled;			/* Allow AXFR? */
 extern int		tcp_enabled;			/* Enable TCP? */
 extern int		dns_update_enabled;		/* Enable DNS UPDATE? */
+extern int		update_group_max;		/* UPDATE messages committed together */
 extern int		use_new_update_acl;		/* Use new update_acl table */
 extern int		tsig_required_for_update;	/* Require TSIG for UPDATE */
 extern int		tsig_enforce_axfr;		/* Require TSIG for AXFR */
+extern int		axfr_tsig_interval;		/* Sign every Nth AXFR message with TSIG */
+extern int		axfr_max_transfers;		/* Outbound AXFRs running at once */
+extern int		axfr_cache_size;		/* Megabytes of rendered AXFRs to keep */
 extern int		tsig_enforce_ixfr;		/* Require TSIG for IXFR */
 extern int		tsig_enforce_update;		/* Require TSIG for DNS UPDATE */
 extern int		tsig_enforce_notify;		/* Require TSIG for NOTIFY */
 extern int		audit_update_log;		/* Log updates to update_log */
 extern int		audit_tsig_log;			/* Log TSIG to tsig_usage_log */
+extern const char	*query_log_format;		/* Query log format (text or dnstap) */
+extern const char	*query_log_output;		/* Where query log records go */
+extern int		query_log_buffer;		/* KB of query log buffer per server */
+extern int		heavy_hitters;			/* Top entries tracked per heavy hitter table */
+extern uint32_t		heavy_hitters_decay;		/* Seconds between halving heavy hitter counts */
+extern const char	*heavy_hitters_allow;		/* Who may query top.*.mydns. */
+extern const char	*metrics_listen;		/* Address the master serves OpenMetrics on */
+extern int		latency_sample;			/* Time one query in this many (0 to disable) */
+extern const char	*control_socket;		/* UNIX socket the master takes commands on */
+extern int		audit_queue;			/* Audit log rows queued per process (0 for none) */
+extern uint32_t		audit_flush_interval;		/* Seconds between audit log INSERTs */
+extern const char	*audit_overflow;		/* "drop", or a file for rows the queue can't hold */
 extern int		dns_notify_enabled;		/* Enable DNS NOTIFY? */
 extern int		notify_timeout;
 extern int		notify_retries;
 extern const char	*notify_algorithm;
+extern uint32_t		notify_interval;		/* Minimum seconds between NOTIFYs for a zone */
+extern uint32_t		notify_cache_ttl;		/* Seconds to cache slave addresses */
 
 extern int		dns_ixfr_enabled;		/* Enable IXFR functionality */
 extern int		ixfr_gc_enabled;		/* Enable IXFR GC Processing */
 extern uint32_t		ixfr_gc_interval;		/* Run the IXFR GC this often */
 extern uint32_t		ixfr_gc_delay;			/* Delay before running first IXFR GC */
+extern int		ixfr_journal_enabled;		/* Serve IXFR from an in-memory journal */
+extern uint32_t		ixfr_journal_size;		/* Changes kept per zone */
+extern uint32_t		ixfr_journal_interval;		/* How often to check zone serials */
+extern const char	*ixfr_journal_dir;		/* Where journals are saved */
 extern int		ignore_minimum;			/* Ignore minimum TTL? */
+extern int		minimal_responses;		/* Only send required ADDITIONAL data? */
 extern char		hostname[256];			/* This machine's hostname */
 
 extern int		dnssec_enabled;			/* Enable DNSSEC signing */
@@ -503,7 +527,7 @@ typedef struct _mydns_rr {				/* `rr' table data (resource records) */
   int			alias;
 #endif
 
-  char			*active;
+  uint32_t		flags;		/* MYDNS_RR_* flags below */
 #if USE_PGSQL
   timestamp		*stamp;
 #else
@@ -519,6 +543,12 @@ typedef struct _mydns_rr {				/* `rr' table data (resource records) */
 
 } MYDNS_RR;
 
+/* MYDNS_RR flags */
+#define MYDNS_RR_ACTIVE		0x0001		/* `active' column is the "yes" value (or absent) */
+#define MYDNS_RR_DELETED	0x0002		/* `active' column is the "deleted" value */
+#define MYDNS_RR_NAME_PACKED	0x0100		/* _name lives in the MYDNS_RR allocation */
+#define MYDNS_RR_DATA_PACKED	0x0200		/* _data.value lives in the MYDNS_RR allocation */
+
 #if DEBUG_ENABLED
 extern void *__mydns_rr_assert_pointer(void *, const char *, const char *, int);
 #define MYDNS_RR_NAME(__rrp)		  ((char*)__mydns_rr_assert_pointer((__rrp)->_name, \
@@ -544,6 +574,7 @@ typedef struct _sql_res {
 	int		current_tuple;
 	SQL_ROW		current_row;
   	unsigned long	*current_length;
+	PGconn		*conn;			/* Set while rows are still being streamed */
 } SQL_RES;
 #else
 typedef MYSQL SQL;
@@ -552,6 +583,22 @@ typedef MYSQL_ROW SQL_ROW;
 #endif
 
 
+/* auditlog.c */
+typedef enum _audit_table_t {				/* Tables auditlog_add() writes to */
+  AUDIT_ACCESS_CONTROL = 0,				/* access_control_log */
+  AUDIT_DNSMANAGER,					/* dnsmanager_logs */
+  AUDIT_UPDATE,						/* update_log */
+  AUDIT_ZONE_TRANSFER,					/* zone_transfer_log */
+  AUDIT_TSIG_USAGE,					/* tsig_usage_log */
+  AUDIT_DNSSEC,						/* dnssec_log */
+  AUDIT_TABLES
+} audit_table_t;
+
+extern void		auditlog_add(SQL *, audit_table_t, const char *, ...) __printflike(3,4);
+extern void		auditlog_close(void);
+extern void		auditlog_status(void);
+
+
 
 /* ip.c */
 extern uint32_t		mydns_revstr_ip4(const uchar *);
@@ -559,11 +606,23 @@ extern int		mydns_extract_arpa(const uchar *, uint8_t ip[]);
 
 
 /* rr.c */
+typedef struct _mydns_rr_stream {			/* Zone records read one row at a time */
+  SQL			*sqlConn;
+  SQL_RES		*res;			/* Rows still on the server, or NULL */
+  MYDNS_RR		*extra;			/* Records loaded once `res' is exhausted */
+  uint32_t		zone;
+  char			*origin;
+  int			pagesize;		/* Rows per query, or 0 for one unbuffered query */
+  int			rows;			/* Rows read from `res' so far */
+  uint32_t		last_id;		/* Highest id read; the next page starts after it */
+  int			error;			/* A page could not be read */
+} MYDNS_RR_STREAM;
+
 extern long		mydns_rr_count(SQL *);
 extern void		mydns_rr_get_active_types(SQL *);
 extern void		mydns_set_rr_table_name(const char *);
 extern void		mydns_set_rr_where_clause(const char *);
-extern dns_qtype_t	mydns_rr_get_type(char *);
+extern dns_qtype_t	mydns_rr_get_type(const char *);
 extern char *		mydns_rr_append_origin(char *, char *);
 extern void		mydns_rr_name_append_origin(MYDNS_RR *, char *);
 extern void		mydns_rr_data_append_origin(MYDNS_RR *, char *);
@@ -585,6 +644,9 @@ extern int		mydns_rr_load_all(SQL *, MYDNS_RR **, uint32_t, dns_qtype_t, const c
 extern int		mydns_rr_load_active(SQL *, MYDNS_RR **, uint32_t, dns_qtype_t, const char *, const char *);
 extern int		mydns_rr_load_inactive(SQL *, MYDNS_RR **, uint32_t, dns_qtype_t, const char *, const char *);
 extern int		mydns_rr_load_deleted(SQL *, MYDNS_RR **, uint32_t, dns_qtype_t, const char *, const char *);
+extern MYDNS_RR_STREAM	*mydns_rr_stream_active(SQL *, uint32_t, const char *, int);
+extern MYDNS_RR		*mydns_rr_stream_next(MYDNS_RR_STREAM *);
+extern void		mydns_rr_stream_close(MYDNS_RR_STREAM *);
 extern int		mydns_rr_count_all(SQL *, uint32_t, dns_qtype_t, const char *, const char *);
 extern int		mydns_rr_count_active(SQL *, uint32_t, dns_qtype_t, const char *, const char *);
 extern int		mydns_rr_count_inactive(SQL *, uint32_t, dns_qtype_t, const char *, const char *);
@@ -620,6 +682,7 @@ extern void		_mydns_soa_free(MYDNS_SOA *);
 extern SQL		*sql;
 extern void		sql_open(const char *user, const char *password, const char *host, const char *database);
 extern void		sql_reopen(void);
+extern SQL		*sql_connect(const char *host);
 extern void		_sql_close(SQL *);
 #define			sql_close(p) if ((p)) _sql_close((p)), (p) = NULL
 /* Allow up to four SQL hosts to be configured */
@@ -629,6 +692,7 @@ extern const char	*sql_active_host(void);
 extern int		sql_nrquery(SQL *, const char *query, size_t querylen);
 extern SQL_RES		*sql_query(SQL *, const char *query, size_t querylen);
 extern SQL_RES		*sql_queryf(SQL *, const char *, ...) __printflike(2,3);
+extern SQL_RES		*sql_uquery(SQL *, const char *query, size_t querylen);
 extern long		sql_count(SQL *, const char *, ...) __printflike(2,3);
 extern SQL_ROW		sql_getrow(SQL_RES *res, unsigned long **lengths);
 extern char		*sql_escstr2(SQL *, char *, size_t);
@@ -0,0 +1,64 @@
+/**************************************************************************************************
+	probes.h: USDT static probes.
+
+	Copyright (C) 2002-2005  Don Moore <bboy@bboy.net>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at Your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+**************************************************************************************************/
+
+#ifndef _MYDNS_PROBES_H
+#define _MYDNS_PROBES_H
+
+/*
+**  Probes are in provider `mydns' and are listed with, for example,
+**  `bpftrace -l "usdt:/usr/local/sbin/mydns:*"'.  Each compiles to a single nop until a
+**  tracer attaches, so arguments should be values already at hand, never computed for the
+**  probe.  See contrib/bpftrace for scripts that use them.
+**
+**  Probe			Arguments
+**  query_received		task id, qname, qtype, qclass, protocol, opcode
+**  reply_sent			task id, qname, qtype, rcode, reply length, protocol
+**  task_timeout		task id, qname, status, protocol
+**  cache_hit, cache_miss	cache name, task id, name, qtype
+**  sql_query_start		statement, statement length
+**  sql_query_done		statement, 1 if it succeeded
+**  axfr_start, ixfr_start	task id, zone origin
+**  axfr_done, ixfr_done	task id, zone origin, records sent
+**  notify_sent		zone id, slave address, retry
+**  notify_acked		zone id, slave address
+**  recursive_sent		task id, qname, qtype, protocol
+**  recursive_received	task id, qname, rcode, reply length
+*/
+
+#if HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define MYDNS_PROBE0(name)			DTRACE_PROBE(mydns, name)
+#define MYDNS_PROBE1(name,a)			DTRACE_PROBE1(mydns, name, a)
+#define MYDNS_PROBE2(name,a,b)			DTRACE_PROBE2(mydns, name, a, b)
+#define MYDNS_PROBE3(name,a,b,c)		DTRACE_PROBE3(mydns, name, a, b, c)
+#define MYDNS_PROBE4(name,a,b,c,d)		DTRACE_PROBE4(mydns, name, a, b, c, d)
+#define MYDNS_PROBE6(name,a,b,c,d,e,f)	DTRACE_PROBE6(mydns, name, a, b, c, d, e, f)
+#else
+#define MYDNS_PROBE0(name)			do { } while (0)
+#define MYDNS_PROBE1(name,a)			do { } while (0)
+#define MYDNS_PROBE2(name,a,b)			do { } while (0)
+#define MYDNS_PROBE3(name,a,b,c)		do { } while (0)
+#define MYDNS_PROBE4(name,a,b,c,d)		do { } while (0)
+#define MYDNS_PROBE6(name,a,b,c,d,e,f)	do { } while (0)
+#endif
+
+#endif /* !_MYDNS_PROBES_H */
+/* vi:set ts=3: */
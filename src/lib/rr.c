@@ -269,117 +269,65 @@ mydns_update_cloudflare_state(void) {
 
 /**************************************************************************************************
 	MYDNS_RR_GET_TYPE
+	Maps a type name (any case) to its qtype.  The names are placed with a perfect hash over the
+	length, the first two and the last character, so each lookup is one probe and one compare.
+	Returns 0 for unknown types.
 **************************************************************************************************/
-inline dns_qtype_t
-mydns_rr_get_type(char *type) {
-  register char *c;
-
-  for (c = type; *c; c++)
-    *c = toupper(*c);
-
-  switch (type[0]) {
-  case 'A':
-    if (!type[1])
-      return DNS_QTYPE_A;
-
-    if (type[1] == 'A' && type[2] == 'A' && type[3] == 'A' && !type[4])
-      return DNS_QTYPE_AAAA;
+#define RR_TYPE_HASH(__t, __len) \
+  (((__len) + 5 * ((__t)[0] & 0xDF) + 32 * ((__t)[(__len)-1] & 0xDF) + ((__t)[1] & 0xDF)) & 63)
 
+static const struct {
+  const char	*name;
+  dns_qtype_t	type;
+} mydns_rr_type_hash[64] = {
+  [ 2] = { "CNAME",		DNS_QTYPE_CNAME },
+  [ 3] = { "NSEC3PARAM",	DNS_QTYPE_NSEC3PARAM },
+  [ 5] = { "OPENPGPKEY",	DNS_QTYPE_OPENPGPKEY },
+  [ 7] = { "DNAME",		DNS_QTYPE_DNAME },
+  [ 8] = { "DNSKEY",		DNS_QTYPE_DNSKEY },
+  [ 9] = { "DS",		DNS_QTYPE_DS },
+  [12] = { "NAPTR",		DNS_QTYPE_NAPTR },
+  [17] = { "RRSIG",		DNS_QTYPE_RRSIG },
+  [18] = { "SMIMEA",		DNS_QTYPE_SMIMEA },
+  [20] = { "TLSA",		DNS_QTYPE_TLSA },
+  [22] = { "HINFO",		DNS_QTYPE_HINFO },
+  [24] = { "CERT",		DNS_QTYPE_CERT },
+  [27] = { "MX",		DNS_QTYPE_MX },
+  [30] = { "URI",		DNS_QTYPE_URI },
+  [33] = { "HTTPS",		DNS_QTYPE_HTTPS },
+  [38] = { "A",			DNS_QTYPE_A },
+  [39] = { "PTR",		DNS_QTYPE_PTR },
+  [42] = { "AAAA",		DNS_QTYPE_AAAA },
+  [44] = { "RP",		DNS_QTYPE_RP },
+  [46] = { "LOC",		DNS_QTYPE_LOC },
+  [51] = { "CAA",		DNS_QTYPE_CAA },
+  [52] = { "SRV",		DNS_QTYPE_SRV },
 #if ALIAS_ENABLED
-    if (type[1] == 'L' && type[2] == 'I' && type[3] == 'A' && type[4] == 'S' && !type[5])
-      return DNS_QTYPE_ALIAS;
+  [54] = { "ALIAS",		DNS_QTYPE_ALIAS },
 #endif
-    break;
-
-  case 'C':
-    if (type[1] == 'N' && type[2] == 'A' && type[3] == 'M' && type[4] == 'E' && !type[5])
-      return DNS_QTYPE_CNAME;
-    if (type[1] == 'A' && type[2] == 'A' && !type[3])
-      return DNS_QTYPE_CAA;
-    if (type[1] == 'E' && type[2] == 'R' && type[3] == 'T' && !type[4])
-      return DNS_QTYPE_CERT;
-    break;
-
-  case 'D':
-    if (type[1] == 'N' && type[2] == 'A' && type[3] == 'M' && type[4] == 'E' && !type[5])
-      return DNS_QTYPE_DNAME;
-    if (type[1] == 'N' && type[2] == 'S' && type[3] == 'K' && type[4] == 'E' && type[5] == 'Y' && !type[6])
-      return DNS_QTYPE_DNSKEY;
-    if (type[1] == 'S' && !type[2])
-      return DNS_QTYPE_DS;
-    break;
-
-  case 'H':
-    if (type[1] == 'I' && type[2] == 'N' && type[3] == 'F' && type[4] == 'O' && !type[5])
-      return DNS_QTYPE_HINFO;
-    if (type[1] == 'T' && type[2] == 'T' && type[3] == 'P' && type[4] == 'S' && !type[5])
-      return DNS_QTYPE_HTTPS;
-    break;
-
-  case 'L':
-    if (type[1] == 'O' && type[2] == 'C' && !type[3])
-      return DNS_QTYPE_LOC;
-    break;
-
-  case 'M':
-    if (type[1] == 'X' && !type[2])
-      return DNS_QTYPE_MX;
-    break;
-
-  case 'N':
-    if (type[1] == 'S' && !type[2])
-      return DNS_QTYPE_NS;
-    if (type[1] == 'A' && type[2] == 'P' && type[3] == 'T' && type[4] == 'R' && !type[5])
-      return DNS_QTYPE_NAPTR;
-    if (type[1] == 'S' && type[2] == 'E' && type[3] == 'C' && !type[4])
-      return DNS_QTYPE_NSEC;
-    if (type[1] == 'S' && type[2] == 'E' && type[3] == 'C' && type[4] == '3' && !type[5])
-      return DNS_QTYPE_NSEC3;
-    if (type[1] == 'S' && type[2] == 'E' && type[3] == 'C' && type[4] == '3' && type[5] == 'P' && type[6] == 'A' && type[7] == 'R' && type[8] == 'A' && type[9] == 'M' && !type[10])
-      return DNS_QTYPE_NSEC3PARAM;
-    break;
-
-  case 'O':
-    if (type[1] == 'P' && type[2] == 'E' && type[3] == 'N' && type[4] == 'P' && type[5] == 'G' && type[6] == 'P' && type[7] == 'K' && type[8] == 'E' && type[9] == 'Y' && !type[10])
-      return DNS_QTYPE_OPENPGPKEY;
-    break;
-
-  case 'P':
-    if (type[1] == 'T' && type[2] == 'R' && !type[3])
-      return DNS_QTYPE_PTR;
-    break;
+  [55] = { "SSHFP",		DNS_QTYPE_SSHFP },
+  [57] = { "SVCB",		DNS_QTYPE_SVCB },
+  [59] = { "NS",		DNS_QTYPE_NS },
+  [61] = { "NSEC",		DNS_QTYPE_NSEC },
+  [62] = { "NSEC3",		DNS_QTYPE_NSEC3 },
+  [63] = { "TXT",		DNS_QTYPE_TXT },
+};
 
-  case 'R':
-    if (type[1] == 'P' && !type[2])
-      return DNS_QTYPE_RP;
-    if (type[1] == 'R' && type[2] == 'S' && type[3] == 'I' && type[4] == 'G' && !type[5])
-      return DNS_QTYPE_RRSIG;
-    break;
-
-  case 'S':
-    if (type[1] == 'R' && type[2] == 'V' && !type[3])
-      return DNS_QTYPE_SRV;
-    if (type[1] == 'M' && type[2] == 'I' && type[3] == 'M' && type[4] == 'E' && type[5] == 'A' && !type[6])
-      return DNS_QTYPE_SMIMEA;
-    if (type[1] == 'S' && type[2] == 'H' && type[3] == 'F' && type[4] == 'P' && !type[5])
-      return DNS_QTYPE_SSHFP;
-    if (type[1] == 'V' && type[2] == 'C' && type[3] == 'B' && !type[4])
-      return DNS_QTYPE_SVCB;
-    break;
-
-  case 'T':
-    if (type[1] == 'X' && type[2] == 'T' && !type[3])
-      return DNS_QTYPE_TXT;
-    if (type[1] == 'L' && type[2] == 'S' && type[3] == 'A' && !type[4])
-      return DNS_QTYPE_TLSA;
-    break;
-
-  case 'U':
-    if (type[1] == 'R' && type[2] == 'I' && !type[3])
-      return DNS_QTYPE_URI;
-    break;
-  }
-  return 0;
+inline dns_qtype_t
+mydns_rr_get_type(const char *type) {
+  register size_t len;
+  register int h;
+
+  for (len = 0; type[len]; len++)
+    if (len > 10)
+      return 0;
+  if (!len)
+    return 0;
+
+  h = RR_TYPE_HASH(type, len);
+  if (!mydns_rr_type_hash[h].name || strcasecmp(mydns_rr_type_hash[h].name, type))
+    return 0;
+  return mydns_rr_type_hash[h].type;
 }
 /*--- mydns_rr_get_type() -----------------------------------------------------------------------*/
 
@@ -407,6 +355,30 @@ mydns_rr_type_to_string(dns_qtype_t type) {
 }
 
 
+/**************************************************************************************************
+	__MYDNS_RR_SET_NAME / __MYDNS_RR_SET_DATA
+	Replace the name or data of an RR with a separately allocated string, releasing the old one
+	unless it was packed into the MYDNS_RR allocation.
+**************************************************************************************************/
+static inline void
+__mydns_rr_set_name(MYDNS_RR *rr, char *name) {
+  if (!(rr->flags & MYDNS_RR_NAME_PACKED))
+    RELEASE(__MYDNS_RR_NAME(rr));
+  rr->flags &= ~MYDNS_RR_NAME_PACKED;
+  __MYDNS_RR_NAME(rr) = name;
+}
+
+static inline void
+__mydns_rr_set_data(MYDNS_RR *rr, char *data, size_t datalen) {
+  if (!(rr->flags & MYDNS_RR_DATA_PACKED))
+    RELEASE(__MYDNS_RR_DATA_VALUE(rr));
+  rr->flags &= ~MYDNS_RR_DATA_PACKED;
+  __MYDNS_RR_DATA_VALUE(rr) = data;
+  __MYDNS_RR_DATA_LENGTH(rr) = datalen;
+}
+/*--- __mydns_rr_set_name() / __mydns_rr_set_data() ---------------------------------------------*/
+
+
 /**************************************************************************************************
 	MYDNS_RR_PARSE_RP
 	RP contains two names in 'data' -- the mbox and the txt.
@@ -435,9 +407,7 @@ mydns_rr_parse_rp(const char *origin, MYDNS_RR *rr) {
 
   ASPRINTF(&merged, "%s %s", canon_mbox, canon_txt);
 
-  RELEASE(__MYDNS_RR_DATA_VALUE(rr));
-  __MYDNS_RR_DATA_VALUE(rr) = merged;
-  __MYDNS_RR_DATA_LENGTH(rr) = strlen(merged);
+  __mydns_rr_set_data(rr, merged, strlen(merged));
 
   if (canon_mbox != mbox)
     RELEASE(canon_mbox);
@@ -486,9 +456,7 @@ mydns_rr_parse_srv(const char *origin, MYDNS_RR *rr) {
   canon_target = mydns_rr_append_origin(target, (char*)origin);
   ASPRINTF(&merged, "%u %u %s", weight_val & 0xFFFF, port_val & 0xFFFF, canon_target);
 
-  RELEASE(__MYDNS_RR_DATA_VALUE(rr));
-  __MYDNS_RR_DATA_VALUE(rr) = merged;
-  __MYDNS_RR_DATA_LENGTH(rr) = strlen(merged);
+  __mydns_rr_set_data(rr, merged, strlen(merged));
 
   if (canon_target != target)
     RELEASE(canon_target);
@@ -591,16 +559,13 @@ mydns_rr_append_origin(char *str, char *origin) {
 void
 mydns_rr_name_append_origin(MYDNS_RR *rr, char *origin) {
   char *res = mydns_rr_append_origin(__MYDNS_RR_NAME(rr), origin);
-  if (__MYDNS_RR_NAME(rr) != res) RELEASE(__MYDNS_RR_NAME(rr));
-  __MYDNS_RR_NAME(rr) = res;
+  if (__MYDNS_RR_NAME(rr) != res) __mydns_rr_set_name(rr, res);
 }
       
 void
 mydns_rr_data_append_origin(MYDNS_RR *rr, char *origin) {
   char *res = mydns_rr_append_origin(__MYDNS_RR_DATA_VALUE(rr), origin);
-  if (__MYDNS_RR_DATA_VALUE(rr) != res) RELEASE(__MYDNS_RR_DATA_VALUE(rr));
-  __MYDNS_RR_DATA_VALUE(rr) = res;
-  __MYDNS_RR_DATA_LENGTH(rr) = strlen(__MYDNS_RR_DATA_VALUE(rr));
+  if (__MYDNS_RR_DATA_VALUE(rr) != res) __mydns_rr_set_data(rr, res, strlen(res));
 }
       
 /**************************************************************************************************
@@ -614,61 +579,104 @@ _mydns_rr_free(MYDNS_RR *first) {
   for (p = first; p; p = tmp) {
     tmp = p->next;
     RELEASE(p->stamp);
-    RELEASE(__MYDNS_RR_NAME(p));
-    RELEASE(__MYDNS_RR_DATA_VALUE(p));
+    if (!(p->flags & MYDNS_RR_NAME_PACKED))
+      RELEASE(__MYDNS_RR_NAME(p));
+    if (!(p->flags & MYDNS_RR_DATA_PACKED))
+      RELEASE(__MYDNS_RR_DATA_VALUE(p));
     RELEASE(p);
   }
 }
 /*--- _mydns_rr_free() --------------------------------------------------------------------------*/
 
-MYDNS_RR *
-mydns_rr_build(uint32_t id,
-	       uint32_t zone,
-	       dns_qtype_t type,
-	       dns_class_t class,
-	       uint32_t aux,
-	       uint32_t ttl,
-	       char *active,
+/**************************************************************************************************
+	MYDNS_RR_ACTIVE_FLAGS
+	Converts a value from the `active' column into MYDNS_RR flags.  No value means the table has
+	no `active' column, so the record is active.
+**************************************************************************************************/
+static inline uint32_t
+mydns_rr_active_flags(const char *active) {
+  if (!active || !strcasecmp(mydns_rr_active_types[0], active))
+    return (MYDNS_RR_ACTIVE);
+  if (!strcasecmp(mydns_rr_active_types[1], active))
+    return (0);
+  if (!strcasecmp(mydns_rr_active_types[2], active))
+    return (MYDNS_RR_DELETED);
+  return (GETBOOL(active) ? MYDNS_RR_ACTIVE : 0);
+}
+/*--- mydns_rr_active_flags() -------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	__MYDNS_RR_BUILD
+	Builds a MYDNS_RR with its name and data packed into the same allocation.  The data is the
+	concatenation of `data' and `xdata' (the optional extended data column).  Room is reserved
+	after the data for the origin that CNAME, MX and NS records may need appended.
+**************************************************************************************************/
+static MYDNS_RR *
+__mydns_rr_build(uint32_t id,
+		 uint32_t zone,
+		 dns_qtype_t type,
+		 dns_class_t class,
+		 uint32_t aux,
+		 uint32_t ttl,
+		 char *active,
 #if USE_PGSQL
-	       timestamp *stamp,
+		 timestamp *stamp,
 #else
-	       MYSQL_TIME *stamp,
+		 MYSQL_TIME *stamp,
 #endif
-	       uint32_t serial,
-	       char *name,
-	       char *data,
-	       uint16_t	datalen,
-	       const char *origin) {
+		 uint32_t serial,
+		 char *name,
+		 char *data,
+		 size_t	datalen,
+		 char *xdata,
+		 size_t xdatalen,
+		 const char *origin) {
   MYDNS_RR	*rr = NULL;
-  uint32_t	namelen;
+  size_t	namelen, originlen = 0;
+  char		*value;
 
 #if DEBUG_ENABLED && DEBUG_LIB_RR
   DebugX("lib-rr", 1, _("mydns_rr_build(): called for id=%d, zone=%d, type=%d, class=%d, aux=%d, "
 			"ttl=%d, active='%s', stamp=%p, serial=%d, name='%s', data=%p, datalen=%d, origin='%s'"),
 	 id, zone, type, class, aux, ttl, active, stamp, serial,
-	 (name)?name:_("<NULL>"), data, datalen, origin);
+	 (name)?name:_("<NULL>"), data, (int)(datalen + xdatalen), origin);
 #endif
 
   if ((namelen = (name)?strlen(name):0) > DNS_MAXNAMELEN) {
     /* Name exceeds permissable length - should report error */
-    goto PARSEFAILED;
+    RELEASE(stamp);
+    return (NULL);
+  }
+  if (datalen + xdatalen > 0xFFFF) {
+    RELEASE(stamp);
+    return (NULL);
   }
 
-  rr = (MYDNS_RR *)ALLOCATE(sizeof(MYDNS_RR), MYDNS_RR);
-  memset(rr, '\0', sizeof(MYDNS_RR));
+  if (origin && (type == DNS_QTYPE_CNAME || type == DNS_QTYPE_MX || type == DNS_QTYPE_NS))
+#ifdef DN_COLUMN_NAMES
+    originlen = 1;
+#else
+    originlen = 1 + strlen(origin);
+#endif
+
+  /* One block: the structure, then the name, then the data with room for ".origin" */
+  rr = (MYDNS_RR *)ALLOCATE(sizeof(MYDNS_RR) + namelen + 1 + datalen + xdatalen + originlen + 1,
+			    MYDNS_RR);
   rr->next = NULL;
 
   rr->id = id;
   rr->zone = zone;
 
-  __MYDNS_RR_NAME(rr) = ALLOCATE(namelen+1, char[]);
-  memset(__MYDNS_RR_NAME(rr), 0, namelen+1);
-  if (name) strncpy(__MYDNS_RR_NAME(rr), name, namelen);
+  __MYDNS_RR_NAME(rr) = (char *)(rr + 1);
+  if (name) memcpy(__MYDNS_RR_NAME(rr), name, namelen);
 
   /* Should store length and buffer rather than handle as a string */
-  __MYDNS_RR_DATA_LENGTH(rr) = datalen;
-  __MYDNS_RR_DATA_VALUE(rr) = ALLOCATE(datalen+1, char[]);
-  memcpy(__MYDNS_RR_DATA_VALUE(rr), data, datalen);
+  value = __MYDNS_RR_NAME(rr) + namelen + 1;
+  if (datalen) memcpy(value, data, datalen);
+  if (xdatalen) memcpy(&value[datalen], xdata, xdatalen);
+  __MYDNS_RR_DATA_VALUE(rr) = value;
+  __MYDNS_RR_DATA_LENGTH(rr) = datalen + xdatalen;
 
   rr->class = class;
   rr->aux = aux;
@@ -682,14 +690,7 @@ mydns_rr_build(uint32_t id,
     rr->alias = 0;
 #endif
 
-  /* Find a constant value so we do not have to allocate or free this one */
-  if (active) {
-    int i;
-    for (i = 0; i < 3; i++) {
-      if (!strcasecmp(mydns_rr_active_types[i], active)) { active = mydns_rr_active_types[i]; break; }
-    }
-  }
-  rr->active = active;
+  rr->flags = MYDNS_RR_NAME_PACKED | MYDNS_RR_DATA_PACKED | mydns_rr_active_flags(active);
   rr->stamp = stamp;
   rr->serial = serial;
 
@@ -724,25 +725,22 @@ mydns_rr_build(uint32_t id,
   case DNS_QTYPE_MX:
   case DNS_QTYPE_NS:
 
-    /* Append origin to data if it's not there for these types: */
+    /* Append origin to data if it's not there for these types (space was reserved above) */
     if (origin) {
       datalen = __MYDNS_RR_DATA_LENGTH(rr);
 #ifdef DN_COLUMN_NAMES
-      datalen += 1;
-      __MYDNS_RR_DATA_LENGTH(rr) = datalen;
-      __MYDNS_RR_DATA_VALUE(rr) = REALLOCATE(__MYDNS_RR_DATA_VALUE(rr), datalen+1, char[]);
       /* Just append dot for DN */
-      ((char*)__MYDNS_RR_DATA_VALUE(rr))[datalen-1] = '.';
+      value[datalen++] = '.';
 #else
-      if (datalen && ((char*)__MYDNS_RR_DATA_VALUE(rr))[datalen-1] != '.') {
-	datalen = datalen + 1 + strlen(origin);
-	__MYDNS_RR_DATA_VALUE(rr) = REALLOCATE(__MYDNS_RR_DATA_VALUE(rr), datalen+1, char[]);
-	((char*)__MYDNS_RR_DATA_VALUE(rr))[__MYDNS_RR_DATA_LENGTH(rr)] = '.';
-	memcpy(&((char*)__MYDNS_RR_DATA_VALUE(rr))[__MYDNS_RR_DATA_LENGTH(rr)+1], origin, strlen(origin));
-	__MYDNS_RR_DATA_LENGTH(rr) = datalen;
+      if (datalen && value[datalen-1] != '.') {
+	value[datalen++] = '.';
+	memcpy(&value[datalen], origin, originlen - 1);
+	datalen += originlen - 1;
       }
 #endif
-      ((char*)__MYDNS_RR_DATA_VALUE(rr))[__MYDNS_RR_DATA_LENGTH(rr)] = '\0';
+      if (datalen > 0xFFFF)
+	goto PARSEFAILED;
+      __MYDNS_RR_DATA_LENGTH(rr) = datalen;
     }
     break;
   default:
@@ -758,6 +756,29 @@ mydns_rr_build(uint32_t id,
   mydns_rr_free(rr);
   return (NULL);
 }
+/*--- __mydns_rr_build() ------------------------------------------------------------------------*/
+
+MYDNS_RR *
+mydns_rr_build(uint32_t id,
+	       uint32_t zone,
+	       dns_qtype_t type,
+	       dns_class_t class,
+	       uint32_t aux,
+	       uint32_t ttl,
+	       char *active,
+#if USE_PGSQL
+	       timestamp *stamp,
+#else
+	       MYSQL_TIME *stamp,
+#endif
+	       uint32_t serial,
+	       char *name,
+	       char *data,
+	       uint16_t	datalen,
+	       const char *origin) {
+  return __mydns_rr_build(id, zone, type, class, aux, ttl, active, stamp, serial,
+			  name, data, datalen, NULL, 0, origin);
+}
 
 /**************************************************************************************************
 	MYDNS_RR_PARSE
@@ -775,9 +796,8 @@ mydns_rr_parse(SQL_ROW row, unsigned long *lengths, const char *origin) {
 #endif
   uint32_t	serial = 0;
   int		ridx = MYDNS_RR_NUMFIELDS;
-  char		*data;
-  uint16_t	datalen;
-  MYDNS_RR	*rr;
+  char		*xdata = NULL;
+  size_t	xdatalen = 0;
 
 #if DEBUG_ENABLED && DEBUG_LIB_RR
   DebugX("lib-rr", 1, _("mydns_rr_parse(): called for origin %s"), origin);
@@ -790,20 +810,12 @@ mydns_rr_parse(SQL_ROW row, unsigned long *lengths, const char *origin) {
     return (NULL);
   }
 
-  data = row[3];
-  datalen = lengths[3];
   if (mydns_rr_extended_data) {
-    if (lengths[ridx]) {
-      char *newdata = ALLOCATE(datalen + lengths[ridx], char[]);
-      memcpy(newdata, data, datalen);
-      memcpy(&newdata[datalen], row[ridx], lengths[ridx]);
-      datalen += lengths[ridx];
-      data = newdata;
-    }
+    xdata = row[ridx];
+    xdatalen = lengths[ridx];
     ridx++;
   }
 
-  /* Copy storage? */
   if (mydns_rr_use_active) active = row[ridx++];
   if (mydns_rr_use_stamp) {
 #if USE_PGSQL
@@ -818,23 +830,21 @@ mydns_rr_parse(SQL_ROW row, unsigned long *lengths, const char *origin) {
     serial = atou(row[ridx++]);
   }
 
-  rr = mydns_rr_build(atou(row[0]),
-		      atou(row[1]),
-		      type,
-		      DNS_CLASS_IN,
-		      atou(row[4]),
-		      atou(row[5]),
-		      active,
-		      stamp,
-		      serial,
-		      row[2],
-		      data,
-		      datalen,
-		      origin);
-
-  if (mydns_rr_extended_data && lengths[MYDNS_RR_NUMFIELDS]) RELEASE(data);
-
-  return (rr);
+  return __mydns_rr_build(atou(row[0]),
+			  atou(row[1]),
+			  type,
+			  DNS_CLASS_IN,
+			  atou(row[4]),
+			  atou(row[5]),
+			  active,
+			  stamp,
+			  serial,
+			  row[2],
+			  row[3],
+			  lengths[3],
+			  xdata,
+			  xdatalen,
+			  origin);
 }
 /*--- mydns_rr_parse() --------------------------------------------------------------------------*/
 
@@ -849,27 +859,30 @@ mydns_rr_dup(MYDNS_RR *start, int recurse) {
   register MYDNS_RR *first = NULL, *last = NULL, *rr, *s, *tmp;
 
   for (s = start; s; s = tmp) {
-    tmp = s->next;
+    size_t namelen = strlen(__MYDNS_RR_NAME(s));
 
-    rr = (MYDNS_RR *)ALLOCATE(sizeof(MYDNS_RR), MYDNS_RR);
+    tmp = s->next;
 
-    memset(rr, '\0', sizeof(MYDNS_RR));
+    /* Name and data are packed behind the structure as in __mydns_rr_build() */
+    rr = (MYDNS_RR *)ALLOCATE(sizeof(MYDNS_RR) + namelen + 1 + __MYDNS_RR_DATA_LENGTH(s) + 1,
+			      MYDNS_RR);
     rr->id = s->id;
     rr->zone = s->zone;
-    __MYDNS_RR_NAME(rr) = STRDUP(__MYDNS_RR_NAME(s));
+    __MYDNS_RR_NAME(rr) = (char *)(rr + 1);
+    memcpy(__MYDNS_RR_NAME(rr), __MYDNS_RR_NAME(s), namelen);
     rr->type = s->type;
     rr->class = s->class;
     __MYDNS_RR_DATA_LENGTH(rr) = __MYDNS_RR_DATA_LENGTH(s);
-    __MYDNS_RR_DATA_VALUE(rr) = ALLOCATE(__MYDNS_RR_DATA_LENGTH(s)+1, char[]);
+    __MYDNS_RR_DATA_VALUE(rr) = __MYDNS_RR_NAME(rr) + namelen + 1;
     memcpy(__MYDNS_RR_DATA_VALUE(rr), __MYDNS_RR_DATA_VALUE(s), __MYDNS_RR_DATA_LENGTH(s));
-    ((char*)__MYDNS_RR_DATA_VALUE(rr))[__MYDNS_RR_DATA_LENGTH(rr)] = '\0';
     rr->aux = s->aux;
     rr->ttl = s->ttl;
 #if ALIAS_ENABLED
     rr->alias = s->alias;
 #endif
 
-    rr->active = s->active;
+    rr->flags = (s->flags & (MYDNS_RR_ACTIVE | MYDNS_RR_DELETED))
+      | MYDNS_RR_NAME_PACKED | MYDNS_RR_DATA_PACKED;
     if (s->stamp) {
 #if USE_PGSQL
       rr->stamp = s->stamp;
@@ -1051,9 +1064,10 @@ mydns_rr_columns() {
   return columns;
 }
 
-char *
-mydns_rr_prepare_query(uint32_t zone, dns_qtype_t type, const char *name, const char *origin,
-		       const char *active, const char *columns, const char *filter) {
+static char *
+__mydns_rr_prepare_query(uint32_t zone, dns_qtype_t type, const char *name, const char *origin,
+			 const char *active, const char *columns, const char *filter,
+			 const char *order) {
   size_t	querylen;
   char		*query = NULL;
   char		*namequery = NULL;
@@ -1201,12 +1215,18 @@ mydns_rr_prepare_query(uint32_t zone, dns_qtype_t type, const char *name, const
 			     (filter)? filter : "",
 
 			     /* Optional sorting */
-			     (mydns_rr_use_stamp)? " ORDER BY stamp DESC" : "");
+			     (order)? order : (mydns_rr_use_stamp)? " ORDER BY stamp DESC" : "");
 
   RELEASE(namequery);
 
   return (query);
 }
+
+char *
+mydns_rr_prepare_query(uint32_t zone, dns_qtype_t type, const char *name, const char *origin,
+		       const char *active, const char *columns, const char *filter) {
+  return __mydns_rr_prepare_query(zone, type, name, origin, active, columns, filter, NULL);
+}
 			 
 static int __mydns_rr_do_load(SQL *sqlConn, MYDNS_RR **rptr, const char *query, const char *origin) {
   MYDNS_RR	*first = NULL, *last = NULL;
@@ -1487,6 +1507,149 @@ __mydns_rr_load(SQL *sqlConn, MYDNS_RR **rptr, uint32_t zone,
   return res;
 }
 
+/**************************************************************************************************
+	__MYDNS_RR_STREAM_QUERY
+	Issues the query for the next rows of the stream.  Returns 0 on success, -1 on error.
+**************************************************************************************************/
+static int
+__mydns_rr_stream_query(MYDNS_RR_STREAM *stream) {
+  char		*query = NULL, *columns = NULL, *filter = NULL, *order = NULL;
+
+  columns = mydns_rr_columns();
+  if (stream->pagesize) {
+    /* Each page starts after the last record of the one before, so it is a cheap index scan */
+#ifdef DN_COLUMN_NAMES
+    sql_build_query(&filter, "rr_id>%u", stream->last_id);
+    sql_build_query(&order, " ORDER BY rr_id LIMIT %d", stream->pagesize);
+#else
+    sql_build_query(&filter, "id>%u", stream->last_id);
+    sql_build_query(&order, " ORDER BY id LIMIT %d", stream->pagesize);
+#endif
+  }
+  query = __mydns_rr_prepare_query(stream->zone, DNS_QTYPE_ANY, NULL, stream->origin,
+				   mydns_rr_active_types[0], columns, filter, order);
+  RELEASE(columns);
+  RELEASE(filter);
+  RELEASE(order);
+  if (!query)
+    return (-1);
+
+#if DEBUG_ENABLED && DEBUG_LIB_RR
+  DebugX("lib-rr", 1, _("mydns_rr_stream_query(query='%s')"), query);
+#endif
+
+  if (stream->pagesize)
+    stream->res = sql_query(stream->sqlConn, query, strlen(query));
+  else
+    stream->res = sql_uquery(stream->sqlConn, query, strlen(query));
+  RELEASE(query);
+  stream->rows = 0;
+  return (stream->res ? 0 : -1);
+}
+/*--- __mydns_rr_stream_query() -----------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	MYDNS_RR_STREAM_ACTIVE
+	Starts reading the active records for `zone' without loading the whole zone into memory.
+	Records are returned one at a time by mydns_rr_stream_next().
+	If `pagesize' is zero the rows come from a single unbuffered query, and no other query may
+	be issued on `sqlConn' until mydns_rr_stream_next() has returned NULL or the stream has been
+	closed.  Otherwise rows are read `pagesize' at a time, in id order, and the connection is
+	free between calls.
+	Returns NULL on error.
+**************************************************************************************************/
+MYDNS_RR_STREAM *
+mydns_rr_stream_active(SQL *sqlConn, uint32_t zone, const char *origin, int pagesize) {
+  MYDNS_RR_STREAM	*stream = NULL;
+
+  if (!sqlConn) {
+    errno = EINVAL;
+    return (NULL);
+  }
+
+  stream = ALLOCATE(sizeof(MYDNS_RR_STREAM), MYDNS_RR_STREAM);
+  memset(stream, 0, sizeof(MYDNS_RR_STREAM));
+  stream->sqlConn = sqlConn;
+  stream->zone = zone;
+  stream->origin = origin ? STRDUP(origin) : NULL;
+  stream->pagesize = (pagesize > 0) ? pagesize : 0;
+
+  if (__mydns_rr_stream_query(stream) < 0) {
+    mydns_rr_stream_close(stream);
+    return (NULL);
+  }
+  return (stream);
+}
+/*--- mydns_rr_stream_active() ------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	MYDNS_RR_STREAM_NEXT
+	Returns the next record from the stream, or NULL when there are no more.  The caller owns
+	the record returned.  If the next page could not be read, NULL is returned with the stream's
+	`error' flag set.
+**************************************************************************************************/
+MYDNS_RR *
+mydns_rr_stream_next(MYDNS_RR_STREAM *stream) {
+  MYDNS_RR	*rr = NULL;
+  SQL_ROW	row;
+  unsigned long	*lengths;
+  char		*cp;
+
+  while (stream->res) {
+    if (!(row = sql_getrow(stream->res, &lengths))) {
+      int full = (stream->rows >= stream->pagesize);
+
+      sql_free(stream->res);
+      if (stream->pagesize && full) {
+	if (__mydns_rr_stream_query(stream) == 0)
+	  continue;
+	stream->error = 1;
+	return (NULL);
+      }
+
+      /* The connection is free again, so any records held elsewhere can be loaded now */
+      mydns_rr_append_cloudflare(stream->sqlConn, &stream->extra, stream->zone, DNS_QTYPE_ANY,
+				 NULL, stream->origin, mydns_rr_active_types[0], NULL);
+      break;
+    }
+    stream->rows++;
+    stream->last_id = atou((char *)row[0]);		/* First column is the id */
+    if (!(rr = mydns_rr_parse(row, lengths, stream->origin)))
+      continue;
+
+    /* Trim origin where the name is exactly the origin, as __mydns_rr_do_load() does */
+    if (stream->origin && (cp = strstr(__MYDNS_RR_NAME(rr), stream->origin))
+	&& !(cp - __MYDNS_RR_NAME(rr)))
+      *cp = '\0';
+    return (rr);
+  }
+
+  if ((rr = stream->extra)) {
+    stream->extra = rr->next;
+    rr->next = NULL;
+  }
+  return (rr);
+}
+/*--- mydns_rr_stream_next() --------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	MYDNS_RR_STREAM_CLOSE
+	Discards any records not yet read and frees the stream.
+**************************************************************************************************/
+void
+mydns_rr_stream_close(MYDNS_RR_STREAM *stream) {
+  if (!stream)
+    return;
+  sql_free(stream->res);
+  mydns_rr_free(stream->extra);
+  RELEASE(stream->origin);
+  RELEASE(stream);
+}
+/*--- mydns_rr_stream_close() -------------------------------------------------------------------*/
+
 int mydns_rr_load_all(SQL *sqlConn, MYDNS_RR **rptr, uint32_t zone,
 		      dns_qtype_t type,
 		      const char *name, const char *origin) {
@@ -303,9 +303,9 @@ mysql_connect_candidates(const char *user, const char *password,
       return conn;
     }
 
-    Warnx(_("Unable to connect to MySQL host %s: %s"),
-	  (display && *display) ? display : _("(default)"),
-	  mysql_error(conn));
+    LogLimit(LOG_WARNING, _("Unable to connect to MySQL host %s: %s"),
+	     (display && *display) ? display : _("(default)"),
+	     mysql_error(conn));
     mysql_close(conn);
     if (hostbuf)
       RELEASE(hostbuf);
@@ -498,6 +498,51 @@ sql_reopen(void) {
 /*--- sql_reopen() ------------------------------------------------------------------------------*/
 
 
+/**************************************************************************************************
+	SQL_CONNECT
+	Opens another connection to `host' as the user sql_open() was given, for a thread of its
+	own.  Outputs nothing, and returns NULL if the server can't be reached.
+**************************************************************************************************/
+SQL *
+sql_connect(const char *host) {
+  SQL *conn = NULL;
+#if USE_PGSQL
+  char *host2 = host ? STRDUP(host) : NULL, *portp = NULL;
+
+  if (host2 && (portp = strchr(host2, ':')))
+    *portp++ = '\0';
+  conn = PQsetdbLogin(host2, portp, NULL, NULL, _sql_database, _sql_user, _sql_password);
+  RELEASE(host2);
+  if (PQstatus(conn) == CONNECTION_BAD) {
+    PQfinish(conn);
+    return (NULL);
+  }
+#else
+  char *hostbuf = NULL;
+  unsigned int port = 0;
+
+  if (host && *host)
+    hostbuf = mysql_extract_host(host, &port);
+  conn = ALLOCATE(sizeof(*conn), MYSQL);
+  if (!mysql_init(conn)) {
+    RELEASE(conn);
+    RELEASE(hostbuf);
+    return (NULL);
+  }
+#if MYSQL_VERSION_ID > 32349
+  mysql_options(conn, MYSQL_READ_DEFAULT_GROUP, "client");
+#endif
+  if (!mysql_real_connect(conn, hostbuf, _sql_user, _sql_password, _sql_database, port, NULL, 0)) {
+    mysql_close(conn);
+    RELEASE(conn);
+  }
+  RELEASE(hostbuf);
+#endif
+  return (conn);
+}
+/*--- sql_connect() -----------------------------------------------------------------------------*/
+
+
 /**************************************************************************************************
 	SQL_ISTABLE
 	Returns 1 if the specified table exists in the current database, or 0 if it does not.
@@ -609,11 +654,10 @@ _sql_close(SQL *sqlConn) {
 
 
 /**************************************************************************************************
-	SQL_NRQUERY
-	Issues an SQL query that does not return a result.  Returns 0 on success, -1 on error.
+	_SQL_NRQUERY
 **************************************************************************************************/
-int
-sql_nrquery(SQL *sqlConn, const char *query, size_t querylen) {
+static int
+_sql_nrquery(SQL *sqlConn, const char *query, size_t querylen) {
 #if USE_PGSQL
   ExecStatusType q_rv = PGRES_COMMAND_OK;
   PGresult *result = NULL;
@@ -638,23 +682,42 @@ retry:
       retried = 1;
       goto retry;
     }
-    if (mysql_error(sql)[0] != '\0')
-      WarnSQL(sql, _("%s: error during query"), mysql_error(sql));
+    if (mysql_error(sql)[0] != '\0') {
+      static LOG_LIMIT limit;
+
+      if (_log_limit(&limit, LOG_WARNING, __FILE__, __LINE__))
+	WarnSQL(sql, _("%s: error during query"), mysql_error(sql));
+    }
     return (-1);
   }
 #endif
 
   return (0);
 }
+/*--- _sql_nrquery() ----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	SQL_NRQUERY
+	Issues an SQL query that does not return a result.  Returns 0 on success, -1 on error.
+**************************************************************************************************/
+int
+sql_nrquery(SQL *sqlConn, const char *query, size_t querylen) {
+  int rv = 0;
+
+  MYDNS_PROBE2(sql_query_start, query, querylen);
+  rv = _sql_nrquery(sqlConn, query, querylen);
+  MYDNS_PROBE2(sql_query_done, query, rv == 0);
+  return (rv);
+}
 /*--- sql_nrquery() -----------------------------------------------------------------------------*/
 
 
 /**************************************************************************************************
-	SQL_QUERY
-	Returns a query's result, or NULL on error.
+	_SQL_QUERY
 **************************************************************************************************/
-SQL_RES *
-sql_query(SQL *sqlConn, const char *query, size_t querylen) {
+static SQL_RES *
+_sql_query(SQL *sqlConn, const char *query, size_t querylen) {
   SQL_RES *res = NULL;
 #if !USE_PGSQL
   int retried = 0;
@@ -675,6 +738,7 @@ sql_query(SQL *sqlConn, const char *query, size_t querylen) {
     res->current_tuple = 0;
     res->current_row = ALLOCATE(res->fields * sizeof(unsigned char *), unsigned char[]);
     res->current_length = ALLOCATE(res->fields * sizeof(int *), int[]);
+    res->conn = NULL;
   } else if (q_rv == PGRES_COMMAND_OK) {
     PQclear(result);
     return (NULL);
@@ -692,17 +756,119 @@ retry:
       retried = 1;
       goto retry;
     }
-    if (mysql_error(sql)[0] != '\0')
-      WarnSQL(sql, _("%s: error during query"), mysql_error(sql));
+    if (mysql_error(sql)[0] != '\0') {
+      static LOG_LIMIT limit;
+
+      if (_log_limit(&limit, LOG_WARNING, __FILE__, __LINE__))
+	WarnSQL(sql, _("%s: error during query"), mysql_error(sql));
+    }
     return (NULL);
   }
 #endif
 
   return (res);
 }
+/*--- _sql_query() ------------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	SQL_QUERY
+	Returns a query's result, or NULL on error.
+**************************************************************************************************/
+SQL_RES *
+sql_query(SQL *sqlConn, const char *query, size_t querylen) {
+  SQL_RES *res = NULL;
+
+  MYDNS_PROBE2(sql_query_start, query, querylen);
+  res = _sql_query(sqlConn, query, querylen);
+  MYDNS_PROBE2(sql_query_done, query, res != NULL);
+  return (res);
+}
 /*--- sql_query() -------------------------------------------------------------------------------*/
 
 
+/**************************************************************************************************
+	_SQL_UQUERY
+**************************************************************************************************/
+static SQL_RES *
+_sql_uquery(SQL *sqlConn, const char *query, size_t querylen) {
+  SQL_RES *res = NULL;
+#if USE_PGSQL
+  PGresult *result = NULL;
+  ExecStatusType q_rv = PGRES_COMMAND_OK;
+
+  if (!PQsendQuery(sqlConn, query) || !PQsetSingleRowMode(sqlConn)) {
+    while ((result = PQgetResult(sqlConn)))
+      PQclear(result);
+    return (NULL);
+  }
+  result = PQgetResult(sqlConn);
+  q_rv = PQresultStatus(result);
+  if (q_rv != PGRES_SINGLE_TUPLE && q_rv != PGRES_TUPLES_OK) {
+    do
+      PQclear(result);
+    while ((result = PQgetResult(sqlConn)));
+    return (NULL);
+  }
+
+  res = ALLOCATE(sizeof(SQL_RES), SQL_RES);
+  res->result = result;
+  res->tuples = PQntuples(result);
+  res->fields = PQnfields(result);
+  res->current_tuple = 0;
+  res->current_row = ALLOCATE(res->fields * sizeof(unsigned char *), unsigned char[]);
+  res->current_length = ALLOCATE(res->fields * sizeof(int *), int[]);
+  res->conn = sqlConn;
+  if (q_rv == PGRES_TUPLES_OK) {				/* Empty result; nothing to stream */
+    while ((result = PQgetResult(sqlConn)))
+      PQclear(result);
+    res->conn = NULL;
+  }
+#else
+  int retried = 0;
+
+retry:
+  if (mysql_real_query(sqlConn, query, querylen)
+      || !(res = mysql_use_result(sqlConn))) {
+    unsigned int errcode = mysql_errno(sqlConn);
+    if (!retried && mysql_should_retry(errcode) && sql_retry_connection(&sqlConn)) {
+      retried = 1;
+      goto retry;
+    }
+    if (mysql_error(sql)[0] != '\0') {
+      static LOG_LIMIT limit;
+
+      if (_log_limit(&limit, LOG_WARNING, __FILE__, __LINE__))
+	WarnSQL(sql, _("%s: error during query"), mysql_error(sql));
+    }
+    return (NULL);
+  }
+#endif
+
+  return (res);
+}
+/*--- _sql_uquery() -----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	SQL_UQUERY
+	Like sql_query, but rows are fetched from the server as sql_getrow() asks for them instead of
+	being read into memory first.  sql_num_rows() is meaningless on the result, and no other
+	query may be issued on the connection until the result has been freed.
+	Returns NULL on error.  `sql_query_done' fires once the first rows are available.
+**************************************************************************************************/
+SQL_RES *
+sql_uquery(SQL *sqlConn, const char *query, size_t querylen) {
+  SQL_RES *res = NULL;
+
+  MYDNS_PROBE2(sql_query_start, query, querylen);
+  res = _sql_uquery(sqlConn, query, querylen);
+  MYDNS_PROBE2(sql_query_done, query, res != NULL);
+  return (res);
+}
+/*--- sql_uquery() ------------------------------------------------------------------------------*/
+
+
 /**************************************************************************************************
 	SQL_QUERYF
 	Like sql_query, but accepts varargs format.
@@ -788,8 +954,27 @@ sql_getrow(SQL_RES *res, unsigned long **lengths) {
 #if USE_PGSQL
   register int n;
 
-  if (res->current_tuple >= res->tuples)
-    return (NULL);
+  if (res->current_tuple >= res->tuples) {
+    PGresult *result = NULL;
+
+    /* Streamed results (from sql_uquery) hold one row at a time */
+    if (!res->conn)
+      return (NULL);
+    if (!(result = PQgetResult(res->conn)) || PQresultStatus(result) != PGRES_SINGLE_TUPLE) {
+      while (result) {
+	PQclear(result);
+	result = PQgetResult(res->conn);
+      }
+      res->conn = NULL;
+      return (NULL);
+    }
+    PQclear(res->result);
+    res->result = result;
+    res->tuples = PQntuples(result);
+    res->current_tuple = 0;
+    if (!res->tuples)
+      return (NULL);
+  }
   for (n = 0; n < res->fields; n++) {
     res->current_row[n] = PQgetvalue(res->result, res->current_tuple, n);
     res->current_length[n] = PQgetlength(res->result, res->current_tuple, n);
@@ -838,6 +1023,11 @@ sql_escstr(SQL *sqlConn, char *src) {
 void
 _sql_free(SQL_RES *res) {
 #if USE_PGSQL
+  PGresult *result = NULL;
+
+  if (res->conn)						/* Discard rows not yet streamed */
+    while ((result = PQgetResult(res->conn)))
+      PQclear(result);
   RELEASE(res->current_length);
   RELEASE(res->current_row);
   PQclear(res->result);
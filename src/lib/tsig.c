@@ -262,67 +262,85 @@ static int encode_name(const char *name, unsigned char *buf, size_t bufsize) {
 }
 
 /**
- * Sign DNS message with TSIG
+ * Compute the MAC over the digest components and append the TSIG RR.
+ *
+ * The digest is the prior MAC (if any), any unsigned messages sent since
+ * it, this message, and then either the full TSIG variables or, for the
+ * later messages of a multi-message response, only the timers
+ * (RFC 8945 section 5.3.1).
  */
-int tsig_sign(unsigned char *message, size_t message_len, size_t buffer_size,
-              tsig_key_t *key, const unsigned char *request_mac, size_t request_mac_len,
-              size_t *output_len) {
-    unsigned char tsig_data[4096];
+static int tsig_sign_digest(unsigned char *message, size_t message_len, size_t buffer_size,
+                            tsig_key_t *key, const unsigned char *prior_mac, size_t prior_mac_len,
+                            const unsigned char *unsigned_data, size_t unsigned_len,
+                            int timers_only, size_t *output_len) {
+    unsigned char *tsig_data;
     size_t tsig_pos = 0;
+    unsigned char key_name[256], alg_name[256];
+    int name_len, alg_name_len;
     unsigned char mac[EVP_MAX_MD_SIZE];
     size_t mac_len;
     time_t now = time(NULL);
+    uint64_t time_48 = (uint64_t)now & 0xFFFFFFFFFFFFULL;
     uint16_t arcount;
-    const char *alg_name;
-    int alg_name_len;
 
     if (!message || !key || !output_len) {
         return -1;
     }
 
-    /* Build TSIG signing data */
-    /* If this is a response, include request MAC */
-    if (request_mac && request_mac_len > 0) {
-        if (tsig_pos + 2 + request_mac_len > sizeof(tsig_data)) {
-            return -1;
-        }
-        tsig_data[tsig_pos++] = (request_mac_len >> 8) & 0xFF;
-        tsig_data[tsig_pos++] = request_mac_len & 0xFF;
-        memcpy(tsig_data + tsig_pos, request_mac, request_mac_len);
-        tsig_pos += request_mac_len;
+    name_len = encode_name(key->name, key_name, sizeof(key_name));
+    alg_name_len = encode_name(tsig_algorithm_name(key->algorithm), alg_name, sizeof(alg_name));
+    if (name_len < 0 || alg_name_len < 0) {
+        return -1;
     }
 
-    /* Add original message (without TSIG) */
-    if (tsig_pos + message_len > sizeof(tsig_data)) {
+    /* Messages may be up to 64KB, so size the signing data to fit */
+    tsig_data = malloc(2 + prior_mac_len + unsigned_len + message_len
+                       + name_len + alg_name_len + 32);
+    if (!tsig_data) {
         return -1;
     }
+
+    /* Build TSIG signing data */
+    /* If this is a response, include request (or prior) MAC */
+    if (prior_mac && prior_mac_len > 0) {
+        tsig_data[tsig_pos++] = (prior_mac_len >> 8) & 0xFF;
+        tsig_data[tsig_pos++] = prior_mac_len & 0xFF;
+        memcpy(tsig_data + tsig_pos, prior_mac, prior_mac_len);
+        tsig_pos += prior_mac_len;
+    }
+
+    /* Messages sent unsigned since the prior MAC */
+    if (unsigned_data && unsigned_len > 0) {
+        memcpy(tsig_data + tsig_pos, unsigned_data, unsigned_len);
+        tsig_pos += unsigned_len;
+    }
+
+    /* Add original message (without TSIG) */
     memcpy(tsig_data + tsig_pos, message, message_len);
     tsig_pos += message_len;
 
     /* Add TSIG variables for signing */
-    /* Key name */
-    int name_len = encode_name(key->name, tsig_data + tsig_pos, sizeof(tsig_data) - tsig_pos);
-    if (name_len < 0) return -1;
-    tsig_pos += name_len;
+    if (!timers_only) {
+        /* Key name */
+        memcpy(tsig_data + tsig_pos, key_name, name_len);
+        tsig_pos += name_len;
 
-    /* Class = ANY (255) */
-    tsig_data[tsig_pos++] = 0x00;
-    tsig_data[tsig_pos++] = 0xFF;
+        /* Class = ANY (255) */
+        tsig_data[tsig_pos++] = 0x00;
+        tsig_data[tsig_pos++] = 0xFF;
 
-    /* TTL = 0 */
-    tsig_data[tsig_pos++] = 0x00;
-    tsig_data[tsig_pos++] = 0x00;
-    tsig_data[tsig_pos++] = 0x00;
-    tsig_data[tsig_pos++] = 0x00;
+        /* TTL = 0 */
+        tsig_data[tsig_pos++] = 0x00;
+        tsig_data[tsig_pos++] = 0x00;
+        tsig_data[tsig_pos++] = 0x00;
+        tsig_data[tsig_pos++] = 0x00;
 
-    /* Algorithm name */
-    alg_name = tsig_algorithm_name(key->algorithm);
-    alg_name_len = encode_name(alg_name, tsig_data + tsig_pos, sizeof(tsig_data) - tsig_pos);
-    if (alg_name_len < 0) return -1;
-    tsig_pos += alg_name_len;
+        /* Algorithm name */
+        memcpy(tsig_data + tsig_pos, alg_name, alg_name_len);
+        tsig_pos += alg_name_len;
+    }
 
     /* Time signed (48-bit) */
-    uint64_t time_48 = (uint64_t)now & 0xFFFFFFFFFFFFULL;
     tsig_data[tsig_pos++] = (time_48 >> 40) & 0xFF;
     tsig_data[tsig_pos++] = (time_48 >> 32) & 0xFF;
     tsig_data[tsig_pos++] = (time_48 >> 24) & 0xFF;
@@ -334,26 +352,26 @@ int tsig_sign(unsigned char *message, size_t message_len, size_t buffer_size,
     tsig_data[tsig_pos++] = 0x01;
     tsig_data[tsig_pos++] = 0x2C;
 
-    /* Error = 0 */
-    tsig_data[tsig_pos++] = 0x00;
-    tsig_data[tsig_pos++] = 0x00;
+    if (!timers_only) {
+        /* Error = 0 */
+        tsig_data[tsig_pos++] = 0x00;
+        tsig_data[tsig_pos++] = 0x00;
 
-    /* Other len = 0 */
-    tsig_data[tsig_pos++] = 0x00;
-    tsig_data[tsig_pos++] = 0x00;
+        /* Other len = 0 */
+        tsig_data[tsig_pos++] = 0x00;
+        tsig_data[tsig_pos++] = 0x00;
+    }
 
     /* Compute HMAC */
     if (tsig_hmac(tsig_data, tsig_pos, key, mac, &mac_len) < 0) {
+        free(tsig_data);
         return -1;
     }
+    free(tsig_data);
 
     /* Now append TSIG RR to message */
     size_t new_len = message_len;
 
-    /* Calculate offset to key name in tsig_data */
-    size_t key_name_offset = (request_mac && request_mac_len > 0) ? (2 + request_mac_len) : 0;
-    key_name_offset += message_len;
-
     /* Check buffer space */
     size_t tsig_rr_len = name_len + 10 + alg_name_len + 16 + mac_len;
     if (new_len + tsig_rr_len > buffer_size) {
@@ -368,7 +386,7 @@ int tsig_sign(unsigned char *message, size_t message_len, size_t buffer_size,
 
     /* Append TSIG RR */
     /* Name */
-    memcpy(message + new_len, tsig_data + key_name_offset, name_len);
+    memcpy(message + new_len, key_name, name_len);
     new_len += name_len;
 
     /* Type = TSIG (250) */
@@ -392,7 +410,7 @@ int tsig_sign(unsigned char *message, size_t message_len, size_t buffer_size,
 
     /* RDATA */
     /* Algorithm name */
-    memcpy(message + new_len, tsig_data + key_name_offset + name_len + 6, alg_name_len);
+    memcpy(message + new_len, alg_name, alg_name_len);
     new_len += alg_name_len;
 
     /* Time signed (48-bit) */
@@ -431,6 +449,27 @@ int tsig_sign(unsigned char *message, size_t message_len, size_t buffer_size,
     return 0;
 }
 
+/**
+ * Sign DNS message with TSIG
+ */
+int tsig_sign(unsigned char *message, size_t message_len, size_t buffer_size,
+              tsig_key_t *key, const unsigned char *request_mac, size_t request_mac_len,
+              size_t *output_len) {
+    return tsig_sign_digest(message, message_len, buffer_size, key,
+                            request_mac, request_mac_len, NULL, 0, 0, output_len);
+}
+
+/**
+ * Sign a later message of a multi-message response with TSIG
+ */
+int tsig_sign_continuation(unsigned char *message, size_t message_len, size_t buffer_size,
+                           tsig_key_t *key, const unsigned char *prior_mac, size_t prior_mac_len,
+                           const unsigned char *unsigned_data, size_t unsigned_len,
+                           size_t *output_len) {
+    return tsig_sign_digest(message, message_len, buffer_size, key,
+                            prior_mac, prior_mac_len, unsigned_data, unsigned_len, 1, output_len);
+}
+
 /**
  * Verify TSIG signature (simplified)
  */
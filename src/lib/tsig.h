@@ -120,6 +120,29 @@ int tsig_sign(unsigned char *message, size_t message_len, size_t buffer_size,
               tsig_key_t *key, const unsigned char *request_mac, size_t request_mac_len,
               size_t *output_len);
 
+/**
+ * Sign the second or later message of a multi-message response (AXFR/IXFR)
+ *
+ * Only the timers are covered along with the message (RFC 8945 5.3.1).
+ * Messages may be sent unsigned between signed ones; they must be passed
+ * in, concatenated, when the next message is signed.
+ *
+ * @param message DNS message buffer
+ * @param message_len Current message length
+ * @param buffer_size Total buffer size
+ * @param key TSIG key
+ * @param prior_mac MAC of the last signed message
+ * @param prior_mac_len Prior MAC length
+ * @param unsigned_data Messages sent unsigned since the prior MAC (may be NULL)
+ * @param unsigned_len Length of unsigned_data
+ * @param output_len Output: new message length with TSIG
+ * @return 0 on success, -1 on error
+ */
+int tsig_sign_continuation(unsigned char *message, size_t message_len, size_t buffer_size,
+                           tsig_key_t *key, const unsigned char *prior_mac, size_t prior_mac_len,
+                           const unsigned char *unsigned_data, size_t unsigned_len,
+                           size_t *output_len);
+
 /**
  * Verify TSIG signature on DNS message
  *
@@ -28,10 +28,11 @@
 /**************************************************************************************************
 	FIND_ALIAS
 	Find an ALIAS or A record for the alias.
-	Returns the RR or NULL if not found.
+	Returns the RR or NULL if not found.  The origin of the zone the RR was found in is
+	stored in `origin'.
 **************************************************************************************************/
 static MYDNS_RR *
-find_alias(TASK *t, char *fqdn) {
+find_alias(TASK *t, char *fqdn, char **origin) {
   register MYDNS_SOA *soa = NULL;
   register MYDNS_RR *rr = NULL;
   register char *label = NULL;
@@ -56,6 +57,8 @@ find_alias(TASK *t, char *fqdn) {
 	DebugX("alias", 1, _("%s: trying exact match `%s'"), desctask(t), label);
 #endif
 	if ((rr = find_rr(t, soa, DNS_QTYPE_A, label))) {
+	  *origin = STRDUP(soa->origin);
+	  mydns_soa_free(soa);
 	  RELEASE(name);
 	  return (rr);
 	}
@@ -92,6 +95,10 @@ find_alias(TASK *t, char *fqdn) {
 		   desctask(t), label, wclabel, rr);
 #endif
 	    if(rr) {
+	      *origin = STRDUP(zsoa->origin);
+	      if (zsoa != soa)
+		mydns_soa_free(zsoa);
+	      mydns_soa_free(soa);
 	      RELEASE(name);
 	      RELEASE(wclabel);
 	      return (rr);
@@ -143,6 +150,7 @@ find_alias(TASK *t, char *fqdn) {
 		  }
 		  zsoa = xsoa;
 		} else {
+		  mydns_soa_free(xsoa);
 		  goto NOWILDCARDMATCH;
 		}
 	      }
@@ -155,88 +163,140 @@ find_alias(TASK *t, char *fqdn) {
 	} while (1);
 
       NOWILDCARDMATCH:
+	if (zsoa != soa)
+	  mydns_soa_free(zsoa);
 	if (!*label)
 	  break;
       }
     }
   }
+  mydns_soa_free(soa);
   RELEASE(name);
   return (NULL);
 }
 /*--- find_alias() ------------------------------------------------------------------------------*/
 
 /**************************************************************************************************
-	ALIAS_RECURSE
-	If the task has a matching ALIAS record, recurse into it.
-	Returns the number of records added.
+	ALIAS_CHAIN_RESOLVE
+	Follows the ALIAS chain starting at `target' until an A record that is not an alias is
+	found.  Returns the flattened chain, holding that record, or NULL if the chain is broken.
 **************************************************************************************************/
-int
-alias_recurse(TASK *t, datasection_t section, char *fqdn, MYDNS_SOA *soa, char *label, MYDNS_RR *alias) {
+static ALIAS_CHAIN *
+alias_chain_resolve(TASK *t, char *fqdn, char *target) {
   uint32_t		aliases[MAX_ALIAS_LEVEL];
-  char			*name = NULL;
+  ALIAS_CHAIN		*chain = NULL;
+  char			*name = NULL, *origin = NULL;
   register MYDNS_RR	*rr = NULL;
   register int		depth = 0, n = 0;
 
   memset(&aliases[0], 0, sizeof(aliases));
-
-  if ((MYDNS_RR_DATA_LENGTH(alias) > 0)
-      && (LASTCHAR((char*)MYDNS_RR_DATA_VALUE(alias)) != '.'))
-    ASPRINTF(&name, "%s.%s", (char*)MYDNS_RR_DATA_VALUE(alias), soa->origin);
-  else
-    name = STRDUP((char*)MYDNS_RR_DATA_VALUE(alias));
+  chain = alias_chain_new();
+  name = STRDUP(target);
 
   for (depth = 0; depth < MAX_ALIAS_LEVEL; depth++) {
 #if DEBUG_ENABLED && DEBUG_ALIAS
     DebugX("alias", 1, _("%s: ALIAS -> `%s'"), desctask(t), name);
 #endif
     /* Are there any alias records? */
-    if ((rr = find_alias(t, name))) {
-      /* We need an A record that is not an alias to end the chain. */
-      if (rr->alias == 0) {
-	/*
-	** Override the id and name, because rrlist_add() checks for
-	** duplicates and we might have several records aliased to one
-	*/
-	rr->id = alias->id;
-	strcpy(MYDNS_RR_NAME(rr), MYDNS_RR_NAME(alias));
-	rrlist_add(t, section, DNS_RRTYPE_RR, (void *)rr, fqdn);
-	t->sort_level++;
+    if (!(rr = find_alias(t, name, &origin))) {
+      Verbose("%s: %s: %s -> %s", desctask(t), _("ALIAS chain is broken"), fqdn, name);
+      break;
+    }
+
+    /* We need an A record that is not an alias to end the chain. */
+    if (rr->alias == 0) {
+      alias_chain_add_rr(chain, ANSWER, DNS_RRTYPE_RR, (void *)rr, name, 0);
+      mydns_rr_free(rr);
+      RELEASE(origin);
+      RELEASE(name);
+      return (chain);
+    }
+
+    /* Check aliases list; if we are looping, stop. Otherwise add this to the list. */
+    for (n = 0; n < depth; n++)
+      if (aliases[n] == rr->id) {
+	/* ALIAS loop: We aren't going to find an A record, so we're done. */
+	Verbose(_("%s: %s: %s (depth %d)"), desctask(t), _("ALIAS loop detected"), fqdn, depth);
 	mydns_rr_free(rr);
+	RELEASE(origin);
 	RELEASE(name);
-	return (1);
+	alias_chain_free(chain);
+	return (NULL);
       }
+    aliases[depth] = rr->id;
 
-      /* Append origin if needed */
-      if ((MYDNS_RR_DATA_LENGTH(rr) > 0)
-	  && (LASTCHAR((char*)MYDNS_RR_DATA_VALUE(rr)) != '.')) {
-	RELEASE(name);
-	name = mydns_rr_append_origin((char*)MYDNS_RR_DATA_VALUE(rr), soa->origin);
-      }
+    /* This link is part of the chain even though no record from it is sent */
+    if (!rr->ttl || !alias_chain_add_link(chain, rr->zone))
+      chain->ttl = 0;
+    else if (rr->ttl < chain->ttl)
+      chain->ttl = rr->ttl;
 
-      /* Check aliases list; if we are looping, stop. Otherwise add this to the list. */
-      for (n = 0; n < depth; n++)
-	if (aliases[n] == rr->id) {
-	  /* ALIAS loop: We aren't going to find an A record, so we're done. */
-	  Verbose(_("%s: %s: %s (depth %d)"), desctask(t), _("ALIAS loop detected"), fqdn, depth);
-	  mydns_rr_free(rr);
-	  RELEASE(name);
-	  return (0);
-	}
-      aliases[depth] = rr->id;
+    /* Continue search with new alias, appending the origin of its zone if needed */
+    RELEASE(name);
+    if ((MYDNS_RR_DATA_LENGTH(rr) > 0)
+	&& (LASTCHAR((char*)MYDNS_RR_DATA_VALUE(rr)) != '.'))
+      ASPRINTF(&name, "%s.%s", (char*)MYDNS_RR_DATA_VALUE(rr), origin);
+    else
+      name = STRDUP((char*)MYDNS_RR_DATA_VALUE(rr));
+    RELEASE(origin);
+    mydns_rr_free(rr);
+  }
+  if (depth == MAX_ALIAS_LEVEL)
+    Verbose(_("%s: %s: %s -> %s (depth %d)"), desctask(t), _("max ALIAS depth exceeded"),
+	    fqdn, target, depth);
+  RELEASE(name);
+  alias_chain_free(chain);
+  return (NULL);
+}
+/*--- alias_chain_resolve() ---------------------------------------------------------------------*/
 
-      /* Continue search with new alias. */
-      strncpy(name, (char*)MYDNS_RR_DATA_VALUE(rr), sizeof(name)-1);
-      mydns_rr_free(rr);
-    } else {
-      Verbose("%s: %s: %s -> %s", desctask(t), _("ALIAS chain is broken"), fqdn, name);
-      RELEASE(name);
+
+/**************************************************************************************************
+	ALIAS_RECURSE
+	If the task has a matching ALIAS record, recurse into it.
+	The flattened chain is kept in AliasCache, keyed on the ALIAS target, so repeat queries
+	cost a single lookup.
+	Returns the number of records added.
+**************************************************************************************************/
+int
+alias_recurse(TASK *t, datasection_t section, char *fqdn, MYDNS_SOA *soa, char *label, MYDNS_RR *alias) {
+  ALIAS_CHAIN		*chain = NULL;
+  char			*target = NULL;
+  register MYDNS_RR	*a = NULL, *rr = NULL;
+  int			cached = 0;
+
+  if ((MYDNS_RR_DATA_LENGTH(alias) > 0)
+      && (LASTCHAR((char*)MYDNS_RR_DATA_VALUE(alias)) != '.'))
+    ASPRINTF(&target, "%s.%s", (char*)MYDNS_RR_DATA_VALUE(alias), soa->origin);
+  else
+    target = STRDUP((char*)MYDNS_RR_DATA_VALUE(alias));
+
+  if (!(chain = chain_cache_find(AliasCache, t, target, DNS_QTYPE_ALIAS))) {
+    if (!(chain = alias_chain_resolve(t, fqdn, target))) {
+      RELEASE(target);
       return (0);
     }
-  }
-  Verbose(_("%s: %s: %s -> %s (depth %d)"), desctask(t), _("max ALIAS depth exceeded"),
-	  fqdn, (char*)MYDNS_RR_DATA_VALUE(alias), depth);
-  RELEASE(name);
-  return (0);
+  } else
+    cached = 1;
+
+  /*
+  ** Send the target record under the id and name of the alias, because rrlist_add() checks
+  ** for duplicates and we might have several records aliased to one.  The TTL is the lowest
+  ** found along the chain.
+  */
+  a = (MYDNS_RR *)chain->head->rr;
+  rr = mydns_rr_build(alias->id, a->zone, a->type, a->class, a->aux,
+		      chain->ttl ? chain->ttl : a->ttl,
+		      NULL, NULL, a->serial, MYDNS_RR_NAME(alias),
+		      (char*)MYDNS_RR_DATA_VALUE(a), MYDNS_RR_DATA_LENGTH(a), NULL);
+  rrlist_add(t, section, DNS_RRTYPE_RR, (void *)rr, fqdn);
+  t->sort_level++;
+  mydns_rr_free(rr);
+
+  if (!cached)
+    chain_cache_add(AliasCache, t, target, DNS_QTYPE_ALIAS, chain);
+  RELEASE(target);
+  return (1);
 }
 /*--- alias_recurse() ---------------------------------------------------------------------------*/
 
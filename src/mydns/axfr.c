@@ -27,123 +27,217 @@
 
 
 #define	AXFR_TIME_LIMIT		3600		/* AXFR may not take more than this long, overall */
-
-static size_t total_records, total_octets;
-
-/* TSIG state for multi-packet signing */
-static tsig_key_t *axfr_tsig_key = NULL;
-static unsigned char axfr_request_mac[64];
-static size_t axfr_request_mac_len = 0;
-static unsigned char axfr_prev_mac[64];
-static size_t axfr_prev_mac_len = 0;
-static int axfr_packet_count = 0;
+#define	AXFR_MESSAGE_SIZE	64000		/* Octets of records per message; leaves room for TSIG */
+#define	AXFR_PAGE_SIZE		1000		/* Records read from the database per query */
+#define	AXFR_CACHE_LIMIT	((size_t)axfr_cache_size * 1024 * 1024)
+
+/* AXFR_RENDER: The messages of a transfer, before TSIG, kept for replay to other slaves */
+typedef struct _axfr_render {
+  uint32_t		zone, serial;
+  char			**msgs;			/* Messages, each starting with the DNS header */
+  size_t		*lens;
+  int			count, alloc;
+  size_t		qdlen;			/* Length of the question in the first message */
+  size_t		size;			/* Total octets held */
+  int			refs;			/* Transfers replaying this render */
+  int			stale;			/* Removed from the cache; free when unused */
+  struct _axfr_render	*prev, *next;
+} AXFR_RENDER;
+
+/* AXFR_XFER: An outbound zone transfer in progress (the task extension) */
+typedef struct _axfr_xfer {
+  MYDNS_SOA		*soa;			/* Zone being transferred */
+  size_t		soasize;		/* Estimated size of the SOA record */
+  MYDNS_RR_STREAM	*stream;		/* Records not yet read, or NULL when done */
+  MYDNS_RR		*held;			/* Record that did not fit in the last message */
+  MYDNS_RR		*memrr;			/* Records not yet sent of a zone snapshot from memzone */
+  int			memzone;		/* Zone is sent from memzone rather than the database */
+  struct timeval	memstart;		/* When the memzone snapshot was started */
+  long			snapshot_ms;		/* Time taken by the snapshot */
+  size_t		pending;		/* Estimated size of the records queued in t->an */
+  int			last;			/* `out' is the final message */
+
+  AXFR_RENDER		*render;		/* Messages recorded for the cache, or NULL */
+  AXFR_RENDER		*replay;		/* Cached messages being sent, or NULL */
+  int			replay_next;		/* Index of the next message in `replay' */
+
+  char			*out;			/* Message being written, with its length octets */
+  size_t		outlen, outoffset;
+
+  time_t		started;
+  size_t		total_records, total_octets;
+
+  /* TSIG state for multi-packet signing */
+  tsig_key_t		*tsig_key;
+  unsigned char		request_mac[64];
+  size_t		request_mac_len;
+  unsigned char		prev_mac[64];
+  size_t		prev_mac_len;
+  int			packet_count;
+  char			*unsigned_msgs;		/* Messages sent since the last signed one */
+  size_t		unsigned_len;
+  int			unsigned_count;
+} AXFR_XFER;
+
+static int axfr_active = 0;			/* Transfers running in this process */
+
+/* AXFR_SNAPSHOT: Records copied out of memzone by axfr_memzone_add() */
+typedef struct _axfr_snapshot {
+  MYDNS_RR		*head, *tail;
+  const char		*origin;
+} AXFR_SNAPSHOT;
+
+static AXFR_RENDER *axfr_cache_head = NULL;	/* Rendered transfers, most recently used first */
+static AXFR_RENDER *axfr_cache_tail = NULL;
+static size_t axfr_cache_octets = 0;		/* Octets held by the cache */
 
 
 /**************************************************************************************************
-	AXFR_ERROR
-	Quits and outputs a warning message.
+	AXFR_RENDER_FREE
+	Frees a rendered transfer.
 **************************************************************************************************/
-/* Stupid compiler doesn't know exit from _exit... */
-/* static void axfr_error(TASK *, const char *, ...) __attribute__ ((__noreturn__)); */
 static void
-axfr_error(TASK *t, const char *fmt, ...) {
-  va_list	ap; 
-  char		*msg = NULL;
-
-  if (t) {
-    task_output_info(t, NULL);
-  } else {
-    va_start(ap, fmt);
-    VASPRINTF(&msg, fmt, ap);
-    va_end(ap);
+axfr_render_free(AXFR_RENDER *r) {
+  register int n = 0;
 
-    Warnx("%s", msg);
-    RELEASE(msg);
-  }
+  if (!r)
+    return;
+  for (n = 0; n < r->count; n++)
+    RELEASE(r->msgs[n]);
+  RELEASE(r->msgs);
+  RELEASE(r->lens);
+  RELEASE(r);
+}
+/*--- axfr_render_free() ------------------------------------------------------------------------*/
 
-  sockclose(t->fd);
 
-  _exit(EXIT_FAILURE);
-  /* NOTREACHED */
+/**************************************************************************************************
+	AXFR_RENDER_RELEASE
+	Called when a transfer is done replaying `r'.  Frees it if it has left the cache.
+**************************************************************************************************/
+static void
+axfr_render_release(AXFR_RENDER *r) {
+  if (!r)
+    return;
+  if (--r->refs <= 0 && r->stale)
+    axfr_render_free(r);
 }
-/*--- axfr_error() ------------------------------------------------------------------------------*/
+/*--- axfr_render_release() ---------------------------------------------------------------------*/
 
 
 /**************************************************************************************************
-	AXFR_TIMEOUT
-	Hard timeout called by SIGALRM after one hour.
+	AXFR_CACHE_REMOVE
+	Takes `r' out of the cache.  It is freed now, or when the last transfer using it finishes.
 **************************************************************************************************/
 static void
-axfr_timeout(int dummy) {
-  axfr_error(NULL, _("AXFR timed out"));
+axfr_cache_remove(AXFR_RENDER *r) {
+  if (r->prev)
+    r->prev->next = r->next;
+  else
+    axfr_cache_head = r->next;
+  if (r->next)
+    r->next->prev = r->prev;
+  else
+    axfr_cache_tail = r->prev;
+  r->prev = r->next = NULL;
+  axfr_cache_octets -= r->size;
+  r->stale = 1;
+  if (r->refs <= 0)
+    axfr_render_free(r);
+}
+/*--- axfr_cache_remove() -----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	AXFR_CACHE_FIND
+	Returns the rendered transfer of `zone' at `serial', or NULL.  A render of the zone at any
+	other serial is out of date and is dropped.  The caller must axfr_render_release() the result.
+**************************************************************************************************/
+static AXFR_RENDER *
+axfr_cache_find(uint32_t zone, uint32_t serial) {
+  register AXFR_RENDER *r = NULL;
+
+  for (r = axfr_cache_head; r; r = r->next)
+    if (r->zone == zone) {
+      if (r->serial != serial) {
+	axfr_cache_remove(r);
+	return (NULL);
+      }
+
+      /* Move to head of list */
+      if (r->prev) {
+	r->prev->next = r->next;
+	if (r->next)
+	  r->next->prev = r->prev;
+	else
+	  axfr_cache_tail = r->prev;
+	r->prev = NULL;
+	r->next = axfr_cache_head;
+	axfr_cache_head->prev = r;
+	axfr_cache_head = r;
+      }
+      r->refs++;
+      return (r);
+    }
+  return (NULL);
 }
-/*--- axfr_timeout() ----------------------------------------------------------------------------*/
+/*--- axfr_cache_find() -------------------------------------------------------------------------*/
 
 
 /**************************************************************************************************
-	AXFR_WRITE_WAIT
-	Wait for the client to become ready to read.  Times out after `task_timeout' seconds.
+	AXFR_CACHE_ADD
+	Adds a completed render to the cache, replacing any other render of the zone and dropping
+	the least recently used renders to stay within `axfr-cache-size'.
 **************************************************************************************************/
 static void
-axfr_write_wait(TASK *t) {
-  int			rv = 0;
-  struct pollfd item;
-  item.fd = t->fd;
-  item.events = POLLOUT;
-  item.revents = 0;
-
-#if HAVE_POLL
-  rv = poll(&item, 1, -1);
-  if (rv >= 0) {
-    if (rv != 1 || !(item.revents & POLLOUT) || (item.revents & (POLLERR|POLLHUP|POLLNVAL)))
-      axfr_error(t, _("axfr_write_wait write timeout failure"));
-  }
-#else
-#if HAVE_SELECT
-  fd_set		wfd;
-  fd_set		efd
-  struct timeval 	tv = { 0, 0 };
-
-  FD_ZERO(&wfd);
-  FD_SET(t->fd, &wfd);
-  FD_ZERO(&efd);
-  FD_SET(t->fd, &efd);
-  tv.tv_sec = task_timeout;
-  tv.tv_usec = 0;
-  rv = select(t->fd + 1, NULL, &wfd, &efd, &tv);
-  if (rv >= 0) {
-    if (rv != 1 || !FD_ISSET(t->fd, &wfd) || FD_ISSET(t->fd, &efd))
-      axfr_error(t, _("axfr_write_waut write timeout failure"));
-  }
-#else
-#error You must have either poll(preferred) or select to compile this code
-#endif
-#endif
-  if (rv < 0)
-    axfr_error(t, "axfr_write_wait poll failed %s(%d)", strerror(errno), errno);
+axfr_cache_add(AXFR_RENDER *r) {
+  register AXFR_RENDER *old = NULL;
+
+  for (old = axfr_cache_head; old; old = old->next)
+    if (old->zone == r->zone) {
+      axfr_cache_remove(old);
+      break;
+    }
+  while (axfr_cache_tail && (axfr_cache_octets + r->size > AXFR_CACHE_LIMIT))
+    axfr_cache_remove(axfr_cache_tail);
+
+  r->prev = NULL;
+  r->next = axfr_cache_head;
+  if (axfr_cache_head)
+    axfr_cache_head->prev = r;
+  else
+    axfr_cache_tail = r;
+  axfr_cache_head = r;
+  axfr_cache_octets += r->size;
 }
-/*--- axfr_write_wait() -------------------------------------------------------------------------*/
+/*--- axfr_cache_add() --------------------------------------------------------------------------*/
 
 
 /**************************************************************************************************
-	AXFR_WRITE
-	Writes the specified buffer, obeying task_timeout (via axfr_write_wait).
+	AXFR_RENDER_ADD
+	Records a message of the transfer being rendered.  Recording stops if the zone would not fit
+	in the cache.
 **************************************************************************************************/
 static void
-axfr_write(TASK *t, char *buf, size_t size) {
-  int		rv = 0;
-  size_t	offset = 0;
-
-  do {
-    axfr_write_wait(t);
-    if ((rv = write(t->fd, buf+offset, size-offset)) < 0)
-      axfr_error(t, _("write: %s"), strerror(errno));
-    if (!rv)
-      axfr_error(t, _("client closed connection"));
-    offset += rv;
-  } while (offset < size);
+axfr_render_add(AXFR_XFER *x, char *msg, size_t len) {
+  AXFR_RENDER *r = x->render;
+
+  if (r->size + len > AXFR_CACHE_LIMIT) {
+    axfr_render_free(r);
+    x->render = NULL;
+    return;
+  }
+  if (r->count == r->alloc) {
+    r->alloc = r->alloc ? r->alloc * 2 : 16;
+    r->msgs = REALLOCATE(r->msgs, r->alloc * sizeof(char *), char *[]);
+    r->lens = REALLOCATE(r->lens, r->alloc * sizeof(size_t), size_t[]);
+  }
+  r->msgs[r->count] = ALLOCATE(len, char[]);
+  memcpy(r->msgs[r->count], msg, len);
+  r->lens[r->count++] = len;
+  r->size += len;
 }
-/*--- axfr_write() ------------------------------------------------------------------------------*/
+/*--- axfr_render_add() -------------------------------------------------------------------------*/
 
 
 /**************************************************************************************************
@@ -300,87 +394,124 @@ extract_tsig_mac(const unsigned char *message, size_t message_len,
 
 
 /**************************************************************************************************
-	AXFR_REPLY
-	Sends one reply to the client.
+	AXFR_QUEUE
+	Makes `msg', which holds `records' records, the next message to send.
+	`last' is nonzero for the final message of the transfer.
+	With TSIG, the first and last messages are always signed, and every `axfr-tsig-interval'th
+	in between (RFC 8945 5.3.1).
 **************************************************************************************************/
 static void
-axfr_reply(TASK *t) {
-  char len[2] = { 0, 0 }, *l = len;
-  char *reply_to_send = NULL;
+axfr_queue(TASK *t, AXFR_XFER *x, char *msg, size_t msglen, size_t records, int last) {
+  char *reply_to_send = NULL, *l = NULL;
   size_t reply_len_to_send = 0;
 
-  build_reply(t, 0);
-
   /* Sign with TSIG if key is present */
-  if (axfr_tsig_key) {
+  if (x->tsig_key && x->packet_count && !last
+      && x->unsigned_count + 1 < axfr_tsig_interval) {
+    /* Sent unsigned; it is covered by the next signed message */
+    x->unsigned_msgs = REALLOCATE(x->unsigned_msgs, x->unsigned_len + msglen, char[]);
+    memcpy(x->unsigned_msgs + x->unsigned_len, msg, msglen);
+    x->unsigned_len += msglen;
+    x->unsigned_count++;
+    x->packet_count++;
+    goto send_unsigned;
+  } else if (x->tsig_key) {
     size_t max_tsig_len = 200;
-    char *signed_reply = ALLOCATE(t->replylen + max_tsig_len, char[]);
+    char *signed_reply = ALLOCATE(msglen + max_tsig_len, char[]);
     size_t new_len = 0;
-    unsigned char *mac_to_use = NULL;
-    size_t mac_len_to_use = 0;
+    int rv = -1;
 
     if (!signed_reply) {
       Warnx(_("Failed to allocate buffer for TSIG signing"));
       goto send_unsigned;
     }
 
-    memcpy(signed_reply, t->reply, t->replylen);
+    memcpy(signed_reply, msg, msglen);
 
-    /* Determine which MAC to use */
-    if (axfr_packet_count == 0) {
+    /* Sign the packet */
+    if (x->packet_count == 0) {
       /* First packet: use request MAC */
-      mac_to_use = axfr_request_mac;
-      mac_len_to_use = axfr_request_mac_len;
+      rv = tsig_sign((unsigned char*)signed_reply, msglen, msglen + max_tsig_len,
+		     x->tsig_key, x->request_mac, x->request_mac_len, &new_len);
     } else {
-      /* Subsequent packets: use previous response MAC */
-      mac_to_use = axfr_prev_mac;
-      mac_len_to_use = axfr_prev_mac_len;
+      /* Subsequent packets: use previous response MAC and any unsigned messages */
+      rv = tsig_sign_continuation((unsigned char*)signed_reply, msglen,
+				  msglen + max_tsig_len, x->tsig_key,
+				  x->prev_mac, x->prev_mac_len,
+				  (unsigned char*)x->unsigned_msgs, x->unsigned_len, &new_len);
     }
+    RELEASE(x->unsigned_msgs);
+    x->unsigned_len = 0;
+    x->unsigned_count = 0;
 
-    /* Sign the packet */
-    if (tsig_sign((unsigned char*)signed_reply, t->replylen, t->replylen + max_tsig_len,
-                  axfr_tsig_key, mac_to_use, mac_len_to_use, &new_len) == 0) {
+    if (rv == 0) {
 
       /* Extract MAC from this signed packet for next packet */
       if (extract_tsig_mac((unsigned char*)signed_reply, new_len,
-                          axfr_prev_mac, &axfr_prev_mac_len) < 0) {
+                          x->prev_mac, &x->prev_mac_len) < 0) {
         /* Failed to extract MAC - continue anyway */
-        Warnx(_("Failed to extract MAC from AXFR packet %d"), axfr_packet_count);
-        axfr_prev_mac_len = 0;
+        Warnx(_("Failed to extract MAC from AXFR packet %d"), x->packet_count);
+        x->prev_mac_len = 0;
       }
 
       reply_to_send = signed_reply;
       reply_len_to_send = new_len;
-      axfr_packet_count++;
+      x->packet_count++;
 
 #if DEBUG_ENABLED && DEBUG_AXFR
       DebugX("axfr", 1, _("AXFR packet %d signed with TSIG (%zu -> %zu bytes)"),
-             axfr_packet_count, t->replylen, new_len);
+             x->packet_count, msglen, new_len);
 #endif
     } else {
       /* Signing failed - send unsigned */
-      Warnx(_("TSIG signing failed for AXFR packet %d"), axfr_packet_count);
+      Warnx(_("TSIG signing failed for AXFR packet %d"), x->packet_count);
       RELEASE(signed_reply);
       goto send_unsigned;
     }
   } else {
 send_unsigned:
-    reply_to_send = t->reply;
-    reply_len_to_send = t->replylen;
+    reply_to_send = msg;
+    reply_len_to_send = msglen;
   }
 
-  /* Send the packet */
-  l = len;
+  /* Queue the packet, preceded by its length */
+  x->out = ALLOCATE(SIZE16 + reply_len_to_send, char[]);
+  l = x->out;
   DNS_PUT16(l, reply_len_to_send);
-  axfr_write(t, len, SIZE16);
-  axfr_write(t, reply_to_send, reply_len_to_send);
-  total_octets += SIZE16 + reply_len_to_send;
-  total_records++;
+  memcpy(l, reply_to_send, reply_len_to_send);
+  x->outlen = SIZE16 + reply_len_to_send;
+  x->outoffset = 0;
+  x->last = last;
+  x->total_octets += x->outlen;
+  x->total_records += records;
 
   /* Free signed reply buffer if allocated */
-  if (reply_to_send != t->reply) {
+  if (reply_to_send != msg) {
     RELEASE(reply_to_send);
   }
+}
+/*--- axfr_queue() ------------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	AXFR_REPLY
+	Builds one message from the records queued in the task and makes it the next message to send.
+	`last' is nonzero for the final message of the transfer.
+**************************************************************************************************/
+static void
+axfr_reply(TASK *t, AXFR_XFER *x, int last) {
+  /* Records must go out in zone order, with the SOA first, so nothing may be sorted */
+  t->an.a_records = t->an.mx_records = t->an.srv_records = 0;
+  build_reply(t, 0);
+
+  if (x->render) {
+    axfr_render_add(x, t->reply, t->replylen);
+    if (last && x->render) {
+      axfr_cache_add(x->render);
+      x->render = NULL;
+    }
+  }
+  axfr_queue(t, x, t->reply, t->replylen, t->an.size, last);
 
   /* Reset the pertinent parts of the task reply data */
   rrlist_free(&t->an);
@@ -398,17 +529,59 @@ send_unsigned:
   /* Nuke question data */
   t->qdcount = 0;
   t->qdlen = 0;
+  x->pending = 0;
 }
 /*--- axfr_reply() ------------------------------------------------------------------------------*/
 
 
+/**************************************************************************************************
+	AXFR_FLUSH
+	Writes as much of the current message as the socket will take without blocking.
+	Returns TASK_COMPLETED once it has all been written, TASK_CONTINUE if the client is not ready
+	for more, or TASK_ABANDONED on error.
+**************************************************************************************************/
+static taskexec_t
+axfr_flush(TASK *t, AXFR_XFER *x) {
+  int		rv = 0;
+
+  while (x->outoffset < x->outlen) {
+    if ((rv = write(t->fd, x->out + x->outoffset, x->outlen - x->outoffset)) < 0) {
+      if (
+	  (errno == EINTR)
+#ifdef EAGAIN
+	  || (errno == EAGAIN)
+#else
+#ifdef EWOULDBLOCK
+	  || (errno == EWOULDBLOCK)
+#endif
+#endif
+	  )
+	return (TASK_CONTINUE);				/* Try again when writable */
+      Warn(_("%s: %s"), desctask(t), _("write (AXFR)"));
+      return (TASK_ABANDONED);
+    }
+    if (rv == 0) {
+      Warnx(_("%s: %s"), desctask(t), _("client closed connection"));
+      return (TASK_ABANDONED);
+    }
+    x->outoffset += rv;
+    t->timeout = MIN(current_time + task_timeout, x->started + AXFR_TIME_LIMIT);
+  }
+  RELEASE(x->out);
+  x->outlen = x->outoffset = 0;
+  return (TASK_COMPLETED);
+}
+/*--- axfr_flush() ------------------------------------------------------------------------------*/
+
+
 /**************************************************************************************************
 	CHECK_XFER
 	If the "xfer" column exists in the soa table, it should contain a list of wildcards separated
 	by commas.  In order for this zone transfer to continue, one of the wildcards must match
 	the client's IP address.
+	Returns nonzero if the transfer may go ahead.
 **************************************************************************************************/
-static void
+static int
 check_xfer(TASK *t, MYDNS_SOA *soa) {
   SQL_RES	*res = NULL;
   SQL_ROW	row = NULL;
@@ -420,7 +593,7 @@ check_xfer(TASK *t, MYDNS_SOA *soa) {
   memset(&ip, 0, sizeof(ip));
 
   if (!mydns_soa_use_xfer)
-    return;
+    return (1);
 
   strncpy(ip, clientaddr(t), sizeof(ip)-1);
 
@@ -433,7 +606,8 @@ check_xfer(TASK *t, MYDNS_SOA *soa) {
   res = sql_query(sql, query, querylen);
   RELEASE(query);
   if (!res) {
-    ErrSQL(sql, "%s: %s", desctask(t), _("error loading zone transfer access rules"));
+    WarnSQL(sql, "%s: %s", desctask(t), _("error loading zone transfer access rules"));
+    return (0);
   }
 
   if ((row = sql_getrow(res, NULL))) {
@@ -449,11 +623,9 @@ check_xfer(TASK *t, MYDNS_SOA *soa) {
   }
   sql_free(res);
 
-  if (!ok) {
-    dnserror(t, DNS_RCODE_REFUSED, ERR_NO_AXFR);
-    axfr_reply(t);
-    axfr_error(t, _("access denied"));
-  }
+  if (!ok)
+    Verbose(_("%s: %s"), desctask(t), _("zone transfer access denied"));
+  return (ok);
 }
 /*--- check_xfer() ------------------------------------------------------------------------------*/
 
@@ -637,7 +809,7 @@ load_tsig_key_for_zone(TASK *t, const char *key_name) {
   size_t querylen = 0;
   tsig_key_t *key = NULL;
 
-  if (!key_name || !strlen(key_name))
+  if (!key_name || !strlen(key_name) || !sql)
     return NULL;
 
   /* Query tsig_keys table */
@@ -678,7 +850,7 @@ load_tsig_key_for_zone(TASK *t, const char *key_name) {
 	Verify TSIG signature in AXFR request.
 **************************************************************************************************/
 static tsig_key_t *
-verify_tsig_for_axfr(TASK *t) {
+verify_tsig_for_axfr(TASK *t, AXFR_XFER *x) {
   char key_name[256];
   unsigned char mac[64];
   size_t mac_len = 0;
@@ -718,9 +890,9 @@ verify_tsig_for_axfr(TASK *t) {
   }
 
   /* Store request MAC for response signing */
-  if (mac_len > 0 && mac_len <= sizeof(axfr_request_mac)) {
-    memcpy(axfr_request_mac, mac, mac_len);
-    axfr_request_mac_len = mac_len;
+  if (mac_len > 0 && mac_len <= sizeof(x->request_mac)) {
+    memcpy(x->request_mac, mac, mac_len);
+    x->request_mac_len = mac_len;
   }
 
   /* Verify MAC signature */
@@ -738,240 +910,474 @@ verify_tsig_for_axfr(TASK *t) {
 
 
 /**************************************************************************************************
-	AXFR_ZONE
-	DNS-based zone transfer.
+	AXFR_RR_SIZE
+	Returns an upper bound on the wire size of `rr', whose name already has the origin appended.
+	Names in the data may still need `originlen' octets of origin.
 **************************************************************************************************/
-static void
-axfr_zone(TASK *t, MYDNS_SOA *soa) {
+static size_t
+axfr_rr_size(MYDNS_RR *rr, size_t originlen) {
+  return (strlen(MYDNS_RR_NAME(rr)) + 2 + 10			/* Owner, type, class, TTL, rdlength */
+	  + MYDNS_RR_DATA_LENGTH(rr) + MYDNS_RR_DATA_LENGTH(rr) / 255	/* Data and string lengths */
+	  + 2 * (originlen + 2) + 16);				/* Origin for up to two names */
+}
+/*--- axfr_rr_size() ----------------------------------------------------------------------------*/
 
-  /* Check optional "xfer" column and initialize reply */
-  check_xfer(t, soa);
-  reply_init(t);
 
-  /* Send opening SOA record */
-  rrlist_add(t, ANSWER, DNS_RRTYPE_SOA, (void *)soa, soa->origin);
-  axfr_reply(t);
-
-  /*
-  **  Get all resource records for zone (if zone ID is nonzero, i.e. not manufactured)
-  **  and transmit each resource record.
-  */
-  if (soa->id) {
-    MYDNS_RR *ThisRR = NULL, *rr = NULL;
-
-    if (mydns_rr_load_active(sql, &ThisRR, soa->id, DNS_QTYPE_ANY, NULL, soa->origin) == 0) {
-      for (rr = ThisRR; rr; rr = rr->next) {
-	/* If 'name' doesn't end with a dot, append the origin */
-	if (!*MYDNS_RR_NAME(rr) || LASTCHAR(MYDNS_RR_NAME(rr)) != '.') {
-	  mydns_rr_name_append_origin(rr, soa->origin);
-	}
+/**************************************************************************************************
+	AXFR_SOA_FROM_MEM
+	Copies a memzone SOA into a new MYDNS_SOA, with the origin ending in a dot.
+**************************************************************************************************/
+static MYDNS_SOA *
+axfr_soa_from_mem(const mem_soa_t *m) {
+  MYDNS_SOA *soa = ALLOCATE(sizeof(MYDNS_SOA), MYDNS_SOA);
+
+  memset(soa, 0, sizeof(MYDNS_SOA));
+  soa->id = m->zone_id;
+  strncpy(soa->origin, m->origin, sizeof(soa->origin) - 2);
+  if (!*soa->origin || LASTCHAR(soa->origin) != '.')
+    strcat(soa->origin, ".");
+  strncpy(soa->ns, m->ns, sizeof(soa->ns) - 1);
+  strncpy(soa->mbox, m->mbox, sizeof(soa->mbox) - 1);
+  soa->serial = m->serial;
+  soa->refresh = m->refresh;
+  soa->retry = m->retry;
+  soa->expire = m->expire;
+  soa->minimum = m->minimum;
+  soa->ttl = m->ttl;
+  return (soa);
+}
+/*--- axfr_soa_from_mem() -----------------------------------------------------------------------*/
 
-#if ALIAS_ENABLED
-	/*
-	 * If we have been compiled with alias support
-	 * and the current record is an alias pass it to alias_recurse()
-	 */
-	if (rr->alias != 0)
-	  alias_recurse(t, ANSWER, MYDNS_RR_NAME(rr), soa, NULL, rr);
-	else
-#endif
-	  rrlist_add(t, ANSWER, DNS_RRTYPE_RR, (void *)rr, MYDNS_RR_NAME(rr));
-	/* Transmit this resource record */
-	axfr_reply(t);
-      }
-      mydns_rr_free(ThisRR);
-    }
-  }
 
-  /* Send closing SOA record */
-  rrlist_add(t, ANSWER, DNS_RRTYPE_SOA, (void *)soa, soa->origin);
-  axfr_reply(t);
+/**************************************************************************************************
+	AXFR_MEMZONE_NAME
+	Memzone origins may be stored with or without the trailing dot.  Returns the spelling of
+	`qname' that memzone holds, in `buf', or NULL if the zone is not in memory.
+	The caller must hold the memzone read lock.
+**************************************************************************************************/
+static char *
+axfr_memzone_name(const char *qname, char *buf, size_t size) {
+  size_t len = strlen(qname);
+
+  if (len >= size)
+    return (NULL);
+  strcpy(buf, qname);
+  if (memzone_find_zone_by_name(Memzone, buf))
+    return (buf);
+  if (len && buf[len - 1] == '.')
+    buf[len - 1] = '\0';
+  else if (len + 1 < size)
+    strcat(buf, ".");
+  return (memzone_find_zone_by_name(Memzone, buf) ? buf : NULL);
+}
+/*--- axfr_memzone_name() -----------------------------------------------------------------------*/
 
-  mydns_soa_free(soa);
+
+/**************************************************************************************************
+	AXFR_MEMZONE_SOA
+	Returns the SOA of `qname' if it is a slave zone held in memzone, or NULL.
+**************************************************************************************************/
+MYDNS_SOA *
+axfr_memzone_soa(const char *qname) {
+  char		name[DNS_MAXNAMELEN + 2];
+  zone_entry_t	*zone = NULL;
+  MYDNS_SOA	*soa = NULL;
+
+  if (!Memzone || !qname)
+    return (NULL);
+  memzone_read_lock(Memzone);
+  if (axfr_memzone_name(qname, name, sizeof(name))
+      && (zone = memzone_find_zone_by_name(Memzone, name)) && zone->soa)
+    soa = axfr_soa_from_mem(zone->soa);
+  memzone_read_unlock(Memzone);
+  return (soa);
 }
-/*--- axfr_zone() -------------------------------------------------------------------------------*/
+/*--- axfr_memzone_soa() ------------------------------------------------------------------------*/
 
 
 /**************************************************************************************************
-	AXFR_GET_SOA
-	Attempt to find a SOA record.  If SOA id is 0, we made it up.
+	AXFR_MEMZONE_ADD
+	memzone_walk_zone() callback.  Copies one record onto the snapshot.  Names in memzone are
+	fully qualified but lack the trailing dot.
 **************************************************************************************************/
-static MYDNS_SOA *
-axfr_get_soa(TASK *t) {
-  MYDNS_SOA *soa = NULL;
-
-  /* Try to load SOA */
-  if (mydns_soa_load(sql, &soa, t->qname) < 0)
-    ErrSQL(sql, "%s: %s", desctask(t), _("error loading zone"));
-  if (soa) {
-    return (soa);
-	}
-
-  /* STILL no SOA?  We aren't authoritative */
-  dnserror(t, DNS_RCODE_REFUSED, ERR_ZONE_NOT_FOUND);
-  axfr_reply(t);
-  axfr_error(t, _("unknown zone"));
-  /* NOTREACHED */
-  return (NULL);
+static int
+axfr_memzone_add(const mem_rr_t *m, void *arg) {
+  AXFR_SNAPSHOT	*snap = (AXFR_SNAPSHOT *)arg;
+  char		name[MEMZONE_NAME_MAX + 1];
+  MYDNS_RR	*rr = NULL;
+
+  snprintf(name, sizeof(name), "%s%s", m->name, (*m->name && LASTCHAR(m->name) == '.') ? "" : ".");
+  if (!(rr = mydns_rr_build((uint32_t)m->id, m->zone_id, m->type, DNS_CLASS_IN, m->aux, m->ttl,
+			    NULL, NULL, 0, name, (char *)m->data, strlen(m->data), snap->origin)))
+    return (0);						/* Skip a record that cannot be sent */
+  if (snap->tail)
+    snap->tail->next = rr;
+  else
+    snap->head = rr;
+  snap->tail = rr;
+  return (0);
 }
-/*--- axfr_get_soa() ----------------------------------------------------------------------------*/
+/*--- axfr_memzone_add() ------------------------------------------------------------------------*/
 
 
 /**************************************************************************************************
-	AXFR
-	DNS-based zone transfer.  Send all resource records for in QNAME's zone to the client.
+	AXFR_MEMZONE_SNAPSHOT
+	Copies the SOA and records of the zone out of memzone under one read lock, so the transfer
+	sends the zone exactly as it was at one serial even if mydns-xfer updates it meanwhile.
+	The snapshot's SOA replaces x->soa.  Returns 0 on success, -1 if the zone has gone.
 **************************************************************************************************/
-void
-axfr(TASK *t) {
+static int
+axfr_memzone_snapshot(TASK *t, AXFR_XFER *x) {
+  AXFR_SNAPSHOT	snap;
+  mem_soa_t	msoa;
+  char		name[DNS_MAXNAMELEN + 2];
+  struct timeval now;
+  int		count = -1;
+
+  memset(&snap, 0, sizeof(snap));
+  snap.origin = x->soa->origin;
+  gettimeofday(&x->memstart, NULL);
+
+  memzone_read_lock(Memzone);
+  if (axfr_memzone_name(x->soa->origin, name, sizeof(name)))
+    count = memzone_walk_zone(Memzone, name, &msoa, axfr_memzone_add, &snap);
+  memzone_read_unlock(Memzone);
+
+  if (count < 0) {
+    mydns_rr_free(snap.head);
+    Warnx(_("%s: %s"), desctask(t), _("zone left memory before AXFR could start"));
+    return (-1);
+  }
+  mydns_soa_free(x->soa);
+  x->soa = axfr_soa_from_mem(&msoa);
+  x->memrr = snap.head;
+
+  gettimeofday(&now, NULL);
+  x->snapshot_ms = (now.tv_sec - x->memstart.tv_sec) * 1000 + (now.tv_usec - x->memstart.tv_usec) / 1000;
 #if DEBUG_ENABLED && DEBUG_AXFR
-  struct timeval start = { 0, 0}, finish = { 0, 0 };	/* Time AXFR began and ended */
+  DebugX("axfr", 1,_("%s: AXFR snapshot of %s from memzone: %d records in %ld ms"),
+	 desctask(t), x->soa->origin, count, x->snapshot_ms);
 #endif
-  MYDNS_SOA *soa = NULL;				/* SOA record for zone (may be bogus!) */
+  return (0);
+}
+/*--- axfr_memzone_snapshot() -------------------------------------------------------------------*/
 
-  /* Do generic startup stuff; this is a child process */
-  signal(SIGALRM, axfr_timeout);
-  alarm(AXFR_TIME_LIMIT);
-  sql_close(sql);
-  db_connect();
 
-#if DEBUG_ENABLED && DEBUG_AXFR
-  gettimeofday(&start, NULL);
-  DebugX("axfr", 1,_("%s: Starting AXFR for task ID %u"), desctask(t), t->internal_id);
-#endif
-  total_records = total_octets = 0;
-  axfr_packet_count = 0;
-  axfr_request_mac_len = 0;
-  axfr_prev_mac_len = 0;
-  t->no_markers = 1;
+/**************************************************************************************************
+	AXFR_REPLAY_MESSAGE
+	Queues the next cached message, with the query ID, RD bit and question of this client.
+**************************************************************************************************/
+static void
+axfr_replay_message(TASK *t, AXFR_XFER *x) {
+  AXFR_RENDER	*r = x->replay;
+  int		n = x->replay_next++;
+  char		*msg = NULL, *dest = NULL, *src = NULL;
+  uint16_t	ancount = 0;
+
+  msg = ALLOCATE(r->lens[n], char[]);
+  memcpy(msg, r->msgs[n], r->lens[n]);
+  dest = msg;
+  DNS_PUT16(dest, t->id);					/* Query ID */
+  msg[2] = (msg[2] & ~0x01) | (t->hdr.rd ? 0x01 : 0x00);		/* RD is copied from the query */
+  if (n == 0 && r->qdlen)
+    memcpy(msg + DNS_HEADERSIZE, t->qd, r->qdlen);		/* Question as the client spelled it */
+  src = msg + 6;
+  DNS_GET16(ancount, src);					/* ANSWER count */
+
+  axfr_queue(t, x, msg, r->lens[n], ancount, (x->replay_next == r->count));
+  RELEASE(msg);
+}
+/*--- axfr_replay_message() ---------------------------------------------------------------------*/
 
-  /* Get SOA for zone */
-  soa = axfr_get_soa(t);
-
-  if (soa){
-    /* Verify TSIG if present */
-    axfr_tsig_key = verify_tsig_for_axfr(t);
-
-    if (tsig_enforce_axfr && !axfr_tsig_key) {
-      /* TSIG required but verification failed */
-      axfr_reply(t);
-      mydns_soa_free(soa);
-      if (axfr_tsig_key) {
-        tsig_key_free(axfr_tsig_key);
-        axfr_tsig_key = NULL;
+
+/**************************************************************************************************
+	AXFR_NEXT_MESSAGE
+	Fills the task with the records for the next message and queues it.
+	Records are read from the database a page at a time (or taken from the memzone snapshot) and
+	packed as many to a message as fit, so that names are compressed across the message and a
+	database zone is never held in memory.
+	Returns 0 on success, or -1 if the records could not be read.
+**************************************************************************************************/
+static int
+axfr_next_message(TASK *t, AXFR_XFER *x) {
+  MYDNS_SOA	*soa = x->soa;
+  MYDNS_RR	*rr = NULL;
+  size_t	originlen = strlen(soa->origin), size = 0;
+
+  if (x->replay) {
+    axfr_replay_message(t, x);
+    return (0);
+  }
+
+  while (x->held || x->memrr || x->stream) {
+    if ((rr = x->held))
+      x->held = NULL;
+    else if ((rr = x->memrr)) {
+      x->memrr = rr->next;
+      rr->next = NULL;
+    } else if (!(rr = mydns_rr_stream_next(x->stream))) {
+      if (x->stream->error) {
+	Warnx(_("%s: %s"), desctask(t), _("error reading zone for AXFR"));
+	return (-1);
       }
-      axfr_error(t, _("TSIG verification failed"));
-      /* NOTREACHED */
+      mydns_rr_stream_close(x->stream);
+      x->stream = NULL;
+      break;
+    } else if (!*MYDNS_RR_NAME(rr) || LASTCHAR(MYDNS_RR_NAME(rr)) != '.') {
+      /* If 'name' doesn't end with a dot, append the origin */
+      mydns_rr_name_append_origin(rr, soa->origin);
     }
 
-    /* Transfer that zone */
-    axfr_zone(t, soa);
-
-    /* Cleanup TSIG key */
-    if (axfr_tsig_key) {
-      tsig_key_free(axfr_tsig_key);
-      axfr_tsig_key = NULL;
+    /* Send what we have if this record would not fit */
+    size = axfr_rr_size(rr, originlen);
+    if (x->pending && (x->pending + size > AXFR_MESSAGE_SIZE)) {
+      x->held = rr;
+      axfr_reply(t, x, 0);
+      return (0);
     }
+    x->pending += size;
+
+#if ALIAS_ENABLED
+    /*
+     * If we have been compiled with alias support
+     * and the current record is an alias pass it to alias_recurse()
+     */
+    if (rr->alias != 0)
+      alias_recurse(t, ANSWER, MYDNS_RR_NAME(rr), soa, NULL, rr);
+    else
+#endif
+      rrlist_add(t, ANSWER, DNS_RRTYPE_RR, (void *)rr, MYDNS_RR_NAME(rr));
+    mydns_rr_free(rr);
+  }
+
+  /* Closing SOA record ends the last message */
+  if (x->pending && (x->pending + x->soasize > AXFR_MESSAGE_SIZE)) {
+    axfr_reply(t, x, 0);
+    return (0);
   }
+  rrlist_add(t, ANSWER, DNS_RRTYPE_SOA, (void *)soa, soa->origin);
+  axfr_reply(t, x, 1);
+  return (0);
+}
+/*--- axfr_next_message() -----------------------------------------------------------------------*/
 
+
+/**************************************************************************************************
+	AXFR_DONE
+	Logs the finished transfer.
+**************************************************************************************************/
+static void
+axfr_done(TASK *t, AXFR_XFER *x) {
 #if DEBUG_ENABLED && DEBUG_AXFR
-  /* Report result */
-  gettimeofday(&finish, NULL);
-  DebugX("axfr", 1,_("AXFR: %u records, %u octets, %.3fs"), 
-	 (unsigned int)total_records, (unsigned int)total_octets,
-	 ((finish.tv_sec + finish.tv_usec / 1000000.0) - (start.tv_sec + start.tv_usec / 1000000.0)));
+  DebugX("axfr", 1,_("AXFR: %u records, %u octets, %ds"),
+	 (unsigned int)x->total_records, (unsigned int)x->total_octets,
+	 (int)(current_time - x->started));
 #endif
+  MYDNS_PROBE3(axfr_done, t->internal_id, x->soa ? x->soa->origin : t->qname, x->total_records);
+  if (x->memzone) {
+    struct timeval now;
+    long ms = 0;
+
+    gettimeofday(&now, NULL);
+    ms = (now.tv_sec - x->memstart.tv_sec) * 1000 + (now.tv_usec - x->memstart.tv_usec) / 1000;
+    Verbose(_("%s: AXFR of %s from memory: %u records, %u octets in %ld ms (%lu records/s, snapshot %ld ms)"),
+	    desctask(t), x->soa->origin, (unsigned int)x->total_records, (unsigned int)x->total_octets,
+	    ms, (unsigned long)(x->total_records * 1000 / (ms ? ms : 1)), x->snapshot_ms);
+  }
   t->qdcount = 1;
-  t->an.size = total_records;
+  t->an.size = x->total_records;
   task_output_info(t, NULL);
-
-  sockclose(t->fd);
-
-  _exit(EXIT_SUCCESS);
+  t->an.size = 0;
 }
-/*--- axfr() ------------------------------------------------------------------------------------*/
+/*--- axfr_done() -------------------------------------------------------------------------------*/
 
-void
-axfr_fork(TASK *t) {
-  int pfd[2] = { -1, -1 };				/* Parent/child pipe descriptors */
-  pid_t pid = -1, parent = -1;
 
-#if DEBUG_ENABLED && DEBUG_AXFR 
-  DebugX("axfr", 1,_("%s: axfr_fork called on fd %d"), desctask(t), t->fd);
-#endif
+/**************************************************************************************************
+	AXFR_RUN
+	Sends the next part of the transfer once the client can take it.  Each call writes at most
+	one message, so transfers take turns with each other and with queries.
+**************************************************************************************************/
+static taskexec_t
+axfr_run(TASK *t, void *data) {
+  AXFR_XFER	*x = (AXFR_XFER *)data;
+  taskexec_t	res = TASK_FAILED;
+
+  if (current_time - x->started > AXFR_TIME_LIMIT) {
+    Warnx(_("%s: %s"), desctask(t), _("AXFR timed out"));
+    return (TASK_ABANDONED);
+  }
 
-  if (pipe(pfd))
-    Err(_("pipe"));
-  parent = getpid();
-  if ((pid = fork()) < 0) {
-    close(pfd[0]);
-    close(pfd[1]);
-    Warn(_("%s: fork"), clientaddr(t));
-    return;
+  if ((res = axfr_flush(t, x)) != TASK_COMPLETED)
+    return (res);
+  if (x->last) {
+    axfr_done(t, x);
+    return (TASK_COMPLETED);
+  }
+  if (axfr_next_message(t, x) < 0)
+    return (TASK_ABANDONED);
+  if ((res = axfr_flush(t, x)) == TASK_COMPLETED && x->last) {
+    axfr_done(t, x);
+    return (TASK_COMPLETED);
   }
+  return (res == TASK_ABANDONED ? TASK_ABANDONED : TASK_CONTINUE);
+}
+/*--- axfr_run() --------------------------------------------------------------------------------*/
 
-  if (!pid) {
-    /* Child: reset all signal handlers to default before we dive off elsewhere */
-    struct sigaction act;
 
-    memset(&act, 0, sizeof(act));
+/**************************************************************************************************
+	AXFR_TIMEDOUT
+	Called when a transfer has made no progress for `timeout' seconds or has run for
+	AXFR_TIME_LIMIT; the task is then dropped, and axfr_free() lets a waiting transfer start.
+**************************************************************************************************/
+static taskexec_t
+axfr_timedout(TASK *t, void *data) {
+  Warnx(_("%s: %s"), desctask(t), _("AXFR timed out"));
+  return (TASK_TIMED_OUT);
+}
+/*--- axfr_timedout() ---------------------------------------------------------------------------*/
+
 
-    sigemptyset(&act.sa_mask);
-    act.sa_flags = 0;
-    act.sa_handler = SIG_DFL;
+/**************************************************************************************************
+	AXFR_FREE
+	Releases the state of a transfer when its task is freed, and lets a waiting transfer start.
+**************************************************************************************************/
+static void
+axfr_free(TASK *t, void *data) {
+  AXFR_XFER	*x = (AXFR_XFER *)data;
+  TASK		*w = NULL;
+
+  mydns_rr_stream_close(x->stream);
+  mydns_rr_free(x->memrr);
+  axfr_render_free(x->render);
+  axfr_render_release(x->replay);
+  mydns_rr_free(x->held);
+  mydns_soa_free(x->soa);
+  if (x->tsig_key)
+    tsig_key_free(x->tsig_key);
+  RELEASE(x->out);
+  RELEASE(x->unsigned_msgs);
+
+  /* Transfers start in the order they were asked for */
+  axfr_active--;
+  for (w = TaskArray[IO_TASK][NORMAL_PRIORITY_TASK]->head; w; w = w->next)
+    if (w->status == NEED_AXFR_WAIT && w->timeout > current_time) {
+      w->status = NEED_AXFR;
+      break;
+    }
+}
+/*--- axfr_free() -------------------------------------------------------------------------------*/
 
-    sigaction(SIGHUP, &act, NULL);
-    sigaction(SIGUSR1, &act, NULL);
-    sigaction(SIGUSR2, &act, NULL);
-    sigaction(SIGALRM, &act, NULL);
-    sigaction(SIGCHLD, &act, NULL);
 
-    sigaction(SIGINT, &act, NULL);
-    sigaction(SIGQUIT, &act, NULL);
-    sigaction(SIGABRT, &act, NULL);
-    sigaction(SIGTERM, &act, NULL);
+/**************************************************************************************************
+	AXFR_START
+	DNS-based zone transfer.  Send all resource records for in QNAME's zone to the client.
+	Slave zones held in memzone are sent from memory, so a server with no database can still
+	feed further slaves.  The transfer runs as part of the task loop: the task waits until the socket is writable and
+	axfr_run() sends the next message.  No more than `axfr-max-transfers' run at once; others
+	wait their turn.
+**************************************************************************************************/
+taskexec_t
+axfr_start(TASK *t) {
+  AXFR_XFER	*x = NULL;
+  MYDNS_SOA	*soa = NULL;				/* SOA record for zone */
 
+  if (axfr_active >= axfr_max_transfers) {
 #if DEBUG_ENABLED && DEBUG_AXFR
-    DebugX("axfr", 1,_("%s: axfr_fork is in the child"), desctask(t));
+    DebugX("axfr", 1,_("%s: %d transfers running; AXFR waits"), desctask(t), axfr_active);
 #endif
-
-    /*  Let parent know I have started */
-    close(pfd[0]);
-    if (write(pfd[1], "OK", 2) != 2)
-      Warn(_("error writing startup notification"));
-    close(pfd[1]);
+    /* Dropped if no slot frees up within `timeout' seconds of the request */
+    t->status = NEED_AXFR_WAIT;
+    return (TASK_CONTINUE);
+  }
 
 #if DEBUG_ENABLED && DEBUG_AXFR
-    DebugX("axfr", 1,_("%s: axfr_fork child has told parent I am running"), desctask(t));
+  DebugX("axfr", 1,_("%s: Starting AXFR for task ID %u"), desctask(t), t->internal_id);
 #endif
+  x = ALLOCATE(sizeof(AXFR_XFER), AXFR_XFER);
+  memset(x, 0, sizeof(AXFR_XFER));
+  x->started = current_time;
+  axfr_active++;
+  task_add_extension(t, x, axfr_free, axfr_run, axfr_timedout);
+  t->status = NEED_TASK_WRITE;
+  t->timeout = current_time + task_timeout;
+  t->no_markers = 1;
+
+  /* Get SOA for zone */
+  if ((soa = axfr_memzone_soa(t->qname)))
+    x->memzone = 1;
+  else if (sql && mydns_soa_load(sql, &soa, t->qname) < 0) {
+    WarnSQL(sql, "%s: %s", desctask(t), _("error loading zone"));
+    return (TASK_ABANDONED);
+  }
+  if (!soa) {
+    /* We aren't authoritative */
+    dnserror(t, DNS_RCODE_REFUSED, ERR_ZONE_NOT_FOUND);
+    axfr_reply(t, x, 1);
+    return (TASK_CONTINUE);
+  }
+  x->soa = soa;
+  MYDNS_PROBE2(axfr_start, t->internal_id, soa->origin);
+
+  /* Verify TSIG if present */
+  x->tsig_key = verify_tsig_for_axfr(t, x);
+  if (tsig_enforce_axfr && !x->tsig_key) {
+    /* TSIG required but verification failed */
+    axfr_reply(t, x, 1);
+    return (TASK_CONTINUE);
+  }
 
-    /* Clean up parents resources */
-    free_other_tasks(t, 1);
+  /* Check optional "xfer" column, or the slave zone ACL when there is no database */
+  if (sql ? !check_xfer(t, soa)
+      : !memzone_check_dns_access(Memzone, ACL_TARGET_SLAVE, clientaddr(t), NULL, 0)) {
+    dnserror(t, DNS_RCODE_REFUSED, ERR_NO_AXFR);
+    axfr_reply(t, x, 1);
+    return (TASK_CONTINUE);
+  }
 
+  /* Replay the messages of an earlier transfer at this serial if we have them */
+  if (axfr_cache_size && soa->id && (x->replay = axfr_cache_find(soa->id, soa->serial))) {
+    if (x->replay->qdlen == t->qdlen) {
 #if DEBUG_ENABLED && DEBUG_AXFR
-    DebugX("axfr", 1,_("%s: AXFR child built"), desctask(t));
+      DebugX("axfr", 1,_("%s: AXFR replays %d cached messages"), desctask(t), x->replay->count);
 #endif
-    /* Do AXFR */
-    axfr(t);
-  } else {	/* Parent */
-    char	buf[5] = "\0\0\0\0\0";
-    int		errct = 0;
-
-    close(pfd[1]);
-
-    for (errct = 0; errct < 5; errct++) {
-      if (read(pfd[0], &buf, 4) != 2)
-	Warn(_("%s (%d of 5)"), _("error reading startup notification"), errct+1);
-      else
-	break;
+      axfr_replay_message(t, x);
+      return (TASK_CONTINUE);
     }
-    close(pfd[0]);
+    axfr_render_release(x->replay);
+    x->replay = NULL;
+  }
 
-#if DEBUG_ENABLED && DEBUG_AXFR
-    DebugX("axfr", 1,_("AXFR: process started on pid %d for TCP fd %d, task ID %u"), pid, t->fd, t->internal_id);
-#endif
+  /* Take the records now; the snapshot's SOA may be newer than the one checked above */
+  if (x->memzone) {
+    if (axfr_memzone_snapshot(t, x) < 0)
+      return (TASK_ABANDONED);
+    soa = x->soa;
+  }
+
+  /* Opening SOA record begins the first message */
+  reply_init(t);
+  x->soasize = strlen(soa->origin) + 2 + 10 + strlen(soa->ns) + strlen(soa->mbox)
+    + 2 * (strlen(soa->origin) + 2) + 24;
+  x->pending = x->soasize;
+  if (axfr_cache_size && soa->id) {
+    x->render = ALLOCATE(sizeof(AXFR_RENDER), AXFR_RENDER);
+    memset(x->render, 0, sizeof(AXFR_RENDER));
+    x->render->zone = soa->id;
+    x->render->serial = soa->serial;
+    x->render->qdlen = t->qdlen;
+  }
+  rrlist_add(t, ANSWER, DNS_RRTYPE_SOA, (void *)soa, soa->origin);
+
+  /* Read the records for the zone (if zone ID is nonzero, i.e. not manufactured) */
+  if (soa->id && !x->memzone && !(x->stream = mydns_rr_stream_active(sql, soa->id, soa->origin, AXFR_PAGE_SIZE))) {
+    WarnSQL(sql, "%s: %s", desctask(t), _("error loading zone"));
+    return (TASK_ABANDONED);
   }
-  /* NOTREACHED*/
+  if (axfr_next_message(t, x) < 0)
+    return (TASK_ABANDONED);
+  return (TASK_CONTINUE);
 }
+/*--- axfr_start() ------------------------------------------------------------------------------*/
 
 /* vi:set ts=3: */
 /* NEED_PO */
@@ -28,11 +28,16 @@
 
 CACHE *ZoneCache = NULL;							/* Data cache */
 CACHE *ReplyCache = NULL;							/* Reply cache */
+CACHE *AliasCache = NULL;							/* Flattened ALIAS/CNAME chain cache */
+CACHE *GlueCache = NULL;							/* Glue/ADDITIONAL address cache */
 
 #if USE_NEGATIVE_CACHE
 CACHE *NegativeCache = NULL;						/* Negative zone cache */
 #endif
 
+/* AliasCache and GlueCache nodes hold an ALIAS_CHAIN */
+#define	IS_CHAIN_CACHE(C)	((C) && ((C) == AliasCache || (C) == GlueCache))
+
 #ifdef DN_COLUMN_NAMES
 extern char	*dn_default_ns;						/* Default NS for directNIC */
 #endif
@@ -138,9 +143,11 @@ _cache_init(uint32_t limit, uint32_t expire, const char *desc) {
 **************************************************************************************************/
 void
 cache_init(void) {
-  uint32_t	cache_size = 0, zone_cache_size = 0, reply_cache_size = 0;
+  uint32_t	cache_size = 0, zone_cache_size = 0, reply_cache_size = 0, alias_cache_size = 0;
+  uint32_t	glue_cache_size = 0;
   int		defaulted = 0;
-  int		zone_cache_expire = 0, reply_cache_expire = 0;
+  int		zone_cache_expire = 0, reply_cache_expire = 0, alias_cache_expire = 0;
+  int		glue_cache_expire = 0;
 
   /* Get ZoneCache size */
   zone_cache_size = atou(conf_get(&Conf, "zone-cache-size", &defaulted));
@@ -162,6 +169,26 @@ cache_init(void) {
   if (defaulted)
     reply_cache_expire = atou(conf_get(&Conf, "cache-expire", NULL)) / 2;
 
+  /* Get AliasCache size */
+  alias_cache_size = atou(conf_get(&Conf, "alias-cache-size", &defaulted));
+  if (defaulted) {
+    cache_size = atou(conf_get(&Conf, "cache-size", NULL));
+    alias_cache_size = cache_size / 3;
+  }
+  alias_cache_expire = atou(conf_get(&Conf, "alias-cache-expire", &defaulted));
+  if (defaulted)
+    alias_cache_expire = atou(conf_get(&Conf, "cache-expire", NULL));
+
+  /* Get GlueCache size */
+  glue_cache_size = atou(conf_get(&Conf, "glue-cache-size", &defaulted));
+  if (defaulted) {
+    cache_size = atou(conf_get(&Conf, "cache-size", NULL));
+    glue_cache_size = cache_size / 3;
+  }
+  glue_cache_expire = atou(conf_get(&Conf, "glue-cache-expire", &defaulted));
+  if (defaulted)
+    glue_cache_expire = atou(conf_get(&Conf, "cache-expire", NULL));
+
   /* Initialize caches */
   if (zone_cache_size)
     ZoneCache = _cache_init(zone_cache_size, zone_cache_expire, "zone");
@@ -171,6 +198,10 @@ cache_init(void) {
 #endif
   if (reply_cache_size)
     ReplyCache = _cache_init(reply_cache_size, reply_cache_expire, "reply");
+  if (alias_cache_size)
+    AliasCache = _cache_init(alias_cache_size, alias_cache_expire, "alias");
+  if (glue_cache_size)
+    GlueCache = _cache_init(glue_cache_size, glue_cache_expire, "glue");
 }
 /*--- cache_init() ------------------------------------------------------------------------------*/
 
@@ -199,6 +230,17 @@ cache_size_update(CACHE *C) {
 	  else
 	    C->size += mydns_rr_size((MYDNS_RR *)N->data);
 	}
+      } else if (IS_CHAIN_CACHE(C)) {
+	register ALIAS_CHAIN_RR *r = NULL;
+
+	C->size += sizeof(ALIAS_CHAIN);
+	for (r = ((ALIAS_CHAIN *)N->data)->head; r; r = r->next) {
+	  C->size += sizeof(ALIAS_CHAIN_RR) + strlen(r->name) + 1;
+	  if (r->rrtype == DNS_RRTYPE_SOA)
+	    C->size += mydns_soa_size((MYDNS_SOA *)r->rr);
+	  else
+	    C->size += mydns_rr_size((MYDNS_RR *)r->rr);
+	}
       } else 
 	C->size += N->datalen;
     }
@@ -308,7 +350,9 @@ cache_free_node(CACHE *ThisCache, uint32_t hash, CNODE *n) {
       mrulist_del(ThisCache, n);				/* Remove from MRU/LRU list */
 
       /* Remove the node */
-      if (cur->datalen) {
+      if (IS_CHAIN_CACHE(ThisCache)) {
+	alias_chain_free((ALIAS_CHAIN *)cur->data);
+      } else if (cur->datalen) {
 	RELEASE(cur->data);
       }	else if (cur->type == DNS_QTYPE_SOA) {
 	mydns_soa_free(cur->data);
@@ -378,6 +422,7 @@ cache_cleanup(CACHE *ThisCache) {
 /**************************************************************************************************
 	CACHE_PURGE_ZONE
 	Deletes all nodes within the cache for the specified zone.
+	Flattened chains are deleted if any link in the chain lives in the zone.
 **************************************************************************************************/
 void
 cache_purge_zone(CACHE *ThisCache, uint32_t zone) {
@@ -391,11 +436,172 @@ cache_purge_zone(CACHE *ThisCache, uint32_t zone) {
       tmp = n->next_node;
       if (n->zone == zone)
 	cache_free_node(ThisCache, ct, n);
+      else if (!IS_CHAIN_CACHE(ThisCache) && n->type == DNS_QTYPE_SOA && !n->datalen && n->data
+	       && ((MYDNS_SOA *)n->data)->id == zone)
+	cache_free_node(ThisCache, ct, n);			/* SOAs are cached under zone 0 */
+      else if (IS_CHAIN_CACHE(ThisCache)) {
+	register ALIAS_CHAIN *chain = (ALIAS_CHAIN *)n->data;
+	register int link = 0;
+
+	for (link = 0; link < chain->nlinks; link++)
+	  if (chain->links[link] == zone) {
+	    cache_free_node(ThisCache, ct, n);
+	    break;
+	  }
+      }
     }
 }
 /*--- cache_purge_zone() ------------------------------------------------------------------------*/
 
 
+/**************************************************************************************************
+	CACHE_NAME_MATCHES
+	Compares two domain names, ignoring case and any trailing dot.  `a' is `alen' bytes.
+**************************************************************************************************/
+static int
+cache_name_matches(const char *a, size_t alen, const char *b) {
+  size_t blen = strlen(b);
+
+  if (alen && a[alen - 1] == '.')
+    alen--;
+  if (blen && b[blen - 1] == '.')
+    blen--;
+  return (alen == blen && !strncasecmp(a, b, alen));
+}
+/*--- cache_name_matches() ----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CACHE_QD_MATCHES
+	Does the question section `qd' ask about `fqdn'?
+**************************************************************************************************/
+static int
+cache_qd_matches(const unsigned char *qd, size_t qdlen, const char *fqdn) {
+  const unsigned char	*q = qd, *end = qd + qdlen;
+  const char		*f = fqdn;
+  size_t		len = 0;
+
+  if (f[0] == '.' && !f[1])
+    f++;
+  while (q < end && *q) {
+    len = *q++;
+    if (q + len > end || strncasecmp((const char *)q, f, len) || (f[len] != '.' && f[len]))
+      return (0);
+    q += len;
+    f += len;
+    if (*f == '.')
+      f++;
+  }
+  return (q < end && !*f);
+}
+/*--- cache_qd_matches() ------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CACHE_PURGE_NAME
+	Deletes all nodes within the cache for `fqdn', which is `label' in `zone' (zone 0 if it
+	is in none of ours).  Flattened chains are deleted if they start at or pass through it.
+**************************************************************************************************/
+void
+cache_purge_name(CACHE *ThisCache, uint32_t zone, const char *label, const char *fqdn) {
+  register uint		ct = 0;
+  register CNODE	*n = NULL, *tmp = NULL;
+  size_t		labellen = strlen(label);
+
+  if (!ThisCache)
+    return;
+  for (ct = 0; ct < ThisCache->slots; ct++)
+    for (n = ThisCache->nodes[ct]; n; n = tmp) {
+      int purge = 0;
+
+      tmp = n->next_node;
+      if (IS_CHAIN_CACHE(ThisCache)) {
+	register ALIAS_CHAIN_RR *crr = NULL;
+
+	purge = cache_name_matches(n->name, n->namelen, fqdn);
+	for (crr = ((ALIAS_CHAIN *)n->data)->head; crr && !purge; crr = crr->next)
+	  purge = crr->name && cache_name_matches(crr->name, strlen(crr->name), fqdn);
+      } else if (ThisCache == ReplyCache)
+	purge = cache_qd_matches((unsigned char *)n->name, n->namelen, fqdn);
+      else if (n->type == DNS_QTYPE_SOA && !n->zone)
+	purge = cache_name_matches(n->name, n->namelen, fqdn);
+      else
+	purge = (zone && n->zone == zone && n->namelen == labellen
+		 && !strncasecmp(n->name, label, labellen));
+      if (purge)
+	cache_free_node(ThisCache, ct, n);
+    }
+}
+/*--- cache_purge_name() ------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CACHE_FLUSH
+	Empties every cache.
+**************************************************************************************************/
+void
+cache_flush(void) {
+  cache_empty(ZoneCache);
+#if USE_NEGATIVE_CACHE
+  cache_empty(NegativeCache);
+#endif
+  cache_empty(ReplyCache);
+  cache_empty(AliasCache);
+  cache_empty(GlueCache);
+}
+/*--- cache_flush() -----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CACHE_FLUSH_ZONE
+	Deletes everything cached for `zone' from every cache.
+**************************************************************************************************/
+void
+cache_flush_zone(uint32_t zone) {
+  cache_purge_zone(ZoneCache, zone);
+#if USE_NEGATIVE_CACHE
+  cache_purge_zone(NegativeCache, zone);
+#endif
+  cache_purge_zone(ReplyCache, zone);
+  cache_purge_zone(AliasCache, zone);
+  cache_purge_zone(GlueCache, zone);
+}
+/*--- cache_flush_zone() ------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CACHE_FLUSH_NAME
+	Deletes everything cached for `fqdn' from every cache.  `zone' and `origin' are the zone
+	it is in, or 0 and NULL if it is in none of ours.
+**************************************************************************************************/
+void
+cache_flush_name(uint32_t zone, const char *origin, const char *fqdn) {
+  char	label[DNS_MAXNAMELEN + 1];
+  int	len = 0;
+
+  /* The label part of `fqdn' below `origin', as find_soa() stores it */
+  label[0] = '\0';
+  if (zone && origin) {
+    len = strlen(fqdn) - strlen(origin) - 1;
+    if (strlen(origin) == 1)
+      len++;
+    if (len < 0) len = 0;
+    if (len > DNS_MAXNAMELEN) len = DNS_MAXNAMELEN;
+    memcpy(label, fqdn, len);
+    label[len] = '\0';
+  }
+
+  cache_purge_name(ZoneCache, zone, label, fqdn);
+#if USE_NEGATIVE_CACHE
+  cache_purge_name(NegativeCache, zone, label, fqdn);
+#endif
+  cache_purge_name(ReplyCache, zone, label, fqdn);
+  cache_purge_name(AliasCache, zone, label, fqdn);
+  cache_purge_name(GlueCache, zone, label, fqdn);
+}
+/*--- cache_flush_name() ------------------------------------------------------------------------*/
+
+
 /**************************************************************************************************
 	CACHE_HASH
 	Returns hash value.
@@ -496,6 +702,7 @@ zone_cache_find(TASK *t, uint32_t zone, char *origin, dns_qtype_t type,
 	      break;
 	    }
 	    NegativeCache->hits++;
+	    MYDNS_PROBE4(cache_hit, NegativeCache->name, t ? t->internal_id : 0, name, type);
 
 	    /* Found in cache; move to head of usefulness list */
 	    mrulist_del(NegativeCache, n);
@@ -504,6 +711,7 @@ zone_cache_find(TASK *t, uint32_t zone, char *origin, dns_qtype_t type,
 	  }
 	}
       NegativeCache->misses++;
+      MYDNS_PROBE4(cache_miss, NegativeCache->name, t ? t->internal_id : 0, name, type);
     }
 #endif
 
@@ -522,6 +730,7 @@ zone_cache_find(TASK *t, uint32_t zone, char *origin, dns_qtype_t type,
 	    break;
 	  }
 	  ZoneCache->hits++;
+	  MYDNS_PROBE4(cache_hit, ZoneCache->name, t ? t->internal_id : 0, name, type);
 
 	  /* Found in cache; move to head of usefulness list */
 	  mrulist_del(ZoneCache, n);
@@ -533,6 +742,7 @@ zone_cache_find(TASK *t, uint32_t zone, char *origin, dns_qtype_t type,
 	}
       }
     }
+    MYDNS_PROBE4(cache_miss, ZoneCache->name, t ? t->internal_id : 0, name, type);
   }
 
   /* Result not found in cache; Get answer from database OR memzone */
@@ -631,7 +841,7 @@ cache_soa:
             ((char*)new_rr->_data.value)[data_len] = '\0';
             new_rr->aux = results[i]->aux;
             new_rr->ttl = results[i]->ttl;
-            new_rr->active = STRDUP("Y");
+            new_rr->flags = MYDNS_RR_ACTIVE;
             new_rr->stamp = NULL;
             new_rr->serial = 0;
             new_rr->next = NULL;
@@ -809,12 +1019,14 @@ reply_cache_find(TASK *t) {
 
 	t->reply_from_cache = 1;
 	ReplyCache->hits++;
+	MYDNS_PROBE4(cache_hit, ReplyCache->name, t->internal_id, t->qname, t->qtype);
 
 	return (1);
       }
     }
   }
   ReplyCache->misses++;
+  MYDNS_PROBE4(cache_miss, ReplyCache->name, t->internal_id, t->qname, t->qtype);
   return (0);
 }
 /*--- reply_cache_find() ------------------------------------------------------------------------*/
@@ -976,5 +1188,220 @@ add_reply_to_cache(TASK *t) {
 }
 /*--- add_reply_to_cache() ----------------------------------------------------------------------*/
 
+
+/**************************************************************************************************
+	ALIAS_CHAIN_NEW
+	Creates an empty flattened chain.
+**************************************************************************************************/
+ALIAS_CHAIN *
+alias_chain_new(void) {
+  ALIAS_CHAIN *chain = ALLOCATE(sizeof(ALIAS_CHAIN), ALIAS_CHAIN);
+
+  memset(chain, 0, sizeof(ALIAS_CHAIN));
+  chain->ttl = (uint32_t)-1;
+  return (chain);
+}
+/*--- alias_chain_new() -------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	ALIAS_CHAIN_FREE
+	Frees a flattened chain and the records it holds.
+**************************************************************************************************/
+void
+alias_chain_free(ALIAS_CHAIN *chain) {
+  register ALIAS_CHAIN_RR *r = NULL, *next = NULL;
+
+  if (!chain)
+    return;
+  for (r = chain->head; r; r = next) {
+    next = r->next;
+    if (r->rrtype == DNS_RRTYPE_SOA) {
+      mydns_soa_free(r->rr);
+    } else {
+      mydns_rr_free(r->rr);
+    }
+    RELEASE(r->name);
+    RELEASE(r);
+  }
+  RELEASE(chain);
+}
+/*--- alias_chain_free() ------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	ALIAS_CHAIN_ADD_LINK
+	Records that the chain depends on `zone'.
+	Returns 0 if the chain touches too many zones to be cached.
+**************************************************************************************************/
+int
+alias_chain_add_link(ALIAS_CHAIN *chain, uint32_t zone) {
+  register int n = 0;
+
+  for (n = 0; n < chain->nlinks; n++)
+    if (chain->links[n] == zone)
+      return (1);
+  if (chain->nlinks >= ALIAS_CHAIN_MAX_LINKS)
+    return (0);
+  chain->links[chain->nlinks++] = zone;
+  return (1);
+}
+/*--- alias_chain_add_link() --------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	ALIAS_CHAIN_ADD_RR
+	Appends a copy of `rr' to the chain, tracking its zone and TTL.
+	Returns 0 (and marks the chain uncacheable) if the record has no TTL or the chain touches
+	too many zones.
+**************************************************************************************************/
+int
+alias_chain_add_rr(ALIAS_CHAIN *chain, datasection_t section, dns_rrtype_t rrtype, void *rr,
+		   const char *name, uint8_t sort_level) {
+  ALIAS_CHAIN_RR *new = NULL;
+  uint32_t zone = 0, ttl = 0;
+  int cacheable = 1;
+
+  if (rrtype == DNS_RRTYPE_SOA) {
+    zone = ((MYDNS_SOA *)rr)->id;
+    ttl = ((MYDNS_SOA *)rr)->ttl;
+  } else {
+    zone = ((MYDNS_RR *)rr)->zone;
+    ttl = ((MYDNS_RR *)rr)->ttl;
+  }
+  if (!ttl || !alias_chain_add_link(chain, zone)) {
+    chain->ttl = 0;
+    cacheable = 0;
+  } else if (ttl < chain->ttl)
+    chain->ttl = ttl;
+
+  new = ALLOCATE(sizeof(ALIAS_CHAIN_RR), ALIAS_CHAIN_RR);
+  new->section = section;
+  new->rrtype = rrtype;
+  if (rrtype == DNS_RRTYPE_SOA)
+    new->rr = mydns_soa_dup((MYDNS_SOA *)rr, 0);
+  else
+    new->rr = mydns_rr_dup((MYDNS_RR *)rr, 0);
+  new->name = STRDUP(name);
+  new->sort_level = sort_level;
+  new->next = NULL;
+
+  if (!chain->head)
+    chain->head = chain->tail = new;
+  else {
+    chain->tail->next = new;
+    chain->tail = new;
+  }
+  return (cacheable);
+}
+/*--- alias_chain_add_rr() ----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CHAIN_CACHE_FIND
+	Looks up the flattened chain for `name'/`type' in AliasCache or GlueCache.
+	The chain returned belongs to the cache and is only valid until the cache is next modified.
+**************************************************************************************************/
+ALIAS_CHAIN *
+chain_cache_find(CACHE *C, TASK *t, const char *name, dns_qtype_t type) {
+  register uint32_t	hash = 0;
+  register CNODE	*n = NULL;
+  register size_t	namelen = 0;
+
+  if (!C || !name)
+    return (NULL);
+
+  namelen = strlen(name);
+  hash = cache_hash(C, type, (void *)name, namelen);
+  C->questions++;
+
+  for (n = C->nodes[hash]; n; n = n->next_node)
+    if ((n->namelen == namelen) && (n->type == type) && !memcmp(n->name, name, namelen)) {
+      /* Is the node expired? */
+      if (n->expire && (current_time > n->expire)) {
+	C->expired++;
+	cache_free_node(C, hash, n);
+	break;
+      }
+      C->hits++;
+      MYDNS_PROBE4(cache_hit, C->name, t ? t->internal_id : 0, name, type);
+
+      /* Found in cache; move to head of usefulness list */
+      mrulist_del(C, n);
+      mrulist_add(C, n);
+#if DEBUG_ENABLED && DEBUG_CACHE
+      DebugX("cache", 1, _("%s: %s cache hit for %s %s"), desctask(t), C->name, mydns_qtype_str(type), name);
+#endif
+      return ((ALIAS_CHAIN *)n->data);
+    }
+  C->misses++;
+  MYDNS_PROBE4(cache_miss, C->name, t ? t->internal_id : 0, name, type);
+  return (NULL);
+}
+/*--- chain_cache_find() ------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CHAIN_CACHE_ADD
+	Inserts `chain' for `name'/`type' into AliasCache or GlueCache.  The cache takes ownership
+	of `chain', which is freed straight away if it is not cacheable.  The entry expires after
+	the lowest TTL seen along the chain.
+**************************************************************************************************/
+void
+chain_cache_add(CACHE *C, TASK *t, const char *name, dns_qtype_t type, ALIAS_CHAIN *chain) {
+  register uint32_t	hash = 0;
+  register CNODE	*n = NULL;
+  register size_t	namelen = 0;
+
+  if (!C || !chain->head || !chain->ttl || (namelen = strlen(name)) > DNS_MAXNAMELEN) {
+    alias_chain_free(chain);
+    return;
+  }
+  hash = cache_hash(C, type, (void *)name, namelen);
+
+  /* Replace any existing entry */
+  for (n = C->nodes[hash]; n; n = n->next_node)
+    if ((n->namelen == namelen) && (n->type == type) && !memcmp(n->name, name, namelen)) {
+      cache_free_node(C, hash, n);
+      break;
+    }
+
+  /* If the cache is full, delete the least recently used node */
+  if (C->count >= C->limit) {
+    if (!C->mruTail) {
+      alias_chain_free(chain);
+      return;
+    }
+    C->removed++;
+    C->removed_secs += current_time - C->mruTail->insert_time;
+    cache_free_node(C, C->mruTail->hash, C->mruTail);
+  }
+
+  C->in++;
+  n = ALLOCATE(sizeof(CNODE), CNODE);
+  memset(n, 0, sizeof(CNODE));
+  n->hash = hash;
+  n->zone = chain->links[0];
+  n->type = type;
+  memcpy(n->name, name, namelen);
+  n->namelen = namelen;
+  n->data = chain;
+  n->insert_time = current_time;
+  if (chain->ttl < (uint32_t)C->expire)
+    n->expire = current_time + chain->ttl;
+  else if (C->expire)
+    n->expire = current_time + C->expire;
+  n->next_node = C->nodes[hash];
+  C->nodes[hash] = n;
+  C->count++;
+  mrulist_add(C, n);
+
+#if DEBUG_ENABLED && DEBUG_CACHE
+  DebugX("cache", 1, _("%s: %s cache add %s %s (%d zones, ttl %u)"), desctask(t), C->name,
+	 mydns_qtype_str(type), name, chain->nlinks, chain->ttl);
+#endif
+}
+/*--- chain_cache_add() -------------------------------------------------------------------------*/
+
 /* vi:set ts=3: */
 /* NEED_PO */
@@ -97,8 +97,38 @@ typedef struct _cache								/* A cache */
 } CACHE;
 
 
+/* Maximum number of distinct zones a flattened ALIAS/CNAME chain may touch and still be cached */
+#define	ALIAS_CHAIN_MAX_LINKS	16
+
+typedef struct _alias_chain_rr							/* A record captured from a resolved chain */
+{
+	datasection_t	section;					/* Section the record was added to */
+	dns_rrtype_t	rrtype;						/* DNS_RRTYPE_RR or DNS_RRTYPE_SOA */
+	void			*rr;						/* Private copy of the record */
+	char			*name;						/* Name sent with the record */
+	uint8_t		sort_level;					/* Sort level, relative to the start of the chain */
+
+	struct _alias_chain_rr *next;
+} ALIAS_CHAIN_RR;
+
+typedef struct _alias_chain							/* A flattened ALIAS/CNAME chain */
+{
+	uint32_t		zone;						/* Zone the chain ends in */
+	uint32_t		minimum_ttl;					/* Minimum TTL of that zone */
+	uint32_t		ttl;						/* Lowest TTL found along the chain */
+	uint8_t		sort_levels;					/* Sort levels consumed by the chain */
+
+	uint32_t		links[ALIAS_CHAIN_MAX_LINKS];			/* Every zone the chain passes through */
+	int			nlinks;
+
+	ALIAS_CHAIN_RR	*head, *tail;					/* Records, in the order they were added */
+} ALIAS_CHAIN;
+
+
 extern CACHE *ZoneCache;							/* Zone cache */
 extern CACHE *ReplyCache;							/* Reply cache */
+extern CACHE *AliasCache;							/* Flattened ALIAS/CNAME chain cache */
+extern CACHE *GlueCache;							/* Glue/ADDITIONAL address cache */
 
 #if USE_NEGATIVE_CACHE
 extern CACHE *NegativeCache;						/* Negative zone cache */
@@ -107,11 +137,21 @@ extern CACHE *NegativeCache;						/* Negative zone cache */
 extern void cache_status(CACHE *);
 extern void cache_init(void), cache_empty(CACHE *), cache_cleanup(CACHE *);
 extern void cache_purge_zone(CACHE *, uint32_t);
+extern void cache_purge_name(CACHE *, uint32_t, const char *, const char *);
+extern void cache_flush(void), cache_flush_zone(uint32_t);
+extern void cache_flush_name(uint32_t, const char *, const char *);
 extern void *zone_cache_find(TASK *, uint32_t, char *, dns_qtype_t, const char *, size_t, int *, MYDNS_SOA *);
 
 extern int  reply_cache_find(TASK *);
 extern void add_reply_to_cache(TASK *);
 
+extern ALIAS_CHAIN *alias_chain_new(void);
+extern void alias_chain_free(ALIAS_CHAIN *);
+extern int  alias_chain_add_link(ALIAS_CHAIN *, uint32_t);
+extern int  alias_chain_add_rr(ALIAS_CHAIN *, datasection_t, dns_rrtype_t, void *, const char *, uint8_t);
+extern ALIAS_CHAIN *chain_cache_find(CACHE *, TASK *, const char *, dns_qtype_t);
+extern void chain_cache_add(CACHE *, TASK *, const char *, dns_qtype_t, ALIAS_CHAIN *);
+
 
 #endif /* _CACHE_H */
 
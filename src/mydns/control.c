@@ -0,0 +1,434 @@
+/**************************************************************************************************
+	Copyright (C) 2002-2005  Don Moore <bboy@bboy.net>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at Your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+**************************************************************************************************/
+
+/*
+**  Control socket.
+**
+**  The master accepts commands, one to a line, on the UNIX socket `control-socket':
+**
+**	FLUSH			Empty every cache
+**	FLUSH ZONE <zone>	Drop everything cached for a zone, given by origin or id
+**	FLUSH NAME <name>	Drop everything cached for one name
+**	RELOAD			As FLUSH, and check the optional tables again (as for SIGHUP)
+**	RELOAD ZONE <zone>	As FLUSH ZONE, and look up the zone's slaves again
+**
+**  Zones and names are looked up once, by the master, and the command is passed to every
+**  server over its comms socket.  Each acts on it and says so, and when all have the
+**  master answers `OK <acked>/<servers>'.  Any that have not within CONTROL_ACK_TIMEOUT
+**  seconds get `PARTIAL' instead, and a command that cannot be run gets `ERROR <why>'.
+*/
+
+#include "named.h"
+
+#include <sys/un.h>
+
+/* Make this nonzero to enable debugging for this source file */
+#define	DEBUG_CONTROL	1
+
+#define CONTROL_MAX_CONNECTIONS	8				/* Concurrent control connections */
+#define CONTROL_TIMEOUT		30				/* Seconds a connection may sit idle */
+#define CONTROL_ACK_TIMEOUT	5				/* Seconds to wait for the servers */
+#define CONTROL_LINE_MAX	1024				/* Longest command line read */
+
+typedef struct _control_conn {					/* One connection to the control socket */
+  TASK		*t;
+  char		in[CONTROL_LINE_MAX];
+  size_t	inlen;
+  int		eof;						/* Client has finished sending */
+  char		out[128];
+  size_t	outlen, offset;
+  uint32_t	seq;						/* Command the servers are acting on */
+  int		expected, acked;
+  struct _control_conn *next;					/* Next connection in `Waiting' */
+} CONTROL_CONN;
+
+static const struct {
+  const char		*name;
+  control_action_t	action;
+  int			arg;					/* Takes a zone (1) or name (2) */
+} control_commands[] = {
+  { "FLUSH ZONE",	CONTROL_FLUSH_ZONE,	1 },
+  { "FLUSH NAME",	CONTROL_FLUSH_NAME,	2 },
+  { "FLUSH",		CONTROL_FLUSH,		0 },
+  { "RELOAD ZONE",	CONTROL_RELOAD_ZONE,	1 },
+  { "RELOAD",		CONTROL_RELOAD,		0 },
+  { NULL,		0,			0 }
+};
+
+static int		ListenFd = -1;
+static int		Connections = 0;
+static uint32_t		Seq = 0;
+static CONTROL_CONN	*Waiting = NULL;			/* Connections waiting on the servers */
+
+static taskexec_t	control_accept(TASK *, void *);
+
+
+/**************************************************************************************************
+	CONTROL_INIT
+	Binds `control-socket' and starts accepting commands.  Called before privileges are
+	dropped; the servers drop the listening task along with the master's others.
+**************************************************************************************************/
+void
+control_init(void) {
+  struct sockaddr_un	sun;
+  mode_t		mask = 0;
+  TASK			*t = NULL;
+
+  if (!control_socket || !control_socket[0])
+    return;
+
+  memset(&sun, 0, sizeof(sun));
+  if (strlen(control_socket) >= sizeof(sun.sun_path)) {
+    Warnx("%s: `%s': %s", "control-socket", control_socket, _("path too long"));
+    return;
+  }
+  sun.sun_family = AF_UNIX;
+  strcpy(sun.sun_path, control_socket);
+
+  if ((ListenFd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+    Warn(_("control_init: socket failed"));
+    return;
+  }
+  unlink(control_socket);
+  mask = umask(0077);						/* Only our own user may connect */
+  if (bind(ListenFd, (struct sockaddr *)&sun, sizeof(sun)) < 0 || listen(ListenFd, SOMAXCONN) < 0) {
+    umask(mask);
+    Warn(_("control_init: cannot listen on %s"), control_socket);
+    close(ListenFd);
+    ListenFd = -1;
+    return;
+  }
+  umask(mask);
+  fcntl(ListenFd, F_SETFL, fcntl(ListenFd, F_GETFL, 0) | O_NONBLOCK);
+
+  t = IOtask_init(HIGH_PRIORITY_TASK, NEED_TASK_READ, ListenFd, SOCK_STREAM, AF_UNIX, NULL);
+  task_add_extension(t, NULL, NULL, control_accept, NULL);
+  Verbose(_("accepting control commands on %s"), control_socket);
+}
+/*--- control_init() ----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CONTROL_RUN
+	Acts on a control command in this process.  `zone' and `origin' are the zone the command
+	is for, if any, and `name' the name; `origin' is NULL if the name is in none of ours.
+**************************************************************************************************/
+void
+control_run(control_action_t action, uint32_t zone, const char *origin, const char *name) {
+  switch (action) {
+  case CONTROL_FLUSH:
+  case CONTROL_RELOAD:
+    cache_flush();
+    if (DnsCache)
+      dnscache_clear(DnsCache);
+    if (action == CONTROL_RELOAD)
+      db_check_optional();
+    break;
+
+  case CONTROL_FLUSH_ZONE:
+  case CONTROL_RELOAD_ZONE:
+    cache_flush_zone(zone);
+    if (action == CONTROL_RELOAD_ZONE)
+      notify_forget_slaves(zone);
+    break;
+
+  case CONTROL_FLUSH_NAME:
+    if (name)
+      cache_flush_name(origin ? zone : 0, origin, name);
+    break;
+  }
+}
+/*--- control_run() -----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CONTROL_REPLY
+	Sets the answer to the command `c' is on, and stops it waiting for the servers.
+**************************************************************************************************/
+static void
+control_reply(CONTROL_CONN *c, const char *fmt, ...) {
+  CONTROL_CONN	**p = NULL;
+  va_list	ap;
+  int		len = 0;
+
+  for (p = &Waiting; *p; p = &(*p)->next)
+    if (*p == c) {
+      *p = c->next;
+      break;
+    }
+  c->next = NULL;
+
+  va_start(ap, fmt);
+  len = vsnprintf(c->out, sizeof(c->out) - 1, fmt, ap);
+  va_end(ap);
+  if (len < 0 || len > (int)sizeof(c->out) - 2)
+    len = sizeof(c->out) - 2;
+  c->out[len++] = '\n';
+  c->outlen = len;
+  c->offset = 0;
+
+  c->t->status = NEED_COMMAND_WRITE;
+  c->t->timeout = current_time + CONTROL_TIMEOUT;
+}
+/*--- control_reply() ---------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CONTROL_ACKED
+	Counts a server's acknowledgement of command `seq'.
+**************************************************************************************************/
+void
+control_acked(uint32_t seq) {
+  CONTROL_CONN *c = NULL;
+
+  for (c = Waiting; c; c = c->next)
+    if (c->seq == seq) {
+      if (++c->acked >= c->expected)
+	control_reply(c, "OK %d/%d", c->acked, c->expected);
+      return;
+    }
+}
+/*--- control_acked() ---------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CONTROL_FIND_ZONE
+	Looks up the zone `name' is in, or that is `name' if `walk' is 0.  A zone may also be
+	given by id.  Returns 1 and fills in `id' and `origin' if found, 0 if not, -1 on error.
+**************************************************************************************************/
+static int
+control_find_zone(const char *name, int walk, uint32_t *id, char *origin) {
+  char		fqdn[DNS_MAXNAMELEN + 2], *suffix = NULL;
+  MYDNS_SOA	*soa = NULL;
+
+  if (!walk && strspn(name, "0123456789") == strlen(name)) {
+    *id = atou(name);
+    strcpy(origin, "-");
+    return (*id ? 1 : 0);
+  }
+
+  if (strlen(name) > DNS_MAXNAMELEN)
+    return (0);
+  strcpy(fqdn, name);
+  if (!fqdn[0] || fqdn[strlen(fqdn) - 1] != '.')
+    strcat(fqdn, ".");
+
+  /* Try each parent in turn, as find_soa() does */
+  for (suffix = fqdn; *suffix; ) {
+    if (!(soa = axfr_memzone_soa(suffix)) && sql && mydns_soa_load(sql, &soa, suffix) < 0) {
+      WarnSQL(sql, _("error loading SOA for %s"), suffix);
+      return (-1);
+    }
+    if (soa) {
+      *id = soa->id;
+      strcpy(origin, soa->origin);
+      mydns_soa_free(soa);
+      return (1);
+    }
+    if (!walk || !(suffix = strchr(suffix, '.')))
+      break;
+    suffix++;
+  }
+  return (0);
+}
+/*--- control_find_zone() -----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CONTROL_COMMAND
+	Runs the command `line' from `c', either here or by passing it to the servers.
+**************************************************************************************************/
+static void
+control_command(CONTROL_CONN *c, char *line) {
+  char		*arg = NULL, origin[DNS_MAXNAMELEN + 1], message[DNS_MAXNAMELEN * 2 + 64];
+  uint32_t	zone = 0;
+  int		n = 0, len = 0, found = 0;
+
+  for (n = 0; control_commands[n].name; n++) {
+    len = strlen(control_commands[n].name);
+    if (!strncasecmp(line, control_commands[n].name, len) && (!line[len] || isspace(line[len])))
+      break;
+  }
+  if (!control_commands[n].name) {
+    control_reply(c, "ERROR %s", _("unknown command"));
+    return;
+  }
+
+  for (arg = line + len; isspace(*arg); arg++)
+    /* DONOTHING */;
+  arg[strcspn(arg, " \t")] = '\0';
+  if (control_commands[n].arg && !*arg) {
+    control_reply(c, "ERROR %s", _("missing argument"));
+    return;
+  }
+  if (!control_commands[n].arg)
+    arg = NULL;
+
+  strcpy(origin, "-");
+  if (arg && (found = control_find_zone(arg, control_commands[n].arg == 2, &zone, origin)) < 0) {
+    control_reply(c, "ERROR %s", _("database error"));
+    return;
+  }
+  if (arg && !found && control_commands[n].arg == 1) {
+    control_reply(c, "ERROR %s", _("zone not found"));
+    return;
+  }
+  Notice(_("control: %s%s%s"), control_commands[n].name, arg ? " " : "", arg ? arg : "");
+
+  /* Single process: there are no servers to tell */
+  if (!Servers || !array_numobjects(Servers)) {
+    control_run(control_commands[n].action, zone, strcmp(origin, "-") ? origin : NULL, arg);
+    control_reply(c, "OK 1/1");
+    return;
+  }
+
+  c->seq = ++Seq;
+  snprintf(message, sizeof(message), "%s %u %u %s %s", control_commands[n].name, c->seq, zone,
+	   origin, arg ? arg : "-");
+  if (!(c->expected = comms_broadcast(message))) {
+    control_reply(c, "ERROR %s", _("no servers running"));
+    return;
+  }
+  c->acked = 0;
+  c->next = Waiting;
+  Waiting = c;
+  c->t->status = NEED_COMMAND_WAIT;
+  c->t->timeout = current_time + CONTROL_ACK_TIMEOUT;
+}
+/*--- control_command() -------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CONTROL_CONN_RUN
+	Reads commands from a connection and writes their answers, one command at a time.
+**************************************************************************************************/
+static taskexec_t
+control_conn_run(TASK *t, void *data) {
+  CONTROL_CONN	*c = (CONTROL_CONN *)data;
+  char		*line = NULL, *end = NULL;
+  int		rv = 0;
+
+  if (t->status == NEED_COMMAND_WRITE) {
+    while (c->offset < c->outlen) {
+      if ((rv = write(t->fd, c->out + c->offset, c->outlen - c->offset)) < 0)
+	return ((errno == EINTR || errno == EAGAIN) ? TASK_CONTINUE : TASK_COMPLETED);
+      c->offset += rv;
+    }
+    t->status = NEED_COMMAND_READ;
+    t->timeout = current_time + CONTROL_TIMEOUT;
+  } else if (!c->eof) {
+    if ((rv = read(t->fd, c->in + c->inlen, sizeof(c->in) - 1 - c->inlen)) < 0)
+      return ((errno == EINTR || errno == EAGAIN) ? TASK_CONTINUE : TASK_COMPLETED);
+    if (rv == 0)
+      c->eof = 1;
+    c->inlen += rv;
+    c->in[c->inlen] = '\0';
+  }
+
+  /* Run the next complete line */
+  while (t->status == NEED_COMMAND_READ) {
+    if (!(end = memchr(c->in, '\n', c->inlen))) {
+      if (c->eof && c->inlen)
+	end = c->in + c->inlen;				/* Last line, without a newline */
+      else if (c->eof || c->inlen >= sizeof(c->in) - 1)
+	return (TASK_COMPLETED);
+      else
+	return (TASK_CONTINUE);
+    }
+    *end = '\0';
+    for (line = c->in; isspace(*line); line++)
+      /* DONOTHING */;
+    for (rv = strlen(line); rv && isspace(line[rv - 1]); rv--)
+      line[rv - 1] = '\0';
+    if (*line)
+      control_command(c, line);
+
+    rv = MIN((size_t)(end - c->in) + 1, c->inlen);
+    memmove(c->in, c->in + rv, c->inlen - rv);
+    c->inlen -= rv;
+    c->in[c->inlen] = '\0';
+  }
+  return (TASK_CONTINUE);
+}
+/*--- control_conn_run() ------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CONTROL_CONN_TIMEOUT
+	Answers a command the servers have not all acted on in time; drops an idle connection.
+**************************************************************************************************/
+static taskexec_t
+control_conn_timeout(TASK *t, void *data) {
+  CONTROL_CONN	*c = (CONTROL_CONN *)data;
+
+  if (t->status != NEED_COMMAND_WAIT)
+    return (TASK_TIMED_OUT);
+  Warnx(_("control: %d of %d servers did not acknowledge command %u"),
+	c->expected - c->acked, c->expected, c->seq);
+  control_reply(c, "PARTIAL %d/%d", c->acked, c->expected);
+  return (TASK_CONTINUE);
+}
+/*--- control_conn_timeout() --------------------------------------------------------------------*/
+
+
+static void
+control_conn_free(TASK *t, void *data) {
+  CONTROL_CONN	*c = (CONTROL_CONN *)data, **p = NULL;
+
+  for (p = &Waiting; *p; p = &(*p)->next)
+    if (*p == c) {
+      *p = c->next;
+      break;
+    }
+  Connections--;
+}
+
+
+/**************************************************************************************************
+	CONTROL_ACCEPT
+	Accepts connections on the control socket.
+**************************************************************************************************/
+static taskexec_t
+control_accept(TASK *t, void *data) {
+  int		fd = -1;
+  TASK		*conn = NULL;
+  CONTROL_CONN	*c = NULL;
+
+  while ((fd = accept(t->fd, NULL, NULL)) >= 0) {
+    if (Connections >= CONTROL_MAX_CONNECTIONS) {
+      close(fd);
+      continue;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    if (!(conn = IOtask_init(NORMAL_PRIORITY_TASK, NEED_COMMAND_READ, fd, SOCK_STREAM, AF_UNIX, NULL))) {
+      close(fd);
+      continue;
+    }
+    conn->info_already_out = 1;				/* Not a query; keep it out of the log */
+    conn->timeout = current_time + CONTROL_TIMEOUT;
+    c = ALLOCATE(sizeof(CONTROL_CONN), CONTROL_CONN);
+    c->t = conn;
+    task_add_extension(conn, c, control_conn_free, control_conn_run, control_conn_timeout);
+    Connections++;
+  }
+  return (TASK_CONTINUE);
+}
+/*--- control_accept() --------------------------------------------------------------------------*/
+
+/* vi:set ts=3: */
+/* NEED_PO */
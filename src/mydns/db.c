@@ -41,11 +41,11 @@ db_connect(void) {
   size_t i;
 
   /* FIRST THING: Print debug message */
-  Warnx(_("DEBUG: db_connect() ENTRY"));
+  Log(LOG_DEBUG, _("db_connect() ENTRY"));
 
   /* MySQL-free slave mode: Skip database connection if explicitly disabled */
   no_database = conf_get(&Conf, "no-database", NULL);
-  Warnx(_("DEBUG: db_connect() after conf_get, no-database='%s'"), no_database ? no_database : "(null)");
+  Log(LOG_DEBUG, _("db_connect() after conf_get, no-database='%s'"), no_database ? no_database : "(null)");
 
   if (no_database && (strcasecmp(no_database, "yes") == 0 || strcasecmp(no_database, "true") == 0 || strcmp(no_database, "1") == 0)) {
     Warnx(_("MySQL-free mode enabled - using memzone for zone storage"));
@@ -77,12 +77,12 @@ db_connect(void) {
   if (!primary_host)
     primary_host = host_values[0];
 
-  Warnx(_("DEBUG: db_connect() about to call sql_open - user=%s host=%s db=%s"),
-        user ? user : "(NULL)", primary_host ? primary_host : "(NULL)", database ? database : "(NULL)");
+  Log(LOG_DEBUG, _("db_connect() about to call sql_open - user=%s host=%s db=%s"),
+      user ? user : "(NULL)", primary_host ? primary_host : "(NULL)", database ? database : "(NULL)");
 
   sql_open(user, password, primary_host, database);
 
-  Warnx(_("DEBUG: db_connect() EXIT after sql_open"));
+  Log(LOG_DEBUG, _("db_connect() EXIT after sql_open"));
 }
 /*--- db_connect() ------------------------------------------------------------------------------*/
 
@@ -0,0 +1,462 @@
+/**************************************************************************************************
+	Copyright (C) 2002-2005  Don Moore <bboy@bboy.net>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at Your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+**************************************************************************************************/
+
+/*
+**  Heavy hitters.
+**
+**  Every server keeps count-min sketches of the query names, domains, NXDOMAIN domains,
+**  client prefixes and zones it answers, with a short list of the keys whose estimates are
+**  highest.  Query types and rcodes have few enough values to be counted exactly.
+**
+**  The counters for all servers live in one block of shared memory mapped by the master
+**  before it forks, one slot per server.  A server only ever writes its own slot, so the
+**  update takes no lock.  Readers (a CHAOS status query to any server, or the master on
+**  SIGUSR1) merge all the slots: the top lists give the candidates and the summed sketches
+**  give their counts.  Counts are halved every heavy-hitters-decay seconds so that the lists
+**  follow the current load.
+*/
+
+#include "named.h"
+
+#include <sys/mman.h>
+
+/* Make this nonzero to enable debugging for this source file */
+#define	DEBUG_HEAVYHITTERS	1
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS		MAP_ANON
+#endif
+
+#define HH_DEPTH		4				/* Rows in each sketch */
+#define HH_WIDTH		2048				/* Counters per row (a power of 2) */
+#define HH_MAX_TOP		64				/* Most keys tracked per table */
+#define HH_SKETCHED		(HH_ZONE + 1)			/* Tables that use a sketch */
+#define HH_QTYPES		512				/* Higher qtypes are counted together */
+#define HH_RCODES		16
+
+typedef struct _hh_entry {
+  uint64_t	hash;
+  uint32_t	count;
+  uint16_t	keylen;
+  unsigned char	key[DNS_MAXNAMELEN + 1];
+} HH_ENTRY;
+
+typedef struct _hh_table {
+  uint32_t	sketch[HH_DEPTH][HH_WIDTH];
+  HH_ENTRY	top[HH_MAX_TOP];
+  int		ntop;						/* Entries used in `top' */
+  int		minidx;						/* Entry in `top' with the lowest count */
+} HH_TABLE;
+
+typedef struct _hh_slot {
+  time_t	decay_at;					/* When the counts are next halved */
+  uint32_t	qtypes[HH_QTYPES];
+  uint32_t	rcodes[HH_RCODES];
+  HH_TABLE	tables[HH_SKETCHED];
+} HH_SLOT;
+
+static HH_SLOT	*Slots = NULL;					/* One per server */
+static int	NumSlots = 0;
+static HH_SLOT	*Mine = NULL;					/* The slot this process fills */
+static int	TopSize = 0;
+
+static const char *hh_table_names[HH_TABLES] = {
+  "qname", "domain", "nxdomain", "client", "zone", "qtype", "rcode"
+};
+
+
+/**************************************************************************************************
+	HEAVYHITTERS_INIT
+	Maps the counters for `slots' servers.  Called by the master before the servers are
+	forked, so that every server sees every slot.
+**************************************************************************************************/
+void
+heavyhitters_init(int slots) {
+  if (heavy_hitters <= 0 || slots <= 0)
+    return;
+  TopSize = MIN(heavy_hitters, HH_MAX_TOP);
+
+  Slots = mmap(NULL, slots * sizeof(HH_SLOT), PROT_READ | PROT_WRITE,
+	       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (Slots == MAP_FAILED) {
+    Warn(_("error mapping heavy hitter counters"));
+    Slots = NULL;
+    return;
+  }
+  NumSlots = slots;
+  Verbose(_("tracking top %d query names, domains, clients and zones"), TopSize);
+}
+/*--- heavyhitters_init() -----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	HEAVYHITTERS_ATTACH
+	Makes `slot' the one this process counts its queries in.
+**************************************************************************************************/
+void
+heavyhitters_attach(int slot) {
+  if (!Slots || slot < 0 || slot >= NumSlots)
+    return;
+  Mine = &Slots[slot];
+  Mine->decay_at = current_time + heavy_hitters_decay;
+}
+/*--- heavyhitters_attach() ---------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	HH_HASH
+	FNV-1a, with a final mix so both halves of the result are usable as sketch hashes.
+**************************************************************************************************/
+static inline uint64_t
+hh_hash(const unsigned char *key, size_t len) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  while (len--) {
+    h ^= *key++;
+    h *= 0x100000001b3ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return (h);
+}
+/*--- hh_hash() ---------------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	HH_COUNTER
+	Returns the counter for `hash' in row `row' of a sketch.
+**************************************************************************************************/
+#define HH_COUNTER(tb, row, hash) \
+  (&(tb)->sketch[(row)][((uint32_t)(hash) + (row) * (uint32_t)(((hash) >> 32) | 1)) & (HH_WIDTH - 1)])
+
+
+/**************************************************************************************************
+	HH_COUNT
+	Counts one occurrence of `key' in table `tb' and keeps the top list up to date.
+	The sketch uses conservative update: only the counters at the current minimum grow.
+**************************************************************************************************/
+static void
+hh_count(HH_TABLE *tb, uint64_t hash, const unsigned char *key, size_t keylen) {
+  uint32_t	*c[HH_DEPTH], est = (uint32_t)-1;
+  register int	n = 0;
+  HH_ENTRY	*e = NULL;
+
+  for (n = 0; n < HH_DEPTH; n++) {
+    c[n] = HH_COUNTER(tb, n, hash);
+    if (*c[n] < est)
+      est = *c[n];
+  }
+  est++;
+  for (n = 0; n < HH_DEPTH; n++)
+    if (*c[n] < est)
+      *c[n] = est;
+
+  /* Nothing below the lowest listed count can enter (or already be in) a full list */
+  if (tb->ntop >= TopSize && est <= tb->top[tb->minidx].count)
+    return;
+
+  for (n = 0; n < tb->ntop; n++)
+    if (tb->top[n].hash == hash) {
+      tb->top[n].count = est;
+      if (n != tb->minidx)
+	return;
+      break;
+    }
+
+  if (n == tb->ntop) {
+    e = (tb->ntop < TopSize) ? &tb->top[tb->ntop++] : &tb->top[tb->minidx];
+    e->hash = hash;
+    e->count = est;
+    e->keylen = keylen;
+    memcpy(e->key, key, keylen);
+  }
+
+  /* Find the new lowest entry */
+  for (tb->minidx = 0, n = 1; n < tb->ntop; n++)
+    if (tb->top[n].count < tb->top[tb->minidx].count)
+      tb->minidx = n;
+}
+/*--- hh_count() --------------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	HH_DECAY
+	Halves every count in `s'.
+**************************************************************************************************/
+static void
+hh_decay(HH_SLOT *s) {
+  register int	n = 0, m = 0, i = 0;
+
+  for (n = 0; n < HH_QTYPES; n++)
+    s->qtypes[n] >>= 1;
+  for (n = 0; n < HH_RCODES; n++)
+    s->rcodes[n] >>= 1;
+
+  for (n = 0; n < HH_SKETCHED; n++) {
+    HH_TABLE *tb = &s->tables[n];
+    uint32_t *c = &tb->sketch[0][0];
+
+    for (i = 0; i < HH_DEPTH * HH_WIDTH; i++)
+      c[i] >>= 1;
+    for (i = m = 0; i < tb->ntop; i++)
+      if ((tb->top[i].count >>= 1))
+	tb->top[m++] = tb->top[i];
+    tb->ntop = m;
+    for (tb->minidx = 0, i = 1; i < tb->ntop; i++)
+      if (tb->top[i].count < tb->top[tb->minidx].count)
+	tb->minidx = i;
+  }
+  s->decay_at = current_time + heavy_hitters_decay;
+}
+/*--- hh_decay() --------------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	HEAVYHITTERS_ADD
+	Counts the finished query `t'.
+**************************************************************************************************/
+void
+heavyhitters_add(TASK *t) {
+  HH_SLOT		*s = Mine;
+  unsigned char		name[DNS_MAXNAMELEN + 1], client[8];
+  register size_t	len = 0;
+  size_t		l1 = 0, l2 = 0, l3 = 0, labels = 0, dom = 0, tld = 0;
+  uint64_t		dhash = 0;
+
+  if (!s || !t->qname[0])
+    return;
+
+  if (heavy_hitters_decay && current_time >= s->decay_at)
+    hh_decay(s);
+
+  s->qtypes[MIN((unsigned int)t->qtype, HH_QTYPES - 1)]++;
+  s->rcodes[t->hdr.rcode & (HH_RCODES - 1)]++;
+
+  /* Lowercase the name, noting where its last three labels start */
+  for (len = 0; len < DNS_MAXNAMELEN && t->qname[len]; len++) {
+    if ((!len || name[len - 1] == '.') && t->qname[len] != '.') {
+      l3 = l2; l2 = l1; l1 = len;
+      labels++;
+    }
+    name[len] = tolower((unsigned char)t->qname[len]);
+  }
+  hh_count(&s->tables[HH_QNAME], hh_hash(name, len), name, len);
+
+  /*
+  ** The registrable domain is guessed without the public suffix list: the last two labels,
+  ** or three under a two-letter TLD with a short second level (example.co.uk).
+  */
+  tld = len - l1 - (name[len - 1] == '.');
+  if (labels >= 3 && tld == 2 && l1 - l2 - 1 <= 3)
+    dom = l3;
+  else if (labels >= 2)
+    dom = l2;
+  dhash = hh_hash(name + dom, len - dom);
+  hh_count(&s->tables[HH_DOMAIN], dhash, name + dom, len - dom);
+  if (t->hdr.rcode == DNS_RCODE_NXDOMAIN)
+    hh_count(&s->tables[HH_NXDOMAIN], dhash, name + dom, len - dom);
+
+  /* Client /24 or /56 */
+  if (t->family == AF_INET) {
+    client[0] = AF_INET;
+    memcpy(client + 1, &t->addr4.sin_addr, 3);
+    hh_count(&s->tables[HH_CLIENT], hh_hash(client, 4), client, 4);
+#if HAVE_IPV6
+  } else if (t->family == AF_INET6) {
+    client[0] = AF_INET6;
+    memcpy(client + 1, &t->addr6.sin6_addr, 7);
+    hh_count(&s->tables[HH_CLIENT], hh_hash(client, 8), client, 8);
+#endif
+  }
+
+  if (t->zone)
+    hh_count(&s->tables[HH_ZONE], hh_hash((unsigned char *)&t->zone, sizeof(t->zone)),
+	     (unsigned char *)&t->zone, sizeof(t->zone));
+}
+/*--- heavyhitters_add() ------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	HEAVYHITTERS_TABLE
+	Returns the table called `name', or -1.
+**************************************************************************************************/
+int
+heavyhitters_table(const char *name, size_t len) {
+  int n = 0;
+
+  for (n = 0; n < HH_TABLES; n++)
+    if (strlen(hh_table_names[n]) == len && !strncasecmp(hh_table_names[n], name, len))
+      return (n);
+  return (-1);
+}
+/*--- heavyhitters_table() ----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	HH_FORMAT
+	Describes key `e' from `table' in `buf'.
+**************************************************************************************************/
+static void
+hh_format(int table, HH_ENTRY *e, char *buf, size_t size) {
+  if (table == HH_CLIENT) {
+    unsigned char addr[16];
+
+    memset(addr, 0, sizeof(addr));
+    memcpy(addr, e->key + 1, e->keylen - 1);
+    if (e->key[0] == AF_INET)
+      snprintf(buf, size, "%s/24", ipaddr(AF_INET, addr));
+#if HAVE_IPV6
+    else
+      snprintf(buf, size, "%s/56", ipaddr(AF_INET6, addr));
+#endif
+  } else if (table == HH_ZONE) {
+    uint32_t	id = 0;
+    char	*query = NULL;
+    size_t	querylen = 0;
+    SQL_RES	*res = NULL;
+    SQL_ROW	row = NULL;
+
+    memcpy(&id, e->key, sizeof(id));
+    snprintf(buf, size, "#%u", id);
+    querylen = sql_build_query(&query, "SELECT origin FROM %s WHERE id=%u", mydns_soa_table_name, id);
+    res = sql_query(sql, query, querylen);
+    RELEASE(query);
+    if (res) {
+      if ((row = sql_getrow(res, NULL)) && row[0])
+	snprintf(buf, size, "%s", row[0]);
+      sql_free(res);
+    }
+  } else
+    snprintf(buf, size, "%.*s", (int)e->keylen, e->key);
+}
+/*--- hh_format() -------------------------------------------------------------------------------*/
+
+
+static int
+hh_compare(const void *a, const void *b) {
+  const HH_ENTRY *x = (const HH_ENTRY *)a, *y = (const HH_ENTRY *)b;
+
+  return ((x->count < y->count) ? 1 : (x->count > y->count) ? -1 : 0);
+}
+
+
+/**************************************************************************************************
+	HEAVYHITTERS_TOP
+	Merges the counters of all servers and stores the `max' largest entries of `table' in
+	`top'.  Returns the number of entries stored.
+**************************************************************************************************/
+int
+heavyhitters_top(int table, HEAVYHITTER *top, int max) {
+  HH_ENTRY	*cand = NULL;
+  int		ncand = 0, n = 0, m = 0, s = 0;
+
+  if (!Slots || table < 0 || table >= HH_TABLES)
+    return (0);
+
+  if (table == HH_QTYPE || table == HH_RCODE) {
+    int		values = (table == HH_QTYPE) ? HH_QTYPES : HH_RCODES;
+
+    cand = ALLOCATE(values * sizeof(HH_ENTRY), HH_ENTRY[]);
+    for (n = 0; n < values; n++) {
+      for (s = 0; s < NumSlots; s++)
+	cand[ncand].count += (table == HH_QTYPE) ? Slots[s].qtypes[n] : Slots[s].rcodes[n];
+      if (cand[ncand].count)
+	cand[ncand++].hash = n;
+    }
+  } else {
+    cand = ALLOCATE(NumSlots * HH_MAX_TOP * sizeof(HH_ENTRY), HH_ENTRY[]);
+
+    /* Every key listed by any server is a candidate; copies torn by a writer are skipped */
+    for (s = 0; s < NumSlots; s++) {
+      HH_TABLE *tb = &Slots[s].tables[table];
+      int ntop = MIN(tb->ntop, HH_MAX_TOP);
+
+      for (n = 0; n < ntop; n++) {
+	HH_ENTRY *e = &cand[ncand];
+
+	memcpy(e, &tb->top[n], sizeof(HH_ENTRY));
+	if (e->keylen > sizeof(e->key) || hh_hash(e->key, e->keylen) != e->hash)
+	  continue;
+	for (m = 0; m < ncand; m++)
+	  if (cand[m].hash == e->hash)
+	    break;
+	if (m == ncand)
+	  ncand++;
+      }
+    }
+
+    /* The merged sketch is the sum of the servers' sketches */
+    for (n = 0; n < ncand; n++) {
+      uint32_t est = (uint32_t)-1;
+
+      for (m = 0; m < HH_DEPTH; m++) {
+	uint32_t sum = 0;
+	for (s = 0; s < NumSlots; s++)
+	  sum += *HH_COUNTER(&Slots[s].tables[table], m, cand[n].hash);
+	est = MIN(est, sum);
+      }
+      cand[n].count = est;
+    }
+  }
+
+  qsort(cand, ncand, sizeof(HH_ENTRY), hh_compare);
+
+  for (n = 0; n < ncand && n < max; n++) {
+    top[n].count = cand[n].count;
+    if (table == HH_QTYPE)
+      snprintf(top[n].key, sizeof(top[n].key), "%s",
+	       (cand[n].hash == HH_QTYPES - 1) ? "OTHER" : mydns_qtype_str(cand[n].hash));
+    else if (table == HH_RCODE)
+      snprintf(top[n].key, sizeof(top[n].key), "%s", mydns_rcode_str(cand[n].hash));
+    else
+      hh_format(table, &cand[n], top[n].key, sizeof(top[n].key));
+  }
+  RELEASE(cand);
+  return (n);
+}
+/*--- heavyhitters_top() ------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	HEAVYHITTERS_STATUS
+	Outputs the first few entries of every table.
+**************************************************************************************************/
+void
+heavyhitters_status(void) {
+  HEAVYHITTER	top[5];
+  char		buf[1024], *b = NULL;
+  int		table = 0, count = 0, n = 0;
+
+  if (!Slots)
+    return;
+
+  for (table = 0; table < HH_TABLES; table++) {
+    if (!(count = heavyhitters_top(table, top, sizeof(top) / sizeof(top[0]))))
+      continue;
+    b = buf;
+    b += snprintf(b, sizeof(buf)-(b-buf), "%s %s:", _("top"), hh_table_names[table]);
+    for (n = 0; n < count && b - buf < (int)sizeof(buf) - 1; n++)
+      b += snprintf(b, sizeof(buf)-(b-buf), " %s=%u", top[n].key, top[n].count);
+    Notice("%s", buf);
+  }
+}
+/*--- heavyhitters_status() ---------------------------------------------------------------------*/
+
+/* vi:set ts=3: */
+/* NEED_PO */
@@ -115,6 +115,56 @@ ixfr_gobble_authority_rr(TASK *t, uchar *query, size_t querylen, uchar *current,
   return src;
 }
 
+/**************************************************************************************************
+	IXFR_JOURNAL_WANTED
+	Returns 1 if the IXFR in `t' can be answered from the journal (or with the current SOA
+	because the client is up to date); otherwise the request is served as a full AXFR.
+	Nothing is sent: a malformed request is left for ixfr() to reject.
+**************************************************************************************************/
+int
+ixfr_journal_wanted(TASK *t) {
+  uchar		*query = (uchar*)t->query;
+  uchar		*end = query + t->len;
+  uchar		*src = NULL, *name = NULL;
+  task_error_t	errcode = 0;
+  MYDNS_SOA	*soa = NULL;
+  uint32_t	serial = 0;
+  int		wanted = 0;
+  register int	n = 0;
+
+  if (!ixfr_journal_enabled || !sql || !query || t->nscount != 1
+      || t->len < DNS_HEADERSIZE + t->qdlen)
+    return (0);
+
+  /* Skip the owner, fixed fields, MNAME and RNAME of the authority SOA to reach its serial */
+  src = query + DNS_HEADERSIZE + t->qdlen;
+  for (n = 0; n < 3; n++) {
+    if (!(name = name_unencode2(query, t->len, &src, &errcode)))
+      return (0);
+    RELEASE(name);
+    if (n == 0) {
+      if (src + 10 > end)
+	return (0);
+      src += 10;
+    }
+  }
+  if (src + SIZE32 > end)
+    return (0);
+  DNS_GET32(serial, src);
+
+  /* Slave zones held in memzone keep no journal */
+  if ((soa = axfr_memzone_soa(t->qname))) {
+    mydns_soa_free(soa);
+    return (0);
+  }
+  if (mydns_soa_load(sql, &soa, t->qname) < 0 || !soa)
+    return (0);
+  wanted = ixfr_journal_covers(soa, serial);
+  mydns_soa_free(soa);
+  return (wanted);
+}
+/*--- ixfr_journal_wanted() ---------------------------------------------------------------------*/
+
 /**************************************************************************************************
 	PARSE_TSIG_FOR_IXFR
 	Parse TSIG record from IXFR request Additional section.
@@ -288,7 +338,7 @@ load_tsig_key_for_ixfr(TASK *t, const char *key_name) {
   size_t querylen = 0;
   tsig_key_t *key = NULL;
 
-  if (!key_name || !strlen(key_name))
+  if (!key_name || !strlen(key_name) || !sql)
     return NULL;
 
   /* Query tsig_keys table */
@@ -395,6 +445,7 @@ ixfr(TASK * t, datasection_t section, dns_qtype_t qtype, char *fqdn, int truncat
   tsig_key_t *tsig_key = NULL;
   unsigned char request_mac[64];
   size_t request_mac_len = 0;
+  int		memzone = 0;
 
 #if DEBUG_ENABLED && DEBUG_IXFR
   DebugX("ixfr", 1, "%s: ixfr(%s, %s, \"%s\", %d)", desctask(t),
@@ -411,7 +462,13 @@ ixfr(TASK * t, datasection_t section, dns_qtype_t qtype, char *fqdn, int truncat
    * only trust the serial number.
    */
 
-  if (mydns_soa_load(sql, &soa, fqdn) < 0) {
+  /*
+   * Slave zones held in memzone keep no history of changes, so the answer is the current SOA:
+   * either the client is up to date or it falls back to AXFR, which is sent from memory.
+   */
+  if ((soa = axfr_memzone_soa(fqdn)))
+    memzone = 1;
+  else if (sql && mydns_soa_load(sql, &soa, fqdn) < 0) {
     dnserror(t, DNS_RCODE_SERVFAIL, ERR_DB_ERROR);
     return (TASK_FAILED);
   }
@@ -420,6 +477,7 @@ ixfr(TASK * t, datasection_t section, dns_qtype_t qtype, char *fqdn, int truncat
     dnserror(t, DNS_RCODE_REFUSED, ERR_ZONE_NOT_FOUND);
     return (TASK_FAILED);
   }
+  MYDNS_PROBE2(ixfr_start, t->internal_id, soa->origin);
 
   /* Verify TSIG if present */
   tsig_key = verify_tsig_for_ixfr(t, request_mac, &request_mac_len);
@@ -520,13 +578,19 @@ ixfr(TASK * t, datasection_t section, dns_qtype_t qtype, char *fqdn, int truncat
    *
    */
 
+  /* The answer depends on the client's serial, so it can't come from the reply cache */
+  t->reply_cache_ok = 0;
+
   if (soa->serial == q->IR.serial) {
     /* Tell the client to do no zone transfer */
     rrlist_add(t, ANSWER, DNS_RRTYPE_SOA, (void *)soa, soa->origin);
     t->sort_level++;
+  } else if (!memzone && !truncateonly && ixfr_journal_answer(t, soa, q->IR.serial)) {
+    /* Changes since the client's serial are in the journal */
+    goto FINISHEDIXFR;
   } else {
     /* Do we have incremental information in the database */
-    if (!truncateonly && mydns_rr_use_active && mydns_rr_use_stamp && mydns_rr_use_serial) {
+    if (!memzone && !truncateonly && mydns_rr_use_active && mydns_rr_use_stamp && mydns_rr_use_serial) {
       /* We can do incrementals */
       /* Need to send an IXFR if available */
       /*
@@ -672,6 +736,7 @@ ixfr(TASK * t, datasection_t section, dns_qtype_t qtype, char *fqdn, int truncat
     tsig_key = NULL;
   }
 
+  MYDNS_PROBE3(ixfr_done, t->internal_id, fqdn, t->an.size);
   return (TASK_EXECUTED);
 }
 
@@ -0,0 +1,739 @@
+/**************************************************************************************************
+	IXFR journal
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at Your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+**************************************************************************************************/
+
+#include "named.h"
+
+/* Make this nonzero to enable debugging for this source file */
+#define	DEBUG_JOURNAL	1
+
+/*
+** The IXFR journal keeps, for each zone a slave has asked for incrementally, the records of the
+** zone at its current serial and a bounded list of the differences between successive serials.
+** Differences are found by comparing the zone with the copy held when its serial changes, either
+** after a dynamic update or when the periodic check of the soa table sees a new serial.
+** IXFR requests whose serial is in the journal are answered from memory.
+*/
+
+#define	JOURNAL_HASH_SIZE	1024			/* Buckets in the zone table */
+#define	JOURNAL_PAGE_SIZE	1000			/* Records read from the database per query */
+#define	JOURNAL_MAGIC		"MYDNSJNL"
+#define	JOURNAL_VERSION		1
+#define	JOURNAL_MAX_RRS		(1 << 20)		/* Most records one change read from a file may hold */
+
+#ifdef DN_COLUMN_NAMES
+#define	JOURNAL_SOA_ID		"zone_id"
+#else
+#define	JOURNAL_SOA_ID		"id"
+#endif
+
+/* JOURNAL_DIFF: The changes that took a zone from one serial to the next */
+typedef struct _journal_diff {
+  uint32_t		from, to;			/* Serials before and after */
+  MYDNS_RR		**del, **add;			/* Records removed and added */
+  int			ndel, nadd;
+  struct _journal_diff	*next;
+} JOURNAL_DIFF;
+
+/* JOURNAL_ZONE: The journal of one zone */
+typedef struct _journal_zone {
+  uint32_t		zone;
+  char			*origin;
+  uint32_t		serial;				/* Serial of `recs' */
+  MYDNS_RR		**recs;				/* Records of the zone, sorted */
+  int			nrecs;				/* -1 until loaded */
+  int			unusable;			/* Zone has records the journal can't hold */
+  JOURNAL_DIFF		*head, *tail;			/* Oldest first */
+  int			ndiffs;
+  struct _journal_zone	*next;
+} JOURNAL_ZONE;
+
+static JOURNAL_ZONE *Journal[JOURNAL_HASH_SIZE];
+
+
+/**************************************************************************************************
+	JOURNAL_RR_CMP
+	Orders records by owner, type, class, aux, TTL and data.  The record id is ignored, so a
+	record deleted and added again unchanged is not a change.
+**************************************************************************************************/
+static int
+journal_rr_cmp(const void *p1, const void *p2) {
+  MYDNS_RR	*a = *(MYDNS_RR **)p1, *b = *(MYDNS_RR **)p2;
+  int		rv = 0;
+
+  if ((rv = strcasecmp(MYDNS_RR_NAME(a), MYDNS_RR_NAME(b))))
+    return (rv);
+  if (a->type != b->type)
+    return (a->type < b->type ? -1 : 1);
+  if (a->class != b->class)
+    return (a->class < b->class ? -1 : 1);
+  if (a->aux != b->aux)
+    return (a->aux < b->aux ? -1 : 1);
+  if (a->ttl != b->ttl)
+    return (a->ttl < b->ttl ? -1 : 1);
+  if ((rv = memcmp(MYDNS_RR_DATA_VALUE(a), MYDNS_RR_DATA_VALUE(b),
+		   MIN(MYDNS_RR_DATA_LENGTH(a), MYDNS_RR_DATA_LENGTH(b)))))
+    return (rv);
+  if (MYDNS_RR_DATA_LENGTH(a) != MYDNS_RR_DATA_LENGTH(b))
+    return (MYDNS_RR_DATA_LENGTH(a) < MYDNS_RR_DATA_LENGTH(b) ? -1 : 1);
+  return (0);
+}
+/*--- journal_rr_cmp() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	JOURNAL_RRS_FREE
+	Frees an array of records.
+**************************************************************************************************/
+static void
+journal_rrs_free(MYDNS_RR **rrs, int count) {
+  register int n = 0;
+
+  if (!rrs)
+    return;
+  for (n = 0; n < count; n++) {
+    mydns_rr_free(rrs[n]);
+  }
+  RELEASE(rrs);
+}
+/*--- journal_rrs_free() ------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	JOURNAL_DIFF_FREE
+**************************************************************************************************/
+static void
+journal_diff_free(JOURNAL_DIFF *d) {
+  if (!d)
+    return;
+  journal_rrs_free(d->del, d->ndel);
+  journal_rrs_free(d->add, d->nadd);
+  RELEASE(d);
+}
+/*--- journal_diff_free() -----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	JOURNAL_CLEAR
+	Forgets the differences held for a zone.
+**************************************************************************************************/
+static void
+journal_clear(JOURNAL_ZONE *jz) {
+  JOURNAL_DIFF *d = NULL, *next = NULL;
+
+  for (d = jz->head; d; d = next) {
+    next = d->next;
+    journal_diff_free(d);
+  }
+  jz->head = jz->tail = NULL;
+  jz->ndiffs = 0;
+}
+/*--- journal_clear() ---------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	JOURNAL_APPEND
+	Adds a difference to the end of a zone's journal, dropping the oldest to stay within
+	`ixfr-journal-size'.
+**************************************************************************************************/
+static void
+journal_append(JOURNAL_ZONE *jz, JOURNAL_DIFF *d) {
+  JOURNAL_DIFF *old = NULL;
+
+  d->next = NULL;
+  if (jz->tail)
+    jz->tail->next = d;
+  else
+    jz->head = d;
+  jz->tail = d;
+  jz->ndiffs++;
+
+  while (jz->ndiffs > (int)ixfr_journal_size && (old = jz->head)) {
+    jz->head = old->next;
+    if (!jz->head)
+      jz->tail = NULL;
+    jz->ndiffs--;
+    journal_diff_free(old);
+  }
+}
+/*--- journal_append() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	JOURNAL_FIND
+	Returns the journal for `zone', or NULL.
+**************************************************************************************************/
+static JOURNAL_ZONE *
+journal_find(uint32_t zone) {
+  register JOURNAL_ZONE *jz = NULL;
+
+  for (jz = Journal[zone % JOURNAL_HASH_SIZE]; jz; jz = jz->next)
+    if (jz->zone == zone)
+      return (jz);
+  return (NULL);
+}
+/*--- journal_find() ----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	JOURNAL_FILENAME
+	Returns the name of the file holding the journal for `zone', or NULL if the journal is not
+	kept on disk.
+**************************************************************************************************/
+static char *
+journal_filename(uint32_t zone) {
+  char *filename = NULL;
+
+  if (!ixfr_journal_dir || !*ixfr_journal_dir)
+    return (NULL);
+  ASPRINTF(&filename, "%s/%u.jnl", ixfr_journal_dir, zone);
+  return (filename);
+}
+/*--- journal_filename() ------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	JOURNAL_WRITE_RRS
+	Writes an array of records to a journal file.  Returns 0 on success.
+**************************************************************************************************/
+static int
+journal_write_rrs(FILE *fp, MYDNS_RR **rrs, int count) {
+  register int n = 0;
+
+  for (n = 0; n < count; n++) {
+    MYDNS_RR	*rr = rrs[n];
+    uint32_t	hdr[5];
+    uint16_t	len[2];
+
+    hdr[0] = rr->type;
+    hdr[1] = rr->class;
+    hdr[2] = rr->aux;
+    hdr[3] = rr->ttl;
+    hdr[4] = rr->id;
+    len[0] = strlen(MYDNS_RR_NAME(rr));
+    len[1] = MYDNS_RR_DATA_LENGTH(rr);
+    if (fwrite(hdr, sizeof(hdr), 1, fp) != 1
+	|| fwrite(len, sizeof(len), 1, fp) != 1
+	|| fwrite(MYDNS_RR_NAME(rr), len[0], 1, fp) != (len[0] ? 1 : 0)
+	|| fwrite(MYDNS_RR_DATA_VALUE(rr), len[1], 1, fp) != (len[1] ? 1 : 0))
+      return (-1);
+  }
+  return (0);
+}
+/*--- journal_write_rrs() -----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	JOURNAL_SAVE
+	Writes the differences held for a zone to its journal file.  The file is replaced in one
+	step, so each server process may save the same journal without locking.
+**************************************************************************************************/
+static void
+journal_save(JOURNAL_ZONE *jz) {
+  char		*filename = NULL, *tmpname = NULL;
+  FILE		*fp = NULL;
+  JOURNAL_DIFF	*d = NULL;
+  uint32_t	hdr[4];
+  int		failed = 0;
+
+  if (!(filename = journal_filename(jz->zone)))
+    return;
+  ASPRINTF(&tmpname, "%s.%d", filename, (int)getpid());
+
+  if (!(fp = fopen(tmpname, "w"))) {
+    Warn("%s: %s", tmpname, _("error creating IXFR journal"));
+    RELEASE(tmpname);
+    RELEASE(filename);
+    return;
+  }
+
+  hdr[0] = JOURNAL_VERSION;
+  hdr[1] = jz->zone;
+  hdr[2] = jz->ndiffs;
+  hdr[3] = 0;
+  if (fwrite(JOURNAL_MAGIC, strlen(JOURNAL_MAGIC), 1, fp) != 1
+      || fwrite(hdr, sizeof(hdr), 1, fp) != 1)
+    failed = 1;
+
+  for (d = jz->head; d && !failed; d = d->next) {
+    uint32_t dhdr[4];
+
+    dhdr[0] = d->from;
+    dhdr[1] = d->to;
+    dhdr[2] = d->ndel;
+    dhdr[3] = d->nadd;
+    if (fwrite(dhdr, sizeof(dhdr), 1, fp) != 1
+	|| journal_write_rrs(fp, d->del, d->ndel) < 0
+	|| journal_write_rrs(fp, d->add, d->nadd) < 0)
+      failed = 1;
+  }
+
+  if (fclose(fp) != 0)
+    failed = 1;
+  if (failed || rename(tmpname, filename) < 0) {
+    Warn("%s: %s", filename, _("error writing IXFR journal"));
+    unlink(tmpname);
+  }
+  RELEASE(tmpname);
+  RELEASE(filename);
+}
+/*--- journal_save() ----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	JOURNAL_READ_RRS
+	Reads `count' records for `zone' from a journal file.  Returns NULL on error.
+**************************************************************************************************/
+static MYDNS_RR **
+journal_read_rrs(FILE *fp, uint32_t zone, int count) {
+  MYDNS_RR	**rrs = NULL;
+  char		name[DNS_MAXNAMELEN + 1];
+  char		*data = NULL;
+  register int	n = 0;
+
+  rrs = ALLOCATE((count + 1) * sizeof(MYDNS_RR *), MYDNS_RR *[]);
+  data = ALLOCATE(DNS_MAXDATALEN + 1, char[]);
+  for (n = 0; n < count; n++) {
+    MYDNS_RR	tmp;
+    uint32_t	hdr[5];
+    uint16_t	len[2];
+
+    if (fread(hdr, sizeof(hdr), 1, fp) != 1
+	|| fread(len, sizeof(len), 1, fp) != 1
+	|| len[0] > DNS_MAXNAMELEN
+	|| fread(name, len[0], 1, fp) != (len[0] ? 1 : 0)
+	|| fread(data, len[1], 1, fp) != (len[1] ? 1 : 0)) {
+      journal_rrs_free(rrs, n);
+      RELEASE(data);
+      return (NULL);
+    }
+    name[len[0]] = '\0';
+    data[len[1]] = '\0';
+
+    /* The data is stored as it was parsed, so copy rather than build */
+    memset(&tmp, 0, sizeof(tmp));
+    tmp.id = hdr[4];
+    tmp.zone = zone;
+    tmp.type = hdr[0];
+    tmp.class = hdr[1];
+    tmp.aux = hdr[2];
+    tmp.ttl = hdr[3];
+    tmp._name = name;
+    tmp._data.len = len[1];
+    tmp._data.value = data;
+    rrs[n] = mydns_rr_dup(&tmp, 0);
+  }
+  RELEASE(data);
+  return (rrs);
+}
+/*--- journal_read_rrs() ------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	JOURNAL_LOAD
+	Reads a zone's journal file.  The differences are kept only if they lead up to the zone's
+	current serial.
+**************************************************************************************************/
+static void
+journal_load(JOURNAL_ZONE *jz) {
+  char		*filename = NULL;
+  char		magic[sizeof(JOURNAL_MAGIC)];
+  FILE		*fp = NULL;
+  uint32_t	hdr[4];
+  register int	n = 0;
+
+  if (!(filename = journal_filename(jz->zone)))
+    return;
+  if (!(fp = fopen(filename, "r"))) {
+    RELEASE(filename);
+    return;
+  }
+
+  if (fread(magic, strlen(JOURNAL_MAGIC), 1, fp) != 1
+      || memcmp(magic, JOURNAL_MAGIC, strlen(JOURNAL_MAGIC))
+      || fread(hdr, sizeof(hdr), 1, fp) != 1
+      || hdr[0] != JOURNAL_VERSION || hdr[1] != jz->zone) {
+    Warnx("%s: %s", filename, _("not an IXFR journal for this zone"));
+    goto JOURNAL_LOAD_DONE;
+  }
+  if (hdr[2] > ixfr_journal_size) {
+    Warnx("%s: %s", filename, _("IXFR journal holds more changes than ixfr-journal-size"));
+    goto JOURNAL_LOAD_DONE;
+  }
+
+  for (n = 0; n < (int)hdr[2]; n++) {
+    JOURNAL_DIFF	*d = NULL;
+    uint32_t		dhdr[4];
+
+    if (fread(dhdr, sizeof(dhdr), 1, fp) != 1) {
+      Warnx("%s: %s", filename, _("IXFR journal is truncated"));
+      journal_clear(jz);
+      goto JOURNAL_LOAD_DONE;
+    }
+    if (dhdr[2] > JOURNAL_MAX_RRS || dhdr[3] > JOURNAL_MAX_RRS) {
+      Warnx("%s: %s", filename, _("IXFR journal is corrupt"));
+      journal_clear(jz);
+      goto JOURNAL_LOAD_DONE;
+    }
+    d = ALLOCATE(sizeof(JOURNAL_DIFF), JOURNAL_DIFF);
+    memset(d, 0, sizeof(JOURNAL_DIFF));
+    d->from = dhdr[0];
+    d->to = dhdr[1];
+    d->ndel = dhdr[2];
+    d->nadd = dhdr[3];
+    if (!(d->del = journal_read_rrs(fp, jz->zone, d->ndel))
+	|| !(d->add = journal_read_rrs(fp, jz->zone, d->nadd))) {
+      journal_diff_free(d);
+      Warnx("%s: %s", filename, _("IXFR journal is truncated"));
+      journal_clear(jz);
+      goto JOURNAL_LOAD_DONE;
+    }
+    journal_append(jz, d);
+  }
+
+  /* The journal is only of use if it ends where the zone is now */
+  if (jz->tail && jz->tail->to != jz->serial)
+    journal_clear(jz);
+
+#if DEBUG_ENABLED && DEBUG_JOURNAL
+  DebugX("ixfr", 1, _("IXFR journal for %s: %d changes loaded from %s"),
+	 jz->origin, jz->ndiffs, filename);
+#endif
+
+ JOURNAL_LOAD_DONE:
+  fclose(fp);
+  RELEASE(filename);
+}
+/*--- journal_load() ----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	JOURNAL_READ_ZONE
+	Reads the active records of a zone into a sorted array.
+	Returns the number of records, or -1 on error or if the zone has ALIAS records, whose answers
+	depend on other zones.
+**************************************************************************************************/
+static int
+journal_read_zone(JOURNAL_ZONE *jz, MYDNS_RR ***rrsp) {
+  MYDNS_RR_STREAM	*stream = NULL;
+  MYDNS_RR		*rr = NULL, **rrs = NULL;
+  int			count = 0, alloc = 0;
+
+  *rrsp = NULL;
+  if (!(stream = mydns_rr_stream_active(sql, jz->zone, jz->origin, JOURNAL_PAGE_SIZE))) {
+    WarnSQL(sql, "%s: %s", jz->origin, _("error loading zone for IXFR journal"));
+    return (-1);
+  }
+  while ((rr = mydns_rr_stream_next(stream))) {
+#if ALIAS_ENABLED
+    if (rr->alias) {
+      mydns_rr_free(rr);
+      mydns_rr_stream_close(stream);
+      journal_rrs_free(rrs, count);
+      jz->unusable = 1;
+      return (-1);
+    }
+#endif
+    if (!*MYDNS_RR_NAME(rr) || LASTCHAR(MYDNS_RR_NAME(rr)) != '.')
+      mydns_rr_name_append_origin(rr, jz->origin);
+    if (count == alloc) {
+      alloc = alloc ? alloc * 2 : 64;
+      rrs = REALLOCATE(rrs, alloc * sizeof(MYDNS_RR *), MYDNS_RR *[]);
+    }
+    rrs[count++] = rr;
+  }
+  if (stream->error) {
+    Warnx("%s: %s", jz->origin, _("error loading zone for IXFR journal"));
+    mydns_rr_stream_close(stream);
+    journal_rrs_free(rrs, count);
+    return (-1);
+  }
+  mydns_rr_stream_close(stream);
+
+  if (count > 1)
+    qsort(rrs, count, sizeof(MYDNS_RR *), journal_rr_cmp);
+  *rrsp = rrs;
+  return (count);
+}
+/*--- journal_read_zone() -----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	JOURNAL_REFRESH
+	Called when the zone's serial may have changed.  Reads the zone and records how it differs
+	from the copy held.
+**************************************************************************************************/
+static void
+journal_refresh(JOURNAL_ZONE *jz, uint32_t serial) {
+  MYDNS_RR	**recs = NULL;
+  JOURNAL_DIFF	*d = NULL;
+  int		nrecs = 0, i = 0, j = 0, cmp = 0;
+
+  if (jz->unusable || (jz->nrecs >= 0 && serial == jz->serial))
+    return;
+
+  if ((nrecs = journal_read_zone(jz, &recs)) < 0) {
+    /* Without the zone the next change can't be recorded, so start again */
+    journal_clear(jz);
+    journal_rrs_free(jz->recs, jz->nrecs);
+    jz->recs = NULL;
+    jz->nrecs = -1;
+    return;
+  }
+
+  /* First load: the zone is the starting point; a saved journal may already lead up to it */
+  if (jz->nrecs < 0) {
+    jz->recs = recs;
+    jz->nrecs = nrecs;
+    jz->serial = serial;
+    journal_load(jz);
+    return;
+  }
+
+  /* Both lists are sorted, so one pass finds what was removed and what was added */
+  d = ALLOCATE(sizeof(JOURNAL_DIFF), JOURNAL_DIFF);
+  memset(d, 0, sizeof(JOURNAL_DIFF));
+  d->from = jz->serial;
+  d->to = serial;
+  d->del = ALLOCATE((jz->nrecs + 1) * sizeof(MYDNS_RR *), MYDNS_RR *[]);
+  d->add = ALLOCATE((nrecs + 1) * sizeof(MYDNS_RR *), MYDNS_RR *[]);
+  while (i < jz->nrecs || j < nrecs) {
+    if (i >= jz->nrecs)
+      cmp = 1;
+    else if (j >= nrecs)
+      cmp = -1;
+    else
+      cmp = journal_rr_cmp(&jz->recs[i], &recs[j]);
+
+    if (cmp < 0)
+      d->del[d->ndel++] = mydns_rr_dup(jz->recs[i++], 0);
+    else if (cmp > 0)
+      d->add[d->nadd++] = mydns_rr_dup(recs[j++], 0);
+    else
+      i++, j++;
+  }
+
+#if DEBUG_ENABLED && DEBUG_JOURNAL
+  DebugX("ixfr", 1, _("IXFR journal for %s: serial %u -> %u, %d deleted, %d added"),
+	 jz->origin, d->from, d->to, d->ndel, d->nadd);
+#endif
+
+  journal_append(jz, d);
+  journal_rrs_free(jz->recs, jz->nrecs);
+  jz->recs = recs;
+  jz->nrecs = nrecs;
+  jz->serial = serial;
+  journal_save(jz);
+}
+/*--- journal_refresh() -------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	IXFR_JOURNAL_UPDATED
+	Called after a dynamic update changes `soa' so the change is recorded straight away.
+**************************************************************************************************/
+void
+ixfr_journal_updated(MYDNS_SOA *soa) {
+  JOURNAL_ZONE *jz = NULL;
+
+  if (!ixfr_journal_enabled || !(jz = journal_find(soa->id)))
+    return;
+  journal_refresh(jz, soa->serial);
+}
+/*--- ixfr_journal_updated() --------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	JOURNAL_ENCODED_SIZE
+	Returns an upper bound on the encoded size of `rr', as if no name were compressed: the owner,
+	the fixed fields, and the data (a name in the data grows by at most one byte, and the
+	priority of MX and SRV records takes a few more).
+**************************************************************************************************/
+static size_t
+journal_encoded_size(MYDNS_RR *rr) {
+  return (strlen(MYDNS_RR_NAME(rr)) + 2 + 10 + MYDNS_RR_DATA_LENGTH(rr) + 8);
+}
+/*--- journal_encoded_size() --------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	JOURNAL_CHAIN
+	Returns the first of the changes that lead from `serial' to the current `soa', or NULL if
+	the journal does not hold them all, if sending the whole zone would be no bigger, or if
+	they might not fit in one TCP message.
+	The zone is added to the journal if it is not already in it.
+**************************************************************************************************/
+static JOURNAL_DIFF *
+journal_chain(MYDNS_SOA *soa, uint32_t serial) {
+  JOURNAL_ZONE	*jz = NULL;
+  JOURNAL_DIFF	*d = NULL, *start = NULL;
+  size_t	size = sizeof(DNS_HEADER) + strlen(soa->origin) + 6;
+  size_t	soasize = strlen(soa->origin) + 12 + strlen(soa->ns) + strlen(soa->mbox) + 24;
+  int		records = 0;
+  register int	n = 0;
+
+  if (!ixfr_journal_enabled || !soa->id)
+    return (NULL);
+
+  if (!(jz = journal_find(soa->id))) {
+    /* Start keeping a journal; it is read from the database at the next check */
+    jz = ALLOCATE(sizeof(JOURNAL_ZONE), JOURNAL_ZONE);
+    memset(jz, 0, sizeof(JOURNAL_ZONE));
+    jz->zone = soa->id;
+    jz->origin = STRDUP(soa->origin);
+    jz->nrecs = -1;
+    jz->next = Journal[soa->id % JOURNAL_HASH_SIZE];
+    Journal[soa->id % JOURNAL_HASH_SIZE] = jz;
+    return (NULL);
+  }
+  if (jz->nrecs < 0 || jz->serial != soa->serial || !jz->tail || jz->tail->to != soa->serial)
+    return (NULL);
+
+  /* Find the most recent change from the client's serial; the rest of the list follows on */
+  for (d = jz->head; d; d = d->next)
+    if (d->from == serial)
+      start = d;
+  if (!start)
+    return (NULL);
+
+  /* Send the whole zone instead if that is no bigger, or if the changes might not fit */
+  size += 2 * soasize;
+  for (d = start; d; d = d->next) {
+    records += d->ndel + d->nadd + 2;
+    size += 2 * soasize;
+    for (n = 0; n < d->ndel; n++)
+      size += journal_encoded_size(d->del[n]);
+    for (n = 0; n < d->nadd; n++)
+      size += journal_encoded_size(d->add[n]);
+  }
+  if (records >= jz->nrecs + 2 || size >= DNS_MAXPACKETLEN_TCP)
+    return (NULL);
+  return (start);
+}
+/*--- journal_chain() ---------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	IXFR_JOURNAL_COVERS
+	Returns 1 if an IXFR from `serial' can be answered without a full zone transfer: the client
+	is up to date, or the journal holds every change since its serial.
+**************************************************************************************************/
+int
+ixfr_journal_covers(MYDNS_SOA *soa, uint32_t serial) {
+  return (soa->serial == serial || journal_chain(soa, serial) != NULL);
+}
+/*--- ixfr_journal_covers() ---------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	IXFR_JOURNAL_ANSWER
+	Adds the incremental transfer from `serial' to the current `soa' to the answer, as described
+	in RFC 1995: the current SOA, then for each change the old SOA, the records removed, the new
+	SOA and the records added, and the current SOA again.
+	Returns the number of changes sent, or 0 if the journal can't answer.
+**************************************************************************************************/
+int
+ixfr_journal_answer(TASK *t, MYDNS_SOA *soa, uint32_t serial) {
+  JOURNAL_DIFF	*d = NULL, *start = NULL;
+  uint32_t	latest_serial = soa->serial;
+  int		count = 0;
+  register int	n = 0;
+
+  if (!(start = journal_chain(soa, serial)))
+    return (0);
+
+  rrlist_add(t, ANSWER, DNS_RRTYPE_SOA, (void *)soa, soa->origin);
+  for (d = start; d; d = d->next, count++) {
+    soa->serial = d->from;
+    rrlist_add(t, ANSWER, DNS_RRTYPE_SOA, (void *)soa, soa->origin);
+    for (n = 0; n < d->ndel; n++)
+      rrlist_add(t, ANSWER, DNS_RRTYPE_RR, (void *)d->del[n], MYDNS_RR_NAME(d->del[n]));
+    soa->serial = d->to;
+    rrlist_add(t, ANSWER, DNS_RRTYPE_SOA, (void *)soa, soa->origin);
+    for (n = 0; n < d->nadd; n++)
+      rrlist_add(t, ANSWER, DNS_RRTYPE_RR, (void *)d->add[n], MYDNS_RR_NAME(d->add[n]));
+  }
+  soa->serial = latest_serial;
+  rrlist_add(t, ANSWER, DNS_RRTYPE_SOA, (void *)soa, soa->origin);
+  t->sort_level++;
+
+#if DEBUG_ENABLED && DEBUG_JOURNAL
+  DebugX("ixfr", 1, _("%s: IXFR for %s from journal: serial %u -> %u in %d changes"),
+	 desctask(t), soa->origin, serial, latest_serial, count);
+#endif
+  return (count);
+}
+/*--- ixfr_journal_answer() ---------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	JOURNAL_CHECK_SERIALS
+	Periodic task: reads the serial of every zone and refreshes the journals of zones that
+	changed outside of dynamic update.
+**************************************************************************************************/
+static taskexec_t
+journal_check_serials(TASK *t, void *data) {
+  SQL_RES	*res = NULL;
+  SQL_ROW	row = NULL;
+  char		*query = NULL;
+  size_t	querylen = 0;
+
+  t->timeout = current_time + ixfr_journal_interval;
+
+  querylen = sql_build_query(&query, "SELECT "JOURNAL_SOA_ID",serial FROM %s%s%s;",
+			     mydns_soa_table_name,
+			     (mydns_soa_where_clause)? " WHERE " : "",
+			     (mydns_soa_where_clause)? mydns_soa_where_clause : "");
+  res = sql_query(sql, query, querylen);
+  RELEASE(query);
+  if (!res) {
+    WarnSQL(sql, "%s: %s", desctask(t), _("error loading zone serials for IXFR journal"));
+    return (TASK_CONTINUE);
+  }
+
+  while ((row = sql_getrow(res, NULL))) {
+    JOURNAL_ZONE *jz = NULL;
+
+    if ((jz = journal_find(atou(row[0]))))
+      journal_refresh(jz, atou(row[1]));
+  }
+  sql_free(res);
+
+  return (TASK_CONTINUE);
+}
+/*--- journal_check_serials() -------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	IXFR_JOURNAL_START
+	Starts the task that watches zone serials for the IXFR journal.
+**************************************************************************************************/
+void
+ixfr_journal_start(void) {
+  TASK *inittask = NULL;
+
+  if (!dns_ixfr_enabled || !ixfr_journal_enabled)
+    return;
+
+  inittask = Ticktask_init(LOW_PRIORITY_TASK, NEED_TASK_RUN, -1, 0, AF_UNSPEC, NULL);
+  task_add_extension(inittask, NULL, NULL, NULL, journal_check_serials);
+  inittask->timeout = current_time + ixfr_journal_interval;
+}
+/*--- ixfr_journal_start() ----------------------------------------------------------------------*/
+
+/* vi:set ts=3: */
+/* NEED_PO */
@@ -0,0 +1,325 @@
+/**************************************************************************************************
+	Copyright (C) 2002-2005  Don Moore <bboy@bboy.net>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at Your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+**************************************************************************************************/
+
+/*
+**  Query latency.
+**
+**  One query in every `latency-sample' is timed at the boundaries of each stage it goes
+**  through (reply cache, resolve, GeoIP, DNSSEC, encoding and the write), and the time spent
+**  in each is added to a log-linear histogram for that stage, protocol and cache result.
+**  Buckets are 1/16th of a power of two wide, so any value read back is within about 6%.
+**
+**  Times are taken from the time stamp counter where there is one and converted to seconds
+**  only when read, against the clock measured over the same interval.  As with the heavy
+**  hitters, each server fills its own slot of a block mapped before the master forks, so
+**  no update takes a lock, and readers merge the slots.
+*/
+
+#include "named.h"
+
+#include <sys/mman.h>
+
+/* Make this nonzero to enable debugging for this source file */
+#define	DEBUG_LATENCY	1
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS		MAP_ANON
+#endif
+
+#define LH_SUB_BITS		4				/* log2 of the buckets per power of two */
+#define LH_SUB			(1 << LH_SUB_BITS)
+#define LH_MAX_EXP		47				/* Larger values share the last bucket */
+#define LH_BUCKETS		((LH_MAX_EXP - LH_SUB_BITS + 2) * LH_SUB)
+
+typedef struct _latency_hist {
+  uint32_t	count;
+  uint64_t	sum;						/* Ticks */
+  uint32_t	buckets[LH_BUCKETS];
+} LATENCY_HIST;
+
+typedef struct _latency_slot {
+  LATENCY_HIST	hist[LATENCY_STAGES][2][2];			/* [stage][tcp][cache hit] */
+} LATENCY_SLOT;
+
+static LATENCY_SLOT	*Slots = NULL;				/* One per server */
+static int		NumSlots = 0;
+static LATENCY_SLOT	*Mine = NULL;				/* The slot this process fills */
+static uint32_t		Unsampled = 0;				/* Queries since one was timed */
+
+static uint64_t		CalibrationTicks = 0;			/* Ticks and usec at latency_init() */
+static uint64_t		CalibrationUsec = 0;
+
+const double latency_quantiles[LATENCY_QUANTILES] = { 0.5, 0.9, 0.99, 0.999 };
+
+static const char *latency_stage_names[LATENCY_STAGES] = {
+  "cache", "resolve", "geoip", "dnssec", "encode", "write", "total"
+};
+
+
+/**************************************************************************************************
+	LATENCY_USEC
+	The current time in microseconds, from a clock that does not jump.
+**************************************************************************************************/
+static uint64_t
+latency_usec(void) {
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  if (!clock_gettime(CLOCK_MONOTONIC, &ts))
+    return ((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#endif
+  {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((uint64_t)tv.tv_sec * 1000000 + tv.tv_usec);
+  }
+}
+/*--- latency_usec() ----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	LATENCY_TICKS
+	Reads the time stamp counter, or the clock in nanoseconds where there is none.
+**************************************************************************************************/
+uint64_t
+latency_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  uint32_t lo, hi;
+
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return (((uint64_t)hi << 32) | lo);
+#else
+  return (latency_usec() * 1000);
+#endif
+}
+/*--- latency_ticks() ---------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	LATENCY_INIT
+	Maps the histograms for `slots' servers.  Called before the servers are spawned.
+**************************************************************************************************/
+void
+latency_init(int slots) {
+  if (latency_sample <= 0 || slots <= 0)
+    return;
+
+  Slots = mmap(NULL, slots * sizeof(LATENCY_SLOT), PROT_READ | PROT_WRITE,
+	       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (Slots == MAP_FAILED) {
+    Warn(_("error mapping latency histograms"));
+    Slots = NULL;
+    return;
+  }
+  NumSlots = slots;
+  CalibrationTicks = latency_ticks();
+  CalibrationUsec = latency_usec();
+}
+/*--- latency_init() ----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	LATENCY_ATTACH
+	Makes `slot' the one this process records its queries in.
+**************************************************************************************************/
+void
+latency_attach(int slot) {
+  if (!Slots || slot < 0 || slot >= NumSlots)
+    return;
+  Mine = &Slots[slot];
+  memset(Mine, 0, sizeof(LATENCY_SLOT));
+}
+/*--- latency_attach() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	LATENCY_START
+	Decides whether to time `t', and if so notes when it arrived.
+**************************************************************************************************/
+void
+latency_start(TASK *t) {
+  if (!Mine || ++Unsampled < (uint32_t)latency_sample)
+    return;
+  Unsampled = 0;
+  t->latency_sampled = 1;
+  t->latency_start = latency_ticks();
+}
+/*--- latency_start() ---------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	LATENCY_BUCKET
+	Returns the histogram bucket for `v' ticks.
+**************************************************************************************************/
+static inline int
+latency_bucket(uint64_t v) {
+  int e = 0;
+
+  if (v < LH_SUB)
+    return (v);
+  e = 63 - __builtin_clzll(v);
+  if (e > LH_MAX_EXP)
+    return (LH_BUCKETS - 1);
+  return ((e - LH_SUB_BITS + 1) * LH_SUB + ((v >> (e - LH_SUB_BITS)) & (LH_SUB - 1)));
+}
+/*--- latency_bucket() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	LATENCY_BUCKET_HIGH
+	Returns the largest number of ticks counted in bucket `b'.
+**************************************************************************************************/
+static uint64_t
+latency_bucket_high(int b) {
+  int e = 0;
+
+  if (b < LH_SUB)
+    return (b);
+  e = b / LH_SUB + LH_SUB_BITS - 1;
+  return ((((uint64_t)(LH_SUB + b % LH_SUB) + 1) << (e - LH_SUB_BITS)) - 1);
+}
+/*--- latency_bucket_high() ---------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	LATENCY_ADD
+	Adds the stage times of `t' to the histograms.  Called as the task is dequeued.
+**************************************************************************************************/
+void
+latency_add(TASK *t) {
+  LATENCY_HIST	*h = NULL;
+  int		stage = 0, tcp = (t->protocol == SOCK_STREAM), hit = (t->reply_from_cache != 0);
+  uint64_t	v = 0;
+
+  if (!Mine || !t->latency_sampled)
+    return;
+
+  /* A query that was written has a total */
+  if (t->latency_stages & (1 << LS_WRITE)) {
+    t->latency[LS_TOTAL] = latency_ticks() - t->latency_start;
+    t->latency_stages |= (1 << LS_TOTAL);
+  }
+
+  for (stage = 0; stage < LATENCY_STAGES; stage++) {
+    if (!(t->latency_stages & (1 << stage)))
+      continue;
+    h = &Mine->hist[stage][tcp][hit];
+    v = t->latency[stage];
+    __atomic_store_n(&h->buckets[latency_bucket(v)], h->buckets[latency_bucket(v)] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->sum, h->sum + v, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+  }
+}
+/*--- latency_add() -----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	LATENCY_SECONDS
+	Converts `ticks' to seconds.
+**************************************************************************************************/
+static double
+latency_seconds(uint64_t ticks) {
+#if defined(__x86_64__) || defined(__i386__)
+  uint64_t usec = latency_usec() - CalibrationUsec;
+  uint64_t elapsed = latency_ticks() - CalibrationTicks;
+
+  if (!usec || !elapsed)
+    return (0.0);
+  return ((double)ticks * usec / elapsed / 1000000.0);
+#else
+  return (ticks / 1000000000.0);
+#endif
+}
+/*--- latency_seconds() -------------------------------------------------------------------------*/
+
+
+const char *
+latency_stage_name(int stage) {
+  return ((stage >= 0 && stage < LATENCY_STAGES) ? latency_stage_names[stage] : "unknown");
+}
+
+
+/**************************************************************************************************
+	LATENCY_SUMMARY
+	Merges the histograms of all servers for `stage', protocol and cache result into `s'.
+	Returns the number of queries counted.
+**************************************************************************************************/
+uint32_t
+latency_summary(int stage, int tcp, int hit, LATENCY_SUMMARY *s) {
+  uint32_t	*buckets = NULL, seen = 0;
+  uint64_t	sum = 0;
+  int		slot = 0, b = 0, q = 0;
+
+  memset(s, 0, sizeof(*s));
+  if (!Slots || stage < 0 || stage >= LATENCY_STAGES)
+    return (0);
+
+  buckets = ALLOCATE(LH_BUCKETS * sizeof(uint32_t), uint32_t[]);
+  for (slot = 0; slot < NumSlots; slot++) {
+    LATENCY_HIST *h = &Slots[slot].hist[stage][tcp ? 1 : 0][hit ? 1 : 0];
+
+    for (b = 0; b < LH_BUCKETS; b++) {
+      uint32_t n = __atomic_load_n(&h->buckets[b], __ATOMIC_RELAXED);
+
+      buckets[b] += n;
+      s->count += n;
+    }
+    sum += __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+  }
+  s->sum = latency_seconds(sum);
+
+  /* Each quantile is the top of the bucket the count reaches it in */
+  for (b = 0; b < LH_BUCKETS && q < LATENCY_QUANTILES && s->count; b++) {
+    seen += buckets[b];
+    while (q < LATENCY_QUANTILES && seen && seen >= latency_quantiles[q] * s->count)
+      s->quantile[q++] = latency_seconds(latency_bucket_high(b));
+  }
+  RELEASE(buckets);
+  return (s->count);
+}
+/*--- latency_summary() -------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	LATENCY_STATUS
+	Outputs the quantiles of every histogram that has counted anything.
+**************************************************************************************************/
+void
+latency_status(void) {
+  LATENCY_SUMMARY	s;
+  int			stage = 0, tcp = 0, hit = 0;
+
+  if (!Slots)
+    return;
+
+  for (stage = 0; stage < LATENCY_STAGES; stage++)
+    for (tcp = 0; tcp < 2; tcp++)
+      for (hit = 0; hit < 2; hit++) {
+	if (!latency_summary(stage, tcp, hit, &s))
+	  continue;
+	Notice(_("latency %s %s %s: %u queries, p50 %.0fus p90 %.0fus p99 %.0fus p99.9 %.0fus"),
+	       latency_stage_names[stage], tcp ? "tcp" : "udp", hit ? _("hit") : _("miss"),
+	       s.count, s.quantile[0] * 1e6, s.quantile[1] * 1e6, s.quantile[2] * 1e6,
+	       s.quantile[3] * 1e6);
+      }
+}
+/*--- latency_status() --------------------------------------------------------------------------*/
+
+/* vi:set ts=3: */
+/* NEED_PO */
@@ -71,15 +71,19 @@ INITIALTASK	master_initial_tasks[] = {
 INITIALTASK	primary_initial_tasks[] = {
   { notify_start,	"NOTIFY" },
   { task_start,		"TASK" },
+  { ixfr_journal_start,	"JOURNAL" },
+  { metrics_start,	"METRICS" },
   { NULL,		NULL }
 };
 
 INITIALTASK	process_initial_tasks[] = {
   { task_start,		"TASK" },
+  { ixfr_journal_start,	"JOURNAL" },
+  { metrics_start,	"METRICS" },
   { NULL,		NULL }
 };
 
-static SERVER	*spawn_server(INITIALTASK *);
+static SERVER	*spawn_server(INITIALTASK *, int);
 
 /**************************************************************************************************
 	USAGE
@@ -433,6 +437,36 @@ server_status(void) {
 		  (unsigned long)Status.tcp_requests);
 
   Notice("%s", buf);
+
+  /* Reply sizes, and what filling ADDITIONAL for NS/MX/SRV answers costs */
+  b = buf;
+  b += snprintf(b, sizeof(buf)-(b-buf), "%u %s ", Status.replies, _("replies"));
+  b += snprintf(b, sizeof(buf)-(b-buf), "(%.0f %s, %u %s) ",
+		Status.replies ? (double)Status.reply_bytes / Status.replies : 0.0, _("bytes avg"),
+		Status.truncated, _("truncated"));
+  b += snprintf(b, sizeof(buf)-(b-buf), "%u %s %.2f %s ", Status.additional_replies,
+		_("NS/MX/SRV replies at"),
+		Status.additional_replies ? (double)Status.additional_lookups / Status.additional_replies : 0.0,
+		_("lookups each"));
+  b += snprintf(b, sizeof(buf)-(b-buf), "(%u %s%s)", Status.glue_hits, _("glue cache hits"),
+		minimal_responses ? _(", minimal responses") : "");
+  Notice("%s", buf);
+
+  /* DNS UPDATE throughput, and how long the zone was locked for it */
+  if (Status.update_commits) {
+    b = buf;
+    b += snprintf(b, sizeof(buf)-(b-buf), "%u %s %u %s ", Status.update_messages, _("UPDATE messages in"),
+		  Status.update_commits, _("commits"));
+    b += snprintf(b, sizeof(buf)-(b-buf), "%u %s (%.0f/s %s) ", Status.update_changes, _("changes"),
+		  Status.update_lock_usec ? Status.update_changes * 1000000.0 / Status.update_lock_usec : 0.0,
+		  _("while locked"));
+    b += snprintf(b, sizeof(buf)-(b-buf), "%s %.1f ms %s, %.1f ms %s", _("lock held"),
+		  (double)Status.update_lock_usec / Status.update_commits / 1000.0, _("avg"),
+		  Status.update_lock_max_usec / 1000.0, _("max"));
+    Notice("%s", buf);
+  }
+
+  querylog_status();
 }
 /*--- server_status() ---------------------------------------------------------------------------*/
 
@@ -450,12 +484,19 @@ master_sigusr1(int dummy) {
   int n = 0;
   for (n = 0; n < array_numobjects(Servers); n++)
     kill_server((SERVER*)array_fetch(Servers, n), SIGUSR1);
+  heavyhitters_status();
+  latency_status();
   got_sigusr1 = 0;
 }
 
 static void
 sigusr1(int dummy) {
   server_status();
+  auditlog_status();
+  if (Servers) {					/* Single process: there is no master to merge */
+    heavyhitters_status();
+    latency_status();
+  }
   got_sigusr1 = 0;
 }
 /*--- sigusr1() ---------------------------------------------------------------------------------*/
@@ -463,7 +504,7 @@ sigusr1(int dummy) {
 
 /**************************************************************************************************
 	SIGUSR2
-	Outputs cache stats.
+	Outputs cache and allocator stats.
 **************************************************************************************************/
 static void
 master_sigusr2(int dummy) {
@@ -480,6 +521,9 @@ sigusr2(int dummy) {
   cache_status(NegativeCache);
 #endif
   cache_status(ReplyCache);
+  cache_status(AliasCache);
+  cache_status(GlueCache);
+  memman_status();
   got_sigusr2 = 0;
 }
 /*--- sigusr2() ---------------------------------------------------------------------------------*/
@@ -499,11 +543,7 @@ master_sighup(int dummy) {
 static void
 sighup(int dummy) {
 
-  cache_empty(ZoneCache);
-#if USE_NEGATIVE_CACHE
-  cache_empty(NegativeCache);
-#endif
-  cache_empty(ReplyCache);
+  cache_flush();
   db_check_optional();
   Notice(_("SIGHUP received: cache emptied, tables reloaded"));
   got_sighup = 0;
@@ -619,6 +659,9 @@ named_shutdown(int signo) {
     Notice(_("exiting due to signal %d"), signo); break;
   }
 
+  /* Write what audit log rows this process has queued */
+  auditlog_close();
+
   server_status();
 
   free_all_tasks();
@@ -628,6 +671,8 @@ named_shutdown(int signo) {
   cache_empty(NegativeCache);
 #endif
   cache_empty(ReplyCache);
+  cache_empty(AliasCache);
+  cache_empty(GlueCache);
 
   /* Free GeoIP context */
   if (GeoIP) {
@@ -709,6 +754,8 @@ master_shutdown(int signo) {
   if (running_procs) {
     Notice(_("%d Clones did not die"), running_procs);
   }
+  querylog_close();
+
   for (n = 0; n < array_numobjects(Servers); n++) {
       SERVER	*server = (SERVER*)array_fetch(Servers, n);
     if (server->pid != -1) {
@@ -801,10 +848,12 @@ master_child_cleanup(int signo) {
 	else {
 	  if (server->listener) dequeue(server->listener);
 	  close(server->serverfd);
+	  querylog_drain();				/* Keep what it logged before dying */
+	  querylog_ring_free(server->querylog);
 	  RELEASE(server);
 	  array_store(Servers, n, NULL);
-	  if (n == 0) server = spawn_server(primary_initial_tasks);
-	  else server = spawn_server(process_initial_tasks);
+	  if (n == 0) server = spawn_server(primary_initial_tasks, n);
+	  else server = spawn_server(process_initial_tasks, n);
 	  server->listener = mcomms_start(server->serverfd);
 	  array_store(Servers, n, server);
 	}
@@ -915,12 +964,6 @@ buildIOtaskItem(TASK *t) {
   static struct pollfd	_item;
   struct pollfd		*item = NULL;
 
-  /* Debug: Log all IO tasks with NEED_RECURSIVE_FWD_READ status */
-  if (t->status == 262417) { /* NEED_RECURSIVE_FWD_READ */
-    Warnx(_("DEBUG buildIOtaskItem: Master task fd=%d, status=%d, has_fd=%d, needs_mask=%d"),
-          t->fd, t->status, (t->fd != 0), (t->status & (Needs2Read|Needs2Write)));
-  }
-
   if (t->fd && (t->status & (Needs2Read|Needs2Write))) {
     item = &_item;
     item->fd = t->fd;
@@ -932,14 +975,6 @@ buildIOtaskItem(TASK *t) {
     if (t->status & Needs2Write) {
       item->events |= POLLOUT;
     }
-
-    /* Debug: Log when master task is added to items */
-    if (t->status == 262417) {
-      Warnx(_("DEBUG buildIOtaskItem: Master task ADDED to poll items, fd=%d, events=%d"),
-            item->fd, item->events);
-    }
-  } else if (t->status == 262417) {
-    Warnx(_("DEBUG buildIOtaskItem: Master task NOT added - fd check or status check failed"));
   }
   return item;
 }
@@ -1024,22 +1059,6 @@ static void
 scheduleTasks(struct pollfd *items[], int *timeoutWanted, int *numfds, int *maxnumfds) {
   int i = 0, j = 0;
 
-  /* Debug: Log IO_TASK queue before scheduling */
-  QUEUE *ioTaskQ = TaskArray[IO_TASK][HIGH_PRIORITY_TASK];
-  TASK *temp = ioTaskQ->head;
-  int count = 0;
-  while (temp) {
-    if (temp->status == 262417) { /* NEED_RECURSIVE_FWD_READ */
-      Warnx(_("DEBUG scheduleTasks: Found master task in IO_TASK queue, fd=%d, status=%d"),
-            temp->fd, temp->status);
-    }
-    temp = temp->next;
-    count++;
-  }
-  if (count > 0) {
-    Warnx(_("DEBUG scheduleTasks: IO_TASK queue has %d tasks"), count);
-  }
-
   for (i = NORMAL_TASK; i <= PERIODIC_TASK; i++) {
     for (j = HIGH_PRIORITY_TASK; j <= LOW_PRIORITY_TASK; j++) {
       scheduleTaskQ(TaskArray[i][j], items, timeoutWanted, numfds, maxnumfds);
@@ -1062,22 +1081,6 @@ run_tasks(struct pollfd items[], int numfds) {
   int rfd = 0, wfd = 0, efd = 0, fd;
   struct pollfd *item = NULL;
 
-  /* Debug: Log all tasks in IO_TASK HIGH_PRIORITY queue */
-  {
-    QUEUE *ioTaskQ = TaskArray[IO_TASK][HIGH_PRIORITY_TASK];
-    TASK *temp = ioTaskQ->head;
-    int count = 0;
-    Warnx(_("DEBUG run_tasks: Checking IO_TASK queue, head=%p"), ioTaskQ->head);
-    while (temp) {
-      count++;
-      Warnx(_("DEBUG run_tasks: IO task #%d: status=%d, fd=%d, IsRecursive=%d, qname=%s"),
-            count, temp->status, temp->fd, TaskIsRecursive(temp->status),
-            temp->qname ? temp->qname : "(null)");
-      temp = temp->next;
-    }
-    Warnx(_("DEBUG run_tasks: Total IO tasks: %d"), count);
-  }
-
   /* Process tasks */
   for (j = HIGH_PRIORITY_TASK; j <= LOW_PRIORITY_TASK; j++) {
     for (i = NORMAL_TASK; i <= PERIODIC_TASK; i++) {
@@ -1085,12 +1088,6 @@ run_tasks(struct pollfd items[], int numfds) {
       for (t = TaskQ->head; t; t = next_task) {
 	next_task = t->next;
 
-	/* Debug: Log recursive tasks */
-	if (TaskIsRecursive(t->status)) {
-	  Warnx(_("DEBUG run_tasks: Found recursive task %s, type=%d, status=%d, fd=%d"),
-	        t->qname, t->type, t->status, t->fd);
-	}
-
 	rfd = 0; wfd = 0; efd = 0;
 	fd = t->fd;
 	if (fd >= 0) {
@@ -1117,18 +1114,6 @@ run_tasks(struct pollfd items[], int numfds) {
 	    purge_bad_task(t);
 	    continue;
 	  } else {
-	    /* Debug: Log if recursive tasks are being skipped */
-	    if (TaskIsRecursive(t->status)) {
-	      if ((t->status & Needs2Read) && !rfd) {
-	        Warnx(_("DEBUG run_tasks: SKIPPING recursive task %s - needs read but no rfd"), t->qname);
-	        continue;
-	      }
-	      if ((t->status & Needs2Write) && !wfd) {
-	        Warnx(_("DEBUG run_tasks: SKIPPING recursive task %s - needs write but no wfd (item=%p)"),
-	              t->qname, item);
-	        continue;
-	      }
-	    }
 	    if ((t->status & Needs2Read) && !rfd) continue;
 	    if ((t->status & Needs2Write) && !wfd) continue;
 	  }
@@ -1139,11 +1124,6 @@ run_tasks(struct pollfd items[], int numfds) {
 #endif
 	}
 
-	/* Debug: Log before calling task_process for recursive tasks */
-	if (TaskIsRecursive(t->status)) {
-	  Warnx(_("DEBUG run_tasks: About to call task_process() for recursive task %s"), t->qname);
-	}
-
 	tasks_executed += task_process(t, rfd, wfd, efd);
 	if (shutting_down) break;
       }
@@ -1233,25 +1213,24 @@ server_loop(INITIALTASK *initial_tasks, int serverfd) {
   struct pollfd	*items = NULL;
   int maxnumfds = 0;
 
-  Warnx(_("DEBUG: server_loop() ENTRY"));
+  Log(LOG_DEBUG, _("server_loop() ENTRY"));
   do_initial_tasks(initial_tasks);
-  Warnx(_("DEBUG: server_loop() after do_initial_tasks()"));
+  Log(LOG_DEBUG, _("server_loop() after do_initial_tasks()"));
 
-  Warnx(_("DEBUG: server_loop() about to call udp_start()"));
+  Log(LOG_DEBUG, _("server_loop() about to call udp_start()"));
   udp_start();
-  Warnx(_("DEBUG: server_loop() after udp_start(), about to call tcp_start()"));
+  Log(LOG_DEBUG, _("server_loop() after udp_start(), about to call tcp_start()"));
   tcp_start();
-  Warnx(_("DEBUG: server_loop() after tcp_start()"));
+  Log(LOG_DEBUG, _("server_loop() after tcp_start()"));
 
   if (serverfd >= 0) {
     fcntl(serverfd, F_SETFL, fcntl(serverfd, F_GETFL, 0) | O_NONBLOCK);
     scomms_start(serverfd);
   }
 
-  Warnx(_("DEBUG: server_loop() about to enter main event loop"));
+  Log(LOG_DEBUG, _("server_loop() about to enter main event loop"));
 
   /* Main loop: Read connections and process queue */
-  static int loop_count = 0;
   for (;;) {
     int			numfds = 0;
     int			rv = 0;
@@ -1259,10 +1238,6 @@ server_loop(INITIALTASK *initial_tasks, int serverfd) {
     struct timeval	tv = { 0, 0 };
     struct timeval	*tvp = NULL;
 
-    if (++loop_count <= 5) {
-      Warnx(_("DEBUG: server_loop() iteration %d"), loop_count);
-    }
-
     /* Handle signals */
     if (got_sighup) sighup(SIGHUP);
     if (got_sigusr1) sigusr1(SIGUSR1);
@@ -1299,6 +1274,14 @@ server_loop(INITIALTASK *initial_tasks, int serverfd) {
       timeoutWanted *= 1000;
     }
 
+    /* Wake up often enough to keep the query log rings from filling */
+    if (querylog_draining() && (timeoutWanted < 0 || timeoutWanted > QUERYLOG_DRAIN_MSEC)) {
+      tv.tv_sec = 0;
+      tv.tv_usec = QUERYLOG_DRAIN_MSEC * 1000;
+      tvp = &tv;
+      timeoutWanted = QUERYLOG_DRAIN_MSEC;
+    }
+
 #if HAVE_POLL
 #if DEBUG_ENABLED
       DebugX("enabled", 1, _("Polling for IO numfds = %d, timeout = %s(%d)"), numfds,
@@ -1398,19 +1381,22 @@ server_loop(INITIALTASK *initial_tasks, int serverfd) {
     if (shutting_down) { break; }
 
     run_tasks(items, numfds);
+    querylog_drain();
   }
 
   RELEASE(items);
+  querylog_close();
   named_shutdown(shutting_down);
 
 }
 
 static SERVER *
-spawn_server(INITIALTASK *initial_tasks) {
+spawn_server(INITIALTASK *initial_tasks, int slot) {
   pid_t	pid = -1;
   int	fd[2] = { -1, -1 };
   int	masterfd = -1, serverfd = -1;
   int	res = 0, n = 0;
+  QUERYLOG_RING *querylog = NULL;
 
 
   res = socketpair(PF_UNIX, SOCK_DGRAM, 0, fd);
@@ -1433,6 +1419,9 @@ spawn_server(INITIALTASK *initial_tasks) {
   fcntl(masterfd, F_SETFL, fcntl(masterfd, F_GETFL, 0) | O_NONBLOCK);
   fcntl(serverfd, F_SETFL, fcntl(serverfd, F_GETFL, 0) | O_NONBLOCK);
 
+  if (querylog_enabled)
+    querylog = querylog_ring_new();
+
   if ((pid = fork()) < 0)
     Err(_("fork"));
 
@@ -1442,6 +1431,7 @@ spawn_server(INITIALTASK *initial_tasks) {
     server->serverfd = masterfd;
     server->listener = NULL;
     server->signalled = 0;
+    server->querylog = querylog;
     close(serverfd);
 
     return server;
@@ -1459,6 +1449,7 @@ spawn_server(INITIALTASK *initial_tasks) {
       DebugX("enabled", 1, _("closing fd %d"), server->serverfd);
 #endif
       close(server->serverfd);
+      querylog_ring_free(server->querylog);
       RELEASE(server);
     }
   }
@@ -1466,6 +1457,11 @@ spawn_server(INITIALTASK *initial_tasks) {
   array_free(Servers, 0);
   Servers = NULL;
 
+  querylog_attach(querylog, 0);
+  heavyhitters_attach(slot);
+  metrics_attach(slot);
+  latency_attach(slot);
+
   close(masterfd);
 
   /* Delete pre-existing tasks as they belong to master */
@@ -1477,10 +1473,10 @@ spawn_server(INITIALTASK *initial_tasks) {
   sql_close(sql); /* Release the database connection held by the master */
 
   db_connect();
-  Warnx(_("DEBUG: WORKER about to call server_loop()"));
+  Log(LOG_DEBUG, _("WORKER about to call server_loop()"));
 
   server_loop(initial_tasks, serverfd);
-  Warnx(_("DEBUG: WORKER returned from server_loop() - this should never happen"));
+  Log(LOG_DEBUG, _("WORKER returned from server_loop() - this should never happen"));
 
   exit(EXIT_SUCCESS);
 
@@ -1540,6 +1536,14 @@ master_loop(INITIALTASK *initial_tasks) {
       timeoutWanted *= 1000;
     }
 
+    /* Wake up often enough to keep the query log rings from filling */
+    if (querylog_draining() && (timeoutWanted < 0 || timeoutWanted > QUERYLOG_DRAIN_MSEC)) {
+      tv.tv_sec = 0;
+      tv.tv_usec = QUERYLOG_DRAIN_MSEC * 1000;
+      tvp = &tv;
+      timeoutWanted = QUERYLOG_DRAIN_MSEC;
+    }
+
 #if HAVE_POLL
 #if DEBUG_ENABLED
       DebugX("enabled", 1, _("Selecting for IO numfds = %d, timeout = %s(%d)"), numfds,
@@ -1638,6 +1642,7 @@ master_loop(INITIALTASK *initial_tasks) {
     if (shutting_down) { break; }
 
     run_tasks(items, numfds);
+    querylog_drain();
   }
 
   RELEASE(items);
@@ -1660,9 +1665,9 @@ main(int argc, char **argv)
   bindtextdomain(PACKAGE, LOCALEDIR);
   textdomain(PACKAGE);
 
-  Warnx(_("DEBUG: main() about to call cmdline()"));
+  Log(LOG_DEBUG, _("main() about to call cmdline()"));
   cmdline(argc, argv);					/* Process command line */
-  Warnx(_("DEBUG: main() after cmdline()"));
+  Log(LOG_DEBUG, _("main() after cmdline()"));
 
 
   /* Set hostname */
@@ -1689,59 +1694,60 @@ main(int argc, char **argv)
   __set_sighandler(SIGABRT, named_cleanup, &mask);
   __set_sighandler(SIGTERM, named_cleanup, &mask);
 
-  Warnx(_("DEBUG: main() about to call init_rlimits()"));
+  Log(LOG_DEBUG, _("main() about to call init_rlimits()"));
   init_rlimits();
 
-  Warnx(_("DEBUG: main() after init_rlimits()"));
+  Log(LOG_DEBUG, _("main() after init_rlimits()"));
   if (opt_daemon) {					/* Move into background if requested */
-    Warnx(_("DEBUG: main() opt_daemon=1, about to call become_daemon()"));
+    Log(LOG_DEBUG, _("main() opt_daemon=1, about to call become_daemon()"));
     become_daemon();
-    Warnx(_("DEBUG: main() after become_daemon()"));
+    Log(LOG_DEBUG, _("main() after become_daemon()"));
   } else {
-    Warnx(_("DEBUG: main() opt_daemon=0, NOT becoming daemon"));
+    Log(LOG_DEBUG, _("main() opt_daemon=0, NOT becoming daemon"));
   }
 
-  Warnx(_("DEBUG: main() about to call conf_set_logging()"));
+  Log(LOG_DEBUG, _("main() about to call conf_set_logging()"));
   conf_set_logging();
-  Warnx(_("DEBUG: main() about to call db_connect()"));
+  querylog_init();
+  Log(LOG_DEBUG, _("main() about to call db_connect()"));
   db_connect();
-  Warnx(_("DEBUG: main() after db_connect()"));
+  Log(LOG_DEBUG, _("main() after db_connect()"));
   create_pidfile();					/* Create PID file */
-  Warnx(_("DEBUG: main() after create_pidfile()"));
+  Log(LOG_DEBUG, _("main() after create_pidfile()"));
 
   /* Initialize GeoIP */
-  Warnx(_("DEBUG: main() about to call geoip_init()"));
+  Log(LOG_DEBUG, _("main() about to call geoip_init()"));
   GeoIP = geoip_init(sql);
-  Warnx(_("DEBUG: main() after geoip_init(), GeoIP=%p"), GeoIP);
+  Log(LOG_DEBUG, _("main() after geoip_init(), GeoIP=%p"), GeoIP);
   if (!GeoIP) {
-    Warnx(_("DEBUG: main() GeoIP is NULL"));
+    Log(LOG_DEBUG, _("main() GeoIP is NULL"));
     Warnx(_("GeoIP initialization failed - geographic features disabled"));
   } else {
-    Warnx(_("DEBUG: main() GeoIP is NOT NULL, about to call Notice()"));
+    Log(LOG_DEBUG, _("main() GeoIP is NOT NULL, about to call Notice()"));
     Notice(_("GeoIP initialized successfully"));
-    Warnx(_("DEBUG: main() after Notice()"));
+    Log(LOG_DEBUG, _("main() after Notice()"));
   }
-  Warnx(_("DEBUG: main() after GeoIP if/else block"));
+  Log(LOG_DEBUG, _("main() after GeoIP if/else block"));
 
   /* Initialize in-memory zone storage (attach to existing shared memory created by mydns-xfer) */
-  Warnx(_("DEBUG: main() about to call memzone_init()"));
+  Log(LOG_DEBUG, _("main() about to call memzone_init()"));
   Memzone = memzone_init(0);  /* 0 = attach to existing, 1 = create new */
-  Warnx(_("DEBUG: main() after memzone_init(), Memzone=%p"), Memzone);
+  Log(LOG_DEBUG, _("main() after memzone_init(), Memzone=%p"), Memzone);
   if (!Memzone) {
     Warnx(_("Memzone initialization failed - AXFR slave zones will not work"));
   } else {
     /* Load ACL rules from database into memory */
-    Warnx(_("DEBUG: main() about to call memzone_load_acl_from_db()"));
+    Log(LOG_DEBUG, _("main() about to call memzone_load_acl_from_db()"));
     int acl_count = memzone_load_acl_from_db(Memzone, sql);
-    Warnx(_("DEBUG: main() after memzone_load_acl_from_db(), acl_count=%d"), acl_count);
+    Log(LOG_DEBUG, _("main() after memzone_load_acl_from_db(), acl_count=%d"), acl_count);
     Notice(_("Memzone initialized successfully: %u zones, %u records, %d ACL rules"),
            Memzone->zone_count, Memzone->record_count, acl_count);
   }
-  Warnx(_("DEBUG: main() after memzone section"));
+  Log(LOG_DEBUG, _("main() after memzone section"));
 
 
   /* Initialize DNS caching/recursive resolver */
-  Warnx(_("DEBUG: main() about to init DNS cache"));
+  Log(LOG_DEBUG, _("main() about to init DNS cache"));
   /* Read cache configuration from mydns.conf */
   int cache_enabled = -1;
   int cache_size_mb = 0;
@@ -1764,10 +1770,10 @@ main(int argc, char **argv)
   }
   cache_upstream = conf_get(&Conf, "dns-cache-upstream", NULL);
 
-  Warnx(_("DEBUG: main() about to call dnscache_init()"));
+  Log(LOG_DEBUG, _("main() about to call dnscache_init()"));
   DnsCache = dnscache_init(sql, cache_enabled, cache_size_mb,
                             cache_ttl_min, cache_ttl_max, cache_upstream);
-  Warnx(_("DEBUG: main() after dnscache_init(), DnsCache=%p"), DnsCache);
+  Log(LOG_DEBUG, _("main() after dnscache_init(), DnsCache=%p"), DnsCache);
   if (!DnsCache) {
     Warnx(_("DNS cache initialization failed - caching disabled"));
   } else {
@@ -1778,7 +1784,7 @@ main(int argc, char **argv)
   }
 
   /* Initialize DNS over HTTPS (DoH) server */
-  Warnx(_("DEBUG: main() about to init DoH"));
+  Log(LOG_DEBUG, _("main() about to init DoH"));
 
   /* Read DoH configuration from mydns.conf */
   int doh_enabled = -1;
@@ -1819,6 +1825,8 @@ main(int argc, char **argv)
 
   /* Start listening fd's */
   create_listeners();
+  metrics_init();
+  control_init();
 
   time(&Status.start_time);
 
@@ -1858,15 +1866,24 @@ main(int argc, char **argv)
 
   Servers = array_init(servers);
 
+  heavyhitters_init(servers ? servers : 1);
+  metrics_alloc(servers ? servers : 1);
+  latency_init(servers ? servers : 1);
+
   if (servers) {
-    array_append(Servers, (void*)spawn_server(primary_initial_tasks));
+    array_append(Servers, (void*)spawn_server(primary_initial_tasks, 0));
 
     for (n = 1; n < servers; n++) {
-      array_append(Servers, (void*)spawn_server(process_initial_tasks));
+      array_append(Servers, (void*)spawn_server(process_initial_tasks, n));
     }
   
     master_loop(master_initial_tasks);
   } else {
+    if (querylog_enabled)
+      querylog_attach(querylog_ring_new(), 1);	/* No master, so drain our own ring */
+    heavyhitters_attach(0);
+    metrics_attach(0);
+    latency_attach(0);
     do_initial_tasks(master_initial_tasks);
     server_loop(primary_initial_tasks, -1);
   }
@@ -0,0 +1,849 @@
+/**************************************************************************************************
+	Copyright (C) 2002-2005  Don Moore <bboy@bboy.net>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at Your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+**************************************************************************************************/
+
+/*
+**  OpenMetrics export.
+**
+**  Every server copies its status counters and cache statistics into its own slot of a
+**  block of shared memory once a second, and counts the responses for each zone there as
+**  it answers them.  The master maps the block before it forks and serves it over HTTP
+**  on `metrics-listen', so a scrape never reaches a server or its query path.
+**
+**  The once-a-second copy is guarded by a sequence count: the server makes it odd while
+**  writing, and the master retries a copy that saw it odd or saw it change.  The zone
+**  counters are only ever written by their own server and are read as they stand.
+*/
+
+#include "named.h"
+
+#include <sys/mman.h>
+#include <stddef.h>
+
+/* Make this nonzero to enable debugging for this source file */
+#define	DEBUG_METRICS	1
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS		MAP_ANON
+#endif
+
+#define METRICS_ZONES		1024				/* Zones counted per server (a power of 2) */
+#define METRICS_PROBES		32				/* Slots tried before a zone is not counted */
+#define METRICS_MAX_CONNECTIONS	8				/* Concurrent HTTP connections */
+#define METRICS_TIMEOUT		10				/* Seconds allowed for one HTTP request */
+#define METRICS_REQUEST_MAX	2048				/* Longest HTTP request header read */
+
+#define METRICS_CONTENT_TYPE	"application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+enum { MC_ZONE, MC_NEGATIVE, MC_REPLY, MC_ALIAS, MC_GLUE, MC_CACHES };
+enum { MR_NOERROR, MR_NXDOMAIN, MR_REFUSED, MR_SERVFAIL, MR_OTHER, MR_RCODES };
+
+typedef struct _metrics_cache {
+  uint32_t	questions, hits, misses;
+  uint32_t	in, out, expired, removed;
+  uint32_t	count, limit;
+} METRICS_CACHE;
+
+typedef struct _metrics_snapshot {				/* What a server publishes each second */
+  pid_t		pid;
+  time_t	started;
+  time_t	published;
+  SERVERSTATUS	status;
+  METRICS_CACHE	caches[MC_CACHES];
+  int		have_resolver;
+  cache_stats_t	resolver;
+  int		have_memzone;
+  uint32_t	memzone_zones, memzone_records;
+  uint64_t	memzone_queries, memzone_hits, memzone_misses;
+} METRICS_SNAPSHOT;
+
+typedef struct _metrics_zone {
+  uint32_t	id;						/* 0 if unused */
+  uint32_t	responses[MR_RCODES];
+} METRICS_ZONE;
+
+typedef struct _metrics_slot {
+  uint32_t	seq;						/* Odd while `snap' is being written */
+  METRICS_SNAPSHOT snap;
+  uint32_t	zone_overflow;					/* Responses for zones that did not fit */
+  METRICS_ZONE	zones[METRICS_ZONES];
+} METRICS_SLOT;
+
+typedef struct _metrics_conn {					/* One HTTP connection to the master */
+  char		request[METRICS_REQUEST_MAX];
+  size_t	requestlen;
+  char		*out;						/* Response, header and body */
+  size_t	outlen, outsize, offset;
+} METRICS_CONN;
+
+static METRICS_SLOT	*Slots = NULL;				/* One per server */
+static int		NumSlots = 0;
+static METRICS_SLOT	*Mine = NULL;				/* The slot this process publishes in */
+static int		ListenFd = -1;
+static int		ListenFamily = AF_UNSPEC;
+static int		Connections = 0;
+
+static taskexec_t	metrics_accept(TASK *, void *);
+
+static const char *metrics_cache_names[MC_CACHES] = {
+  "zone", "negative", "reply", "alias", "glue"
+};
+
+static const dns_rcode_t metrics_rcodes[MR_OTHER] = {
+  DNS_RCODE_NOERROR, DNS_RCODE_NXDOMAIN, DNS_RCODE_REFUSED, DNS_RCODE_SERVFAIL
+};
+
+/* Counters and gauges taken straight from the snapshot; `group' says when they exist */
+enum { MF_U32, MF_U64, MF_USEC32, MF_USEC64 };
+enum { MG_ALWAYS, MG_RESOLVER, MG_MEMZONE };
+
+typedef struct _metrics_field {
+  const char	*name;
+  const char	*type;
+  const char	*help;
+  size_t	offset;
+  int		kind;
+  int		group;
+} METRICS_FIELD;
+
+#define MS(f)	offsetof(METRICS_SNAPSHOT, f)
+
+static const METRICS_FIELD metrics_fields[] = {
+  { "mydns_timeouts",		"counter", "Tasks that timed out",
+    MS(status.timedout),		MF_U32,		MG_ALWAYS },
+  { "mydns_replies",		"counter", "Replies built",
+    MS(status.replies),		MF_U32,		MG_ALWAYS },
+  { "mydns_truncated_replies",	"counter", "Replies truncated to fit",
+    MS(status.truncated),		MF_U32,		MG_ALWAYS },
+  { "mydns_reply_bytes",		"counter", "Bytes of replies built",
+    MS(status.reply_bytes),	MF_U64,		MG_ALWAYS },
+  { "mydns_additional_replies",	"counter", "Replies to NS, MX and SRV questions",
+    MS(status.additional_replies),	MF_U32,		MG_ALWAYS },
+  { "mydns_additional_lookups",	"counter", "Zone lookups made filling ADDITIONAL sections",
+    MS(status.additional_lookups),	MF_U32,		MG_ALWAYS },
+  { "mydns_glue_hits",		"counter", "ADDITIONAL address sets found in the glue cache",
+    MS(status.glue_hits),		MF_U32,		MG_ALWAYS },
+  { "mydns_update_messages",	"counter", "DNS UPDATE messages received",
+    MS(status.update_messages),	MF_U32,		MG_ALWAYS },
+  { "mydns_update_commits",	"counter", "DNS UPDATE transactions committed",
+    MS(status.update_commits),	MF_U32,		MG_ALWAYS },
+  { "mydns_update_changes",	"counter", "Resource records changed by DNS UPDATE",
+    MS(status.update_changes),	MF_U32,		MG_ALWAYS },
+  { "mydns_update_lock_seconds",	"counter", "Time spent inside DNS UPDATE transactions",
+    MS(status.update_lock_usec),	MF_USEC64,	MG_ALWAYS },
+  { "mydns_update_lock_max_seconds", "gauge", "Longest DNS UPDATE transaction",
+    MS(status.update_lock_max_usec), MF_USEC32,	MG_ALWAYS },
+  { "mydns_resolver_queries",	"counter", "Recursive queries looked up in the resolver cache",
+    MS(resolver.queries),		MF_U64,		MG_RESOLVER },
+  { "mydns_resolver_hits",	"counter", "Resolver cache hits",
+    MS(resolver.hits),		MF_U64,		MG_RESOLVER },
+  { "mydns_resolver_misses",	"counter", "Resolver cache misses",
+    MS(resolver.misses),		MF_U64,		MG_RESOLVER },
+  { "mydns_resolver_inserts",	"counter", "Records added to the resolver cache",
+    MS(resolver.inserts),		MF_U64,		MG_RESOLVER },
+  { "mydns_resolver_evictions",	"counter", "Records evicted from the resolver cache",
+    MS(resolver.evictions),	MF_U64,		MG_RESOLVER },
+  { "mydns_resolver_upstream_queries", "counter", "Queries sent to upstream servers",
+    MS(resolver.upstream_queries),	MF_U64,		MG_RESOLVER },
+  { "mydns_resolver_upstream_failures", "counter", "Queries to upstream servers that failed",
+    MS(resolver.upstream_failures), MF_U64,		MG_RESOLVER },
+  { "mydns_resolver_acl_denials",	"counter", "Recursive queries refused by the ACL",
+    MS(resolver.acl_denials),	MF_U64,		MG_RESOLVER },
+  { "mydns_memzone_zones",	"gauge",   "Zones held in memory",
+    MS(memzone_zones),		MF_U32,		MG_MEMZONE },
+  { "mydns_memzone_records",	"gauge",   "Records held in memory",
+    MS(memzone_records),		MF_U32,		MG_MEMZONE },
+  { "mydns_memzone_queries",	"counter", "Lookups in zones held in memory",
+    MS(memzone_queries),		MF_U64,		MG_MEMZONE },
+  { "mydns_memzone_hits",		"counter", "Lookups in memory that found the name",
+    MS(memzone_hits),		MF_U64,		MG_MEMZONE },
+  { "mydns_memzone_misses",	"counter", "Lookups in memory that did not find the name",
+    MS(memzone_misses),		MF_U64,		MG_MEMZONE },
+  { NULL,			NULL,	   NULL,	0,	0,		0 }
+};
+
+
+/**************************************************************************************************
+	METRICS_INIT
+	Binds the `metrics-listen' socket.  Called before privileges are dropped.
+**************************************************************************************************/
+void
+metrics_init(void) {
+  char			addr[256], *c = NULL;
+  int			port = 0, opt = 1;
+  struct sockaddr_in	sa4;
+#if HAVE_IPV6
+  struct sockaddr_in6	sa6;
+#endif
+  struct sockaddr	*sa = NULL;
+  socklen_t		salen = 0;
+
+  if (!metrics_listen || !metrics_listen[0])
+    return;
+
+  memset(&sa4, 0, sizeof(sa4));
+#if HAVE_IPV6
+  memset(&sa6, 0, sizeof(sa6));
+#endif
+  strncpy(addr, metrics_listen, sizeof(addr) - 1);
+  addr[sizeof(addr) - 1] = '\0';
+
+  /* Port separators are as for `listen': '+' for IPv6, '+' or ':' for IPv4 */
+#if HAVE_IPV6
+  if (is_ipv6(addr)) {
+    if ((c = strchr(addr, '+')))
+      *c++ = '\0';
+    port = c ? atoi(c) : 0;
+    if (inet_pton(AF_INET6, addr, &sa6.sin6_addr) <= 0)
+      port = 0;
+    sa6.sin6_family = ListenFamily = AF_INET6;
+    sa6.sin6_port = htons(port);
+    sa = (struct sockaddr *)&sa6;
+    salen = sizeof(sa6);
+  } else
+#endif
+    {
+      if ((c = strchr(addr, '+')) || (c = strchr(addr, ':')))
+	*c++ = '\0';
+      port = c ? atoi(c) : 0;
+      if (inet_pton(AF_INET, addr, &sa4.sin_addr) <= 0)
+	port = 0;
+      sa4.sin_family = ListenFamily = AF_INET;
+      sa4.sin_port = htons(port);
+      sa = (struct sockaddr *)&sa4;
+      salen = sizeof(sa4);
+    }
+  if (port <= 0 || port > 65535) {
+    Warnx("%s: `%s': %s", "metrics-listen", metrics_listen, _("invalid address or port"));
+    return;
+  }
+
+  if ((ListenFd = socket(ListenFamily, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+    Warn(_("metrics_init: socket failed"));
+    return;
+  }
+  setsockopt(ListenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  fcntl(ListenFd, F_SETFL, fcntl(ListenFd, F_GETFL, 0) | O_NONBLOCK);
+  if (bind(ListenFd, sa, salen) < 0 || listen(ListenFd, SOMAXCONN) < 0) {
+    Warn(_("metrics_init: cannot listen on %s"), metrics_listen);
+    close(ListenFd);
+    ListenFd = -1;
+    return;
+  }
+  Verbose(_("serving metrics on %s"), metrics_listen);
+}
+/*--- metrics_init() ----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	METRICS_ALLOC
+	Maps the shared counters for `slots' servers and starts accepting scrapes.  Called before
+	the servers are spawned; they drop the listening task along with the master's others.
+**************************************************************************************************/
+void
+metrics_alloc(int slots) {
+  TASK *t = NULL;
+
+  if (ListenFd < 0 || slots <= 0)
+    return;
+
+  Slots = mmap(NULL, slots * sizeof(METRICS_SLOT), PROT_READ | PROT_WRITE,
+	       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (Slots == MAP_FAILED) {
+    Warn(_("error mapping metrics counters"));
+    Slots = NULL;
+    return;
+  }
+  NumSlots = slots;
+
+  t = IOtask_init(HIGH_PRIORITY_TASK, NEED_TASK_READ, ListenFd, SOCK_STREAM, ListenFamily, NULL);
+  task_add_extension(t, NULL, NULL, metrics_accept, NULL);
+}
+/*--- metrics_alloc() ---------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	METRICS_ATTACH
+	Makes `slot' the one this process publishes in.  A server that replaces one which died
+	starts its counters from zero, as OpenMetrics expects of a restarted process.
+**************************************************************************************************/
+void
+metrics_attach(int slot) {
+  uint32_t	seq = 0;
+
+  if (!Slots || slot < 0 || slot >= NumSlots)
+    return;
+  Mine = &Slots[slot];
+
+  seq = Mine->seq;
+  __atomic_store_n(&Mine->seq, seq | 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memset(&Mine->snap, 0, sizeof(Mine->snap));
+  Mine->snap.pid = getpid();
+  Mine->snap.started = current_time;
+  Mine->zone_overflow = 0;
+  memset(Mine->zones, 0, sizeof(Mine->zones));
+  __atomic_store_n(&Mine->seq, (seq | 1) + 1, __ATOMIC_RELEASE);
+}
+/*--- metrics_attach() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	METRICS_ADD
+	Counts the response to `t' against its zone.
+**************************************************************************************************/
+void
+metrics_add(TASK *t) {
+  register uint32_t	id = t->zone, n = 0, idx = 0;
+  register METRICS_ZONE	*z = NULL;
+  int			r = MR_OTHER;
+
+  if (!Mine || !id)
+    return;
+
+  for (n = 0; n < MR_OTHER; n++)
+    if (t->hdr.rcode == metrics_rcodes[n]) {
+      r = n;
+      break;
+    }
+
+  idx = (id * 2654435761U) & (METRICS_ZONES - 1);
+  for (n = 0; n < METRICS_PROBES; n++, idx = (idx + 1) & (METRICS_ZONES - 1)) {
+    z = &Mine->zones[idx];
+    if (z->id == id) {
+      __atomic_store_n(&z->responses[r], z->responses[r] + 1, __ATOMIC_RELAXED);
+      return;
+    }
+    if (!z->id) {
+      __atomic_store_n(&z->responses[r], 1, __ATOMIC_RELAXED);
+      __atomic_store_n(&z->id, id, __ATOMIC_RELEASE);
+      return;
+    }
+  }
+  __atomic_store_n(&Mine->zone_overflow, Mine->zone_overflow + 1, __ATOMIC_RELAXED);
+}
+/*--- metrics_add() -----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	METRICS_COPY_CACHE
+**************************************************************************************************/
+static void
+metrics_copy_cache(METRICS_CACHE *mc, CACHE *C) {
+  if (!C)
+    return;
+  mc->questions = C->questions;
+  mc->hits = C->hits;
+  mc->misses = C->misses;
+  mc->in = C->in;
+  mc->out = C->out;
+  mc->expired = C->expired;
+  mc->removed = C->removed;
+  mc->count = C->count;
+  mc->limit = C->limit;
+}
+/*--- metrics_copy_cache() ----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	METRICS_PUBLISH
+	Copies this server's counters into its slot.  Runs once a second.
+**************************************************************************************************/
+static taskexec_t
+metrics_publish(TASK *t, void *data) {
+  METRICS_SNAPSHOT	*s = &Mine->snap;
+  uint32_t		seq = Mine->seq;
+
+  __atomic_store_n(&Mine->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  s->published = current_time;
+  memcpy(&s->status, &Status, sizeof(s->status));
+  metrics_copy_cache(&s->caches[MC_ZONE], ZoneCache);
+#if USE_NEGATIVE_CACHE
+  metrics_copy_cache(&s->caches[MC_NEGATIVE], NegativeCache);
+#endif
+  metrics_copy_cache(&s->caches[MC_REPLY], ReplyCache);
+  metrics_copy_cache(&s->caches[MC_ALIAS], AliasCache);
+  metrics_copy_cache(&s->caches[MC_GLUE], GlueCache);
+  if (DnsCache) {
+    memcpy(&s->resolver, dnscache_get_stats(DnsCache), sizeof(s->resolver));
+    s->have_resolver = 1;
+  }
+  if (Memzone) {
+    memzone_get_stats(Memzone, &s->memzone_zones, &s->memzone_records,
+		      &s->memzone_queries, &s->memzone_hits, &s->memzone_misses);
+    s->have_memzone = 1;
+  }
+
+  __atomic_store_n(&Mine->seq, seq + 2, __ATOMIC_RELEASE);
+
+  t->timeout = current_time + 1;
+  return (TASK_CONTINUE);
+}
+/*--- metrics_publish() -------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	METRICS_START
+	Starts publishing this server's counters.
+**************************************************************************************************/
+void
+metrics_start(void) {
+  TASK *t = NULL;
+
+  if (!Mine)
+    return;
+
+  t = Ticktask_init(LOW_PRIORITY_TASK, NEED_TASK_RUN, -1, 0, AF_UNSPEC, NULL);
+  task_add_extension(t, NULL, NULL, NULL, metrics_publish);
+  t->timeout = current_time;
+}
+/*--- metrics_start() ---------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	METRICS_SNAPSHOT_READ
+	Copies the last counters published in `slot' into `snap'.  Returns 0 if the slot has
+	never been published or a consistent copy could not be made.
+**************************************************************************************************/
+static int
+metrics_snapshot_read(METRICS_SLOT *slot, METRICS_SNAPSHOT *snap) {
+  uint32_t	seq = 0;
+  int		tries = 0;
+
+  for (tries = 0; tries < 100; tries++) {
+    if ((seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE)) & 1)
+      continue;
+    memcpy(snap, &slot->snap, sizeof(*snap));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq)
+      return (snap->published != 0);
+  }
+  return (0);
+}
+/*--- metrics_snapshot_read() -------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	METRICS_PRINTF
+	Appends to the response being built for `c'.
+**************************************************************************************************/
+static void
+metrics_printf(METRICS_CONN *c, const char *fmt, ...) {
+  va_list	ap;
+  char		*s = NULL;
+  int		len = 0;
+
+  va_start(ap, fmt);
+  len = VASPRINTF(&s, fmt, ap);
+  va_end(ap);
+  if (len <= 0) {
+    RELEASE(s);
+    return;
+  }
+  if (c->outlen + len > c->outsize) {
+    c->outsize = MAX(c->outsize * 2, c->outlen + len + 4096);
+    c->out = REALLOCATE(c->out, c->outsize, char[]);
+  }
+  memcpy(c->out + c->outlen, s, len);
+  c->outlen += len;
+  RELEASE(s);
+}
+/*--- metrics_printf() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	METRICS_LABEL
+	Appends `value' to the response as a label value, escaped.
+**************************************************************************************************/
+static void
+metrics_label(METRICS_CONN *c, const char *value) {
+  char	buf[DNS_MAXNAMELEN * 2 + 1], *b = buf;
+
+  for (; *value && b < buf + sizeof(buf) - 2; value++) {
+    if (*value == '\\' || *value == '"')
+      *b++ = '\\';
+    else if (*value == '\n') {
+      *b++ = '\\';
+      *b++ = 'n';
+      continue;
+    }
+    *b++ = *value;
+  }
+  *b = '\0';
+  metrics_printf(c, "%s", buf);
+}
+/*--- metrics_label() ---------------------------------------------------------------------------*/
+
+
+static void
+metrics_family(METRICS_CONN *c, const char *name, const char *type, const char *help) {
+  metrics_printf(c, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+
+static int
+metrics_zone_compare(const void *a, const void *b) {
+  const METRICS_ZONE *x = (const METRICS_ZONE *)a, *y = (const METRICS_ZONE *)b;
+
+  return ((x->id < y->id) ? -1 : (x->id > y->id) ? 1 : 0);
+}
+
+
+/**************************************************************************************************
+	METRICS_ZONES_OUTPUT
+	Appends the responses for each zone, summed over all servers, labelled with the origin.
+**************************************************************************************************/
+static void
+metrics_zones_output(METRICS_CONN *c) {
+  METRICS_ZONE	*zones = NULL;
+  char		**origins = NULL, *query = NULL, *ids = NULL;
+  size_t	querylen = 0, idslen = 0;
+  int		nzones = 0, n = 0, s = 0, r = 0, merged = 0;
+  SQL_RES	*res = NULL;
+  SQL_ROW	row = NULL;
+
+  zones = ALLOCATE(NumSlots * METRICS_ZONES * sizeof(METRICS_ZONE), METRICS_ZONE[]);
+  for (s = 0; s < NumSlots; s++)
+    for (n = 0; n < METRICS_ZONES; n++) {
+      METRICS_ZONE *z = &Slots[s].zones[n];
+
+      if (!(zones[nzones].id = __atomic_load_n(&z->id, __ATOMIC_ACQUIRE)))
+	continue;
+      for (r = 0; r < MR_RCODES; r++)
+	zones[nzones].responses[r] = __atomic_load_n(&z->responses[r], __ATOMIC_RELAXED);
+      nzones++;
+    }
+
+  /* Sum the servers' counts for each zone */
+  qsort(zones, nzones, sizeof(METRICS_ZONE), metrics_zone_compare);
+  for (n = 0; n < nzones; n++) {
+    if (merged && zones[merged - 1].id == zones[n].id) {
+      for (r = 0; r < MR_RCODES; r++)
+	zones[merged - 1].responses[r] += zones[n].responses[r];
+    } else
+      memcpy(&zones[merged++], &zones[n], sizeof(METRICS_ZONE));
+  }
+  nzones = merged;
+  if (!nzones) {
+    RELEASE(zones);
+    return;
+  }
+
+  /* Look up all the origins at once */
+  origins = ALLOCATE(nzones * sizeof(char *), char *[]);
+  ids = ALLOCATE(nzones * 11 + 1, char[]);
+  for (n = 0; n < nzones; n++)
+    idslen += sprintf(ids + idslen, "%s%u", n ? "," : "", zones[n].id);
+  querylen = sql_build_query(&query, "SELECT id,origin FROM %s WHERE id IN (%s)",
+			     mydns_soa_table_name, ids);
+  RELEASE(ids);
+  if ((res = sql_query(sql, query, querylen))) {
+    while ((row = sql_getrow(res, NULL))) {
+      METRICS_ZONE	key, *z = NULL;
+
+      if (!row[0] || !row[1])
+	continue;
+      key.id = atou(row[0]);
+      if ((z = bsearch(&key, zones, nzones, sizeof(METRICS_ZONE), metrics_zone_compare)))
+	origins[z - zones] = STRDUP(row[1]);
+    }
+    sql_free(res);
+  } else
+    WarnSQL(sql, _("error loading zone origins for metrics"));
+  RELEASE(query);
+
+  metrics_family(c, "mydns_zone_responses", "counter", "Responses sent for each zone, by rcode");
+  for (n = 0; n < nzones; n++)
+    for (r = 0; r < MR_RCODES; r++) {
+      if (!zones[n].responses[r])
+	continue;
+      metrics_printf(c, "mydns_zone_responses_total{zone=\"");
+      if (origins[n])
+	metrics_label(c, origins[n]);
+      else
+	metrics_printf(c, "#%u", zones[n].id);
+      metrics_printf(c, "\",rcode=\"%s\"} %u\n",
+		     (r == MR_OTHER) ? "other" : mydns_rcode_str(metrics_rcodes[r]),
+		     zones[n].responses[r]);
+    }
+
+  for (n = 0; n < nzones; n++)
+    RELEASE(origins[n]);
+  RELEASE(origins);
+  RELEASE(zones);
+}
+/*--- metrics_zones_output() --------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	METRICS_LATENCY_OUTPUT
+	Appends the quantiles of the query latency histograms, merged over all servers.
+**************************************************************************************************/
+static void
+metrics_latency_output(METRICS_CONN *c) {
+  LATENCY_SUMMARY	s;
+  int			stage = 0, tcp = 0, hit = 0, q = 0;
+
+  metrics_family(c, "mydns_query_stage_seconds", "summary", "Time sampled queries spent in each stage");
+  for (stage = 0; stage < LATENCY_STAGES; stage++)
+    for (tcp = 0; tcp < 2; tcp++)
+      for (hit = 0; hit < 2; hit++) {
+	char labels[128];
+
+	if (!latency_summary(stage, tcp, hit, &s))
+	  continue;
+	snprintf(labels, sizeof(labels), "stage=\"%s\",protocol=\"%s\",cache=\"%s\"",
+		 latency_stage_name(stage), tcp ? "tcp" : "udp", hit ? "hit" : "miss");
+	for (q = 0; q < LATENCY_QUANTILES; q++)
+	  metrics_printf(c, "mydns_query_stage_seconds{%s,quantile=\"%g\"} %.9f\n",
+			 labels, latency_quantiles[q], s.quantile[q]);
+	metrics_printf(c, "mydns_query_stage_seconds_count{%s} %u\n", labels, s.count);
+	metrics_printf(c, "mydns_query_stage_seconds_sum{%s} %.9f\n", labels, s.sum);
+      }
+}
+/*--- metrics_latency_output() ------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	METRICS_OUTPUT
+	Builds the OpenMetrics exposition in `c'.
+**************************************************************************************************/
+static void
+metrics_output(METRICS_CONN *c) {
+  METRICS_SNAPSHOT	*snaps = NULL;
+  int			*ok = NULL, s = 0, n = 0;
+  const METRICS_FIELD	*f = NULL;
+
+  snaps = ALLOCATE(NumSlots * sizeof(METRICS_SNAPSHOT), METRICS_SNAPSHOT[]);
+  ok = ALLOCATE(NumSlots * sizeof(int), int[]);
+  for (s = 0; s < NumSlots; s++)
+    ok[s] = metrics_snapshot_read(&Slots[s], &snaps[s]);
+
+  metrics_family(c, "mydns_worker_start_time_seconds", "gauge", "When the server process started");
+  for (s = 0; s < NumSlots; s++)
+    if (ok[s])
+      metrics_printf(c, "mydns_worker_start_time_seconds{worker=\"%d\"} %lu\n",
+		     s, (unsigned long)snaps[s].started);
+
+  metrics_family(c, "mydns_requests", "counter", "Requests received");
+  for (s = 0; s < NumSlots; s++)
+    if (ok[s]) {
+      metrics_printf(c, "mydns_requests_total{worker=\"%d\",transport=\"udp\"} %u\n",
+		     s, snaps[s].status.udp_requests);
+      metrics_printf(c, "mydns_requests_total{worker=\"%d\",transport=\"tcp\"} %u\n",
+		     s, snaps[s].status.tcp_requests);
+    }
+
+  metrics_family(c, "mydns_responses", "counter", "Responses sent, by rcode");
+  for (s = 0; s < NumSlots; s++)
+    if (ok[s])
+      for (n = 0; n < MAX_RESULTS; n++)
+	if (snaps[s].status.results[n])
+	  metrics_printf(c, "mydns_responses_total{worker=\"%d\",rcode=\"%s\"} %u\n",
+			 s, mydns_rcode_str(n), snaps[s].status.results[n]);
+
+  for (f = metrics_fields; f->name; f++) {
+    int printed = 0;
+
+    for (s = 0; s < NumSlots; s++) {
+      const char *p = (const char *)&snaps[s] + f->offset;
+
+      if (!ok[s]
+	  || (f->group == MG_RESOLVER && !snaps[s].have_resolver)
+	  || (f->group == MG_MEMZONE && !snaps[s].have_memzone))
+	continue;
+      if (!printed++)
+	metrics_family(c, f->name, f->type, f->help);
+      metrics_printf(c, "%s%s{worker=\"%d\"} ", f->name, strcmp(f->type, "counter") ? "" : "_total", s);
+      switch (f->kind) {
+      case MF_U32:
+	metrics_printf(c, "%u\n", *(const uint32_t *)p);
+	break;
+      case MF_U64:
+	metrics_printf(c, "%llu\n", (unsigned long long)*(const uint64_t *)p);
+	break;
+      case MF_USEC32:
+	metrics_printf(c, "%.6f\n", *(const uint32_t *)p / 1000000.0);
+	break;
+      case MF_USEC64:
+	metrics_printf(c, "%.6f\n", *(const uint64_t *)p / 1000000.0);
+	break;
+      }
+    }
+  }
+
+#define CACHE_FAMILY(name, type, help, field) \
+  metrics_family(c, name, type, help); \
+  for (s = 0; s < NumSlots; s++) \
+    if (ok[s]) \
+      for (n = 0; n < MC_CACHES; n++) \
+	if (snaps[s].caches[n].limit) \
+	  metrics_printf(c, "%s%s{worker=\"%d\",cache=\"%s\"} %u\n", name, \
+			 strcmp(type, "counter") ? "" : "_total", s, metrics_cache_names[n], \
+			 snaps[s].caches[n].field);
+  CACHE_FAMILY("mydns_cache_lookups", "counter", "Cache lookups", questions);
+  CACHE_FAMILY("mydns_cache_hits", "counter", "Cache hits", hits);
+  CACHE_FAMILY("mydns_cache_misses", "counter", "Cache misses", misses);
+  CACHE_FAMILY("mydns_cache_inserts", "counter", "Entries added to the cache", in);
+  CACHE_FAMILY("mydns_cache_expired", "counter", "Cache entries that expired", expired);
+  CACHE_FAMILY("mydns_cache_removed", "counter", "Cache entries removed to make room", removed);
+  CACHE_FAMILY("mydns_cache_entries", "gauge", "Entries in the cache", count);
+  CACHE_FAMILY("mydns_cache_capacity", "gauge", "Entries the cache may hold", limit);
+#undef CACHE_FAMILY
+
+  metrics_family(c, "mydns_zone_untracked_responses", "counter",
+		 "Responses for zones beyond the per-server zone table");
+  for (s = 0; s < NumSlots; s++)
+    if (ok[s])
+      metrics_printf(c, "mydns_zone_untracked_responses_total{worker=\"%d\"} %u\n",
+		     s, __atomic_load_n(&Slots[s].zone_overflow, __ATOMIC_RELAXED));
+
+  metrics_latency_output(c);
+  metrics_zones_output(c);
+
+  metrics_printf(c, "# EOF\n");
+
+  RELEASE(ok);
+  RELEASE(snaps);
+}
+/*--- metrics_output() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	METRICS_RESPOND
+	Builds the HTTP response to the request read into `c'.
+**************************************************************************************************/
+static void
+metrics_respond(METRICS_CONN *c) {
+  METRICS_CONN	body;
+  const char	*status = "200 OK", *type = METRICS_CONTENT_TYPE;
+  char		*path = NULL, *end = NULL;
+
+  memset(&body, 0, sizeof(body));
+  c->request[MIN(c->requestlen, sizeof(c->request) - 1)] = '\0';
+
+  if (strncmp(c->request, "GET ", 4)) {
+    status = "405 Method Not Allowed";
+  } else {
+    path = c->request + 4;
+    for (end = path; *end && *end != ' ' && *end != '?' && *end != '\r' && *end != '\n'; end++)
+      /* DONOTHING */;
+    *end = '\0';
+    if (strcmp(path, "/metrics") && strcmp(path, "/"))
+      status = "404 Not Found";
+  }
+
+  if (status[0] == '2')
+    metrics_output(&body);
+  else {
+    type = "text/plain; charset=utf-8";
+    metrics_printf(&body, "%s\n", status);
+  }
+
+  metrics_printf(c, "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %u\r\n"
+		 "Connection: close\r\n\r\n", status, type, (unsigned int)body.outlen);
+  if (body.outlen) {
+    c->out = REALLOCATE(c->out, c->outlen + body.outlen, char[]);
+    memcpy(c->out + c->outlen, body.out, body.outlen);
+    c->outlen += body.outlen;
+    c->outsize = c->outlen;
+  }
+  RELEASE(body.out);
+}
+/*--- metrics_respond() -------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	METRICS_CONN_RUN
+	Reads the request from a connection, then writes the response.
+**************************************************************************************************/
+static taskexec_t
+metrics_conn_run(TASK *t, void *data) {
+  METRICS_CONN	*c = (METRICS_CONN *)data;
+  int		rv = 0;
+
+  if (t->status == NEED_COMMAND_READ) {
+    if ((rv = read(t->fd, c->request + c->requestlen, sizeof(c->request) - 1 - c->requestlen)) < 0)
+      return ((errno == EINTR || errno == EAGAIN) ? TASK_CONTINUE : TASK_COMPLETED);
+    if (rv == 0)
+      return (TASK_COMPLETED);
+    c->requestlen += rv;
+    c->request[c->requestlen] = '\0';
+    if (!strstr(c->request, "\r\n\r\n") && !strstr(c->request, "\n\n")
+	&& c->requestlen < sizeof(c->request) - 1)
+      return (TASK_CONTINUE);
+    metrics_respond(c);
+    t->status = NEED_COMMAND_WRITE;
+  }
+
+  while (c->offset < c->outlen) {
+    if ((rv = write(t->fd, c->out + c->offset, c->outlen - c->offset)) < 0)
+      return ((errno == EINTR || errno == EAGAIN) ? TASK_CONTINUE : TASK_COMPLETED);
+    c->offset += rv;
+  }
+  return (TASK_COMPLETED);
+}
+/*--- metrics_conn_run() ------------------------------------------------------------------------*/
+
+
+static void
+metrics_conn_free(TASK *t, void *data) {
+  METRICS_CONN	*c = (METRICS_CONN *)data;
+
+  RELEASE(c->out);
+  Connections--;
+}
+
+
+/**************************************************************************************************
+	METRICS_ACCEPT
+	Accepts scrapes on the listening socket.
+**************************************************************************************************/
+static taskexec_t
+metrics_accept(TASK *t, void *data) {
+  struct sockaddr_storage	addr;
+  socklen_t			addrlen = sizeof(addr);
+  int				fd = -1;
+  TASK				*conn = NULL;
+
+  while ((fd = accept(t->fd, (struct sockaddr *)&addr, &addrlen)) >= 0) {
+    addrlen = sizeof(addr);
+    if (Connections >= METRICS_MAX_CONNECTIONS) {
+      close(fd);
+      continue;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    if (!(conn = IOtask_init(NORMAL_PRIORITY_TASK, NEED_COMMAND_READ, fd, SOCK_STREAM,
+			     t->family, &addr))) {
+      close(fd);
+      continue;
+    }
+    conn->info_already_out = 1;				/* Not a query; keep it out of the log */
+    conn->timeout = current_time + METRICS_TIMEOUT;
+    task_add_extension(conn, ALLOCATE(sizeof(METRICS_CONN), METRICS_CONN),
+		       metrics_conn_free, metrics_conn_run, NULL);
+    Connections++;
+  }
+  return (TASK_CONTINUE);
+}
+/*--- metrics_accept() --------------------------------------------------------------------------*/
+
+
+/* vi:set ts=3: */
+/* NEED_PO */
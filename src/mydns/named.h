@@ -101,15 +101,27 @@ typedef struct _serverstatus									/* Server status information */
 	uint32_t	udp_requests, tcp_requests;					/* Total # of requests handled */
 	uint32_t	timedout;	 										/* Number of requests that timed out */
 	uint32_t	results[MAX_RESULTS];							/* Result codes */
+	uint32_t	replies, truncated;								/* Replies built, and how many were truncated */
+	uint64_t	reply_bytes;										/* Total size of those replies */
+	uint32_t	additional_replies;								/* Replies to NS/MX/SRV questions */
+	uint32_t	additional_lookups;								/* Zone lookups made filling their ADDITIONAL */
+	uint32_t	glue_hits;											/* ADDITIONAL address sets found in GlueCache */
+	uint32_t	update_messages, update_commits;					/* UPDATE messages, and transactions committed */
+	uint32_t	update_changes;										/* RRs changed by those transactions */
+	uint64_t	update_lock_usec;									/* Time spent inside them */
+	uint32_t	update_lock_max_usec;								/* Longest of them */
 } SERVERSTATUS;
 
 extern SERVERSTATUS Status;
 
+typedef struct _named_querylog_ring QUERYLOG_RING;
+
 typedef struct _named_server {
   pid_t		pid;
   int		serverfd;
   TASK		*listener;
   int		signalled;
+  QUERYLOG_RING	*querylog;		/* Query log records written by this server */
 } SERVER;
 
 extern ARRAY	*Servers;
@@ -142,8 +154,21 @@ extern void		*array_remove(ARRAY *);
 #define array_max(A)		((A)->maxidx)
 #define array_numobjects(A)	(array_max((A))+1)
 /* axfr.c */
-extern void		axfr(TASK *);
-extern void		axfr_fork(TASK *);
+extern taskexec_t	axfr_start(TASK *);
+extern MYDNS_SOA	*axfr_memzone_soa(const char *);
+
+/* control.c */
+typedef enum _control_action_t {				/* What a control command does */
+  CONTROL_FLUSH,
+  CONTROL_FLUSH_ZONE,
+  CONTROL_FLUSH_NAME,
+  CONTROL_RELOAD,
+  CONTROL_RELOAD_ZONE,
+} control_action_t;
+
+extern void		control_init(void);
+extern void		control_run(control_action_t, uint32_t, const char *, const char *);
+extern void		control_acked(uint32_t);
 
 /* data.c */
 extern MYDNS_SOA	*find_soa(TASK *, char *, char *);
@@ -169,9 +194,33 @@ extern int		rr_error(uint32_t, const char *, ...) __printflike(2,3);
 #define formerr(task,rcode,reason,xtra)	_formerr_internal((task),(rcode),(reason),(xtra),__FILE__,__LINE__)
 #define dnserror(task,rcode,reason)			_dnserror_internal((task),(rcode),(reason),__FILE__,__LINE__)
 
+/* heavyhitters.c */
+typedef enum _hh_table_t {					/* Heavy hitter tables */
+  HH_QNAME = 0, HH_DOMAIN, HH_NXDOMAIN, HH_CLIENT, HH_ZONE, HH_QTYPE, HH_RCODE, HH_TABLES
+} hh_table_t;
+
+typedef struct _named_heavyhitter {
+  char		key[DNS_MAXNAMELEN + 16];
+  uint32_t	count;
+} HEAVYHITTER;
+
+extern void		heavyhitters_init(int);
+extern void		heavyhitters_attach(int);
+extern void		heavyhitters_add(TASK *);
+extern int		heavyhitters_table(const char *, size_t);
+extern int		heavyhitters_top(int, HEAVYHITTER *, int);
+extern void		heavyhitters_status(void);
+
 /* ixfr.c */
 extern taskexec_t	ixfr(TASK *, datasection_t, dns_qtype_t, char *, int);
 extern void		ixfr_start(void);
+extern int		ixfr_journal_wanted(TASK *);
+
+/* journal.c */
+extern void		ixfr_journal_updated(MYDNS_SOA *);
+extern int		ixfr_journal_covers(MYDNS_SOA *, uint32_t);
+extern int		ixfr_journal_answer(TASK *, MYDNS_SOA *, uint32_t);
+extern void		ixfr_journal_start(void);
 
 /* listen.c */
 extern char 		**all_interface_addresses(void);
@@ -196,21 +245,74 @@ extern char		*dns_make_message(TASK *, uint16_t, uint8_t, dns_qtype_t,
 #define dns_make_notify(t,id,qtype,name,rd,length) \
   dns_make_message((t),(id),DNS_OPCODE_NOTIFY,(qtype),(name),(rd),(length))
 
+/* latency.c */
+#define			LATENCY_QUANTILES	4
+
+typedef struct _named_latency_summary {
+  uint32_t	count;
+  double	sum;						/* Seconds */
+  double	quantile[LATENCY_QUANTILES];			/* Seconds, at latency_quantiles[] */
+} LATENCY_SUMMARY;
+
+extern const double	latency_quantiles[LATENCY_QUANTILES];
+
+extern uint64_t		latency_ticks(void);
+extern void		latency_init(int);
+extern void		latency_attach(int);
+extern void		latency_start(TASK *);
+extern void		latency_add(TASK *);
+extern const char	*latency_stage_name(int);
+extern uint32_t		latency_summary(int, int, int, LATENCY_SUMMARY *);
+extern void		latency_status(void);
+
+/* Time a stage of a sampled query: `start' holds the ticks LATENCY_BEGIN() returned */
+#define LATENCY_BEGIN(t)		((t)->latency_sampled ? latency_ticks() : 0)
+#define LATENCY_END(t, stage, start) \
+  do { \
+    if ((t)->latency_sampled) { \
+      (t)->latency[(stage)] += latency_ticks() - (start); \
+      (t)->latency_stages |= (1 << (stage)); \
+    } \
+  } while (0)
+
+/* metrics.c */
+extern void		metrics_init(void);
+extern void		metrics_alloc(int);
+extern void		metrics_attach(int);
+extern void		metrics_add(TASK *);
+extern void		metrics_start(void);
+
 /* notify.c */
 
 typedef struct _notify_slave {
   int			replied;	/* Have we had a reply from the slave */
   int			retries;        /* How many retries have we made */
   time_t		lastsent;	/* Last message was sent then */
-  struct sockaddr	slaveaddr;
+  struct sockaddr_storage slaveaddr;	/* Large enough for an IPv6 address */
 } NOTIFYSLAVE;
 
 extern taskexec_t	notify_write(TASK *);
 extern taskexec_t	notify_read(TASK*);
 extern void		notify_slaves(TASK *, MYDNS_SOA *);
+extern void		notify_forget_slaves(uint32_t);
 extern void		notify_start(void);
 extern int		name_servers2ip(TASK *, ARRAY *, ARRAY *, ARRAY *);
 
+/* querylog.c */
+#define			QUERYLOG_DRAIN_MSEC	100	/* Longest wait before the rings are drained */
+
+extern int		querylog_enabled;
+
+extern void		querylog_init(void);
+extern QUERYLOG_RING	*querylog_ring_new(void);
+extern void		querylog_ring_free(QUERYLOG_RING *);
+extern void		querylog_attach(QUERYLOG_RING *, int);
+extern void		querylog_add(TASK *, char *);
+extern int		querylog_draining(void);
+extern void		querylog_drain(void);
+extern void		querylog_close(void);
+extern void		querylog_status(void);
+
 /* queue.c */
 extern QUEUE		*queue_init(char *, char *);
 extern void		queue_stats(void);
@@ -254,6 +356,7 @@ extern void		rrlist_free(RRLIST *);
 /* servercomms.c */
 extern TASK		*scomms_start(int);
 extern TASK		*mcomms_start(int);
+extern int		comms_broadcast(const char *);
 
 /* sort.c */
 extern void		sort_a_recs(TASK *, RRLIST *, datasection_t);
@@ -34,6 +34,19 @@ typedef struct _notify_data {
   ARRAY			*slaves;	/* Slaves */
 } NOTIFYDATA;
 
+/* NOTIFYZONE: What is remembered about a zone between NOTIFY tasks */
+typedef struct _notify_zone {
+  uint32_t		soa_id;
+  time_t		lastsent;	/* When a NOTIFY for this zone last went out */
+  unsigned int		updates;	/* Changes announced by the next NOTIFY */
+  time_t		expires;	/* When the cached slave addresses go stale; 0 if none */
+  ARRAY			*slaves4;	/* Cached slave addresses */
+  ARRAY			*slaves6;
+  struct _notify_zone	*next;
+} NOTIFYZONE;
+
+#define	NOTIFY_ZONE_HASH	256
+
 typedef struct _init_data {
   int			zonecount;	/* Number of zones still to process */
   int			lastzone;	/* Last zoneid read in */
@@ -48,6 +61,41 @@ static int notifyfd6 = -1;
 static int notify_tasks_running6 = 0;
 #endif
 
+static NOTIFYZONE *notify_zones[NOTIFY_ZONE_HASH];
+
+/* Lookups of slave lists, and how many were answered from the cache */
+static unsigned long notify_lookups = 0, notify_lookups_cached = 0;
+
+/* Returns the NOTIFY state of zone `soa_id', creating it if need be */
+static NOTIFYZONE *
+notify_zone(uint32_t soa_id) {
+  NOTIFYZONE *z = NULL;
+
+  for (z = notify_zones[soa_id % NOTIFY_ZONE_HASH]; z; z = z->next)
+    if (z->soa_id == soa_id)
+      return z;
+  z = (NOTIFYZONE*)ALLOCATE(sizeof(NOTIFYZONE), NOTIFYZONE);
+  memset(z, 0, sizeof(NOTIFYZONE));
+  z->soa_id = soa_id;
+  z->next = notify_zones[soa_id % NOTIFY_ZONE_HASH];
+  notify_zones[soa_id % NOTIFY_ZONE_HASH] = z;
+  return z;
+}
+
+/* When the next NOTIFY for the zone may go out */
+static time_t
+notify_due(NOTIFYZONE *z) {
+  if (z->lastsent && (z->lastsent + (time_t)notify_interval > current_time))
+    return z->lastsent + notify_interval;
+  return current_time;
+}
+
+/* Status for a NOTIFY task due at `due': one that must wait is not put up for writing */
+static taskstat_t
+notify_status(time_t due) {
+  return (due > current_time) ? NEED_NOTIFY_RETRY : NEED_NOTIFY_WRITE;
+}
+
 static void
 notify_free(TASK *t, void *data) {
   /*
@@ -116,6 +164,7 @@ notify_write(TASK *t) {
   time_t	timeout = INT_MAX;
   char		*out = NULL;
   size_t 	reqlen = 0;
+  int		firstsent = 0;
 
   slavecount = array_numobjects(notify->slaves);
 
@@ -278,6 +327,9 @@ notify_write(TASK *t) {
     /* Cleanup signed packet */
     if (signed_packet) RELEASE(signed_packet);
 	   
+    MYDNS_PROBE3(notify_sent, notify->soa_id, msg, slave->retries);
+    if (!slave->retries)
+      firstsent++;
     slave->lastsent = current_time;
     slave->replied = 0;
     slave->retries += 1;
@@ -289,6 +341,16 @@ notify_write(TASK *t) {
 
   RELEASE(out);
 
+  if (firstsent) {
+    NOTIFYZONE *z = notify_zone(notify->soa_id);
+
+    Verbose(_("DNS NOTIFY for %s sent to %d slave(s), announcing %u update(s); "
+	      "%lu of %lu slave list lookups answered from cache"),
+	    notify->origin, firstsent, z->updates, notify_lookups_cached, notify_lookups);
+    z->lastsent = current_time;
+    z->updates = 0;
+  }
+
   /* Cleanup TSIG key */
   if (tsig_key) {
     tsig_key_free(tsig_key);
@@ -363,6 +425,7 @@ _notify_read(TASK *t, struct sockaddr *from, socklen_t fromlen) {
     } else {
       /* Mark this slave as finished */
       slave->replied = 1;
+      MYDNS_PROBE2(notify_acked, notify->soa_id, msg);
     }
 
     slavecount--;
@@ -572,25 +635,35 @@ notify_read(TASK *t) {
   return ((rv > 0)?TASK_CONTINUE:TASK_COMPLETED);
 }
 
-static TASK *
-notify_running(TASK *t, MYDNS_SOA *soa) {
+/*
+ * Reschedule the NOTIFY tasks (one per address family) already running for the zone,
+ * so that they start again with the latest serial once notify-interval allows.
+ * Returns the number of tasks found.
+ */
+static int
+notify_running(TASK *t, MYDNS_SOA *soa, NOTIFYZONE *z) {
   TASK *checkt = NULL;
-  int j = 0;
-  /*
-   * Scan running tasks for one that is doing notification on this soa
-   */
+  int i = 0, j = 0, found = 0;
 
   for (j = HIGH_PRIORITY_TASK; j <= LOW_PRIORITY_TASK; j++) {
     for (checkt = TaskArray[PERIODIC_TASK][j]->head; checkt; checkt = checkt->next) {
-      if (t->freeextension == notify_free) {
-	NOTIFYDATA *notify = t->extension;
-	if (notify->soa_id == soa->id) {
-	  return checkt;
+      if (checkt->freeextension == notify_free) {
+	NOTIFYDATA *notify = checkt->extension;
+	if (notify->soa_id != soa->id)
+	  continue;
+	for (i = 0; i < array_numobjects(notify->slaves); i++) {
+	  NOTIFYSLAVE *slave = array_fetch(notify->slaves, i);
+	  slave->lastsent = 0;
+	  slave->replied = 0;
+	  slave->retries = 0;
 	}
+	checkt->timeout = notify_due(z);
+	checkt->status = notify_status(checkt->timeout);
+	found++;
       }
     }
   }
-  return NULL;
+  return found;
 }
 
 static ARRAY *
@@ -977,6 +1050,73 @@ name_servers2ip(TASK *t, ARRAY *name_servers,
     ;
 }
 
+/* Appends fresh copies of the cached slaves in `from' to `to'; returns how many */
+static int
+notify_copy_slaves(ARRAY *from, ARRAY *to) {
+  int i, count = 0;
+
+  for (i = 0; from && i < array_numobjects(from); i++) {
+    NOTIFYSLAVE *cached = (NOTIFYSLAVE*)array_fetch(from, i), *slave = NULL;
+    if (!cached) continue;
+    slave = (NOTIFYSLAVE*)ALLOCATE(sizeof(NOTIFYSLAVE), NOTIFYSLAVE);
+    memcpy(slave, cached, sizeof(NOTIFYSLAVE));
+    slave->lastsent = 0;
+    slave->replied = 0;
+    slave->retries = 0;
+    array_append(to, slave);
+    count++;
+  }
+  return count;
+}
+
+/*
+ * Fill `ips4' and `ips6' with the slaves of the zone.  The list costs an SQL query for the
+ * NS records and also-notify column and a lookup of every name server, so it is kept for
+ * notify-cache-ttl seconds, or until an update changes the zone's NS records.
+ * Returns the number of slaves.
+ */
+static int
+notify_get_slaves(TASK *t, MYDNS_SOA *soa, NOTIFYZONE *z, ARRAY *ips4, ARRAY *ips6) {
+  int count = 0;
+
+  notify_lookups++;
+  if (!z->expires || z->expires <= current_time) {
+    array_free(z->slaves4, 1);
+    z->slaves4 = array_init(8);
+#if HAVE_IPV6
+    array_free(z->slaves6, 1);
+    z->slaves6 = array_init(8);
+#endif
+    name_servers2ip(t, notify_get_server_list(t, soa), z->slaves4,
+#if HAVE_IPV6
+		    z->slaves6
+#else
+		    NULL
+#endif
+		    );
+    z->expires = current_time + notify_cache_ttl;
+  } else
+    notify_lookups_cached++;
+
+  count = notify_copy_slaves(z->slaves4, ips4);
+#if HAVE_IPV6
+  count += notify_copy_slaves(z->slaves6, ips6);
+#endif
+  return count;
+}
+
+/* Drop the cached slave addresses of a zone, e.g. after its NS records change */
+void
+notify_forget_slaves(uint32_t soa_id) {
+  NOTIFYZONE *z = NULL;
+
+  for (z = notify_zones[soa_id % NOTIFY_ZONE_HASH]; z; z = z->next)
+    if (z->soa_id == soa_id) {
+      z->expires = 0;
+      return;
+    }
+}
+
 static int
 notify_allocate_fd(int family, struct sockaddr *sourceaddr)
 {
@@ -1089,24 +1229,22 @@ void
 notify_slaves(TASK *t, MYDNS_SOA *soa) {
   TASK *notify_task = NULL, *notify_master = NULL;
   NOTIFYDATA *notify = NULL;
+  NOTIFYZONE *zone = notify_zone(soa->id);
 
 #if DEBUG_ENABLED && DEBUG_NOTIFY
   DebugX("notify", 1, _("%s: DNS NOTIFY notify_slaves called for %s"), desctask(t), soa->origin);
 #endif
 
+  zone->updates++;
+
   /*
-   * Locate a currently running NOTIFY task for this SOA
+   * Locate a currently running NOTIFY task for this SOA; an update burst then costs
+   * one NOTIFY per notify-interval
    */
-  if ((notify_task = notify_running(t, soa))) {
-    int		i;
-    notify = (NOTIFYDATA*)t->extension;
-    for (i = 0; i < array_numobjects(notify->slaves); i++) {
-      NOTIFYSLAVE *slave = array_fetch(notify->slaves, i);
-      slave->lastsent = 0;
-      slave->replied = 0;
-      slave->retries = 0;
-    }
-    t->timeout = current_time;
+  if (notify_running(t, soa, zone)) {
+#if DEBUG_ENABLED && DEBUG_NOTIFY
+    DebugX("notify", 1, _("%s: DNS NOTIFY for %s merged into running task"), desctask(t), soa->origin);
+#endif
   } else {
     /*
      * Build a new task to process this notify operation
@@ -1121,20 +1259,20 @@ notify_slaves(TASK *t, MYDNS_SOA *soa) {
      * Allocate UDP port for this task
      *
      * Queue task for later running - we do not do anything yet as an update storm
-     * could result in this task being pushed up a number of times
+     * could result in this task being pushed up a number of times; it runs no sooner
+     * than notify-interval after the last NOTIFY for the zone
      */
-    ARRAY *name_servers = notify_get_server_list(t, soa);
     ARRAY *slavesipv4 = array_init(8);
 #if HAVE_IPV6
     ARRAY *slavesipv6 = array_init(8);
 #endif
-    int slavecount = name_servers2ip(t, name_servers, slavesipv4,
+    int slavecount = notify_get_slaves(t, soa, zone, slavesipv4,
 #if HAVE_IPV6
-				     slavesipv6
+				       slavesipv6
 #else
-				     NULL
+				       NULL
 #endif
-				     );
+				       );
 
 #if DEBUG_ENABLED && DEBUG_NOTIFY
     DebugX("notify", 1, _("%s: DNS NOTIFY notify_slaves has %d slaves to notify for %s"),
@@ -1186,9 +1324,9 @@ notify_slaves(TASK *t, MYDNS_SOA *soa) {
 	DebugX("notify", 1, _("%s: DNS NOTIFY notify_slaves initializing notifier IPV4 task for %s"),
 	       desctask(t), soa->origin);
 #endif
-      notify_task = Ticktask_init(NORMAL_PRIORITY_TASK, NEED_NOTIFY_WRITE, notifyfd,
+      notify_task = Ticktask_init(NORMAL_PRIORITY_TASK, notify_status(notify_due(zone)), notifyfd,
 				  SOCK_DGRAM, AF_INET, NULL);
-      notify_task->timeout = current_time; /* Timeout immediately and therefore run */
+      notify_task->timeout = notify_due(zone); /* Run as soon as notify-interval allows */
       notify_task->id = notify_task->internal_id;
       task_add_extension(notify_task,
 			 (void*)notify,
@@ -1239,9 +1377,9 @@ notify_slaves(TASK *t, MYDNS_SOA *soa) {
 	DebugX("notify", 1, _("%s: DNS NOTIFY notify_slaves initializing notifier IPV6 task for %s"),
 	       desctask(t), soa->origin);
 #endif
-      notify_task = Ticktask_init(NORMAL_PRIORITY_TASK, NEED_NOTIFY_WRITE, notifyfd,
+      notify_task = Ticktask_init(NORMAL_PRIORITY_TASK, notify_status(notify_due(zone)), notifyfd6,
 				  SOCK_DGRAM, AF_INET6, NULL);
-      notify_task->timeout = 0; /* Timeout immediately and therefore run */
+      notify_task->timeout = notify_due(zone); /* Run as soon as notify-interval allows */
       notify_task->id = notify_task->internal_id;
       task_add_extension(notify_task,
 			 (void*)notify,
@@ -0,0 +1,811 @@
+/**************************************************************************************************
+	Copyright (C) 2002-2005  Don Moore <bboy@bboy.net>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at Your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+**************************************************************************************************/
+
+/*
+**  Query logging.
+**
+**  Each server process appends a fixed-layout record for every finished query to its own
+**  ring buffer, held in anonymous shared memory created by the master before the fork.  The
+**  ring has one producer (the server) and one consumer (the master), so it needs no lock:
+**  the producer owns `head', the consumer owns `tail', and each publishes its counter with
+**  release ordering once the bytes behind it are written or read.  A full ring drops the
+**  record and counts it; the server never waits on the log.
+**
+**  The master formats the records, either as the traditional text line or as dnstap
+**  (protobuf inside Frame Streams), and writes them to syslog, a file or a Unix socket.
+*/
+
+#include "named.h"
+
+#include <sys/mman.h>
+#include <sys/un.h>
+
+/* Make this nonzero to enable debugging for this source file */
+#define	DEBUG_QUERYLOG	1
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS		MAP_ANON
+#endif
+
+#define QUERYLOG_TEXT		0
+#define QUERYLOG_DNSTAP		1
+
+#define QUERYLOG_MIN_BUFFER	64				/* Smallest ring, in KB */
+#define QUERYLOG_MAX_BUFFER	(1024 * 1024)			/* Largest ring, in KB */
+#define QUERYLOG_MAX_DESC	1024				/* Longest UPDATE description kept */
+#define QUERYLOG_MAX_MESSAGE	4096				/* Longest reply kept for dnstap */
+#define QUERYLOG_MAX_RECORD	(sizeof(QUERYLOG_REC) + DNS_MAXNAMELEN + 256 \
+				 + QUERYLOG_MAX_DESC + QUERYLOG_MAX_MESSAGE + 8)
+#define QUERYLOG_MAX_FRAME	(QUERYLOG_MAX_RECORD + 1024)
+#define QUERYLOG_MAX_PENDING	(1024 * 1024)			/* Output held for a slow socket */
+#define QUERYLOG_RETRY		10				/* Seconds between reconnects */
+#define QUERYLOG_REPORT		10				/* Seconds between drop reports */
+
+#define QUERYLOG_ALIGN(n)	(((n) + 7) & ~7)
+
+/* Frame Streams control frames */
+#define FSTRM_CONTROL_ACCEPT	0x01
+#define FSTRM_CONTROL_START	0x02
+#define FSTRM_CONTROL_STOP	0x03
+#define FSTRM_CONTROL_READY	0x04
+#define FSTRM_FIELD_CONTENT	0x01
+#define DNSTAP_CONTENT_TYPE	"protobuf:dnstap.Dnstap"
+
+/* dnstap.proto values used here */
+#define DNSTAP_TYPE_MESSAGE		1
+#define DNSTAP_AUTH_RESPONSE		2
+#define DNSTAP_UPDATE_RESPONSE		14
+#define DNSTAP_INET			1
+#define DNSTAP_INET6			2
+#define DNSTAP_UDP			1
+#define DNSTAP_TCP			2
+
+struct _named_querylog_ring {
+  uint32_t	head;						/* Producer offset (free running) */
+  char		pad1[60];
+  uint32_t	tail;						/* Consumer offset (free running) */
+  char		pad2[60];
+  uint32_t	size;						/* Bytes in `data', a power of 2 */
+  uint32_t	logged;						/* Records written by the producer */
+  uint32_t	dropped;					/* Records lost because the ring was full */
+  uint32_t	reported;					/* Drops already reported by the consumer */
+  unsigned char	data[];
+};
+
+typedef struct _querylog_rec {
+  uint32_t	reclen;						/* Record length, 0 means wrap to start */
+  uint32_t	internal_id;
+  uint32_t	sec, usec;					/* When the reply was finished */
+  uint16_t	id, qclass, qtype, port;
+  uint16_t	qdcount, ancount, nscount, arcount;
+  uint16_t	qnamelen, reasonlen, desclen, msglen;
+  uint8_t	protocol, family, rcode, opcode;
+  uint8_t	from_cache, pad[3];
+  uint8_t	addr[16];
+  /* Followed by qname, reason and description (each NUL-terminated) and the reply */
+} QUERYLOG_REC;
+
+#define QUERYLOG_QNAME(r)	((char *)(r) + sizeof(QUERYLOG_REC))
+#define QUERYLOG_REASON(r)	(QUERYLOG_QNAME(r) + (r)->qnamelen + 1)
+#define QUERYLOG_DESC(r)	(QUERYLOG_REASON(r) + (r)->reasonlen + 1)
+#define QUERYLOG_MESSAGE(r)	((unsigned char *)QUERYLOG_DESC(r) + (r)->desclen + 1)
+
+int			querylog_enabled = 0;			/* Are queries being logged? */
+
+static int		QueryLogFormat = QUERYLOG_TEXT;
+static QUERYLOG_RING	*Ring = NULL;				/* This process's ring */
+static int		RingLocal = 0;				/* Do we also drain it ourselves? */
+static uint32_t		Unringed = 0;				/* Dropped for want of a ring */
+
+static int		OutputFd = -1;				/* File or socket being written */
+static int		OutputSocket = 0;			/* Is `OutputFd' a Unix socket? */
+static time_t		OutputRetry = 0;			/* When to try opening the output again */
+static int		OutputStarted = 0;			/* Has the dnstap file had its START? */
+static unsigned char	*Pending = NULL;			/* Output not yet written */
+static size_t		PendingLen = 0, PendingSize = 0;
+static uint32_t		OutputDropped = 0;			/* Records the output could not take */
+static uint32_t		OutputReported = 0;
+static time_t		LastReport = 0;
+
+
+/**************************************************************************************************
+	QUERYLOG_INIT
+	Reads the query log options.  Called once the configuration has been loaded.
+**************************************************************************************************/
+void
+querylog_init(void) {
+  const char *format = query_log_format ? query_log_format : "text";
+
+  if (!strcasecmp(format, "dnstap")) {
+    if (!query_log_output || !*query_log_output)
+      Warnx(_("query-log-format `dnstap' needs query-log-output; using text"));
+    else
+      QueryLogFormat = QUERYLOG_DNSTAP;
+  } else if (strcasecmp(format, "text"))
+    Warnx(_("unknown query-log-format `%s'; using text"), format);
+
+  /* A collector socket only speaks dnstap */
+  if (QueryLogFormat == QUERYLOG_TEXT && query_log_output && !strncasecmp(query_log_output, "unix:", 5)) {
+    Warnx(_("query-log-output `%s' needs dnstap; using dnstap"), query_log_output);
+    QueryLogFormat = QUERYLOG_DNSTAP;
+  }
+
+  querylog_enabled = err_verbose || (query_log_output && *query_log_output);
+  if (querylog_enabled && query_log_output && *query_log_output)
+    Verbose(_("query log: %s to %s, %d KB per server"),
+	    (QueryLogFormat == QUERYLOG_DNSTAP) ? "dnstap" : "text", query_log_output, query_log_buffer);
+}
+/*--- querylog_init() ---------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_RING_NEW
+	Creates a ring in shared memory.  Called by the master before it forks the server that
+	will fill it.  Returns NULL if the memory could not be mapped.
+**************************************************************************************************/
+QUERYLOG_RING *
+querylog_ring_new(void) {
+  QUERYLOG_RING	*ring = NULL;
+  uint32_t	kb = QUERYLOG_MIN_BUFFER;
+
+  while (kb < (uint32_t)query_log_buffer && kb < QUERYLOG_MAX_BUFFER)
+    kb <<= 1;
+
+  ring = mmap(NULL, sizeof(QUERYLOG_RING) + kb * 1024, PROT_READ | PROT_WRITE,
+	      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (ring == MAP_FAILED) {
+    Warn(_("error mapping %u KB query log buffer"), kb);
+    return (NULL);
+  }
+  ring->size = kb * 1024;
+  return (ring);
+}
+/*--- querylog_ring_new() -----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_RING_FREE
+	Unmaps a ring.  The master drains it first if the records are wanted.
+**************************************************************************************************/
+void
+querylog_ring_free(QUERYLOG_RING *ring) {
+  if (ring)
+    munmap(ring, sizeof(QUERYLOG_RING) + ring->size);
+}
+/*--- querylog_ring_free() ----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_ATTACH
+	Makes `ring' the one this process logs to.  If `local' is set there is no master, so this
+	process drains the ring itself.
+**************************************************************************************************/
+void
+querylog_attach(QUERYLOG_RING *ring, int local) {
+  Ring = ring;
+  RingLocal = local;
+}
+/*--- querylog_attach() -------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_FILL
+	Copies the task into record `r', which has room for `reclen' bytes.
+**************************************************************************************************/
+static void
+querylog_fill(QUERYLOG_REC *r, uint32_t reclen, TASK *t, const char *qname, size_t qnamelen,
+	      const char *reason, size_t reasonlen, const char *desc, size_t desclen, size_t msglen) {
+  struct timeval tv = { 0, 0 };
+  char *dest = NULL;
+
+  gettimeofday(&tv, NULL);
+
+  memset(r, 0, sizeof(QUERYLOG_REC));
+  r->reclen = reclen;
+  r->internal_id = t->internal_id;
+  r->sec = tv.tv_sec;
+  r->usec = tv.tv_usec;
+  r->id = t->id;
+  r->qclass = t->qclass;
+  r->qtype = t->qtype;
+  r->qdcount = t->qdcount;
+  r->ancount = t->an.size;
+  r->nscount = t->ns.size;
+  r->arcount = t->ar.size;
+  r->qnamelen = qnamelen;
+  r->reasonlen = reasonlen;
+  r->desclen = desclen;
+  r->msglen = msglen;
+  r->protocol = t->protocol;
+  r->family = t->family;
+  r->rcode = t->hdr.rcode;
+  r->opcode = t->hdr.opcode;
+  r->from_cache = t->reply_from_cache ? 1 : 0;
+  if (t->family == AF_INET) {
+    memcpy(r->addr, &t->addr4.sin_addr, 4);
+    r->port = ntohs(t->addr4.sin_port);
+#if HAVE_IPV6
+  } else if (t->family == AF_INET6) {
+    memcpy(r->addr, &t->addr6.sin6_addr, 16);
+    r->port = ntohs(t->addr6.sin6_port);
+#endif
+  }
+
+  dest = QUERYLOG_QNAME(r);
+  memcpy(dest, qname, qnamelen);
+  dest[qnamelen] = '\0';
+  dest = QUERYLOG_REASON(r);
+  memcpy(dest, reason, reasonlen);
+  dest[reasonlen] = '\0';
+  dest = QUERYLOG_DESC(r);
+  memcpy(dest, desc, desclen);
+  dest[desclen] = '\0';
+  if (msglen)
+    memcpy(QUERYLOG_MESSAGE(r), t->reply, msglen);
+}
+/*--- querylog_fill() ---------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	PB_VARINT / PB_KEY / PB_BYTES / PB_FIXED32
+	Just enough protobuf encoding for dnstap.
+**************************************************************************************************/
+static unsigned char *
+pb_varint(unsigned char *p, uint64_t v) {
+  while (v >= 0x80) {
+    *p++ = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (unsigned char)v;
+  return (p);
+}
+
+#define pb_key(p, field, wiretype)	pb_varint((p), ((field) << 3) | (wiretype))
+
+static unsigned char *
+pb_bytes(unsigned char *p, int field, const void *data, size_t len) {
+  p = pb_key(p, field, 2);
+  p = pb_varint(p, len);
+  memcpy(p, data, len);
+  return (p + len);
+}
+
+static unsigned char *
+pb_fixed32(unsigned char *p, int field, uint32_t v) {
+  p = pb_key(p, field, 5);
+  *p++ = v & 0xff;
+  *p++ = (v >> 8) & 0xff;
+  *p++ = (v >> 16) & 0xff;
+  *p++ = (v >> 24) & 0xff;
+  return (p);
+}
+/*--- pb_varint() -------------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_DNSTAP_FRAME
+	Encodes `r' as a Frame Streams data frame holding a dnstap Message.  Returns the frame
+	length.
+**************************************************************************************************/
+static size_t
+querylog_dnstap_frame(QUERYLOG_REC *r, unsigned char *frame) {
+  unsigned char	msg[QUERYLOG_MAX_MESSAGE + 128], *m = msg;
+  unsigned char	*p = frame + 4;
+  size_t	len = 0;
+
+  m = pb_key(m, 1, 0);
+  m = pb_varint(m, (r->opcode == DNS_OPCODE_UPDATE) ? DNSTAP_UPDATE_RESPONSE : DNSTAP_AUTH_RESPONSE);
+  if (r->family == AF_INET || r->family == AF_INET6) {
+    m = pb_key(m, 2, 0);
+    m = pb_varint(m, (r->family == AF_INET) ? DNSTAP_INET : DNSTAP_INET6);
+    m = pb_bytes(m, 4, r->addr, (r->family == AF_INET) ? 4 : 16);
+    m = pb_key(m, 6, 0);
+    m = pb_varint(m, r->port);
+  }
+  m = pb_key(m, 3, 0);
+  m = pb_varint(m, (r->protocol == SOCK_STREAM) ? DNSTAP_TCP : DNSTAP_UDP);
+  m = pb_key(m, 12, 0);
+  m = pb_varint(m, r->sec);
+  m = pb_fixed32(m, 13, r->usec * 1000);
+  if (r->msglen)
+    m = pb_bytes(m, 14, QUERYLOG_MESSAGE(r), r->msglen);
+
+  p = pb_bytes(p, 1, hostname, strlen(hostname));
+  p = pb_bytes(p, 2, PACKAGE_STRING, sizeof(PACKAGE_STRING) - 1);
+  if (r->desclen)
+    p = pb_bytes(p, 3, QUERYLOG_DESC(r), r->desclen);
+  p = pb_bytes(p, 14, msg, m - msg);
+  p = pb_key(p, 15, 0);
+  p = pb_varint(p, DNSTAP_TYPE_MESSAGE);
+
+  len = p - frame - 4;
+  DNS_PUT32(frame, len);
+  return (len + 4);
+}
+/*--- querylog_dnstap_frame() -------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_CONTROL_FRAME
+	Builds a Frame Streams control frame of `type' carrying the dnstap content type.
+**************************************************************************************************/
+static size_t
+querylog_control_frame(unsigned char *frame, uint32_t type) {
+  unsigned char	*p = frame;
+  uint32_t	len = 4;
+
+  if (type != FSTRM_CONTROL_STOP)
+    len += 8 + sizeof(DNSTAP_CONTENT_TYPE) - 1;
+
+  DNS_PUT32(p, 0);					/* Escape: this is a control frame */
+  DNS_PUT32(p, len);
+  DNS_PUT32(p, type);
+  if (type != FSTRM_CONTROL_STOP) {
+    DNS_PUT32(p, FSTRM_FIELD_CONTENT);
+    DNS_PUT32(p, sizeof(DNSTAP_CONTENT_TYPE) - 1);
+    memcpy(p, DNSTAP_CONTENT_TYPE, sizeof(DNSTAP_CONTENT_TYPE) - 1);
+    p += sizeof(DNSTAP_CONTENT_TYPE) - 1;
+  }
+  return (p - frame);
+}
+/*--- querylog_control_frame() ------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_CLOSE_OUTPUT
+	Closes the output after an error; it is opened again after QUERYLOG_RETRY seconds.
+**************************************************************************************************/
+static void
+querylog_close_output(void) {
+  if (OutputFd >= 0)
+    close(OutputFd);
+  OutputFd = -1;
+  PendingLen = 0;
+  OutputRetry = current_time + QUERYLOG_RETRY;
+}
+/*--- querylog_close_output() -------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_FLUSH
+	Writes as much pending output as the file or socket will take without blocking.
+**************************************************************************************************/
+static void
+querylog_flush(void) {
+  size_t	off = 0;
+  ssize_t	rv = 0;
+
+  while (OutputFd >= 0 && off < PendingLen) {
+    if ((rv = write(OutputFd, Pending + off, PendingLen - off)) < 0) {
+      if (errno == EINTR)
+	continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+	break;
+      Warn(_("error writing query log to %s"), query_log_output);
+      querylog_close_output();
+      return;
+    }
+    off += rv;
+  }
+  if (off) {
+    memmove(Pending, Pending + off, PendingLen - off);
+    PendingLen -= off;
+  }
+}
+/*--- querylog_flush() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_OUTPUT
+	Queues `len' bytes for the output.  Returns -1 (and counts a drop) if there is no room.
+**************************************************************************************************/
+static int
+querylog_output(const void *data, size_t len) {
+  if (OutputFd < 0 || PendingLen + len > QUERYLOG_MAX_PENDING) {
+    OutputDropped++;
+    return (-1);
+  }
+  if (PendingLen + len > PendingSize) {
+    PendingSize = MAX(PendingSize * 2, PendingLen + len);
+    PendingSize = MIN(PendingSize, QUERYLOG_MAX_PENDING);
+    Pending = REALLOCATE(Pending, PendingSize, unsigned char[]);
+  }
+  memcpy(Pending + PendingLen, data, len);
+  PendingLen += len;
+  if (PendingLen >= PendingSize / 2)
+    querylog_flush();
+  return (0);
+}
+/*--- querylog_output() -------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_CONNECT
+	Connects to a dnstap collector on Unix socket `path' and performs the Frame Streams
+	handshake (READY, ACCEPT, START).  Returns the socket, or -1 on error.
+**************************************************************************************************/
+static int
+querylog_connect(const char *path) {
+  struct sockaddr_un	addr;
+  struct timeval	tv = { 1, 0 };
+  unsigned char		frame[128], reply[128];
+  size_t		len = 0;
+  ssize_t		rv = 0;
+  int			fd = -1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    return (-1);
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    goto failed;
+
+  len = querylog_control_frame(frame, FSTRM_CONTROL_READY);
+  if (write(fd, frame, len) != (ssize_t)len)
+    goto failed;
+
+  /* The collector must ACCEPT our content type */
+  if ((rv = read(fd, reply, sizeof(reply))) < 12) {
+    errno = EPROTO;
+    goto failed;
+  } else {
+    unsigned char *p = reply + 8;
+    uint32_t type = 0;
+    DNS_GET32(type, p);
+    if (type != FSTRM_CONTROL_ACCEPT) {
+      errno = EPROTO;
+      goto failed;
+    }
+  }
+
+  len = querylog_control_frame(frame, FSTRM_CONTROL_START);
+  if (write(fd, frame, len) != (ssize_t)len)
+    goto failed;
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  return (fd);
+
+failed:
+  Warn(_("error connecting to dnstap collector at %s"), path);
+  close(fd);
+  return (-1);
+}
+/*--- querylog_connect() ------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_OPEN_OUTPUT
+	Opens query-log-output if it is not open and it is time to try again.  A dnstap file is
+	truncated only when its stream begins; opened again after an error, the stream carries on.
+**************************************************************************************************/
+static void
+querylog_open_output(void) {
+  unsigned char	frame[128];
+
+  if (OutputFd >= 0 || !query_log_output || !*query_log_output || current_time < OutputRetry)
+    return;
+
+  OutputSocket = !strncasecmp(query_log_output, "unix:", 5);
+  if (OutputSocket)
+    OutputFd = querylog_connect(query_log_output + 5);
+  else if (QueryLogFormat == QUERYLOG_DNSTAP && !OutputStarted)
+    OutputFd = open(query_log_output, O_WRONLY | O_CREAT | O_TRUNC, 0640);
+  else
+    OutputFd = open(query_log_output, O_WRONLY | O_CREAT | O_APPEND, 0640);
+
+  if (OutputFd < 0) {
+    if (!OutputSocket)
+      Warn(_("error opening query log %s"), query_log_output);
+    OutputRetry = current_time + QUERYLOG_RETRY;
+    return;
+  }
+  PendingLen = 0;
+
+  /* A dnstap file begins with START; over a socket it was sent by querylog_connect() */
+  if (QueryLogFormat == QUERYLOG_DNSTAP && !OutputSocket
+      && (!OutputStarted || lseek(OutputFd, 0, SEEK_END) == 0)) {
+    querylog_output(frame, querylog_control_frame(frame, FSTRM_CONTROL_START));
+    OutputStarted = 1;
+  }
+}
+/*--- querylog_open_output() --------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_WRITE
+	Formats one record and sends it to the output.
+**************************************************************************************************/
+static void
+querylog_write(QUERYLOG_REC *r) {
+  if (QueryLogFormat == QUERYLOG_DNSTAP) {
+    static unsigned char frame[QUERYLOG_MAX_FRAME];
+    querylog_output(frame, querylog_dnstap_frame(r, frame));
+  } else {
+    char	line[DNS_MAXNAMELEN + QUERYLOG_MAX_DESC + 512];
+    int		len = 0;
+#if !DISABLE_DATE_LOGGING
+    time_t	tt = r->sec;
+    char	datebuf[80];
+
+    strftime(datebuf, sizeof(datebuf)-1, "%d-%b-%Y %H:%M:%S", localtime(&tt));
+#endif
+
+    len = snprintf(line, sizeof(line),
+#if !DISABLE_DATE_LOGGING
+		   "%s+%06lu "
+#endif
+		   "#%u "
+		   "%u "	/* Client-provided ID */
+		   "%s "	/* TCP or UDP? */
+		   "%s "	/* Client IP */
+		   "%s "	/* Class */
+		   "%s "	/* Query type (A, MX, etc) */
+		   "%s "	/* Name */
+		   "%s "	/* Return code (NOERROR, NXDOMAIN, etc) */
+		   "%s "	/* Reason */
+		   "%u "	/* Question section */
+		   "%u "	/* Answer section */
+		   "%u "	/* Authority section */
+		   "%u "	/* Additional section */
+		   "LOG "
+		   "%s "	/* Reply from cache? */
+		   "%s "	/* Opcode */
+		   "\"%s\""	/* UPDATE description (if any) */
+		   ,
+#if !DISABLE_DATE_LOGGING
+		   datebuf, (unsigned long)r->usec,
+#endif
+		   r->internal_id,
+		   r->id,
+		   (r->protocol == SOCK_STREAM)?"TCP"
+		   :(r->protocol == SOCK_DGRAM)?"UDP"
+		   :"UNKNOWN",
+		   (r->family == AF_INET || r->family == AF_INET6) ? ipaddr(r->family, r->addr)
+		   : _("Address unknown"),
+		   mydns_class_str(r->qclass),
+		   mydns_qtype_str(r->qtype),
+		   QUERYLOG_QNAME(r),
+		   mydns_rcode_str(r->rcode),
+		   QUERYLOG_REASON(r),
+		   (unsigned int)r->qdcount,
+		   (unsigned int)r->ancount,
+		   (unsigned int)r->nscount,
+		   (unsigned int)r->arcount,
+		   (r->from_cache ? "Y" : "N"),
+		   mydns_opcode_str(r->opcode),
+		   QUERYLOG_DESC(r)
+		   );
+    if (len < 0)
+      return;
+    if (len >= (int)sizeof(line))
+      len = sizeof(line) - 1;
+
+    if (!query_log_output || !*query_log_output)
+      Verbose("%s", line);
+    else {
+      line[len++] = '\n';
+      querylog_output(line, len);
+    }
+  }
+}
+/*--- querylog_write() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_ADD
+	Logs the finished task `t'.  `desc' describes an UPDATE operation, or is NULL.
+	With a ring this only copies the record; otherwise (the master, or if the ring could not
+	be mapped) text records are written at once and dnstap records are dropped.
+**************************************************************************************************/
+void
+querylog_add(TASK *t, char *desc) {
+  const char	*qname = (char *)t->qname;
+  const char	*reason = err_reason_str(t, t->reason);
+  size_t	qnamelen = MIN(strlen(qname), DNS_MAXNAMELEN);
+  size_t	reasonlen = MIN(strlen(reason), 255);
+  size_t	desclen = desc ? MIN(strlen(desc), QUERYLOG_MAX_DESC) : 0;
+  size_t	msglen = 0;
+  uint32_t	reclen = 0;
+
+  if (QueryLogFormat == QUERYLOG_DNSTAP && t->reply && t->replylen <= QUERYLOG_MAX_MESSAGE)
+    msglen = t->replylen;
+  reclen = QUERYLOG_ALIGN(sizeof(QUERYLOG_REC) + qnamelen + reasonlen + desclen + 3 + msglen);
+
+  if (Ring) {
+    uint32_t head = Ring->head;
+    uint32_t tail = __atomic_load_n(&Ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t off = head & (Ring->size - 1);
+    uint32_t skip = (off + reclen > Ring->size) ? Ring->size - off : 0;
+
+    if ((head - tail) + skip + reclen > Ring->size) {
+      __atomic_store_n(&Ring->dropped, Ring->dropped + 1, __ATOMIC_RELAXED);
+      return;
+    }
+    if (skip) {
+      ((QUERYLOG_REC *)&Ring->data[off])->reclen = 0;
+      head += skip;
+      off = 0;
+    }
+    querylog_fill((QUERYLOG_REC *)&Ring->data[off], reclen, t, qname, qnamelen,
+		  reason, reasonlen, desc, desclen, msglen);
+    __atomic_store_n(&Ring->logged, Ring->logged + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&Ring->head, head + reclen, __ATOMIC_RELEASE);
+    return;
+  }
+
+  if (QueryLogFormat == QUERYLOG_TEXT) {
+    static uint64_t rec[QUERYLOG_MAX_RECORD / sizeof(uint64_t) + 1];
+    querylog_fill((QUERYLOG_REC *)rec, reclen, t, qname, qnamelen,
+		  reason, reasonlen, desc, desclen, msglen);
+    querylog_open_output();
+    querylog_write((QUERYLOG_REC *)rec);
+    querylog_flush();
+  } else
+    Unringed++;
+}
+/*--- querylog_add() ----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_RING_DRAIN
+	Writes out every record in `ring'.  Returns the number of records read.
+**************************************************************************************************/
+static int
+querylog_ring_drain(QUERYLOG_RING *ring, pid_t pid) {
+  uint32_t	tail = ring->tail;
+  uint32_t	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  uint32_t	dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+  int		count = 0;
+
+  while (tail != head) {
+    uint32_t	off = tail & (ring->size - 1);
+    QUERYLOG_REC *r = (QUERYLOG_REC *)&ring->data[off];
+
+    if (!r->reclen) {
+      tail += ring->size - off;
+      continue;
+    }
+    /* A server that died mid-write cannot publish a partial record, but check anyway */
+    if (r->reclen < sizeof(QUERYLOG_REC) || r->reclen > head - tail || off + r->reclen > ring->size) {
+      Warnx(_("query log buffer for pid %d is corrupt; discarding %u bytes"), (int)pid, head - tail);
+      tail = head;
+      break;
+    }
+    querylog_write(r);
+    tail += r->reclen;
+    count++;
+  }
+  __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+  if (dropped != ring->reported && current_time >= LastReport + QUERYLOG_REPORT) {
+    Warnx(_("query log: %u records dropped by pid %d (buffer full)"), dropped - ring->reported, (int)pid);
+    ring->reported = dropped;
+    LastReport = current_time;
+  }
+  return (count);
+}
+/*--- querylog_ring_drain() ---------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_DRAINING
+	Does this process drain rings?  If so its poll timeout must stay short.
+**************************************************************************************************/
+int
+querylog_draining(void) {
+  return (querylog_enabled && (RingLocal || (Servers && array_numobjects(Servers) > 0)));
+}
+/*--- querylog_draining() -----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_DRAIN
+	Writes out the records waiting in every ring this process is responsible for.
+**************************************************************************************************/
+void
+querylog_drain(void) {
+  int	n = 0;
+
+  if (!querylog_draining())
+    return;
+
+  querylog_open_output();
+
+  if (Servers)
+    for (n = 0; n < array_numobjects(Servers); n++) {
+      SERVER *server = (SERVER *)array_fetch(Servers, n);
+      if (server && server->querylog)
+	querylog_ring_drain(server->querylog, server->pid);
+    }
+  if (RingLocal && Ring)
+    querylog_ring_drain(Ring, getpid());
+
+  querylog_flush();
+
+  if (OutputDropped != OutputReported && current_time >= LastReport + QUERYLOG_REPORT) {
+    Warnx(_("query log: %u records dropped writing to %s"), OutputDropped - OutputReported,
+	  query_log_output);
+    OutputReported = OutputDropped;
+    LastReport = current_time;
+  }
+}
+/*--- querylog_drain() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_CLOSE
+	Drains the rings and closes the output, ending a dnstap stream with STOP.
+**************************************************************************************************/
+void
+querylog_close(void) {
+  unsigned char	frame[16];
+
+  querylog_drain();
+  if (OutputFd < 0)
+    return;
+  if (QueryLogFormat == QUERYLOG_DNSTAP) {
+    querylog_output(frame, querylog_control_frame(frame, FSTRM_CONTROL_STOP));
+    OutputStarted = 0;
+  }
+  if (OutputSocket)
+    fcntl(OutputFd, F_SETFL, fcntl(OutputFd, F_GETFL, 0) & ~O_NONBLOCK);
+  querylog_flush();
+  close(OutputFd);
+  OutputFd = -1;
+  RELEASE(Pending);
+  PendingLen = PendingSize = 0;
+}
+/*--- querylog_close() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	QUERYLOG_STATUS
+	Reports how many records were logged and dropped.
+**************************************************************************************************/
+void
+querylog_status(void) {
+  uint32_t	logged = 0, dropped = Unringed;
+  int		n = 0;
+
+  if (!querylog_enabled)
+    return;
+
+  if (Ring) {
+    logged += Ring->logged;
+    dropped += Ring->dropped;
+  }
+  if (Servers)
+    for (n = 0; n < array_numobjects(Servers); n++) {
+      SERVER *server = (SERVER *)array_fetch(Servers, n);
+      if (server && server->querylog) {
+	logged += server->querylog->logged;
+	dropped += server->querylog->dropped;
+      }
+    }
+
+  Notice(_("query log: %u %s, %u %s (%s), %u %s (%s)"), logged, _("logged"),
+	 dropped, _("dropped"), _("buffer full"), OutputDropped, _("dropped"), _("output"));
+}
+/*--- querylog_status() -------------------------------------------------------------------------*/
+
+/* vi:set ts=3: */
+/* NEED_PO */
@@ -183,12 +183,18 @@ _dequeue(QUEUE **q, TASK *t, const char *file, unsigned int line) {
   DebugX("queue", 1,_("%s: dequeuing (by %s:%u)"), taskdesc, file, line);
 #endif
 
-  if (err_verbose)				/* Output task info if being verbose */
+  if (querylog_enabled)				/* Output task info if logging queries */
     task_output_info(t, NULL);
 
   if (t->hdr.rcode >= 0 && t->hdr.rcode < MAX_RESULTS)		/* Store results in stats */
     Status.results[t->hdr.rcode]++;
 
+  if (t->qdlen) {					/* Count answered questions */
+    heavyhitters_add(t);
+    metrics_add(t);
+    latency_add(t);
+  }
+
   __queue_remove(q, t);
 
   task_free(t);
@@ -797,37 +797,37 @@ __recursive_fwd_write_udp(TASK *t, void *data) {
   recursive_fwd_write_t	*querypacket = NULL;
   taskexec_t		res = TASK_FAILED;
 
-  Warnx(_("DEBUG __recursive_fwd_write_udp: ENTRY for %s"), desctask(t));
+  Log(LOG_DEBUG, _("__recursive_fwd_write_udp: ENTRY for %s"), desctask(t));
 
 #if DEBUG_ENABLED && DEBUG_RECURSIVE
   DebugX("recursive", 1, _("%s: recursive_fwd_write() UDP"), desctask(t));
 #endif
 
   if (!udp_recursive_master) {
-    Warnx(_("DEBUG __recursive_fwd_write_udp: No udp_recursive_master!"));
+    Log(LOG_DEBUG, _("__recursive_fwd_write_udp: No udp_recursive_master!"));
 #if DEBUG_ENABLED && DEBUG_RECURSIVE
     DebugX("recursive", 1, _("%s: recursive_fwd_write() UDP - no recursion master give up task"), desctask(t));
 #endif
     return dnserror(t, DNS_RCODE_SERVFAIL, ERR_FWD_RECURSIVE);
   }
 
-  Warnx(_("DEBUG __recursive_fwd_write_udp: udp_recursive_master status=%d, NEED_RECURSIVE_FWD_CONNECT=%d"),
-        udp_recursive_master->status, NEED_RECURSIVE_FWD_CONNECT);
+  Log(LOG_DEBUG, _("__recursive_fwd_write_udp: udp_recursive_master status=%d, NEED_RECURSIVE_FWD_CONNECT=%d"),
+      udp_recursive_master->status, NEED_RECURSIVE_FWD_CONNECT);
 
   if (udp_recursive_master->status == NEED_RECURSIVE_FWD_CONNECT) {
-    Warnx(_("DEBUG __recursive_fwd_write_udp: Master still connecting, returning TASK_CONTINUE"));
+    Log(LOG_DEBUG, _("__recursive_fwd_write_udp: Master still connecting, returning TASK_CONTINUE"));
 #if DEBUG_ENABLED && DEBUG_RECURSIVE
     DebugX("recursive", 1, _("%s: recursive_fwd_write() UDP - still waiting for connect try again later"), desctask(t));
 #endif
     return TASK_CONTINUE;
   }
 
-  Warnx(_("DEBUG __recursive_fwd_write_udp: Calling __recursive_fwd_setup_query"));
+  Log(LOG_DEBUG, _("__recursive_fwd_write_udp: Calling __recursive_fwd_setup_query"));
   res = __recursive_fwd_setup_query(t, &querypacket);
-  Warnx(_("DEBUG __recursive_fwd_write_udp: __recursive_fwd_setup_query returned %d (TASK_COMPLETED=%d)"),
-        res, TASK_COMPLETED);
+  Log(LOG_DEBUG, _("__recursive_fwd_write_udp: __recursive_fwd_setup_query returned %d (TASK_COMPLETED=%d)"),
+      res, TASK_COMPLETED);
   if (res != TASK_COMPLETED) {
-    Warnx(_("DEBUG __recursive_fwd_write_udp: Query setup failed, returning %d"), res);
+    Log(LOG_DEBUG, _("__recursive_fwd_write_udp: Query setup failed, returning %d"), res);
 #if DEBUG_ENABLED && DEBUG_RECURSIVE
     DebugX("recursive", 1, _("%s: recursive_fwd_write() UDP - query setup failed"), desctask(t));
 #endif
@@ -839,11 +839,11 @@ __recursive_fwd_write_udp(TASK *t, void *data) {
 
   fd = recursive_udp_fd;
 
-  Warnx(_("DEBUG __recursive_fwd_write_udp: About to send %d bytes to fd=%d"), querylen, fd);
+  Log(LOG_DEBUG, _("__recursive_fwd_write_udp: About to send %d bytes to fd=%d"), querylen, fd);
   rv = send(fd, query, querylen, MSG_DONTWAIT|MSG_EOR);
-  Warnx(_("DEBUG __recursive_fwd_write_udp: send() returned %d"), rv);
+  Log(LOG_DEBUG, _("__recursive_fwd_write_udp: send() returned %d"), rv);
   if (rv < 0) {
-    Warnx(_("DEBUG __recursive_fwd_write_udp: send() failed with errno=%d (%s)"), errno, strerror(errno));
+    Log(LOG_DEBUG, _("__recursive_fwd_write_udp: send() failed with errno=%d (%s)"), errno, strerror(errno));
     if (
 	(errno == EINTR)
 #ifdef EAGAIN
@@ -873,13 +873,14 @@ __recursive_fwd_write_udp(TASK *t, void *data) {
 #endif
     return TASK_CONTINUE;
   } else {
-    Warnx(_("DEBUG __recursive_fwd_write_udp: About to set status to NEED_RECURSIVE_FWD_RETRY"));
+    MYDNS_PROBE4(recursive_sent, t->internal_id, t->qname, t->qtype, SOCK_DGRAM);
+    Log(LOG_DEBUG, _("__recursive_fwd_write_udp: About to set status to NEED_RECURSIVE_FWD_RETRY"));
     t->status = NEED_RECURSIVE_FWD_RETRY;
-    Warnx(_("DEBUG __recursive_fwd_write_udp: About to set timeout"));
+    Log(LOG_DEBUG, _("__recursive_fwd_write_udp: About to set timeout"));
     t->timeout = current_time + _recursive_timeout(t, querypacket);
-    Warnx(_("DEBUG __recursive_fwd_write_udp: About to set querywritten=0"));
+    Log(LOG_DEBUG, _("__recursive_fwd_write_udp: About to set querywritten=0"));
     querypacket->querywritten = 0;
-    Warnx(_("DEBUG __recursive_fwd_write_udp: About to return TASK_CONTINUE"));
+    Log(LOG_DEBUG, _("__recursive_fwd_write_udp: About to return TASK_CONTINUE"));
 #if DEBUG_ENABLED && DEBUG_RECURSIVE
     DebugX("recursive", 1, _("%s: recursive_fwd_write() UDP - sent full packet retry if no reply by timeout"), desctask(t));
 #endif
@@ -994,6 +995,7 @@ __recursive_fwd_write_tcp(TASK *t, void *data) {
     t->timeout = current_time + _recursive_timeout(t, querypacket);
     return TASK_CONTINUE;
   } else {
+    MYDNS_PROBE4(recursive_sent, t->internal_id, t->qname, t->qtype, SOCK_STREAM);
     t->status = NEED_RECURSIVE_FWD_RETRY;
     t->timeout = current_time + _recursive_timeout(t, querypacket);
     querypacket->querywritten = 0;
@@ -1252,6 +1254,7 @@ __recursive_fwd_read(TASK *t, char *reply, int replylen) {
   t->an.size = ancount;
   t->ns.size = nscount;
   t->ar.size = arcount;
+  MYDNS_PROBE4(recursive_received, t->internal_id, t->qname, t->hdr.rcode, replylen);
 
   /* Cache these replies! */
   t->reply_cache_ok = 1;
@@ -1328,7 +1331,7 @@ __recursive_fwd_read_udp(TASK *t, void *data) {
   taskexec_t		res = TASK_FAILED;
   int			fd = -1;
 
-  Warnx(_("DEBUG __recursive_fwd_read_udp: ENTRY for fd=%d, status=%d"), t->fd, t->status);
+  Log(LOG_DEBUG, _("__recursive_fwd_read_udp: ENTRY for fd=%d, status=%d"), t->fd, t->status);
 
 #if DEBUG_ENABLED && DEBUG_RECURSIVE
   DebugX("recursive", 1, _("%s: recursive_fwd_read() UDP"), desctask(t));
@@ -1601,7 +1604,7 @@ __recursive_fwd_read_tcp(TASK *t, void *data) {
 
 static taskexec_t
 __recursive_fwd_udp(TASK *t) {
-  Warnx(_("DEBUG: __recursive_fwd_udp() ENTRY for %s"), t->qname);
+  Log(LOG_DEBUG, _("__recursive_fwd_udp() ENTRY for %s"), t->qname);
 
 #if DEBUG_ENABLED && DEBUG_RECURSIVE
   DebugX("recursive", 1, _("%s: recursive_fwd() protocol = UDP"), desctask(t));
@@ -1612,7 +1615,7 @@ __recursive_fwd_udp(TASK *t) {
     taskexec_t		rv = TASK_FAILED;
     struct sockaddr	*rsa = NULL;
 
-    Warnx(_("DEBUG: __recursive_fwd_udp() creating master task"));
+    Log(LOG_DEBUG, _("__recursive_fwd_udp() creating master task"));
     sockclose(recursive_udp_fd);
     rv = __recursive_start_comms(t, &recursive_udp_fd, SOCK_DGRAM);
 
@@ -1620,31 +1623,31 @@ __recursive_fwd_udp(TASK *t) {
 
     (void)get_serveraddr(&rsa);
 
-    Warnx(_("DEBUG: About to call IOtask_init() for master"));
+    Log(LOG_DEBUG, _("About to call IOtask_init() for master"));
     udp_recursive_master = IOtask_init(t->priority, NEED_RECURSIVE_FWD_CONNECT,
 				       recursive_udp_fd,
 				       SOCK_DGRAM, recursive_family, rsa);
-    Warnx(_("DEBUG: IOtask_init() returned, master=%p"), (void*)udp_recursive_master);
+    Log(LOG_DEBUG, _("IOtask_init() returned, master=%p"), (void*)udp_recursive_master);
 
     if (!udp_recursive_master) {
       Warnx(_("ERROR: IOtask_init() returned NULL!"));
       return dnserror(t, DNS_RCODE_SERVFAIL, ERR_INTERNAL);
     }
 
-    Warnx(_("DEBUG: Created udp_recursive_master task, status=%d, fd=%d"),
-          udp_recursive_master->status, udp_recursive_master->fd);
+    Log(LOG_DEBUG, _("Created udp_recursive_master task, status=%d, fd=%d"),
+	udp_recursive_master->status, udp_recursive_master->fd);
 
     /* No connectQ - tasks stay in TaskArray */
-    Warnx(_("DEBUG: About to call task_add_extension()"));
+    Log(LOG_DEBUG, _("About to call task_add_extension()"));
     task_add_extension(udp_recursive_master, NULL, __recursive_fwd_read_free,
 		       __recursive_fwd_read_udp, __recursive_fwd_read_timeout);
-    Warnx(_("DEBUG: task_add_extension() completed"));
+    Log(LOG_DEBUG, _("task_add_extension() completed"));
 
     /* Immediately initiate the connection */
-    Warnx(_("DEBUG: Calling recursive_fwd_connect() to initiate master connection"));
+    Log(LOG_DEBUG, _("Calling recursive_fwd_connect() to initiate master connection"));
     taskexec_t conn_result = recursive_fwd_connect(udp_recursive_master);
-    Warnx(_("DEBUG: recursive_fwd_connect() returned %d, master status now %d"),
-          conn_result, udp_recursive_master->status);
+    Log(LOG_DEBUG, _("recursive_fwd_connect() returned %d, master status now %d"),
+	conn_result, udp_recursive_master->status);
   }
 
   /* Keep task as PERIODIC so it gets checked regularly */
@@ -1656,7 +1659,7 @@ __recursive_fwd_udp(TASK *t) {
   if (udp_recursive_master->status == NEED_RECURSIVE_FWD_CONNECT
       || udp_recursive_master->status == NEED_RECURSIVE_FWD_CONNECTING) {
     /* Master is still connecting - mark query as waiting */
-    Warnx(_("DEBUG: __recursive_fwd_udp() master connecting, query %s waiting"), t->qname);
+    Log(LOG_DEBUG, _("__recursive_fwd_udp() master connecting, query %s waiting"), t->qname);
     t->status = NEED_RECURSIVE_FWD_CONNECTED;
     /* Task stays in TaskArray as PERIODIC_TASK and will be checked again */
     udp_recursion_running++;
@@ -1664,14 +1667,14 @@ __recursive_fwd_udp(TASK *t) {
   }
 
   /* Master is connected - proceed with write */
-  Warnx(_("DEBUG: __recursive_fwd_udp() master connected, proceeding with write for %s"), t->qname);
+  Log(LOG_DEBUG, _("__recursive_fwd_udp() master connected, proceeding with write for %s"), t->qname);
   t->status = NEED_RECURSIVE_FWD_WRITE;
   task_add_extension(t, NULL, __recursive_fwd_write_free,
 		     __recursive_fwd_write_udp, __recursive_fwd_write_timeout);
 
   udp_recursion_running++;
 
-  Warnx(_("DEBUG: __recursive_fwd_udp() EXIT returning TASK_EXECUTED for %s"), t->qname);
+  Log(LOG_DEBUG, _("__recursive_fwd_udp() EXIT returning TASK_EXECUTED for %s"), t->qname);
   return TASK_EXECUTED;
 }
 
@@ -1776,7 +1779,7 @@ __recursive_fwd_connect_udp(TASK *t) {
   socklen_t		rsalen = get_serveraddr(&rsa);
   int			fd = -1;
 
-  Warnx(_("DEBUG: __recursive_fwd_connect_udp() ENTRY for %s"), desctask(t));
+  Log(LOG_DEBUG, _("__recursive_fwd_connect_udp() ENTRY for %s"), desctask(t));
 
 #if DEBUG_ENABLED && DEBUG_RECURSIVE
   DebugX("recursive", 1, _("%s: recursive_fwd_connect() UDP"), desctask(t));
@@ -1791,13 +1794,13 @@ __recursive_fwd_connect_udp(TASK *t) {
   }
 
   if ((rv = connect(fd, rsa, rsalen)) < 0) {
-    Warnx(_("DEBUG __recursive_fwd_connect_udp: connect() failed with errno=%d (%s)"), errno, strerror(errno));
+    Log(LOG_DEBUG, _("__recursive_fwd_connect_udp: connect() failed with errno=%d (%s)"), errno, strerror(errno));
     Warn("%s: %s %s", desctask(t), _("error connecting to recursive forwarder"),
 	 recursive_fwd_server);
     return dnserror(t, DNS_RCODE_SERVFAIL, ERR_FWD_RECURSIVE);
   }
 
-  Warnx(_("DEBUG __recursive_fwd_connect_udp: connect() SUCCESS"));
+  Log(LOG_DEBUG, _("__recursive_fwd_connect_udp: connect() SUCCESS"));
 
   /* Mark master as connected and ready to send queries */
   t->status = NEED_RECURSIVE_FWD_READ;
@@ -1811,7 +1814,7 @@ __recursive_fwd_connect_udp(TASK *t) {
 
   /* No need to restore tasks - they're already in TaskArray as PERIODIC_TASK */
   /* They'll automatically check master status on their next iteration */
-  Warnx(_("DEBUG __recursive_fwd_connect_udp: Master connected, waiting tasks will proceed on next check"));
+  Log(LOG_DEBUG, _("__recursive_fwd_connect_udp: Master connected, waiting tasks will proceed on next check"));
 
   return TASK_CONTINUE;
 }
@@ -1939,20 +1942,20 @@ __recursive_fwd_connecting_tcp(TASK *t) {
 taskexec_t
 recursive_fwd_connect(TASK *t) {
 
-  Warnx(_("DEBUG: recursive_fwd_connect() ENTRY, status=%d, protocol=%d, fd=%d"),
-        t->status, t->protocol, t->fd);
+  Log(LOG_DEBUG, _("recursive_fwd_connect() ENTRY, status=%d, protocol=%d, fd=%d"),
+      t->status, t->protocol, t->fd);
 
   switch (t->protocol) {
 
   case SOCK_DGRAM:
-    Warnx(_("DEBUG: recursive_fwd_connect() SOCK_DGRAM case, calling __recursive_fwd_connect_udp()"));
+    Log(LOG_DEBUG, _("recursive_fwd_connect() SOCK_DGRAM case, calling __recursive_fwd_connect_udp()"));
     return __recursive_fwd_connect_udp(t);
   case SOCK_STREAM:
-    Warnx(_("DEBUG: recursive_fwd_connect() SOCK_STREAM case, calling __recursive_fwd_connect_tcp()"));
+    Log(LOG_DEBUG, _("recursive_fwd_connect() SOCK_STREAM case, calling __recursive_fwd_connect_tcp()"));
     return __recursive_fwd_connect_tcp(t);
 
   default:
-    Warnx(_("DEBUG: recursive_fwd_connect() DEFAULT case - unknown protocol %d"), t->protocol);
+    Log(LOG_DEBUG, _("recursive_fwd_connect() DEFAULT case - unknown protocol %d"), t->protocol);
     return dnserror(t, DNS_RCODE_SERVFAIL, ERR_INTERNAL);
 
   }
@@ -1981,20 +1984,20 @@ recursive_fwd_connecting(TASK *t) {
 taskexec_t
 recursive_fwd_write(TASK *t) {
 
-  Warnx(_("DEBUG recursive_fwd_write: ENTRY for %s, protocol=%d, status=%d"),
-        desctask(t), t->protocol, t->status);
+  Log(LOG_DEBUG, _("recursive_fwd_write: ENTRY for %s, protocol=%d, status=%d"),
+      desctask(t), t->protocol, t->status);
 
   switch (t->protocol) {
 
   case SOCK_DGRAM:
-    Warnx(_("DEBUG recursive_fwd_write: SOCK_DGRAM case, calling __recursive_fwd_write_udp"));
+    Log(LOG_DEBUG, _("recursive_fwd_write: SOCK_DGRAM case, calling __recursive_fwd_write_udp"));
     return __recursive_fwd_write_udp(t, NULL);
   case SOCK_STREAM:
-    Warnx(_("DEBUG recursive_fwd_write: SOCK_STREAM case, calling __recursive_fwd_write_tcp"));
+    Log(LOG_DEBUG, _("recursive_fwd_write: SOCK_STREAM case, calling __recursive_fwd_write_tcp"));
     return __recursive_fwd_write_tcp(t, NULL);
 
   default:
-    Warnx(_("DEBUG recursive_fwd_write: DEFAULT case - unknown protocol %d"), t->protocol);
+    Log(LOG_DEBUG, _("recursive_fwd_write: DEFAULT case - unknown protocol %d"), t->protocol);
     return dnserror(t, DNS_RCODE_SERVFAIL, ERR_INTERNAL);
 
   }
@@ -2009,8 +2012,8 @@ recursive_fwd_write(TASK *t) {
 **************************************************************************************************/
 taskexec_t
 recursive_fwd_read(TASK *t) {
-  Warnx(_("DEBUG: recursive_fwd_read() ENTRY for fd=%d, protocol=%d, status=%d"),
-        t->fd, t->protocol, t->status);
+  Log(LOG_DEBUG, _("recursive_fwd_read() ENTRY for fd=%d, protocol=%d, status=%d"),
+      t->fd, t->protocol, t->status);
 
   switch (t->protocol) {
 
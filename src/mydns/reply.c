@@ -51,30 +51,128 @@ reply_init(TASK *t) {
 /*--- reply_init() ------------------------------------------------------------------------------*/
 
 
+/**************************************************************************************************
+	REPLY_GLUE_REQUIRED
+	Returns nonzero if `target' is at or below `owner', i.e. the address of a name server
+	named in a delegation cannot be found without the glue we send.
+**************************************************************************************************/
+static int
+reply_glue_required(const char *owner, const char *target) {
+  size_t olen = strlen(owner), tlen = strlen(target);
+
+  if (olen && owner[olen-1] == '.') olen--;
+  if (tlen && target[tlen-1] == '.') tlen--;
+  if (!olen || tlen < olen)
+    return (0);
+  if (tlen > olen && target[tlen - olen - 1] != '.')
+    return (0);
+  return (!strncasecmp(target + tlen - olen, owner, olen));
+}
+/*--- reply_glue_required() ---------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	REPLY_GLUE_LOAD
+	Loads the A records for `target' for GlueCache.  Only plain records matching `target'
+	exactly are handled; returns NULL if resolve() has to do the work.
+**************************************************************************************************/
+static ALIAS_CHAIN *
+reply_glue_load(TASK *t, char *target) {
+  MYDNS_SOA		*soa = NULL;
+  MYDNS_RR		*rr = NULL;
+  register MYDNS_RR	*r = NULL;
+  ALIAS_CHAIN		*glue = NULL;
+  char			*label = NULL;
+
+  if (!(soa = find_soa2(t, target, &label)))
+    return (NULL);
+
+  if (!soa->recursive && (rr = find_rr(t, soa, DNS_QTYPE_A, label))) {
+    for (r = rr; r; r = r->next)
+      if (r->alias)
+	break;
+    if (!r) {
+      glue = alias_chain_new();
+      glue->zone = soa->id;
+      glue->minimum_ttl = soa->minimum;
+      for (r = rr; r; r = r->next)
+	alias_chain_add_rr(glue, ADDITIONAL, DNS_RRTYPE_RR, (void *)r, target, 0);
+    }
+    mydns_rr_free(rr);
+  }
+  RELEASE(label);
+  mydns_soa_free(soa);
+  return (glue);
+}
+/*--- reply_glue_load() -------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	REPLY_ADD_GLUE
+	Adds the addresses of `target' to the ADDITIONAL section, via GlueCache where possible.
+	Returns 1 if the zone had to be searched, 0 if the addresses came from the cache.
+**************************************************************************************************/
+static int
+reply_add_glue(TASK *t, char *target) {
+  ALIAS_CHAIN		*glue = NULL;
+  register ALIAS_CHAIN_RR *r = NULL;
+  uint32_t		minimum_ttl = t->minimum_ttl;
+  int			cached = 0;
+
+  if ((glue = chain_cache_find(GlueCache, t, target, DNS_QTYPE_A))) {
+    Status.glue_hits++;
+    cached = 1;
+  } else if (!GlueCache || !(glue = reply_glue_load(t, target))) {
+    (void)resolve(t, ADDITIONAL, DNS_QTYPE_A, target, 0);
+    return (1);
+  }
+
+  t->minimum_ttl = glue->minimum_ttl;
+  for (r = glue->head; r; r = r->next)
+    rrlist_add(t, ADDITIONAL, r->rrtype, r->rr, r->name);
+  t->minimum_ttl = minimum_ttl;
+  t->sort_level++;
+
+  if (cached)
+    return (0);
+  chain_cache_add(GlueCache, t, target, DNS_QTYPE_A, glue);
+  return (1);
+}
+/*--- reply_add_glue() --------------------------------------------------------------------------*/
+
+
 /**************************************************************************************************
 	REPLY_ADD_ADDITIONAL
 	Add ADDITIONAL for each item in the provided list.
+	With `minimal-responses' only the glue needed to follow a delegation is added.
+	Returns the number of zone lookups made.
 **************************************************************************************************/
-static void
-reply_add_additional(TASK *t, RRLIST *rrlist) {
+static int
+reply_add_additional(TASK *t, RRLIST *rrlist, datasection_t ds) {
   register RR *p = NULL;
+  register int lookups = 0;
 
   if (!rrlist)
-    return;
+    return (0);
 
   /* Examine each RR in the rrlist */
   for (p = rrlist->head; p; p = p->next) {
     if (p->rrtype == DNS_RRTYPE_RR) {
       MYDNS_RR *rr = (MYDNS_RR *)p->rr;
       if (rr->type == DNS_QTYPE_NS || rr->type == DNS_QTYPE_MX || rr->type == DNS_QTYPE_SRV) {
-	(void)resolve(t, ADDITIONAL, DNS_QTYPE_A, MYDNS_RR_DATA_VALUE(rr), 0);
-      }	else if (rr->type == DNS_QTYPE_CNAME) {
+	if (!minimal_responses
+	    || (rr->type == DNS_QTYPE_NS && ds == AUTHORITY
+		&& reply_glue_required((char *)p->name, MYDNS_RR_DATA_VALUE(rr))))
+	  lookups += reply_add_glue(t, MYDNS_RR_DATA_VALUE(rr));
+      }	else if (rr->type == DNS_QTYPE_CNAME && !minimal_responses) {
 	/* Don't do this */
 	(void)resolve(t, ADDITIONAL, DNS_QTYPE_CNAME, MYDNS_RR_DATA_VALUE(rr), 0);
+	lookups++;
       }
     }
     t->sort_level++;
   }
+  return (lookups);
 }
 /*--- reply_add_additional() --------------------------------------------------------------------*/
 
@@ -482,6 +580,8 @@ reply_add_a(TASK *t, RR *r) {
 
   /* Check for GeoIP-specific data */
   if (GeoIP && t->client_sensor_id > 0 && t->zone > 0) {
+    uint64_t started = LATENCY_BEGIN(t);
+
     /* Check if zone has GeoIP enabled */
     zone_geoip_enabled = geoip_zone_enabled(GeoIP, t->zone);
     if (zone_geoip_enabled == 1) {
@@ -494,6 +594,7 @@ reply_add_a(TASK *t, RR *r) {
 #endif
       }
     }
+    LATENCY_END(t, LS_GEOIP, started);
   }
 
   if (inet_pton(AF_INET, data_value, (void *)&addr) <= 0) {
@@ -544,6 +645,8 @@ reply_add_aaaa(TASK *t, RR *r) {
 
   /* Check for GeoIP-specific data */
   if (GeoIP && t->client_sensor_id > 0 && t->zone > 0) {
+    uint64_t started = LATENCY_BEGIN(t);
+
     /* Check if zone has GeoIP enabled */
     zone_geoip_enabled = geoip_zone_enabled(GeoIP, t->zone);
     if (zone_geoip_enabled == 1) {
@@ -556,6 +659,7 @@ reply_add_aaaa(TASK *t, RR *r) {
 #endif
       }
     }
+    LATENCY_END(t, LS_GEOIP, started);
   }
 
   if (inet_pton(AF_INET6, data_value, (void *)&addr) <= 0) {
@@ -1517,13 +1621,20 @@ build_reply(TASK *t, int want_additional) {
 
   /* Add data to ADDITIONAL section */
   if (want_additional) {
-    reply_add_additional(t, &t->an);
-    reply_add_additional(t, &t->ns);
+    int lookups = reply_add_additional(t, &t->an, ANSWER);
+
+    lookups += reply_add_additional(t, &t->ns, AUTHORITY);
+    if (t->qtype == DNS_QTYPE_NS || t->qtype == DNS_QTYPE_MX || t->qtype == DNS_QTYPE_SRV) {
+      Status.additional_replies++;
+      Status.additional_lookups += lookups;
+    }
   }
 
   /* Add DNSSEC records if enabled and zone supports it */
   /* Note: This is a simplified integration - full version would iterate through RRsets */
   if (dnssec_enabled && t->zone) {
+    uint64_t started = LATENCY_BEGIN(t);
+
     /* For DNSKEY queries, add DNSKEYs and their RRSIGs */
     if (t->qtype == DNS_QTYPE_DNSKEY) {
       dnssec_add_to_response(t, ANSWER, t->zone, t->qname, t->qname, DNS_QTYPE_DNSKEY);
@@ -1536,6 +1647,7 @@ build_reply(TASK *t, int want_additional) {
     else if (t->an.size > 0) {
       dnssec_add_to_response(t, ANSWER, t->zone, t->qname, t->qname, t->qtype);
     }
+    LATENCY_END(t, LS_DNSSEC, started);
   }
 
   /* Sort records where necessary */
@@ -1581,6 +1693,11 @@ build_reply(TASK *t, int want_additional) {
     DNS_PUT(dest, t->qd, t->qdlen);				/* Data for QUESTION section */
   DNS_PUT(dest, t->rdata, t->rdlen);				/* Resource record data */
 
+  Status.replies++;
+  Status.reply_bytes += t->replylen;
+  if (t->hdr.tc)
+    Status.truncated++;
+
 #if DEBUG_ENABLED && DEBUG_REPLY
   DebugX("reply", 1, _("%s: reply:     id = %u"), desctask(t),
 	 t->id);
@@ -52,7 +52,7 @@ resolve_soa(TASK *t, datasection_t section, char *fqdn, int level) {
 	  /* Force UDP for upstream forwarding regardless of client protocol */
 	  int original_protocol = t->protocol;
 	  t->protocol = SOCK_DGRAM;
-	  Warnx(_("DEBUG resolve_soa: Forcing UDP for recursive forwarding (original protocol=%d)"), original_protocol);
+	  Log(LOG_DEBUG, _("resolve_soa: Forcing UDP for recursive forwarding (original protocol=%d)"), original_protocol);
 	  return recursive_fwd(t);
 	}
       return dnserror(t, DNS_RCODE_REFUSED, ERR_ZONE_NOT_FOUND);
@@ -91,11 +91,11 @@ resolve_soa(TASK *t, datasection_t section, char *fqdn, int level) {
 
   /* No SOA found - try recursive resolution if enabled */
   if (section == ANSWER && t->hdr.rd) {
-    Warnx(_("DEBUG resolve_soa: No SOA for %s, section=ANSWER, rd=%d, forward_recursive=%d, DnsCache=%p"),
-          fqdn, t->hdr.rd, forward_recursive, DnsCache);
+    Log(LOG_DEBUG, _("resolve_soa: No SOA for %s, section=ANSWER, rd=%d, forward_recursive=%d, DnsCache=%p"),
+	fqdn, t->hdr.rd, forward_recursive, DnsCache);
     /* Traditional recursive forwarding (master servers with 'recursive' config) */
     if (forward_recursive) {
-      Warnx(_("DEBUG resolve_soa: Calling recursive_fwd() for %s"), fqdn);
+      Log(LOG_DEBUG, _("resolve_soa: Calling recursive_fwd() for %s"), fqdn);
 #if DEBUG_ENABLED && DEBUG_RESOLVE
       DebugX("resolve", 1, _("%s: No SOA found for %s, trying recursive_fwd"), desctask(t), fqdn);
 #endif
@@ -103,12 +103,12 @@ resolve_soa(TASK *t, datasection_t section, char *fqdn, int level) {
       /* TCP responses will be handled if upstream returns truncated response */
       int original_protocol = t->protocol;
       t->protocol = SOCK_DGRAM;
-      Warnx(_("DEBUG resolve: Forcing UDP for recursive forwarding (original protocol=%d)"), original_protocol);
+      Log(LOG_DEBUG, _("resolve: Forcing UDP for recursive forwarding (original protocol=%d)"), original_protocol);
       return recursive_fwd(t);
     }
     /* DNS cache forwarding (MySQL-free slave servers with 'dns-cache-enabled') */
     else if (DnsCache) {
-      Warnx(_("DEBUG resolve_soa: Calling dnscache_fwd() for %s"), fqdn);
+      Log(LOG_DEBUG, _("resolve_soa: Calling dnscache_fwd() for %s"), fqdn);
 #if DEBUG_ENABLED && DEBUG_RESOLVE
       DebugX("resolve", 1, _("%s: No SOA found for %s, trying DNS cache"), desctask(t), fqdn);
 #endif
@@ -116,21 +116,21 @@ resolve_soa(TASK *t, datasection_t section, char *fqdn, int level) {
     }
   }
 
-  Warnx(_("DEBUG resolve_soa: Returning REFUSED for %s (section=%d, rd=%d, forward_recursive=%d)"),
-        fqdn, section, t->hdr.rd, forward_recursive);
+  Log(LOG_DEBUG, _("resolve_soa: Returning REFUSED for %s (section=%d, rd=%d, forward_recursive=%d)"),
+      fqdn, section, t->hdr.rd, forward_recursive);
   return (section == ANSWER ? dnserror(t, DNS_RCODE_REFUSED, ERR_ZONE_NOT_FOUND) : TASK_EXECUTED);
 }
 /*--- resolve_soa() -----------------------------------------------------------------------------*/
 
 
 /**************************************************************************************************
-	CNAME_RECURSE
+	_CNAME_RECURSE
 	If task has a dominant matching CNAME record, recurse into it.
 	Returns the number of records added.
 **************************************************************************************************/
 static taskexec_t
-cname_recurse(TASK *t, datasection_t section, dns_qtype_t qtype,
-	      char *fqdn, MYDNS_RR *cname, int level) {
+_cname_recurse(TASK *t, datasection_t section, dns_qtype_t qtype,
+	       char *fqdn, MYDNS_RR *cname, int level) {
   register int n = 0;
 
   if (level >= MAX_CNAME_LEVEL)
@@ -164,6 +164,87 @@ cname_recurse(TASK *t, datasection_t section, dns_qtype_t qtype,
   /* Resolve with this new CNAME record as the FQDN */
   return resolve(t, section, qtype, MYDNS_RR_DATA_VALUE(cname), level+1);
 }
+/*--- _cname_recurse() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CNAME_CACHE_REPLAY
+	Adds the records of a flattened CNAME chain to the reply, exactly as resolving the chain
+	added them.
+**************************************************************************************************/
+static void
+cname_cache_replay(TASK *t, ALIAS_CHAIN *chain) {
+  register ALIAS_CHAIN_RR *r = NULL;
+  uint8_t base = t->sort_level;
+
+  /* TTLs were already raised to each zone's minimum when the chain was captured */
+  t->minimum_ttl = 0;
+  for (r = chain->head; r; r = r->next) {
+    t->sort_level = base + r->sort_level;
+    rrlist_add(t, r->section, r->rrtype, r->rr, r->name);
+  }
+  t->sort_level = base + chain->sort_levels;
+  t->zone = chain->zone;
+  t->minimum_ttl = chain->minimum_ttl;
+}
+/*--- cname_cache_replay() ----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CNAME_CACHE_ADD
+	Captures everything added to the (previously empty) reply while following a CNAME chain
+	and stores it in AliasCache under `fqdn'/`qtype'.
+**************************************************************************************************/
+static void
+cname_cache_add(TASK *t, char *fqdn, dns_qtype_t qtype, uint8_t base) {
+  RRLIST		*lists[3] = { &t->an, &t->ns, &t->ar };
+  datasection_t		sections[3] = { ANSWER, AUTHORITY, ADDITIONAL };
+  ALIAS_CHAIN		*chain = NULL;
+  register RR		*r = NULL;
+  register int		n = 0;
+
+  chain = alias_chain_new();
+  for (n = 0; n < 3; n++)
+    for (r = lists[n]->head; r; r = r->next)
+      if (!alias_chain_add_rr(chain, sections[n], r->rrtype, r->rr, (char *)r->name,
+			      (uint8_t)(r->sort_level - base))) {
+	alias_chain_free(chain);
+	return;
+      }
+  chain->zone = t->zone;
+  chain->minimum_ttl = t->minimum_ttl;
+  chain->sort_levels = t->sort_level - base;
+  chain_cache_add(AliasCache, t, fqdn, qtype, chain);
+}
+/*--- cname_cache_add() -------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	CNAME_RECURSE
+	Follows a CNAME chain.  A chain starting at the question name is served whole from
+	AliasCache when possible, and stored there once resolved.
+**************************************************************************************************/
+static taskexec_t
+cname_recurse(TASK *t, datasection_t section, dns_qtype_t qtype,
+	      char *fqdn, MYDNS_RR *cname, int level) {
+  ALIAS_CHAIN	*chain = NULL;
+  uint8_t	base = t->sort_level;
+  taskexec_t	rv = TASK_FAILED;
+
+  if (level || section != ANSWER || !AliasCache || t->qtype == DNS_QTYPE_CNAME
+      || t->qtype == DNS_QTYPE_IXFR || t->an.size || t->ns.size || t->ar.size)
+    return _cname_recurse(t, section, qtype, fqdn, cname, level);
+
+  if ((chain = chain_cache_find(AliasCache, t, fqdn, qtype))) {
+    cname_cache_replay(t, chain);
+    return (TASK_COMPLETED);
+  }
+
+  rv = _cname_recurse(t, section, qtype, fqdn, cname, level);
+  if (rv == TASK_COMPLETED && t->hdr.rcode == DNS_RCODE_NOERROR && t->reply_cache_ok)
+    cname_cache_add(t, fqdn, qtype, base);
+  return (rv);
+}
 /*--- cname_recurse() ---------------------------------------------------------------------------*/
 
 
@@ -530,22 +611,22 @@ resolve(TASK *t, datasection_t section, dns_qtype_t qtype, char *fqdn, int level
   DebugX("resolve", 1, _("%s: resolve(%s) -> soa %s"), desctask(t), fqdn, (soa)?soa->origin:_("not found"));
 #endif
 
-  Warnx(_("DEBUG resolve: fqdn=%s, soa=%p, section=%d, level=%d, t->hdr.rd=%d"),
-        fqdn, soa, section, level, t->hdr.rd);
+  Log(LOG_DEBUG, _("resolve: fqdn=%s, soa=%p, section=%d, level=%d, t->hdr.rd=%d"),
+      fqdn, soa, section, level, t->hdr.rd);
   if (soa) {
-    Warnx(_("DEBUG resolve: soa->origin=%s, soa->recursive=%d"), soa->origin, soa->recursive);
+    Log(LOG_DEBUG, _("resolve: soa->origin=%s, soa->recursive=%d"), soa->origin, soa->recursive);
   }
 
   if (!soa || soa->recursive) {
-    Warnx(_("DEBUG resolve: entering recursive block (!soa=%d || soa->recursive=%d)"),
-          !soa, soa ? soa->recursive : 0);
+    Log(LOG_DEBUG, _("resolve: entering recursive block (!soa=%d || soa->recursive=%d)"),
+	!soa, soa ? soa->recursive : 0);
     RELEASE(name);
     if ((section == ANSWER) && !level) {
-      Warnx(_("DEBUG resolve: section==ANSWER && !level, checking recursive options"));
-      Warnx(_("DEBUG resolve: DnsCache=%p, forward_recursive=%d, t->hdr.rd=%d"),
-            DnsCache, forward_recursive, t->hdr.rd);
+      Log(LOG_DEBUG, _("resolve: section==ANSWER && !level, checking recursive options"));
+      Log(LOG_DEBUG, _("resolve: DnsCache=%p, forward_recursive=%d, t->hdr.rd=%d"),
+	  DnsCache, forward_recursive, t->hdr.rd);
       if (DnsCache) {
-        Warnx(_("DEBUG resolve: DnsCache->config.enabled=%d"), DnsCache->config.enabled);
+        Log(LOG_DEBUG, _("resolve: DnsCache->config.enabled=%d"), DnsCache->config.enabled);
       }
 #if DEBUG_ENABLED && DEBUG_RESOLVE
       DebugX("resolve", 1, _("%s: Checking for recursion soa = %p, soa->recursive = %d, "
@@ -556,14 +637,14 @@ resolve(TASK *t, datasection_t section, dns_qtype_t qtype, char *fqdn, int level
 #endif
       /* Try DNS cache first if enabled */
       if (DnsCache && DnsCache->config.enabled && t->hdr.rd) {
-        Warnx(_("DEBUG resolve: about to call dnscache_resolve() for %s"), fqdn);
+        Log(LOG_DEBUG, _("resolve: about to call dnscache_resolve() for %s"), fqdn);
         cache_record_t *records[100];
         const char *client_ip = clientaddr(t);
         int cache_result = dnscache_resolve(DnsCache, Memzone, fqdn, qtype,
                                           client_ip, NULL, 0,
                                           records, 100);
 
-        Warnx(_("DEBUG resolve: dnscache_resolve() returned %d for %s"), cache_result, fqdn);
+        Log(LOG_DEBUG, _("resolve: dnscache_resolve() returned %d for %s"), cache_result, fqdn);
 
         if (cache_result > 0) {
           /* Cache hit - add records to response */
@@ -612,11 +693,11 @@ resolve(TASK *t, datasection_t section, dns_qtype_t qtype, char *fqdn, int level
 #endif
           /* Fall back to traditional recursive forwarding if available */
           if (forward_recursive && t->hdr.rd) {
-            Warnx(_("DEBUG: Falling back to recursive_fwd() for %s after DNS cache failure"), fqdn);
+            Log(LOG_DEBUG, _("Falling back to recursive_fwd() for %s after DNS cache failure"), fqdn);
             /* Force UDP for upstream forwarding regardless of client protocol */
             int original_protocol = t->protocol;
             t->protocol = SOCK_DGRAM;
-            Warnx(_("DEBUG resolve: Forcing UDP for upstream fallback (client protocol=%d)"), original_protocol);
+            Log(LOG_DEBUG, _("resolve: Forcing UDP for upstream fallback (client protocol=%d)"), original_protocol);
             return recursive_fwd(t);
           }
           return dnserror(t, DNS_RCODE_SERVFAIL, ERR_INTERNAL);
@@ -625,12 +706,12 @@ resolve(TASK *t, datasection_t section, dns_qtype_t qtype, char *fqdn, int level
 
       /* Use traditional recursive forwarding if DNS cache is not enabled */
       if (forward_recursive && t->hdr.rd) {
-        Warnx(_("DEBUG: Using recursive_fwd() for %s (DNS cache not enabled)"), fqdn);
+        Log(LOG_DEBUG, _("Using recursive_fwd() for %s (DNS cache not enabled)"), fqdn);
         /* Force UDP for upstream forwarding regardless of client protocol */
         /* TCP responses will be handled if upstream returns truncated response */
         int original_protocol = t->protocol;
         t->protocol = SOCK_DGRAM;
-        Warnx(_("DEBUG resolve: Forcing UDP for upstream (client protocol=%d)"), original_protocol);
+        Log(LOG_DEBUG, _("resolve: Forcing UDP for upstream (client protocol=%d)"), original_protocol);
 	return recursive_fwd(t);
       }
       return dnserror(t, DNS_RCODE_REFUSED, ERR_ZONE_NOT_FOUND);
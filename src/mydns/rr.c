@@ -147,9 +147,10 @@ rrlist_add(
     break;
 
   case ANSWER:
-    /* Suppress this check if the reply is an IXFR */
+    /* Suppress this check if the reply is a zone transfer; the closing SOA may share a
+       message with the opening one */
     list = &t->an;
-    if (t->qtype == DNS_QTYPE_IXFR) break;
+    if (t->qtype == DNS_QTYPE_IXFR || t->qtype == DNS_QTYPE_AXFR) break;
     if (rrdup(&t->an, rrtype, id)) {
 #if DEBUG_ENABLED && DEBUG_RR
       DebugX("rr", 1, _("%s: Duplicate record, ignored"), desctask(t));
@@ -49,14 +49,21 @@ static int messageid = 0;
 
 static int comms_sendping(TASK *, COMMS *, char *);
 static int comms_sendpong(TASK *, COMMS *, char *);
+static int comms_flush_zone(TASK *, COMMS *, char *);
+static int comms_flush_name(TASK *, COMMS *, char *);
+static int comms_flush(TASK *, COMMS *, char *);
+static int comms_reload_zone(TASK *, COMMS *, char *);
+static int comms_reload(TASK *, COMMS *, char *);
+static int comms_acked(TASK *, COMMS *, char *);
 
 /* Commands from the master to the server */
 static COMMAND servercommands[] = { { "STOP AXFR",	NULL },
 				    { "START AXFR",	NULL },
-				    { "FLUSH ZONE",	NULL },
-				    { "FLUSH",		NULL },
-				    { "RELOAD ZONE",	NULL },
-				    { "RELOAD",		NULL },
+				    { "FLUSH ZONE",	comms_flush_zone },
+				    { "FLUSH NAME",	comms_flush_name },
+				    { "FLUSH",		comms_flush },
+				    { "RELOAD ZONE",	comms_reload_zone },
+				    { "RELOAD",		comms_reload },
 				    { "SEND STATS",	NULL },
 				    { "PING",		comms_sendpong },
 				    { "PONG",		NULL },
@@ -67,10 +74,11 @@ static COMMAND mastercommands[] = { { "STATS",		NULL },
 				    { "TCP START",	NULL },
 				    { "STOPPED AXFR",	NULL },
 				    { "STARTED AXFR",	NULL },
-				    { "FLUSHED ZONE",	NULL },
-				    { "FLUSHED",	NULL },
-				    { "RELOADED ZONE",	NULL },
-				    { "RELOADED",	NULL },
+				    { "FLUSHED ZONE",	comms_acked },
+				    { "FLUSHED NAME",	comms_acked },
+				    { "FLUSHED",	comms_acked },
+				    { "RELOADED ZONE",	comms_acked },
+				    { "RELOADED",	comms_acked },
 				    { "PING",		comms_sendpong },
 				    { "PONG",		NULL },
 				    { NULL,		NULL } };
@@ -337,7 +345,7 @@ comms_start(int fd, FreeExtension comms_freeer, RunExtension comms_runner,
 }
 
 static taskexec_t
-comms_run(TASK *t, void * data) {
+comms_run(TASK *t, void * data, COMMAND *commands) {
   taskexec_t		rv = TASK_FAILED;
   COMMS			*comms = NULL;
   CommandProcessor	action = NULL;
@@ -355,17 +363,31 @@ comms_run(TASK *t, void * data) {
   if ((rv == TASK_FAILED) || (rv == TASK_CONTINUE)) return TASK_CONTINUE;
 
   /* Got a message dispatch it. */
-  action = comms_find_command(t, comms, servercommands, &args);
+  action = comms_find_command(t, comms, commands, &args);
+  if (action)
+    args = STRDUP(args);				/* `args' points into the message */
 
   __comms_free(t, comms);
   comms->donesofar = 0;
 
-  if (action)
+  if (action) {
     action(t, comms, args);
+    RELEASE(args);
+  }
 
   return TASK_CONTINUE;
 }
 
+static taskexec_t
+scomms_run(TASK *t, void *data) {
+  return comms_run(t, data, servercommands);
+}
+
+static taskexec_t
+mcomms_run(TASK *t, void *data) {
+  return comms_run(t, data, mastercommands);
+}
+
 static taskexec_t
 comms_sendcommand(TASK *t, COMMS *comms, const char *commandstring) {
   taskexec_t	rv = TASK_FAILED;
@@ -456,13 +478,34 @@ mcomms_tick(TASK *t, void *data) {
 
 TASK *
 scomms_start(int fd) {
-  return comms_start(fd, __comms_free, comms_run, scomms_tick);
+  return comms_start(fd, __comms_free, scomms_run, scomms_tick);
 }
 
 TASK *
 mcomms_start(int fd) {
-  return comms_start(fd, __comms_free, comms_run, mcomms_tick);
+  return comms_start(fd, __comms_free, mcomms_run, mcomms_tick);
+}
+
+
+/**************************************************************************************************
+	COMMS_BROADCAST
+	Sends `commandstring' to every server.  Returns the number of servers it was sent to.
+**************************************************************************************************/
+int
+comms_broadcast(const char *commandstring) {
+  int		n = 0, sent = 0;
+
+  for (n = 0; Servers && n < array_numobjects(Servers); n++) {
+    SERVER *server = (SERVER*)array_fetch(Servers, n);
+
+    if (!server || !server->listener)
+      continue;
+    comms_sendcommand(server->listener, NULL, commandstring);
+    sent++;
+  }
+  return sent;
 }
+/*--- comms_broadcast() -------------------------------------------------------------------------*/
 
 
 static taskexec_t
@@ -483,5 +526,61 @@ comms_sendpong(TASK *t, COMMS *comms, char *args) {
   return rv;
 }
 
+
+/**************************************************************************************************
+	COMMS_CONTROL
+	Acts on a control command from the master, then tells it so with `reply'.  The master
+	sends "<seq> <zone id> <origin> <name>", with `-' for an origin or name it has not got.
+**************************************************************************************************/
+static taskexec_t
+comms_control(TASK *t, COMMS *comms, char *args, control_action_t action, const char *reply) {
+  unsigned int	seq = 0, zone = 0;
+  char		origin[DNS_MAXNAMELEN + 1], name[DNS_MAXNAMELEN + 1], response[64];
+
+  origin[0] = name[0] = '\0';
+  if (!args || sscanf(args, " %u %u %255s %255s", &seq, &zone, origin, name) < 1) {
+    Warnx(_("%s: malformed %s command from master"), desctask(t), reply);
+    return TASK_CONTINUE;
+  }
+  control_run(action, zone, (origin[0] && strcmp(origin, "-")) ? origin : NULL,
+	      (name[0] && strcmp(name, "-")) ? name : NULL);
+
+  snprintf(response, sizeof(response), "%s %u", reply, seq);
+  return comms_sendcommand(t, comms, response);
+}
+/*--- comms_control() ---------------------------------------------------------------------------*/
+
+static taskexec_t
+comms_flush_zone(TASK *t, COMMS *comms, char *args) {
+  return comms_control(t, comms, args, CONTROL_FLUSH_ZONE, "FLUSHED ZONE");
+}
+
+static taskexec_t
+comms_flush_name(TASK *t, COMMS *comms, char *args) {
+  return comms_control(t, comms, args, CONTROL_FLUSH_NAME, "FLUSHED NAME");
+}
+
+static taskexec_t
+comms_flush(TASK *t, COMMS *comms, char *args) {
+  return comms_control(t, comms, args, CONTROL_FLUSH, "FLUSHED");
+}
+
+static taskexec_t
+comms_reload_zone(TASK *t, COMMS *comms, char *args) {
+  return comms_control(t, comms, args, CONTROL_RELOAD_ZONE, "RELOADED ZONE");
+}
+
+static taskexec_t
+comms_reload(TASK *t, COMMS *comms, char *args) {
+  return comms_control(t, comms, args, CONTROL_RELOAD, "RELOADED");
+}
+
+static taskexec_t
+comms_acked(TASK *t, COMMS *comms, char *args) {
+  if (args)
+    control_acked(atou(args));
+  return TASK_CONTINUE;
+}
+
 /* vi:set ts=3: */
 /* NEED_PO */
@@ -112,6 +112,63 @@ status_version_mydns(TASK *t) {
 /*--- status_version_mydns() --------------------------------------------------------------------*/
 
 
+/**************************************************************************************************
+	STATUS_TOP_ALLOWED
+	May the client see heavy hitters?  It must match an entry in heavy-hitters-allow.
+**************************************************************************************************/
+static int
+status_top_allowed(TASK *t) {
+  char		*list = NULL, *l = NULL, *wild = NULL;
+  char		*ip = (char *)clientaddr(t);
+  int		ok = 0;
+
+  if (!heavy_hitters_allow)
+    return (0);
+
+  list = l = STRDUP(heavy_hitters_allow);
+  while (!ok && (wild = strsep(&l, ", \t"))) {
+    if (!*wild)
+      continue;
+    if (strchr(wild, '/'))
+      ok = in_cidr_match(wild, ip);
+    else
+      ok = wildcard_match(wild, ip);
+  }
+  RELEASE(list);
+  return (ok);
+}
+/*--- status_top_allowed() ----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	STATUS_TOP
+	Respond to 'top.<table>.mydns.' with the heavy hitters of <table>, one TXT record each
+	holding rank, count and key.
+**************************************************************************************************/
+static int
+status_top(TASK *t) {
+  HEAVYHITTER	top[64];
+  char		*table = t->qname + 4, *end = NULL;
+  int		id = -1, count = 0, n = 0;
+
+  if (!(end = strchr(table, '.')) || strcasecmp(end, ".mydns.")
+      || (id = heavyhitters_table(table, end - table)) < 0)
+    return formerr(t, DNS_RCODE_NOTIMP, ERR_NO_CLASS, NULL);
+
+  if (!status_top_allowed(t)) {
+    Verbose(_("%s: %s"), desctask(t), _("heavy hitter query denied"));
+    return formerr(t, DNS_RCODE_REFUSED, ERR_NO_CLASS, NULL);
+  }
+
+  count = heavyhitters_top(id, top, MIN(heavy_hitters, (int)(sizeof(top) / sizeof(top[0]))));
+  for (n = 0; n < count; n++)
+    status_fake_rr(t, ANSWER, t->qname, "%d %u %s", n + 1, top[n].count, top[n].key);
+
+  return TASK_COMPLETED;
+}
+/*--- status_top() ------------------------------------------------------------------------------*/
+
+
 /**************************************************************************************************
 	REMOTE_STATUS
 **************************************************************************************************/
@@ -128,6 +185,10 @@ remote_status(TASK *t) {
   else if (!strcasecmp(t->qname, "version.mydns."))
     return status_version_mydns(t);
 
+  /* Heavy hitters 'top.<table>.mydns.' ("dig txt chaos top.qname.mydns") */
+  else if (!strncasecmp(t->qname, "top.", 4))
+    return status_top(t);
+
   return formerr(t, DNS_RCODE_NOTIMP, ERR_NO_CLASS, NULL);
 }
 /*--- remote_status() ---------------------------------------------------------------------------*/
@@ -179,6 +179,7 @@ task_status_name(TASK *t) {
 
   case NEED_READ:			return _("NEED_READ");
   case NEED_IXFR:			return _("NEED_IXFR");
+  case NEED_UPDATE:			return _("NEED_UPDATE");
   case NEED_ANSWER:			return _("NEED_ANSWER");
   case NEED_WRITE:			return _("NEED_WRITE");
 
@@ -196,9 +197,12 @@ task_status_name(TASK *t) {
   case NEED_TASK_RUN:			return _("NEED_TASK_RUN");
   case NEED_AXFR:			return _("NEED_AXFR");
   case NEED_TASK_READ:			return _("NEED_TASK_READ");
+  case NEED_TASK_WRITE:			return _("NEED_TASK_WRITE");
+  case NEED_AXFR_WAIT:			return _("NEED_AXFR_WAIT");
 
   case NEED_COMMAND_READ:		return _("NEED_COMMAND_READ");
   case NEED_COMMAND_WRITE:		return _("NEED_COMMAND_WRITE");
+  case NEED_COMMAND_WAIT:		return _("NEED_COMMAND_WAIT");
 
   default:
     {
@@ -341,6 +345,8 @@ task_new(TASK *t, unsigned char *data, size_t len) {
   }
 
   DNS_GET16(t->qclass, src);
+  MYDNS_PROBE6(query_received, t->internal_id, t->qname, t->qtype, t->qclass, t->protocol,
+	       t->hdr.opcode);
 
   t->qdlen = src - qdtop;
 
@@ -377,9 +383,12 @@ task_new(TASK *t, unsigned char *data, size_t len) {
     }
   }
 
-  /* If DNS updates are enabled and the opcode is UPDATE, do the update */
-  if (dns_update_enabled && t->hdr.opcode == DNS_OPCODE_UPDATE)
-    return (dns_update(t));
+  /* If DNS updates are enabled and the opcode is UPDATE, queue the update; UPDATEs waiting
+     for the same zone are committed together */
+  if (dns_update_enabled && t->hdr.opcode == DNS_OPCODE_UPDATE) {
+    t->status = NEED_UPDATE;
+    return TASK_CONTINUE;
+  }
 
   /* Handle Notify messages - currently do nothing so return not implemented */
   if (t->hdr.opcode == DNS_OPCODE_NOTIFY) {
@@ -411,9 +420,10 @@ task_new(TASK *t, unsigned char *data, size_t len) {
   if ((t->qtype == DNS_QTYPE_AXFR || t->qtype == DNS_QTYPE_IXFR) && (!axfr_enabled || t->protocol != SOCK_STREAM))
     return formerr(t, DNS_RCODE_REFUSED, ERR_NO_AXFR, NULL);
 
-  /* If this is AXFR, fork to handle it so that other requests don't block */
+  /* If this is AXFR, run it as its own task so that other requests don't block */
 //  if (t->protocol == SOCK_STREAM && t->qtype == DNS_QTYPE_AXFR) {
-  if ((t->protocol == SOCK_STREAM && t->qtype == DNS_QTYPE_AXFR) || (t->protocol == SOCK_STREAM && t->qtype == DNS_QTYPE_IXFR)) {
+  if ((t->protocol == SOCK_STREAM && t->qtype == DNS_QTYPE_AXFR)
+      || (t->protocol == SOCK_STREAM && t->qtype == DNS_QTYPE_IXFR && !ixfr_journal_wanted(t))) {
     task_change_type_and_priority(t, IO_TASK, NORMAL_PRIORITY_TASK);
     t->status = NEED_AXFR;
   } else if (t->qtype == DNS_QTYPE_IXFR) {
@@ -560,16 +570,16 @@ _task_init(
 
   TaskQ = &(TaskArray[type][priority]);
 
-  Warnx(_("DEBUG _task_init: About to enqueue task, type=%d, priority=%d, status=%d, fd=%d"),
-        type, priority, status, fd);
+  Log(LOG_DEBUG, _("_task_init: About to enqueue task, type=%d, priority=%d, status=%d, fd=%d"),
+      type, priority, status, fd);
 
   if (enqueue(TaskQ, new) < 0) {
-    Warnx(_("DEBUG _task_init: enqueue() FAILED!"));
+    Log(LOG_DEBUG, _("_task_init: enqueue() FAILED!"));
     task_free(new);
     return (NULL);
   }
 
-  Warnx(_("DEBUG _task_init: enqueue() SUCCESS, task added to TaskArray[%d][%d]"), type, priority);
+  Log(LOG_DEBUG, _("_task_init: enqueue() SUCCESS, task added to TaskArray[%d][%d]"), type, priority);
 
   return (new);
 }
@@ -687,24 +697,24 @@ void
 task_add_extension(TASK *t, void *extension, FreeExtension freeextension, RunExtension runextension,
 		   TimeExtension timeextension)
 {
-  Warnx(_("DEBUG task_add_extension: ENTRY, t=%p, extension=%p"), (void*)t, extension);
+  Log(LOG_DEBUG, _("task_add_extension: ENTRY, t=%p, extension=%p"), (void*)t, extension);
 
   if (t->extension && t->freeextension) {
-    Warnx(_("DEBUG task_add_extension: About to free existing extension"));
+    Log(LOG_DEBUG, _("task_add_extension: About to free existing extension"));
     t->freeextension(t, t->extension);
-    Warnx(_("DEBUG task_add_extension: Freed existing extension"));
+    Log(LOG_DEBUG, _("task_add_extension: Freed existing extension"));
   }
 
-  Warnx(_("DEBUG task_add_extension: About to RELEASE t->extension"));
+  Log(LOG_DEBUG, _("task_add_extension: About to RELEASE t->extension"));
   RELEASE(t->extension);
-  Warnx(_("DEBUG task_add_extension: RELEASE completed"));
+  Log(LOG_DEBUG, _("task_add_extension: RELEASE completed"));
 
   t->extension = extension;
   t->freeextension = freeextension;
   t->runextension = runextension;
   t->timeextension = timeextension;
 
-  Warnx(_("DEBUG task_add_extension: Successfully set all extension fields"));
+  Log(LOG_DEBUG, _("task_add_extension: Successfully set all extension fields"));
 }
 
 void
@@ -735,15 +745,12 @@ task_init_header(TASK *t) {
 
 /**************************************************************************************************
 	TASK_OUTPUT_INFO
+	Hands the finished task to the query log (see querylog.c).
 **************************************************************************************************/
 void
 task_output_info(TASK *t, char *update_desc) {
-#if !DISABLE_DATE_LOGGING
-  struct timeval tv = { 0, 0 };
-  time_t tt = 0;
-  struct tm *tm = NULL;
-  char datebuf[80]; /* This is magic and needs rethinking - string should be ~ 23 characters */
-#endif
+  if (!querylog_enabled)
+    return;
 
   /* If we've already outputted the info for this (i.e. multiple DNS UPDATE requests), ignore */
   if (t->info_already_out)
@@ -753,58 +760,7 @@ task_output_info(TASK *t, char *update_desc) {
   if (t->protocol == SOCK_STREAM && t->fd < 0)
     return;
 
-#if !DISABLE_DATE_LOGGING
-  gettimeofday(&tv, NULL);
-  tt = tv.tv_sec;
-  tm = localtime(&tt);
-
-  strftime(datebuf, sizeof(datebuf)-1, "%d-%b-%Y %H:%M:%S", tm);
-#endif
-
-  Verbose(
-#if !DISABLE_DATE_LOGGING
-	  "%s+%06lu "
-#endif
-	  "#%u "
-	  "%u "		/* Client-provided ID */
-	  "%s "		/* TCP or UDP? */
-	  "%s "		/* Client IP */
-	  "%s "		/* Class */
-	  "%s "		/* Query type (A, MX, etc) */
-	  "%s "		/* Name */
-	  "%s "		/* Return code (NOERROR, NXDOMAIN, etc) */
-	  "%s "		/* Reason */
-	  "%u "		/* Question section */
-	  "%u "		/* Answer section */
-	  "%u "		/* Authority section */
-	  "%u "		/* Additional section */
-	  "LOG "
-	  "%s "		/* Reply from cache? */
-	  "%s "		/* Opcode */
-	  "\"%s\""	/* UPDATE description (if any) */
-	  ,
-#if !DISABLE_DATE_LOGGING
-	  datebuf, tv.tv_usec,
-#endif
-	  t->internal_id,
-	  t->id,
-	  (t->protocol == SOCK_STREAM)?"TCP"
-	  :(t->protocol == SOCK_DGRAM)?"UDP"
-	  :"UNKNOWN",
-	  clientaddr(t),
-	  mydns_class_str(t->qclass),
-	  mydns_qtype_str(t->qtype),
-	  t->qname,
-	  mydns_rcode_str(t->hdr.rcode),
-	  err_reason_str(t, t->reason),
-	  (unsigned int)t->qdcount,
-	  (unsigned int)t->an.size,
-	  (unsigned int)t->ns.size,
-	  (unsigned int)t->ar.size,
-	  (t->reply_from_cache ? "Y" : "N"),
-	  mydns_opcode_str(t->hdr.opcode),
-	  update_desc ? update_desc : ""
-	  );
+  querylog_add(t, update_desc);
 }
 /*--- task_output_info() ------------------------------------------------------------------------*/
 
@@ -822,6 +778,7 @@ task_timedout(TASK *t) {
   if (!t) {
     Err(_("task_timedout called with NULL task"));
   }
+  MYDNS_PROBE4(task_timeout, t->internal_id, t->qname, t->status, t->protocol);
 
   if (t->timeextension) {
     res = t->timeextension(t, t->extension);
@@ -852,13 +809,18 @@ task_timedout(TASK *t) {
 static taskexec_t
 task_process_query(TASK *t, int rfd, int wfd, int efd) {
   taskexec_t	res = TASK_DID_NOT_EXECUTE;
+  uint64_t	started = 0;
+  int		cached = 0;
 
-  Warnx(_("DEBUG: task_process_query(%s) status=%d qname=%s rfd=%d"), desctask(t), t->status, t->qname, rfd);
+  Log(LOG_DEBUG, _("task_process_query(%s) status=%d qname=%s rfd=%d"), desctask(t), t->status, t->qname, rfd);
 
 #if DEBUG_ENABLED && DEBUG_TASK
   DebugX("task", 1, _("%s: task_process_query called rfd = %d, wfd = %d, efd = %d"), desctask(t), rfd, wfd, efd);
 #endif
 
+  if (t->status == NEED_COMMAND_WAIT)
+    return TASK_CONTINUE;
+
   switch (TASKIOTYPE(t->status)) {
 
   case Needs2Read:
@@ -937,27 +899,42 @@ task_process_query(TASK *t, int rfd, int wfd, int efd) {
       t->status = NEED_WRITE;
       return TASK_CONTINUE;
 
+    case NEED_UPDATE:
+      /*
+      **  NEED_UPDATE: Need to apply a DNS UPDATE (and any others waiting for the zone)
+      */
+      dns_update(t);
+      t->status = NEED_WRITE;
+      return TASK_CONTINUE;
+
     case NEED_ANSWER:
       /*
       **  NEED_ANSWER: Need to resolve query
       */
-      Warnx(_("DEBUG: NEED_ANSWER case for %s qtype=%d"), t->qname, t->qtype);
-      if (reply_cache_find(t)) {
-	Warnx(_("DEBUG: found cached reply for %s"), t->qname);
+      Log(LOG_DEBUG, _("NEED_ANSWER case for %s qtype=%d"), t->qname, t->qtype);
+      started = LATENCY_BEGIN(t);
+      cached = reply_cache_find(t);
+      LATENCY_END(t, LS_CACHE, started);
+      if (cached) {
+	Log(LOG_DEBUG, _("found cached reply for %s"), t->qname);
 	char *dest = t->reply;
 	DNS_PUT16(dest, t->id);						/* Query ID */
 	DNS_PUT(dest, &t->hdr, SIZE16);					/* Header */
       } else {
-	Warnx(_("DEBUG: calling resolve() for %s"), t->qname);
+	Log(LOG_DEBUG, _("calling resolve() for %s"), t->qname);
+	started = LATENCY_BEGIN(t);
 	resolve(t, ANSWER, t->qtype, t->qname, 0);
-	Warnx(_("DEBUG: after resolve() for %s, status=%d, TaskIsRecursive=%d"),
-	      t->qname, t->status, TaskIsRecursive(t->status & Needs2Recurse));
+	LATENCY_END(t, LS_RESOLVE, started);
+	Log(LOG_DEBUG, _("after resolve() for %s, status=%d, TaskIsRecursive=%d"),
+	    t->qname, t->status, TaskIsRecursive(t->status & Needs2Recurse));
 	if (TaskIsRecursive(t->status & Needs2Recurse)) {
-	  Warnx(_("DEBUG: Task %s is recursive, returning TASK_CONTINUE"), t->qname);
+	  Log(LOG_DEBUG, _("Task %s is recursive, returning TASK_CONTINUE"), t->qname);
 	  return TASK_CONTINUE;
 	} else {
-	  Warnx(_("DEBUG: Task %s is NOT recursive, building reply"), t->qname);
+	  Log(LOG_DEBUG, _("Task %s is NOT recursive, building reply"), t->qname);
+	  started = LATENCY_BEGIN(t);
 	  build_reply(t, 1);
+	  LATENCY_END(t, LS_ENCODE, started);
 	  if (t->reply_cache_ok)
 	    add_reply_to_cache(t);
 	}
@@ -987,7 +964,9 @@ task_process_query(TASK *t, int rfd, int wfd, int efd) {
 	switch (t->protocol) {
 
 	case SOCK_DGRAM:
+	  started = LATENCY_BEGIN(t);
 	  res = write_udp_reply(t);
+	  LATENCY_END(t, LS_WRITE, started);
 	  if (res == TASK_EXECUTED) return TASK_EXECUTED;
 	  if (res == TASK_CONTINUE) return TASK_CONTINUE;
 	  if (res == TASK_FAILED) return TASK_FAILED;
@@ -997,7 +976,9 @@ task_process_query(TASK *t, int rfd, int wfd, int efd) {
 	  return TASK_FAILED;
 
 	case SOCK_STREAM:
+	  started = LATENCY_BEGIN(t);
 	  res = write_tcp_reply(t);
+	  LATENCY_END(t, LS_WRITE, started);
 	  if (res == TASK_EXECUTED)  return TASK_EXECUTED;
 	  if (res == TASK_ABANDONED) return TASK_ABANDONED;
 	  if (res == TASK_COMPLETED) return TASK_COMPLETED;
@@ -1036,7 +1017,7 @@ static taskexec_t
 task_process_recursive(TASK *t, int rfd, int wfd, int efd) {
   taskexec_t	res = TASK_DID_NOT_EXECUTE;
 
-  Warnx(_("DEBUG: task_process_recursive() for %s status=%d"), t->qname, t->status);
+  Log(LOG_DEBUG, _("task_process_recursive() for %s status=%d"), t->qname, t->status);
 
 #if DEBUG_ENABLED && DEBUG_TASK
   DebugX("task", 1, _("%s: task_process_recursive called rfd = %d, wfd = %d, efd = %d"),
@@ -1046,17 +1027,17 @@ task_process_recursive(TASK *t, int rfd, int wfd, int efd) {
   switch (TASKIOTYPE(t->status)) {
 
   case Needs2Connect:
-	Warnx(_("DEBUG task_process_recursive: Needs2Connect case, status=%d"), t->status);
+	Log(LOG_DEBUG, _("task_process_recursive: Needs2Connect case, status=%d"), t->status);
     switch(t->status) {
 
     case NEED_RECURSIVE_FWD_CONNECT:
       /*
       **  NEED_RECURSIVE_FWD_CONNECT: Need to connnect to recursive forwarder
       */
-      Warnx(_("DEBUG task_process_recursive: NEED_RECURSIVE_FWD_CONNECT case matched!"));
-      Warnx(_("DEBUG task_process_recursive: About to call recursive_fwd_connect()"));
+      Log(LOG_DEBUG, _("task_process_recursive: NEED_RECURSIVE_FWD_CONNECT case matched!"));
+      Log(LOG_DEBUG, _("task_process_recursive: About to call recursive_fwd_connect()"));
       res = recursive_fwd_connect(t);
-      Warnx(_("DEBUG task_process_recursive: recursive_fwd_connect() returned %d"), res);
+      Log(LOG_DEBUG, _("task_process_recursive: recursive_fwd_connect() returned %d"), res);
       if (res == TASK_FAILED) return TASK_FAILED;
       if (res != TASK_CONTINUE) {
 	Warnx("%s: %d: %s", desctask(t), (int)res, _("unexpected result from recursive_fwd_connect"));
@@ -1065,8 +1046,8 @@ task_process_recursive(TASK *t, int rfd, int wfd, int efd) {
       return TASK_CONTINUE;
 
     default:
-      Warnx(_("DEBUG task_process_recursive: DEFAULT case in Needs2Connect! status=%d (NEED_RECURSIVE_FWD_CONNECT=%d)"),
-            t->status, NEED_RECURSIVE_FWD_CONNECT);
+      Log(LOG_DEBUG, _("task_process_recursive: DEFAULT case in Needs2Connect! status=%d (NEED_RECURSIVE_FWD_CONNECT=%d)"),
+	  t->status, NEED_RECURSIVE_FWD_CONNECT);
       Warnx("%s: %d %s", desctask(t), t->status, _("unrecognised task status"));
       return TASK_FAILED;
     }
@@ -1119,12 +1100,12 @@ task_process_recursive(TASK *t, int rfd, int wfd, int efd) {
 
     case NEED_RECURSIVE_FWD_CONNECTED:
       /* Re-check if master is ready for this waiting query */
-      Warnx("DEBUG task_process: NEED_RECURSIVE_FWD_CONNECTED, calling recursive_fwd() for %s", desctask(t));
+      Log(LOG_DEBUG, "task_process: NEED_RECURSIVE_FWD_CONNECTED, calling recursive_fwd() for %s", desctask(t));
       /* Force UDP for upstream forwarding regardless of client protocol */
       {
         int original_protocol = t->protocol;
         t->protocol = SOCK_DGRAM;
-        Warnx("DEBUG task: Forcing UDP for upstream (client protocol=%d)", original_protocol);
+        Log(LOG_DEBUG, "task: Forcing UDP for upstream (client protocol=%d)", original_protocol);
         res = recursive_fwd(t);
       }
       if (res == TASK_FAILED) return TASK_FAILED;
@@ -1284,13 +1265,19 @@ task_process_runtask(TASK *t, int rfd, int wfd, int efd) {
   switch (t->status) {
 
   case NEED_AXFR:
-    axfr_fork(t);
-    return TASK_COMPLETED;
+    return axfr_start(t);
+
+  case NEED_AXFR_WAIT:
+    return TASK_CONTINUE;
 
   case NEED_TASK_READ:
     if (!rfd && !efd) return TASK_CONTINUE;
     break;
 
+  case NEED_TASK_WRITE:
+    if (!wfd) return TASK_CONTINUE;
+    break;
+
   case NEED_TASK_RUN:
     break;
 
@@ -1318,28 +1305,28 @@ task_process(TASK *t, int rfd, int wfd, int efd) {
 
   /* Debug: Log task_process entry for recursive tasks */
   if (TaskIsRecursive(t->status)) {
-    Warnx(_("DEBUG task_process: ENTRY for recursive task, status=%d, TASKCLASS=%d, TaskIsRecursive=%d"),
-          t->status, TASKCLASS(t->status), TaskIsRecursive(t->status));
+    Log(LOG_DEBUG, _("task_process: ENTRY for recursive task, status=%d, TASKCLASS=%d, TaskIsRecursive=%d"),
+	t->status, TASKCLASS(t->status), TaskIsRecursive(t->status));
   }
 
   switch (TASKCLASS(t->status)) {
 
   case QueryTask:
 
-    Warnx(_("DEBUG task_process: QueryTask case matched, TaskIsRecursive=%d, Needs2Recurse=%d"),
-          TaskIsRecursive(t->status), Needs2Recurse);
+    Log(LOG_DEBUG, _("task_process: QueryTask case matched, TaskIsRecursive=%d, Needs2Recurse=%d"),
+	TaskIsRecursive(t->status), Needs2Recurse);
 
     switch (TaskIsRecursive(t->status)) {
 
     default: /* Not a recursive query */
 
-      Warnx(_("DEBUG task_process: DEFAULT case - calling task_process_query"));
+      Log(LOG_DEBUG, _("task_process: DEFAULT case - calling task_process_query"));
       res = task_process_query(t, rfd, wfd, efd);
       break;
 
     case Needs2Recurse:
 
-      Warnx(_("DEBUG task_process: Needs2Recurse case matched - calling task_process_recursive"));
+      Log(LOG_DEBUG, _("task_process: Needs2Recurse case matched - calling task_process_recursive"));
       res = task_process_recursive(t, rfd, wfd, efd);
       break;
 
@@ -41,6 +41,18 @@ typedef enum _task_execstatus_t {
   TASK_CONTINUE		= 5,		/* Task needs to run again */
 } taskexec_t;
 
+/* Query stages timed for the latency histograms */
+typedef enum _latency_stage_t {
+  LS_CACHE = 0,				/* Reply cache lookup */
+  LS_RESOLVE,				/* resolve(), including the SQL lookups */
+  LS_GEOIP,				/* GeoIP client and record lookups */
+  LS_DNSSEC,				/* DNSSEC records added to the reply */
+  LS_ENCODE,				/* build_reply(), including DNSSEC and GeoIP records */
+  LS_WRITE,				/* Writing the reply */
+  LS_TOTAL,				/* From the query being read to the reply written */
+  LATENCY_STAGES
+} latency_stage_t;
+
 /* Task type select */
 typedef enum _taskpriority_t {
   HIGH_PRIORITY_TASK = 0,
@@ -60,6 +72,7 @@ typedef enum _tasktype_t {
 #define Needs2Exec		0x0008
 
 #define Needs2Recurse		0x0010
+#define Needs2TimeOut		0x0020		/* A RunTask status that is still subject to t->timeout */
 
 /*
  * Use the following scheme for task status
@@ -84,7 +97,7 @@ typedef enum _tasktype_t {
 #define TaskIsRecursive(n)	((n)&Needs2Recurse)
 #define TASKSTAT(n)		((n)<<16)
 #define TASKSTATVAL(n)		(((n)>>16)&0xFFFF)
-#define TASKTIMESOUT(n)		((n)&(QueryTask|ReqTask|TickTask))
+#define TASKTIMESOUT(n)		((n)&(QueryTask|ReqTask|TickTask|Needs2TimeOut))
 
 /* Task status flags */
 typedef enum _taskstat_t {
@@ -96,6 +109,8 @@ typedef enum _taskstat_t {
   NEED_WRITE = TASKSTAT(2)|QueryTask|Needs2Write,
   /* We need to process an IXFR request */
   NEED_IXFR = TASKSTAT(3)|QueryTask|Needs2Exec,
+  /* We need to apply a DNS UPDATE */
+  NEED_UPDATE = TASKSTAT(4)|QueryTask|Needs2Exec,
 
   /* Need to open connection to recursive server */
   NEED_RECURSIVE_FWD_CONNECT = TASKSTAT(0)|QueryTask|Needs2Connect|Needs2Recurse,
@@ -121,10 +136,15 @@ typedef enum _taskstat_t {
   NEED_TASK_RUN = TASKSTAT(0)|RunTask|Needs2Exec,
   NEED_AXFR = TASKSTAT(1)|RunTask|Needs2Exec,
   NEED_TASK_READ = TASKSTAT(2)|RunTask|Needs2Read,
+  NEED_TASK_WRITE = TASKSTAT(3)|RunTask|Needs2Write|Needs2TimeOut,
+  /* AXFR waits for a running transfer to finish */
+  NEED_AXFR_WAIT = TASKSTAT(4)|RunTask|Needs2TimeOut,
 
   /* Interprocess commands */
   NEED_COMMAND_READ = TASKSTAT(3)|QueryTask|Needs2Read,
   NEED_COMMAND_WRITE = TASKSTAT(4)|QueryTask|Needs2Write,
+  /* Command waits for the servers to act on it; not polled, only woken or timed out */
+  NEED_COMMAND_WAIT = TASKSTAT(5)|QueryTask,
 } taskstat_t;
 
 
@@ -249,6 +269,12 @@ typedef struct _named_task {
   /* GeoIP fields */
   char			client_ip[46];		/* Client IP address (IPv4 or IPv6) */
   int			client_sensor_id;	/* Geographic sensor ID for client */
+
+  /* Latency fields, only set if the query is sampled */
+  int			latency_sampled;	/* Is this query being timed? */
+  uint64_t		latency_start;		/* Ticks when the query was read */
+  uint64_t		latency[LATENCY_STAGES];/* Ticks spent in each stage */
+  uint32_t		latency_stages;		/* Stages timed (bit per stage) */
 } TASK;
 
 #endif /* !_MYDNS_TASK_H */
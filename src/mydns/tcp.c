@@ -241,7 +241,8 @@ read_tcp_query(TASK *t) {
     return (TASK_EXECUTED);				/* Not finished reading */
   }
   t->offset = 0;					/* Reset offset for writing reply */
-  
+  latency_start(t);
+
   return task_new(t, (unsigned char*)t->query, t->len);
 }
 /*--- read_tcp_query() --------------------------------------------------------------------------*/
@@ -352,6 +353,7 @@ write_tcp_reply(TASK *t)
   t->offset += rv;
   if (t->offset < t->replylen)
     return (TASK_CONTINUE);	/* Not finished yet... */
+  MYDNS_PROBE6(reply_sent, t->internal_id, t->qname, t->qtype, t->hdr.rcode, t->replylen, t->protocol);
   
   /* Task complete; reset.  The TCP client must be able to perform multiple queries on
      the same connection (BIND8 AXFR does this for sure) */
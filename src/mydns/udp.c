@@ -75,11 +75,13 @@ read_udp_query(int fd, int family) {
   }
   if (!(t = IOtask_init(HIGH_PRIORITY_TASK, NEED_ANSWER, fd, SOCK_DGRAM, family, &addr)))
     return (TASK_FAILED);
+  latency_start(t);
 
   /* GeoIP lookup */
   if (GeoIP) {
     const char *country_code;
     char client_ip_str[INET6_ADDRSTRLEN];
+    uint64_t started = LATENCY_BEGIN(t);
 
     /* Extract client IP address */
     if (family == AF_INET) {
@@ -107,6 +109,7 @@ read_udp_query(int fd, int family) {
       /* Use default sensor if GeoIP lookup failed */
       t->client_sensor_id = geoip_get_default_sensor(GeoIP);
     }
+    LATENCY_END(t, LS_GEOIP, started);
 
 #if DEBUG_ENABLED
     if (t->client_sensor_id > 0) {
@@ -193,6 +196,7 @@ write_udp_reply(TASK *t) {
 #if DEBUG_ENABLED && DEBUG_UDP
   DebugX("udp", 1, _("%s: WRITE %u UDP octets (id %u)"), desctask(t), (unsigned int)t->replylen, t->id);
 #endif
+  MYDNS_PROBE6(reply_sent, t->internal_id, t->qname, t->qtype, t->hdr.rcode, t->replylen, t->protocol);
   return (TASK_COMPLETED);
 }
 /*--- write_udp_reply() -------------------------------------------------------------------------*/
@@ -219,15 +223,15 @@ void
 udp_start() {
   int		n = 0;
 
-  Warnx(_("DEBUG: udp_start() ENTRY - num_udp4_fd=%d"), num_udp4_fd);
+  Log(LOG_DEBUG, _("udp_start() ENTRY - num_udp4_fd=%d"), num_udp4_fd);
   for (n = 0; n < num_udp4_fd; n++) {
-    Warnx(_("DEBUG: udp_start() creating UDP4 task for fd=%d"), udp4_fd[n]);
+    Log(LOG_DEBUG, _("udp_start() creating UDP4 task for fd=%d"), udp4_fd[n]);
     TASK *udptask = IOtask_init(HIGH_PRIORITY_TASK, NEED_TASK_READ,
 				udp4_fd[n], SOCK_DGRAM, AF_INET, NULL);
     task_add_extension(udptask, NULL, NULL, udp_read_message, udp_tick);
-    Warnx(_("DEBUG: udp_start() UDP4 task created"));
+    Log(LOG_DEBUG, _("udp_start() UDP4 task created"));
   }
-  Warnx(_("DEBUG: udp_start() EXIT after creating %d UDP4 tasks"), num_udp4_fd);
+  Log(LOG_DEBUG, _("udp_start() EXIT after creating %d UDP4 tasks"), num_udp4_fd);
 #if HAVE_IPV6
   for (n = 0; n < num_udp6_fd; n++) {
     TASK *udptask = IOtask_init(HIGH_PRIORITY_TASK, NEED_TASK_READ,
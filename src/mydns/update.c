@@ -85,10 +85,49 @@ typedef struct _update_query {
   TMPRR			**tmprr;		/* Temporary RR list for prerequisite */
   int			num_tmprr;		/* Number of items in "tmprr" */
   uchar			*name;			/* The zone name */
+
+  struct _update_prname	*prnames;		/* Zone <NAME,TYPE>s the prerequisites ask about */
+  int			numprnames;		/* Number of items in "prnames" */
+  int			prloaded;		/* Has "prnames" been loaded? */
 } UQ;
 
 #define UQ_NAME(__qp)		((__qp)->name)
 
+/* A <NAME,TYPE> found in the zone while checking prerequisites */
+typedef struct _update_prname {
+  char			*name;
+  char			*type;
+} UPNAME;
+
+/* An RR waiting to be added to the zone (RFC 2136 3.4.2.2) */
+typedef struct _update_add {
+  UQRR			*rr;
+  char			*data, *edata;
+  size_t		datalen, edatalen;
+  uint32_t		aux;
+  char			*xname, *xhost, *xdata, *xedata;	/* Escaped for SQL */
+  int			present;		/* Already in the zone or earlier in the batch */
+} UPDATE_ADD;
+
+/* A run of additions sent to the database together */
+typedef struct _update_add_batch {
+  UPDATE_ADD		*add;
+  int			count;
+  int			size;
+} UPDATE_ADDS;
+
+#define UPDATE_BATCH_SIZE	100		/* Most RRs in one statement */
+
+/* One UPDATE message applied as part of a group commit */
+typedef struct _update_member {
+  TASK			*t;
+  UQ			*q;
+  tsig_key_t		*tsig_key;		/* TSIG key for authentication */
+  unsigned char		request_mac[64];	/* Request TSIG MAC for response signing */
+  size_t		request_mac_len;
+  int			ok;			/* Applied without error? */
+} UPDATE_MEMBER;
+
 /**************************************************************************************************
 	FREE_UQ
 	Frees a 'UQ' structure.
@@ -149,6 +188,12 @@ free_uq(UQ *uq) {
 
   RELEASE(UQ_NAME(uq));
 
+  for (n = 0; n < uq->numprnames; n++) {
+    RELEASE(uq->prnames[n].name);
+    RELEASE(uq->prnames[n].type);
+  }
+  RELEASE(uq->prnames);
+
   RELEASE(uq);
 #if DEBUG_ENABLED && DEBUG_UPDATE
   DebugX("update", 1, _("free_uq freed %p"), uq);
@@ -176,9 +221,10 @@ update_transaction(TASK *t, const char *query) {
 /**************************************************************************************************
 	LOAD_TSIG_KEY_FOR_ZONE
 	Load TSIG key from database for a given zone
+	The key's id in tsig_keys is stored in `key_id'.
 **************************************************************************************************/
 static tsig_key_t *
-load_tsig_key_for_zone(TASK *t, const char *key_name) {
+load_tsig_key_for_zone(TASK *t, const char *key_name, unsigned int *key_id) {
   SQL_RES *res = NULL;
   SQL_ROW row = NULL;
   char *query = NULL;
@@ -190,7 +236,7 @@ load_tsig_key_for_zone(TASK *t, const char *key_name) {
 
   /* Query tsig_keys table */
   querylen = sql_build_query(&query,
-    "SELECT name, algorithm, secret FROM tsig_keys WHERE name='%s' AND enabled=TRUE",
+    "SELECT name, algorithm, secret, id FROM tsig_keys WHERE name='%s' AND enabled=TRUE",
     key_name);
 
 #if DEBUG_ENABLED && DEBUG_UPDATE_SQL
@@ -208,6 +254,7 @@ load_tsig_key_for_zone(TASK *t, const char *key_name) {
   if ((row = sql_getrow(res, NULL))) {
     /* Create TSIG key from database row */
     key = tsig_key_create(row[0], row[1], row[2]);
+    *key_id = atou(row[3]);
 
 #if DEBUG_ENABLED && DEBUG_UPDATE
     DebugX("update", 1, _("%s: Loaded TSIG key '%s' algorithm '%s'"),
@@ -334,8 +381,6 @@ log_update_operation(TASK *t, MYDNS_SOA *soa, const char *operation_type,
                     const char *record_name, const char *record_type,
                     const char *record_data, int success, int rcode,
                     const char *tsig_key_name) {
-  char *query = NULL;
-  size_t querylen = 0;
   const char *ip = clientaddr(t);
 
   if (!audit_update_log)
@@ -345,34 +390,20 @@ log_update_operation(TASK *t, MYDNS_SOA *soa, const char *operation_type,
   DebugX("update", 1, _("%s: Logging UPDATE operation to update_log"), desctask(t));
 #endif
 
-  /* Log to update_log table */
-  querylen = sql_build_query(&query,
-    "INSERT INTO update_log (zone, source_ip, key_name, operation_type, "
-    "record_name, record_type, record_data, success, rcode, new_serial, created_at) "
-    "VALUES ('%s', '%s', %s%s%s, '%s', '%s', '%s', '%s', %d, %d, %u, NOW())",
-    soa->origin,
-    ip,
-    tsig_key_name ? "'" : "",
-    tsig_key_name ? tsig_key_name : "NULL",
-    tsig_key_name ? "'" : "",
-    operation_type,
-    record_name ? record_name : "",
-    record_type ? record_type : "",
-    record_data ? record_data : "",
-    success ? 1 : 0,
-    rcode,
-    soa->serial);
-
-#if DEBUG_ENABLED && DEBUG_UPDATE_SQL
-  DebugX("update-sql", 1, _("%s: AUDIT LOG: %s"), desctask(t), query);
-#endif
-
-  /* Execute but don't fail if logging fails */
-  if (sql_nrquery(sql, query, querylen) != 0) {
-    WarnSQL(sql, "%s: %s", desctask(t), _("error logging DNS UPDATE operation"));
-  }
-
-  RELEASE(query);
+  /* Queue for the update_log table; a failure to log doesn't fail the UPDATE */
+  auditlog_add(sql, AUDIT_UPDATE, "'%s', '%s', %s%s%s, '%s', '%s', '%s', '%s', %d, %d, %u",
+	       soa->origin,
+	       ip,
+	       tsig_key_name ? "'" : "",
+	       tsig_key_name ? tsig_key_name : "NULL",
+	       tsig_key_name ? "'" : "",
+	       operation_type,
+	       record_name ? record_name : "",
+	       record_type ? record_type : "",
+	       record_data ? record_data : "",
+	       success ? 1 : 0,
+	       rcode,
+	       soa->serial);
 }
 /*--- log_update_operation() --------------------------------------------------------------------*/
 
@@ -558,6 +589,7 @@ verify_tsig_in_update(TASK *t, unsigned char *request_mac_out, size_t *request_m
   uint64_t time_signed = 0;
   uint16_t fudge = 300;  /* Default 5 minutes */
   tsig_key_t *key = NULL;
+  unsigned int key_id = 0;
   time_t now = time(NULL);
 
   /* Initialize outputs */
@@ -583,7 +615,7 @@ verify_tsig_in_update(TASK *t, unsigned char *request_mac_out, size_t *request_m
 #endif
 
   /* Load key from database */
-  key = load_tsig_key_for_zone(t, key_name);
+  key = load_tsig_key_for_zone(t, key_name, &key_id);
   if (!key) {
     Warnx(_("%s: TSIG key '%s' not found or disabled"), desctask(t), key_name);
     dnserror(t, DNS_RCODE_NOTAUTH, ERR_NO_UPDATE);
@@ -614,19 +646,11 @@ verify_tsig_in_update(TASK *t, unsigned char *request_mac_out, size_t *request_m
   DebugX("update", 1, _("%s: TSIG MAC signature verified successfully"), desctask(t));
 #endif
 
-  /* Log TSIG usage if enabled */
-  if (audit_tsig_log) {
-    char *log_query = NULL;
-    size_t log_querylen = 0;
+  /* Log TSIG usage if enabled, under the id the key was loaded with */
+  if (audit_tsig_log && key_id) {
     const char *ip = clientaddr(t);
 
-    log_querylen = sql_build_query(&log_query,
-      "INSERT INTO tsig_usage_log (key_id, operation, source_ip, success, created_at) "
-      "SELECT id, 'UPDATE', '%s', TRUE, NOW() FROM tsig_keys WHERE name='%s'",
-      ip, key_name);
-
-    sql_nrquery(sql, log_query, log_querylen);
-    RELEASE(log_query);
+    auditlog_add(sql, AUDIT_TSIG_USAGE, "%u, 'UPDATE', '%s', TRUE", key_id, ip);
   }
 
   /* Copy request MAC for response signing */
@@ -1348,6 +1372,47 @@ update_in_zone(uchar *name, char *origin) {
 }
 /*--- update_in_zone() --------------------------------------------------------------------------*/
 
+/**************************************************************************************************
+	UPDATE_SQL_APPEND
+	Appends to a query being built up piece by piece in a growing buffer.
+**************************************************************************************************/
+static void
+update_sql_append(char **query, size_t *querylen, size_t *querysize, const char *fmt, ...) {
+  va_list	ap;
+  char		*tmp = NULL;
+  int		len = 0;
+
+  va_start(ap, fmt);
+  len = VASPRINTF(&tmp, fmt, ap);
+  va_end(ap);
+
+  if (*querylen + len + 1 > *querysize) {
+    while (*querylen + len + 1 > *querysize)
+      *querysize = (*querysize) ? *querysize * 2 : 1024;
+    *query = REALLOCATE(*query, *querysize, char[]);
+  }
+  memcpy(*query + *querylen, tmp, len + 1);
+  *querylen += len;
+  RELEASE(tmp);
+}
+/*--- update_sql_append() -----------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	UPDATE_HOST_NAME
+	Returns the name of 'rr' relative to the zone origin, as kept in the rr table.
+**************************************************************************************************/
+static char *
+update_host_name(MYDNS_SOA *soa, UQRR *rr) {
+  char		*host = NULL;
+
+  ASPRINTF(&host, "%.*s",
+	   strlen((char*)UQRR_NAME(rr)) - strlen(soa->origin) - 1,
+	   UQRR_NAME(rr));
+  return (host);
+}
+/*--- update_host_name() ------------------------------------------------------------------------*/
+
 static void
 update_escape_name(TASK *t, MYDNS_SOA *soa, UQRR *rr, char **xname, char **xhost) {
   char		*tmp = NULL;
@@ -1358,59 +1423,121 @@ update_escape_name(TASK *t, MYDNS_SOA *soa, UQRR *rr, char **xname, char **xhost
 
   *xname = sql_escstr(sql, (char*)UQRR_NAME(rr));
 
-  ASPRINTF(&tmp, "%.*s",
-	   strlen((char*)UQRR_NAME(rr)) - strlen(soa->origin) - 1,
-	   UQRR_NAME(rr));
+  tmp = update_host_name(soa, rr);
   *xhost = sql_escstr(sql, tmp);
 
   RELEASE(tmp);
 }
 
 /**************************************************************************************************
-	UPDATE_ZONE_HAS_NAME
-	Check to see that there is at least one RR in the zone whose name is the same as the
-	prerequisite RR.
-	Returns 1 if the name exists, 0 if not, -1 on error.
+	UPDATE_LOAD_PRNAMES
+	Loads every <NAME,TYPE> in the zone for the names used by the "name is in use" and "RRset
+	exists" prerequisites (RFC 2136 2.4.1 - 2.4.5) with one query, rather than one per
+	prerequisite.
+	Returns 0 on success, -1 on error.
 **************************************************************************************************/
 static int
-update_zone_has_name(TASK *t, MYDNS_SOA *soa, UQRR *rr) {
+update_load_prnames(TASK *t, MYDNS_SOA *soa, UQ *q) {
   SQL_RES	*res = NULL;
+  SQL_ROW	row = NULL;
   char		*query = NULL;
-  size_t	querylen = 0;
+  size_t	querylen = 0, querysize = 0;
   char		*xname = NULL, *xhost = NULL;
-  int		found = 0;
+  int		n = 0, names = 0;
 
-#if DEBUG_ENABLED && DEBUG_UPDATE
-  DebugX("update", 1, _("%s: DNS UPDATE: update_zone_has_name: does [%s] have an RR for [%s]?"), desctask(t),
-	 soa->origin, UQRR_NAME(rr));
-#endif
+  q->prloaded = 1;
 
-  update_escape_name(t, soa, rr, &xname, &xhost);
+  update_sql_append(&query, &querylen, &querysize,
+		    "SELECT DISTINCT name,type FROM %s WHERE zone=%u AND name IN (",
+		    mydns_rr_table_name, soa->id);
+  for (n = 0; n < q->numPR; n++) {
+    UQRR *rr = &q->PR[n];
 
-  querylen = sql_build_query(&query,
-			     "SELECT id FROM %s WHERE zone=%u AND (name='%s' OR name='%s') LIMIT 1",
-			     mydns_rr_table_name, soa->id, xhost, xname);
+    if ((rr->class != DNS_CLASS_ANY && rr->class != DNS_CLASS_NONE)
+	|| !update_in_zone(UQRR_NAME(rr), soa->origin))
+      continue;
+    update_escape_name(t, soa, rr, &xname, &xhost);
+    update_sql_append(&query, &querylen, &querysize, "%s'%s','%s'", (names++) ? "," : "", xhost, xname);
+    RELEASE(xname);
+    RELEASE(xhost);
+  }
+  if (!names) {
+    RELEASE(query);
+    return (0);
+  }
+  update_sql_append(&query, &querylen, &querysize, ")");
 #if DEBUG_ENABLED && DEBUG_UPDATE_SQL
   DebugX("update-sql", 1, _("%s: DNS UPDATE: %s"), desctask(t), query);
 #endif
 
-  RELEASE(xname);
-  RELEASE(xhost);
-
   res = sql_query(sql, query, querylen);
   RELEASE(query);
-  if (!(res))	{
-    WarnSQL(sql, "%s: %s", desctask(t), _("error searching name for DNS UPDATE"));
+  if (!(res)) {
+    WarnSQL(sql, "%s: %s", desctask(t), _("error searching names for DNS UPDATE"));
     return dnserror(t, DNS_RCODE_SERVFAIL, ERR_DB_ERROR);
   }
 
-  if (sql_num_rows(res) > 0)
-    found = 1;
-
+  if (sql_num_rows(res) > 0) {
+    q->prnames = ALLOCATE(sizeof(UPNAME) * sql_num_rows(res), UPNAME[]);
+    while ((row = sql_getrow(res, NULL))) {
+      q->prnames[q->numprnames].name = STRDUP(row[0] ? row[0] : "");
+      q->prnames[q->numprnames].type = STRDUP(row[1] ? row[1] : "");
+      q->numprnames++;
+    }
+  }
   sql_free(res);
 
+#if DEBUG_ENABLED && DEBUG_UPDATE
+  DebugX("update", 1, _("%s: DNS UPDATE: %d prerequisites matched %d names/types in zone"), desctask(t),
+	 names, q->numprnames);
+#endif
+  return (0);
+}
+/*--- update_load_prnames() ---------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	UPDATE_ZONE_HAS_PRNAME
+	Check to see that there is at least one RR in the zone whose name is the same as the
+	prerequisite RR and, unless 'type' is NULL, whose type is 'type'.
+	Returns 1 if the name exists, 0 if not, -1 on error.
+**************************************************************************************************/
+static int
+update_zone_has_prname(TASK *t, MYDNS_SOA *soa, UQ *q, UQRR *rr, const char *type) {
+  char		*host = NULL;
+  int		n = 0, found = 0;
+
+  if (!q->prloaded && update_load_prnames(t, soa, q) != 0)
+    return (-1);
+
+  host = update_host_name(soa, rr);
+  for (n = 0; n < q->numprnames && !found; n++)
+    if ((!strcasecmp(q->prnames[n].name, host) || !strcasecmp(q->prnames[n].name, (char*)UQRR_NAME(rr)))
+	&& (!type || !strcasecmp(q->prnames[n].type, type)))
+      found = 1;
+  RELEASE(host);
+
   return (found);
 }
+/*--- update_zone_has_prname() ------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	UPDATE_ZONE_HAS_NAME
+	Check to see that there is at least one RR in the zone whose name is the same as the
+	prerequisite RR.
+	Returns 1 if the name exists, 0 if not, -1 on error.
+**************************************************************************************************/
+static int
+update_zone_has_name(TASK *t, MYDNS_SOA *soa, UQ *q, UQRR *rr) {
+
+#if DEBUG_ENABLED && DEBUG_UPDATE
+  DebugX("update", 1, _("%s: DNS UPDATE: update_zone_has_name: does [%s] have an RR for [%s]?"), desctask(t),
+	 soa->origin, UQRR_NAME(rr));
+#endif
+
+  return update_zone_has_prname(t, soa, q, rr, NULL);
+}
 /*--- update_zone_has_name() --------------------------------------------------------------------*/
 
 
@@ -1421,12 +1548,7 @@ update_zone_has_name(TASK *t, MYDNS_SOA *soa, UQRR *rr) {
 	Returns 1 if the name exists, 0 if not, -1 on error.
 **************************************************************************************************/
 static int
-update_zone_has_rrset(TASK *t, MYDNS_SOA *soa, UQRR *rr) {
-  SQL_RES	*res = NULL;
-  char		*query = NULL;
-  size_t	querylen = 0;
-  char		*xname = NULL, *xhost = NULL;
-  int		found = 0;
+update_zone_has_rrset(TASK *t, MYDNS_SOA *soa, UQ *q, UQRR *rr) {
 
 #if DEBUG_ENABLED && DEBUG_UPDATE
   DebugX("update", 1, _("%s: DNS UPDATE: update_zone_has_rrset: does [%s] have an RR for [%s] with type %s?"),
@@ -1434,32 +1556,7 @@ update_zone_has_rrset(TASK *t, MYDNS_SOA *soa, UQRR *rr) {
 	 soa->origin, UQRR_NAME(rr), mydns_qtype_str(rr->type));
 #endif
 
-  update_escape_name(t, soa, rr, &xname, &xhost);
-
-  querylen = sql_build_query(&query,
-			     "SELECT id FROM %s "
-			     " WHERE zone=%u AND (name='%s' OR name='%s') AND type='%s' LIMIT 1",
-			     mydns_rr_table_name, soa->id, xhost, xname, mydns_qtype_str(rr->type));
-#if DEBUG_ENABLED && DEBUG_UPDATE_SQL
-  DebugX("update-sql", 1, _("%s: DNS UPDATE: %s"), desctask(t), query);
-#endif
-
-  RELEASE(xname);
-  RELEASE(xhost);
-
-  res = sql_query(sql, query, querylen);
-  RELEASE(query);
-  if (!(res)) {
-    WarnSQL(sql, "%s: %s", desctask(t), _("error searching name/type for DNS UPDATE"));
-    return dnserror(t, DNS_RCODE_SERVFAIL, ERR_DB_ERROR);
-  }
-
-  if (sql_num_rows(res) > 0)
-    found = 1;
-
-  sql_free(res);
-
-  return (found);
+  return update_zone_has_prname(t, soa, q, rr, mydns_qtype_str(rr->type));
 }
 /*--- update_zone_has_rrset() -------------------------------------------------------------------*/
 
@@ -1526,7 +1623,7 @@ check_prerequisite(TASK *t, MYDNS_SOA *soa, UQ *q, UQRR *rr) {
       return dnserror(t, DNS_RCODE_FORMERR, ERR_INVALID_DATA);	
     }
     if (rr->type == DNS_QTYPE_ANY) {
-      if ((rv = update_zone_has_name(t, soa, rr)) != 1) {
+      if ((rv = update_zone_has_name(t, soa, q, rr)) != 1) {
 	if (!rv) {
 #if DEBUG_ENABLED && DEBUG_UPDATE
 	  DebugX("update", 1, _("%s: DNS UPDATE: check_prerequisite failed: zone contains no names matching [%s]"),
@@ -1537,7 +1634,7 @@ check_prerequisite(TASK *t, MYDNS_SOA *soa, UQ *q, UQRR *rr) {
 	  return (TASK_FAILED);
 	}
       }
-    } else if ((rv = update_zone_has_rrset(t, soa, rr)) != 1) {
+    } else if ((rv = update_zone_has_rrset(t, soa, q, rr)) != 1) {
       if (!rv) {
 #if DEBUG_ENABLED && DEBUG_UPDATE
 	DebugX("update", 1,
@@ -1558,7 +1655,7 @@ check_prerequisite(TASK *t, MYDNS_SOA *soa, UQ *q, UQRR *rr) {
       return dnserror(t, DNS_RCODE_FORMERR, ERR_INVALID_DATA);	
     }
     if (rr->type == DNS_QTYPE_ANY) {
-      if ((rv = update_zone_has_name(t, soa, rr)) != 0) {
+      if ((rv = update_zone_has_name(t, soa, q, rr)) != 0) {
 	if (rv == 1) {
 #if DEBUG_ENABLED && DEBUG_UPDATE
 	  DebugX("update", 1, _("%s: DNS UPDATE: check_prerequisite failed: zone contains a name matching [%s]"),
@@ -1569,7 +1666,7 @@ check_prerequisite(TASK *t, MYDNS_SOA *soa, UQ *q, UQRR *rr) {
 	  return (TASK_FAILED);
 	}
       }
-    } else if ((rv = update_zone_has_rrset(t, soa, rr)) != 0) {
+    } else if ((rv = update_zone_has_rrset(t, soa, q, rr)) != 0) {
       if (rv == 1) {
 #if DEBUG_ENABLED && DEBUG_UPDATE
 	DebugX("update", 1, _("%s: DNS UPDATE: check_prerequisite failed: zone contains a name matching [%s] with type %s"),
@@ -1732,28 +1829,39 @@ prescan_update(TASK *t, UQ *q, UQRR *rr) {
 
 
 /**************************************************************************************************
-	UPDATE_ADD_RR
-	Add an RR to the zone.
-	Returns 0 on success, -1 on failure.
+	UPDATE_ADD_CLEAR
+	Empties a batch of additions, keeping its storage for the next run.
 **************************************************************************************************/
+static void
+update_add_clear(UPDATE_ADDS *adds) {
+  int		n = 0;
 
-/*************************************************************************************************
- *	With the advent of the deleted state for records in the database
- *	 (a new state for 'active') we need to cope with resurrecting old records
- *	we do this by detecting 'duplicates' which postgres already did and replacing them with a
- *	current verision.
- ************************************************************************************************/
+  for (n = 0; n < adds->count; n++) {
+    UPDATE_ADD *add = &adds->add[n];
+
+    RELEASE(add->data);
+    RELEASE(add->xname);
+    RELEASE(add->xhost);
+    RELEASE(add->xdata);
+    RELEASE(add->xedata);
+  }
+  adds->count = 0;
+}
+/*--- update_add_clear() ------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	UPDATE_ADD_QUEUE
+	Add an RR to the zone.  The RR is only queued here; runs of additions are written by
+	update_add_flush() with one statement rather than a SELECT and an INSERT each.
+	Returns 0 on success, -1 on failure.
+**************************************************************************************************/
 static taskexec_t
-update_add_rr(TASK *t, MYDNS_SOA *soa, UQRR *rr, uint32_t next_serial) {
+update_add_queue(TASK *t, MYDNS_SOA *soa, UPDATE_ADDS *adds, UQRR *rr) {
   char		*data = NULL, *edata = NULL;
   size_t	datalen = 0, edatalen = 0;
   uint32_t	aux = 0;
-  char		*xhost = NULL, *xname = NULL, *xdata = NULL, *xedata = NULL;
-  char		*query = NULL;
-  size_t	querylen = 0;
-#if USE_PGSQL
-  int		duplicate = 0;
-#endif
+  UPDATE_ADD	*add = NULL;
   taskexec_t	ures = TASK_FAILED;
 
   if ((ures = update_get_rr_data(t, rr,
@@ -1769,189 +1877,236 @@ update_add_rr(TASK *t, MYDNS_SOA *soa, UQRR *rr, uint32_t next_serial) {
 	 UQRR_NAME(rr), rr->ttl, mydns_class_str(rr->class), mydns_qtype_str(rr->type), aux, data);
 #endif
 
-  /* Construct query */
-  update_escape_name(t, soa, rr, &xname, &xhost);
+  if (adds->count == adds->size) {
+    adds->size = (adds->size) ? adds->size * 2 : 16;
+    adds->add = REALLOCATE(adds->add, sizeof(UPDATE_ADD) * adds->size, UPDATE_ADD[]);
+  }
+  add = &adds->add[adds->count++];
+  memset(add, 0, sizeof(UPDATE_ADD));
 
-  xdata = sql_escstr2(sql, data, datalen);
+  add->rr = rr;
+  add->data = data;
+  add->datalen = datalen;
+  add->edata = edata;
+  add->edatalen = edatalen;
+  add->aux = aux;
+
+  /* Construct query parts */
+  update_escape_name(t, soa, rr, &add->xname, &add->xhost);
+  add->xdata = sql_escstr2(sql, data, datalen);
   if (edatalen)
-    xedata = sql_escstr2(sql, edata, edatalen);
+    add->xedata = sql_escstr2(sql, edata, edatalen);
 
-  /* IXFR support code */
-  if(mydns_rr_use_active && mydns_rr_use_stamp && mydns_rr_use_serial) {
-    SQL_RES	*res = NULL;
-    /*
-    **  Find out if the record exists - update active records otherwise insert a new active one
-    ** We check edatakey as this is indexed
-    */
-    querylen = sql_build_query(&query,
-			       "SELECT id,serial FROM %s "
-			       "WHERE zone=%u AND (name='%s' OR name='%s') AND type='%s' "
-			       "AND data='%s' AND active='%s'%s%s%s",
-			       mydns_rr_table_name, soa->id,
-			       xhost, xname, mydns_qtype_str(rr->type), xdata,
-			       mydns_rr_active_types[0],
-			       (edatalen)?" AND edatakey=md5('":"",
-			       (edatalen)?xedata:"",
-			       (edatalen)?"')":"");
+  return (TASK_EXECUTED);
+}
+/*--- update_add_queue() ------------------------------------------------------------------------*/
 
-    res = sql_query(sql, query, querylen);
-    RELEASE(query);
-    if(!(res)) {
-      WarnSQL(sql, "%s: %s", desctask(t), _("error searching pre-existing for DNS UPDATE"));
-      return dnserror(t, DNS_RCODE_SERVFAIL, ERR_DB_ERROR);
-    }
-    if (sql_num_rows(res) > 0) {
-      /* Pre-existing record ignore. */
-      sql_free(res);
-      return (TASK_EXECUTED);
-    }
-    sql_free(res);
-    /* Record needs inserting */
-    querylen = sql_build_query(&query,
-			       "INSERT INTO %s (zone,name,type,data,aux,ttl,serial,active%s)"
-			       " VALUES (%u,'%s','%s','%s',%u,%u,%u,'%s'%s%s%s%s%s%s)",
-			       mydns_rr_table_name,
-			       (edatalen)?",edata,edatakey":"",
-			       soa->id, xhost, mydns_qtype_str(rr->type),
-			       xdata, aux, rr->ttl, next_serial, mydns_rr_active_types[0],
-			       (edatalen)?",'":"",
-			       (edatalen)?xedata:"",
-			       (edatalen)?"'":"",
-			       (edatalen)?",md5('":"",
-			       (edatalen)?xedata:"",
-			       (edatalen)?"')":"");
-    if (sql_nrquery(sql, query, querylen) != 0) {
-      WarnSQL(sql, "%s: %s %s", desctask(t), _("error updating entries using"), query);
-      RELEASE(query);
-      return dnserror(t, DNS_RCODE_SERVFAIL, ERR_DB_ERROR);
-    }
-  } else {
-    /* Non IXFR Support Code */
-    /* POSTGRES ONLY */
-    /* First we have to see if this record exists.  If it does, we should "silently ignore" it. */
-#if USE_PGSQL
-    SQL_RES	*res = NULL;
 
-    /*
-    ** This is only necessary for Postgres, we can use "INSERT IGNORE" with MySQL
-    */
-    querylen = sql_build_query(&query,
-			       "SELECT id FROM %s "
-			       "WHERE zone=%u AND (name='%s' OR name='%s') AND type='%s' "
-			       "AND data='%s'%s%s%s LIMIT 1",
-			       mydns_rr_table_name, soa->id,
-			       xhost, xname, mydns_qtype_str(rr->type), xdata,
-			       (edatalen)?" AND edatakey=md5('":"",
-			       (edatalen)?xedata:"",
-			       (edatalen)?"')":"");
-#if DEBUG_ENABLED && DEBUG_UPDATE
-    DebugX("update", 1, _("%s: DNS UPDATE: UPDATE_ADD_RR: %s"), desctask(t), query);
-#else
+/**************************************************************************************************
+	UPDATE_ADD_PROBE
+	Finds out which of adds[start] to adds[end - 1] the zone already has, using a single query
+	made of one "LIMIT 1" SELECT per RR.  Those found are marked as present.
+	Returns 0 on success, -1 on failure.
+**************************************************************************************************/
+static taskexec_t
+update_add_probe(TASK *t, MYDNS_SOA *soa, UPDATE_ADDS *adds, int start, int end, int ixfr) {
+  SQL_RES	*res = NULL;
+  SQL_ROW	row = NULL;
+  char		*query = NULL;
+  size_t	querylen = 0, querysize = 0;
+  int		n = 0, probes = 0;
+
+  for (n = start; n < end; n++) {
+    UPDATE_ADD *add = &adds->add[n];
+
+    if (add->present)
+      continue;
+    update_sql_append(&query, &querylen, &querysize,
+		      "%s(SELECT %d FROM %s "
+		      "WHERE zone=%u AND (name='%s' OR name='%s') AND type='%s' "
+		      "AND data='%s'%s%s%s%s%s%s LIMIT 1)",
+		      (probes++) ? " UNION ALL " : "", n, mydns_rr_table_name, soa->id,
+		      add->xhost, add->xname, mydns_qtype_str(add->rr->type), add->xdata,
+		      (ixfr) ? " AND active='" : "",
+		      (ixfr) ? mydns_rr_active_types[0] : "",
+		      (ixfr) ? "'" : "",
+		      (add->edatalen) ? " AND edatakey=md5('" : "",
+		      (add->edatalen) ? add->xedata : "",
+		      (add->edatalen) ? "')" : "");
+  }
+  if (!probes)
+    return (TASK_EXECUTED);
+
 #if DEBUG_ENABLED && DEBUG_UPDATE_SQL
-    DebugX("update", 1, _("%s: DNS UPDATE: %s"), desctask(t), query);
-#endif
-#endif
-    res = sql_query(sql, query, querylen);
-    RELEASE(query);
-    if (!res) {
-      WarnSQL(sql, "%s: %s", desctask(t), _("error searching duplicate for DNS UPDATE"));
-      return dnserror(t, DNS_RCODE_SERVFAIL, ERR_DB_ERROR);
-    }
-    if (sql_num_rows(res) > 0)
-      duplicate = 1;
-    sql_free(res);
-#if DEBUG_ENABLED && DEBUG_UPDATE
-    DebugX("update", 1, _("%s: UPDATE_ADD_RR: duplicate=%d"), desctask(t), duplicate);
-#endif
+  DebugX("update", 1, _("%s: DNS UPDATE: %s"), desctask(t), query);
 #endif
-    /* END POSTGRES ONLY */
+  res = sql_query(sql, query, querylen);
+  RELEASE(query);
+  if (!res) {
+    WarnSQL(sql, "%s: %s", desctask(t), _("error searching pre-existing for DNS UPDATE"));
+    return dnserror(t, DNS_RCODE_SERVFAIL, ERR_DB_ERROR);
+  }
+  while ((row = sql_getrow(res, NULL)))
+    if (row[0] && (n = atoi(row[0])) >= start && n < end)
+      adds->add[n].present = 1;
+  sql_free(res);
 
-    /*
-     * For Postgresql we need to update any deleted but not
-     * inactive records to be active with the latest serial number
-     */
-#if USE_PGSQL
-    if (!duplicate)
-#endif
-      {
-	char *serialstr = NULL;
-	if (mydns_rr_use_serial)
-	  ASPRINTF(&serialstr, "%u", next_serial);
-	querylen = sql_build_query(&query,
+  return (TASK_EXECUTED);
+}
+/*--- update_add_probe() ------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	UPDATE_ADD_INSERT
+	Inserts those of adds[start] to adds[end - 1] that are not present and do ('ext') or do not
+	have extended data, with one multi-row INSERT.
+	Returns 0 on success, -1 on failure.
+**************************************************************************************************/
+static taskexec_t
+update_add_insert(TASK *t, MYDNS_SOA *soa, UPDATE_ADDS *adds, int start, int end, int ext,
+		  int ixfr, uint32_t next_serial) {
+  char		*query = NULL;
+  size_t	querylen = 0, querysize = 0;
+  int		n = 0, rows = 0;
+
+  for (n = start; n < end; n++) {
+    UPDATE_ADD *add = &adds->add[n];
+
+    if (add->present || (add->edatalen != 0) != ext)
+      continue;
+
+    if (!rows) {
+      if (ixfr)
+	update_sql_append(&query, &querylen, &querysize,
+			  "INSERT INTO %s (zone,name,type,data,aux,ttl,serial,active%s) VALUES ",
+			  mydns_rr_table_name, (ext) ? ",edata,edatakey" : "");
+      else
+	update_sql_append(&query, &querylen, &querysize,
 #if USE_PGSQL
-				   "INSERT INTO %s"
+			  "INSERT INTO %s"
 #else
-				   "INSERT IGNORE INTO %s"
-#endif
-				   " (zone,name,type,data,aux,ttl"
-				   /* Optional edata */
-				   "%s"
-				   /* Optional Active key */
-				   "%s"
-				   /* Optional serial number */
-				   "%s"
-				   ")"
-				   " VALUES (%u,'%s','%s','%s',%u,%u"
-				   /* Optional edata values */
-				   "%s%s%s%s%s%s"
-				   /* Optional Active values */
-				   "%s%s%s"
-				   /* Optional Serial number */
-				   "%s"
-				   ")",
-				   mydns_rr_table_name,
-				   (edatalen) ?",edata,edatakey" : "",
-				   mydns_rr_use_active ? ",active" : "",
-				   mydns_rr_use_serial ? ",serial" : "",
-				   soa->id, xhost, mydns_qtype_str(rr->type), xdata, aux, rr->ttl,
-				   (edatalen) ? ",'" : "",
-				   (edatalen) ? xedata : "",
-				   (edatalen) ? "'" : "",
-				   (edatalen) ? ",md5('" : "",
-				   (edatalen) ? xedata : "",
-				   (edatalen) ? "')" : "",
-				   (mydns_rr_use_active)? ",'" : "",
-				   (mydns_rr_use_active)? mydns_rr_active_types[0] : "",
-				   (mydns_rr_use_active)? "'" : "",
-				   (mydns_rr_use_serial)? serialstr : ""
-				   );
-	RELEASE(serialstr);
-  /* Execute the query */
-#if DEBUG_ENABLED && DEBUG_UPDATE
-	DebugX("update", 1, _("%s: DNS UPDATE: ADD RR: %s"), desctask(t), query);
+			  "INSERT IGNORE INTO %s"
+#endif
+			  " (zone,name,type,data,aux,ttl%s%s%s) VALUES ",
+			  mydns_rr_table_name,
+			  (ext) ? ",edata,edatakey" : "",
+			  (mydns_rr_use_active) ? ",active" : "",
+			  (mydns_rr_use_serial) ? ",serial" : "");
+    }
+
+    update_sql_append(&query, &querylen, &querysize, "%s(%u,'%s','%s','%s',%u,%u",
+		      (rows++) ? "," : "",
+		      soa->id, add->xhost, mydns_qtype_str(add->rr->type), add->xdata, add->aux,
+		      add->rr->ttl);
+    if (ixfr)
+      update_sql_append(&query, &querylen, &querysize, ",%u,'%s'",
+			next_serial, mydns_rr_active_types[0]);
+    if (ext)
+      update_sql_append(&query, &querylen, &querysize, ",'%s',md5('%s')", add->xedata, add->xedata);
+    if (!ixfr && mydns_rr_use_active)
+      update_sql_append(&query, &querylen, &querysize, ",'%s'", mydns_rr_active_types[0]);
+    if (!ixfr && mydns_rr_use_serial)
+      update_sql_append(&query, &querylen, &querysize, ",%u", next_serial);
+    update_sql_append(&query, &querylen, &querysize, ")");
+  }
+  if (!rows)
+    return (TASK_EXECUTED);
+
+#if DEBUG_ENABLED && DEBUG_UPDATE
+  DebugX("update", 1, _("%s: DNS UPDATE: ADD %d RRs: %s"), desctask(t), rows, query);
 #else
 #if DEBUG_ENABLED && DEBUG_UPDATE_SQL
-	DebugX("update", 1, _("%s: DNS UPDATE: %s"), desctask(t), query);
+  DebugX("update", 1, _("%s: DNS UPDATE: %s"), desctask(t), query);
 #endif
 #endif
 
-	if (sql_nrquery(sql, query, querylen) != 0) {
-	  WarnSQL(sql, "%s: %s", desctask(t), _("error adding RR via DNS UPDATE"));
-	  RELEASE(query);
-	  return dnserror(t, DNS_RCODE_SERVFAIL, ERR_DB_ERROR);
-	}
-      }
+  if (sql_nrquery(sql, query, querylen) != 0) {
+    WarnSQL(sql, "%s: %s", desctask(t), _("error adding RR via DNS UPDATE"));
+    RELEASE(query);
+    return dnserror(t, DNS_RCODE_SERVFAIL, ERR_DB_ERROR);
   }
-
-  RELEASE(xhost);
-  RELEASE(xname);
-  RELEASE(xdata);
-  RELEASE(xedata);
   RELEASE(query);
 
-  /* Output info to verbose log */
-  { char	*tmp = NULL;
-    ASPRINTF(&tmp, "ADD %s %u IN %s %u %s",
-	     UQRR_NAME(rr), rr->ttl, mydns_qtype_str(rr->type), aux, data);
-    task_output_info(t, tmp);
-    RELEASE(tmp);
+  return (TASK_EXECUTED);
+}
+/*--- update_add_insert() -----------------------------------------------------------------------*/
+
+
+/*************************************************************************************************
+	UPDATE_ADD_FLUSH
+	Writes the queued additions to the zone.
+
+	With the advent of the deleted state for records in the database (a new state for 'active')
+	we need to cope with resurrecting old records.  When 'active', 'stamp' and 'serial' are all
+	in use, RRs that are already active are silently ignored.  Otherwise MySQL relies on
+	"INSERT IGNORE" and PostgreSQL looks for duplicates first.
+	Returns 0 on success, -1 on failure.
+**************************************************************************************************/
+static taskexec_t
+update_add_flush(TASK *t, MYDNS_SOA *soa, UPDATE_ADDS *adds, uint32_t next_serial) {
+  int		ixfr = (mydns_rr_use_active && mydns_rr_use_stamp && mydns_rr_use_serial);
+  int		n = 0, i = 0, ext = 0, start = 0, end = 0;
+  taskexec_t	res = TASK_EXECUTED;
+
+  if (!adds->count)
+    return (TASK_EXECUTED);
+
+  /* An RR repeated within the batch is only inserted once */
+  for (n = 1; n < adds->count; n++) {
+    UPDATE_ADD *add = &adds->add[n];
+
+    for (i = 0; i < n; i++) {
+      UPDATE_ADD *prev = &adds->add[i];
+
+      if (prev->rr->type == add->rr->type
+	  && prev->datalen == add->datalen && !memcmp(prev->data, add->data, add->datalen)
+	  && prev->edatalen == add->edatalen
+	  && (!add->edatalen || !memcmp(prev->edata, add->edata, add->edatalen))
+	  && !strcasecmp((char*)UQRR_NAME(prev->rr), (char*)UQRR_NAME(add->rr))) {
+	add->present = 1;
+	break;
+      }
+    }
   }
-  t->update_done++;
-  RELEASE(data);
 
-  return (TASK_EXECUTED);
+  /* Find out which RRs exist - this is only necessary for Postgres without IXFR support,
+     as we can use "INSERT IGNORE" with MySQL */
+#if !USE_PGSQL
+  if (ixfr)
+#endif
+    for (start = 0; start < adds->count && res == TASK_EXECUTED; start += UPDATE_BATCH_SIZE) {
+      end = MIN(start + UPDATE_BATCH_SIZE, adds->count);
+      res = update_add_probe(t, soa, adds, start, end, ixfr);
+    }
+
+  /* RRs with extended data have two more columns, so they go in statements of their own */
+  for (ext = 0; ext < 2 && res == TASK_EXECUTED; ext++)
+    for (start = 0; start < adds->count && res == TASK_EXECUTED; start += UPDATE_BATCH_SIZE) {
+      end = MIN(start + UPDATE_BATCH_SIZE, adds->count);
+      res = update_add_insert(t, soa, adds, start, end, ext, ixfr, next_serial);
+    }
+
+  if (res == TASK_EXECUTED)
+    for (n = 0; n < adds->count; n++) {
+      UPDATE_ADD	*add = &adds->add[n];
+      char		*tmp = NULL;
+
+      /* Pre-existing active records are ignored */
+      if (ixfr && add->present)
+	continue;
+
+      /* Output info to verbose log */
+      ASPRINTF(&tmp, "ADD %s %u IN %s %u %s",
+	       UQRR_NAME(add->rr), add->rr->ttl, mydns_qtype_str(add->rr->type), add->aux, add->data);
+      task_output_info(t, tmp);
+      RELEASE(tmp);
+      t->update_done++;
+    }
+
+  update_add_clear(adds);
+  return (res);
 }
-/*--- update_add_rr() ---------------------------------------------------------------------------*/
+/*--- update_add_flush() ------------------------------------------------------------------------*/
 
 
 /**************************************************************************************************
@@ -2387,11 +2542,12 @@ update_delete_rrset(TASK *t, MYDNS_SOA *soa, UQRR *rr, uint32_t next_serial) {
 
 /**************************************************************************************************
 	PROCESS_UPDATE
-	Perform the requested update.
+	Perform the requested update.  Additions are queued in 'adds'; the queue is written out
+	before any deletion so that the updates still take effect in order.
 	Returns 0 on success, -1 on failure.
 **************************************************************************************************/
 static taskexec_t
-process_update(TASK *t, MYDNS_SOA *soa, UQ *q, UQRR *rr, uint32_t next_serial) {
+process_update(TASK *t, MYDNS_SOA *soa, UQ *q, UQRR *rr, UPDATE_ADDS *adds, uint32_t next_serial) {
 
 #if DEBUG_ENABLED && DEBUG_UPDATE
   DebugX("update", 1, _("%s: DNS UPDATE: process_update: q->name=[%s], q->type=%s, q->class=%s"), desctask(t),
@@ -2406,9 +2562,12 @@ process_update(TASK *t, MYDNS_SOA *soa, UQ *q, UQRR *rr, uint32_t next_serial) {
 #if DEBUG_ENABLED && DEBUG_UPDATE
     DebugX("update", 1, _("%s: DNS UPDATE: 2.5.1: Add to an RRset"), desctask(t));
 #endif
-    return update_add_rr(t, soa, rr, next_serial);
+    return update_add_queue(t, soa, adds, rr);
   }
 
+  if (update_add_flush(t, soa, adds, next_serial) != TASK_EXECUTED)
+    return (TASK_FAILED);
+
   /* 2.5.2: Delete an RRset */
   if (rr->type != DNS_CLASS_ANY && !UQRR_DATA_LENGTH(rr)) {
 #if DEBUG_ENABLED && DEBUG_UPDATE
@@ -2768,34 +2927,168 @@ are_we_master(TASK *t, MYDNS_SOA *soa) {
 
   return (res);
 }
+/**************************************************************************************************
+	UPDATE_GROUP
+	Gathers the UPDATE messages waiting for the same zone as 't', so that they can share one
+	transaction, one change of serial number and one round of NOTIFYs.  't' is always first.
+	Returns the number of messages in the group.
+**************************************************************************************************/
+static int
+update_group(TASK *t, UPDATE_MEMBER *group, int max) {
+  TASK		*w = NULL;
+  int		i = 0, j = 0, count = 0;
+
+  group[count++].t = t;
+  for (i = NORMAL_TASK; i <= PERIODIC_TASK && count < max; i++)
+    for (j = HIGH_PRIORITY_TASK; j <= LOW_PRIORITY_TASK && count < max; j++)
+      for (w = TaskArray[i][j]->head; w && count < max; w = w->next)
+	if (w != t && w->status == NEED_UPDATE && !strcasecmp(w->qname, t->qname))
+	  group[count++].t = w;
+
+  return (count);
+}
+/*--- update_group() ----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	UPDATE_PREPARE
+	Authenticates and parses one UPDATE message.
+	Returns TASK_EXECUTED if the message may be applied, TASK_FAILED once the error reply has
+	been set up.
+**************************************************************************************************/
+static taskexec_t
+update_prepare(UPDATE_MEMBER *m, MYDNS_SOA *soa) {
+  TASK		*t = m->t;
+
+  /* Verify TSIG signature if present */
+  m->tsig_key = verify_tsig_in_update(t, m->request_mac, &m->request_mac_len);
+  if (tsig_enforce_update && !m->tsig_key)
+    return (TASK_FAILED);			/* verify_tsig_in_update() already called dnserror() */
+
+  /* Check the optional 'update' column if it exists */
+  if (check_update(t, soa) != 0)
+    return (TASK_FAILED);
+
+  /* Parse the update query */
+  m->q = ALLOCATE(sizeof(UQ), UQ);
+  return parse_update_query(t, m->q);
+}
+/*--- update_prepare() --------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	UPDATE_APPLY
+	Checks the prerequisites of one UPDATE message and makes its changes.  This runs inside the
+	transaction, so each message sees the changes made by those before it in the group.
+	Returns TASK_EXECUTED once every change is made, TASK_FAILED if a prerequisite fails or a
+	change cannot be made; the error reply has then been set up.
+**************************************************************************************************/
+static taskexec_t
+update_apply(UPDATE_MEMBER *m, MYDNS_SOA *soa, UPDATE_ADDS *adds, uint32_t next_serial) {
+  TASK		*t = m->t;
+  UQ		*q = m->q;
+  int		n = 0;
+
+  /* Check the prerequsites as described in RFC 2136 3.2 */
+  for (n = 0; n < q->numPR; n++)
+    if (check_prerequisite(t, soa, q, &q->PR[n]) != TASK_EXECUTED)
+      return (TASK_FAILED);
+
+  /* Check the prerequisite RRsets -- RFC 2136 3.2.3 */
+  if (check_tmprr(t, soa, q) != TASK_EXECUTED)
+    return (TASK_FAILED);
+
+  /* Prescan the update section (RFC 2136 3.4.1) */
+  for (n = 0; n < q->numUP; n++)
+    if (prescan_update(t, q, &q->UP[n]) != TASK_EXECUTED)
+      return (TASK_FAILED);
+
+  /* Process the update section (RFC 2136 3.4.2) */
+  for (n = 0; n < q->numUP; n++)
+    if (process_update(t, soa, q, &q->UP[n], adds, next_serial) != TASK_EXECUTED) {
+      update_add_clear(adds);
+      return (TASK_FAILED);
+    }
+  return update_add_flush(t, soa, adds, next_serial);
+}
+/*--- update_apply() ----------------------------------------------------------------------------*/
+
+
+/**************************************************************************************************
+	UPDATE_SIGN_REPLY
+	Signs the reply to an UPDATE message with TSIG if the request was signed.
+**************************************************************************************************/
+static void
+update_sign_reply(UPDATE_MEMBER *m) {
+  TASK		*t = m->t;
+  size_t	new_len = 0;
+  size_t	max_tsig_len = 200;			/* Estimated max TSIG record size */
+  char		*new_reply = NULL;
+
+  if (!m->tsig_key || !m->request_mac_len)
+    return;
+
+  /* Allocate larger buffer for response + TSIG */
+  new_reply = ALLOCATE(t->replylen + max_tsig_len, char[]);
+  memcpy(new_reply, t->reply, t->replylen);
+
+  if (tsig_sign((unsigned char*)new_reply, t->replylen, t->replylen + max_tsig_len,
+		m->tsig_key, m->request_mac, m->request_mac_len, &new_len) == 0) {
+    /* Replace reply buffer with signed version */
+    RELEASE(t->reply);
+    t->reply = new_reply;
+    t->replylen = new_len;
+#if DEBUG_ENABLED && DEBUG_UPDATE
+    DebugX("update", 1, _("%s: Signed UPDATE response with TSIG (len=%zu)"), desctask(t), new_len);
+#endif
+  } else {
+    RELEASE(new_reply);
+    if (m->ok)
+      Warnx(_("%s: Failed to sign UPDATE response with TSIG"), desctask(t));
+  }
+}
+/*--- update_sign_reply() -----------------------------------------------------------------------*/
+
+
 /**************************************************************************************************
 	DNS_UPDATE
 	Process a DNS UPDATE query.
+	Any other UPDATE messages waiting for the same zone are processed with it and committed
+	together (see update-group-max).  Each message is applied behind a savepoint, so one that
+	fails does not undo the others, and the serial is only changed once for the group.
 **************************************************************************************************/
 taskexec_t
 dns_update(TASK *t) {
   MYDNS_SOA	*soa = NULL;						/* SOA record for zone */
-  UQ		*q = NULL;						/* Update query data */
-  int		n = 0;
-  uint32_t	next_serial = 0;
-  tsig_key_t	*tsig_key = NULL;				/* TSIG key for authentication */
-  unsigned char	request_mac[64];				/* Request TSIG MAC for response signing */
-  size_t	request_mac_len = 0;
+  UPDATE_MEMBER	*group = NULL, *m = NULL;				/* Messages committed together */
+  UPDATE_ADDS	adds = { NULL, 0, 0 };					/* Additions not yet written */
+  TASK		*last = NULL;						/* Last task to change the zone */
+  int		max = MAX(update_group_max, 1);
+  int		count = 0, n = 0, i = 0, changes = 0, failed = 0, committed = 0;
+  uint32_t	next_serial = 0, old_serial = 0;
+  struct timeval start = { 0, 0 }, finish = { 0, 0 };
+  unsigned long	held = 0;						/* Transaction time in usec */
+  taskexec_t	res = TASK_FAILED;
+
+  group = ALLOCATE(sizeof(UPDATE_MEMBER) * max, UPDATE_MEMBER[]);
+  count = update_group(t, group, max);
 
   /* Try to load SOA for zone */
   if (mydns_soa_load(sql, &soa, t->qname) < 0) {
-    dnserror(t, DNS_RCODE_SERVFAIL, ERR_DB_ERROR);
-    return (TASK_FAILED);
+    for (n = 0; n < count; n++)
+      dnserror(group[n].t, DNS_RCODE_SERVFAIL, ERR_DB_ERROR);
+    goto dns_update_reply;
   }
 
   /* If there's no such zone, say REFUSED rather than NOTAUTH, to prevent "zone mining" */
   if (!soa) {
-    dnserror(t, DNS_RCODE_REFUSED, ERR_ZONE_NOT_FOUND);
-    return (TASK_FAILED);
+    for (n = 0; n < count; n++)
+      dnserror(group[n].t, DNS_RCODE_REFUSED, ERR_ZONE_NOT_FOUND);
+    goto dns_update_reply;
   }
 
 #if DEBUG_ENABLED && DEBUG_UPDATE
-  DebugX("update", 1, _("%s: DNS UPDATE: SOA id %u"), desctask(t), soa->id);
+  DebugX("update", 1, _("%s: DNS UPDATE: SOA id %u, %d message(s)"), desctask(t), soa->id, count);
   DebugX("update", 1, _("%s: DNS UPDATE: ZOCOUNT=%d (Zone)"), desctask(t), t->qdcount);
   DebugX("update", 1, _("%s: DNS UPDATE: PRCOUNT=%d (Prerequisite)"), desctask(t), t->ancount);
   DebugX("update", 1, _("%s: DNS UPDATE: UPCOUNT=%d (Update)"), desctask(t), t->nscount);
@@ -2806,152 +3099,126 @@ dns_update(TASK *t) {
    * Check that we are the master for this zone
    * i.e. one of our addresses matches the master record
    */
-  if(!are_we_master(t, soa)) {
-    dnserror(t, DNS_RCODE_NOTAUTH, ERR_NO_UPDATE);
-    return (TASK_FAILED);
+  if (!are_we_master(t, soa)) {
+    for (n = 0; n < count; n++)
+      dnserror(group[n].t, DNS_RCODE_NOTAUTH, ERR_NO_UPDATE);
+    goto dns_update_reply;
   }
 
-  /* Verify TSIG signature if present */
-  tsig_key = verify_tsig_in_update(t, request_mac, &request_mac_len);
-  if (tsig_enforce_update && !tsig_key) {
-    /* verify_tsig_in_update() already called dnserror() */
-    mydns_soa_free(soa);
-    return (TASK_FAILED);
-  }
-
-  /* Check the optional 'update' column if it exists */
-  if (check_update(t, soa) != 0) {
-    if (tsig_key) tsig_key_free(tsig_key);
-    return (TASK_FAILED);
-  }
+  /* Authenticate and parse each message */
+  for (n = 0; n < count; n++)
+    group[n].ok = (update_prepare(&group[n], soa) == TASK_EXECUTED);
 
-  /* Parse the update query */
-  q = ALLOCATE(sizeof(UQ), UQ);
-  if (parse_update_query(t, q) != TASK_EXECUTED) {
-    goto dns_update_error;
-  }
-
-  /* Check the prerequsites as described in RFC 2136 3.2 */
-  for (n = 0; n < q->numPR; n++)
-    if (check_prerequisite(t, soa, q, &q->PR[n]) != TASK_EXECUTED) {
-      goto dns_update_error;
-    }
+  /* Apply the messages in one transaction */
+  gettimeofday(&start, NULL);
+  if (update_transaction(t, "BEGIN") != 0)			/* Start transaction */
+    failed = 1;
 
-  /* Check the prerequisite RRsets -- RFC 2136 3.2.3 */
-  if (check_tmprr(t, soa, q) != TASK_EXECUTED) {
-    goto dns_update_error;
-  }
-
-  /* Prescan the update section (RFC 2136 3.4.1) */
-  for (n = 0; n < q->numUP; n++)
-    if (prescan_update(t, q, &q->UP[n]) != TASK_EXECUTED) {
-      goto dns_update_error;
-    }
-
-  /* Process the update section (RFC 2136 3.4.2) */
-  if (update_transaction(t, "BEGIN") != 0)	/* Start transaction */
-    goto dns_update_error;
   /* Increment the serial on the SOA so that changes get stamped with the new one */
   next_serial = increment_soa_serial(t, soa);
-  for (n = 0; n < q->numUP; n++) {
-    if (process_update(t, soa, q, &q->UP[n], next_serial) != TASK_EXECUTED) {
-      update_transaction(t, "ROLLBACK");	/* Rollback transaction */
-      goto dns_update_error;
+  for (n = 0; n < count && !failed; n++) {
+    m = &group[n];
+    if (!m->ok)
+      continue;
+    if (count > 1 && update_transaction(m->t, "SAVEPOINT mydns_update") != 0) {
+      failed = 1;
+      break;
     }
+    if (update_apply(m, soa, &adds, next_serial) == TASK_EXECUTED) {
+      if (m->t->update_done) {
+	changes += m->t->update_done;
+	last = m->t;
+      }
+      continue;
+    }
+    m->ok = 0;
+    if (count > 1 && update_transaction(m->t, "ROLLBACK TO SAVEPOINT mydns_update") != 0)
+      failed = 1;
   }
-  if (t->update_done) {
+
+  if (!failed && last) {
+    old_serial = soa->serial;
     soa->serial = next_serial;
-    if(update_soa_serial(t, soa) != TASK_EXECUTED) {
-      update_transaction(t, "ROLLBACK");	/* Rollback transaction */
-      goto dns_update_error;
-    }
-    if (update_transaction(t, "COMMIT") != 0)	/* Commit changes */
-      goto dns_update_error;
-    t->info_already_out = 1;
+    if (update_soa_serial(last, soa) != TASK_EXECUTED
+	|| update_transaction(last, "COMMIT") != 0) {		/* Commit changes */
+      soa->serial = old_serial;
+      failed = 1;
+    } else
+      committed = 1;
+  }
+  if (!committed)
+    update_transaction(t, "ROLLBACK");				/* Rollback transaction */
+  gettimeofday(&finish, NULL);
+  held = (finish.tv_sec - start.tv_sec) * 1000000UL + finish.tv_usec - start.tv_usec;
+
+  /* Nothing in the transaction was kept, so no message succeeded */
+  if (failed)
+    for (n = 0; n < count; n++)
+      if (group[n].ok) {
+	dnserror(group[n].t, DNS_RCODE_SERVFAIL, ERR_DB_ERROR);
+	group[n].ok = 0;
+      }
 
-    /* Log successful UPDATE operation */
-    log_update_operation(t, soa, "UPDATE", t->qname, "MULTIPLE",
-                        "Success", 1, DNS_RCODE_NOERROR,
-                        tsig_key ? tsig_key->name : NULL);
+  Status.update_messages += count;
+  if (committed) {
+    Status.update_commits++;
+    Status.update_changes += changes;
+    Status.update_lock_usec += held;
+    if (held > Status.update_lock_max_usec)
+      Status.update_lock_max_usec = held;
+    Verbose(_("%s: UPDATE %s: %d %s, %d %s committed in %.1f ms (%.0f/s)"), desctask(t), soa->origin,
+	    count, _("message(s)"), changes, _("change(s)"), held / 1000.0,
+	    held ? changes * 1000000.0 / held : 0.0);
 
     /* Purge the cache for this zone */
-    cache_purge_zone(ZoneCache, soa->id);
-#if USE_NEGATIVE_CACHE
-    cache_purge_zone(NegativeCache, soa->id);
-#endif
-    cache_purge_zone(ReplyCache, soa->id);
+    cache_flush_zone(soa->id);
+
+    /* Record the change for IXFR */
+    ixfr_journal_updated(soa);
+
+    /* A change to the NS records changes who gets told */
+    for (n = 0; n < count; n++)
+      if (group[n].ok && group[n].t->update_done)
+	for (i = 0; i < group[n].q->numUP; i++)
+	  if (group[n].q->UP[i].type == DNS_QTYPE_NS || group[n].q->UP[i].type == DNS_QTYPE_ANY) {
+	    notify_forget_slaves(soa->id);
+	    n = count;
+	    break;
+	  }
 
     /* Send out the notifications */
-    notify_slaves(t, soa);
-  } else {
-    update_transaction(t, "ROLLBACK");
+    notify_slaves(last, soa);
   }
 
-  /* Construct reply and set task status */
-  build_reply(t, 0);
+ dns_update_reply:
+  /* Log the operations, construct the replies and set task status */
+  for (n = 0; n < count; n++) {
+    m = &group[n];
+    if (soa)
+      log_update_operation(m->t, soa, "UPDATE", m->t->qname, "MULTIPLE",
+			   (m->ok) ? "Success" : "Failed", m->ok, m->t->hdr.rcode,
+			   m->tsig_key ? m->tsig_key->name : NULL);
+    if (m->ok && m->t->update_done)
+      m->t->info_already_out = 1;
 
-  /* Sign response with TSIG if request was signed */
-  if (tsig_key && request_mac_len > 0) {
-    size_t new_len = 0;
-    size_t max_tsig_len = 200;  /* Estimated max TSIG record size */
-    char *new_reply = NULL;
+    build_reply(m->t, !m->ok);
 
-    /* Allocate larger buffer for response + TSIG */
-    new_reply = ALLOCATE(t->replylen + max_tsig_len, char[]);
-    memcpy(new_reply, t->reply, t->replylen);
+    /* Sign response with TSIG if request was signed */
+    update_sign_reply(m);
 
-    if (tsig_sign((unsigned char*)new_reply, t->replylen, t->replylen + max_tsig_len,
-                  tsig_key, request_mac, request_mac_len, &new_len) == 0) {
-      /* Replace reply buffer with signed version */
-      RELEASE(t->reply);
-      t->reply = new_reply;
-      t->replylen = new_len;
-#if DEBUG_ENABLED && DEBUG_UPDATE
-      DebugX("update", 1, _("%s: Signed UPDATE response with TSIG (len=%zu)"), desctask(t), new_len);
-#endif
-    } else {
-      RELEASE(new_reply);
-      Warnx(_("%s: Failed to sign UPDATE response with TSIG"), desctask(t));
-    }
+    m->t->status = NEED_WRITE;
+    if (m->q)
+      free_uq(m->q);
+    if (m->tsig_key)
+      tsig_key_free(m->tsig_key);
   }
-
-  t->status = NEED_WRITE;
+  res = (group[0].ok) ? TASK_EXECUTED : TASK_FAILED;
 
   /* Clean up and return */
-  free_uq(q);
+  RELEASE(adds.add);
+  RELEASE(group);
   mydns_soa_free(soa);
-  if (tsig_key) tsig_key_free(tsig_key);
-  return (TASK_EXECUTED);
-
-dns_update_error:
-  /* Log failed UPDATE operation */
-  log_update_operation(t, soa, "UPDATE", t->qname, "MULTIPLE",
-                      "Failed", 0, t->hdr.rcode,
-                      tsig_key ? tsig_key->name : NULL);
-
-  build_reply(t, 1);
-
-  /* Sign error response with TSIG if request was signed */
-  if (tsig_key && request_mac_len > 0) {
-    size_t new_len = 0;
-    size_t max_tsig_len = 200;
-    char *new_reply = ALLOCATE(t->replylen + max_tsig_len, char[]);
-    memcpy(new_reply, t->reply, t->replylen);
-
-    if (tsig_sign((unsigned char*)new_reply, t->replylen, t->replylen + max_tsig_len,
-                  tsig_key, request_mac, request_mac_len, &new_len) == 0) {
-      RELEASE(t->reply);
-      t->reply = new_reply;
-      t->replylen = new_len;
-    } else {
-      RELEASE(new_reply);
-    }
-  }
-
-  free_uq(q);
-  mydns_soa_free(soa);
-  if (tsig_key) tsig_key_free(tsig_key);
-  return (TASK_FAILED);
+  return (res);
 }
 /*--- dns_update() ------------------------------------------------------------------------------*/
 
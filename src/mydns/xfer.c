@@ -6,14 +6,28 @@
  * allowing MyDNS to act as an AXFR slave.
  *
  * Usage:
- *   mydns-xfer [-c config] [-d] [-f] [-z zone_id]
+ *   mydns-xfer [-c config] [-d] [-f] [-j jobs] [-m jobs] [-z zone_id]
  *
  * Options:
  *   -c config   Configuration file (default: /etc/mydns.conf)
  *   -d          Daemon mode (run continuously)
  *   -f          Foreground mode (don't daemonize)
+ *   -j jobs     Zones checked/transferred at once (default: 8)
+ *   -m jobs     Zones checked/transferred at once per master (default: 2)
  *   -z zone_id  Transfer only specific zone
  *   -h          Show help
+ *
+ * Each zone is checked on its own schedule, taken from the REFRESH and
+ * RETRY values in the master's SOA (with some jitter so zones do not move in
+ * lockstep), using a min-heap of due times.  Zones that come due together
+ * are checked in one batch of UDP queries.  A NOTIFY moves its zone to the
+ * front; repeated NOTIFYs before the check are coalesced.  A zone whose
+ * master has not answered for EXPIRE seconds stops being served until it
+ * can be refreshed again.
+ *
+ * Zones that are behind are transferred in child processes so that slow
+ * masters do not hold up the rest.  Zones waiting for a slot are kept in a
+ * priority queue; NOTIFY zones go first.
  */
 
 #include "mydns.h"
@@ -25,15 +39,73 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/select.h>
+#include <sys/wait.h>
 #include <arpa/inet.h>
 
+#define XFER_DEFAULT_JOBS		8	/* Default -j */
+#define XFER_DEFAULT_MASTER_JOBS	2	/* Default -m */
+#define XFER_RELOAD_INTERVAL	300	/* Seconds between re-reading the zone list */
+#define XFER_DEFAULT_REFRESH	300	/* Used until the master's SOA has been seen */
+#define XFER_DEFAULT_RETRY	60
+#define XFER_DEFAULT_EXPIRE	604800
+#define XFER_MIN_INTERVAL	30	/* Never check a zone more often than this */
+#define XFER_NOTIFY_BURST	256	/* NOTIFYs read per wakeup */
+
+/* Child exit codes */
+#define XFER_EXIT_TRANSFERRED	0
+#define XFER_EXIT_FAILED	2
+
+/* A slave zone and when it is next due for a serial check */
+typedef struct {
+    axfr_zone_t zone;
+    time_t due;                  /* Next serial check */
+    time_t last_ok;              /* Last time the zone was confirmed current */
+    int heap_pos;                /* Position in the due heap, -1 if not scheduled */
+    int notified;                /* NOTIFY received since the last check */
+    int busy;                    /* Queued for or running a transfer */
+    int expired;                 /* Past EXPIRE; not being served */
+    int removed;                 /* No longer configured */
+} xfer_sched_t;
+
+/* A zone waiting to be transferred */
+typedef struct {
+    int sched;                   /* Index into scheds */
+    int notify;                  /* Queued because of a NOTIFY */
+    unsigned long seq;           /* Queue order among equal priorities */
+} xfer_job_t;
+
+/* A running transfer */
+typedef struct {
+    pid_t pid;
+    int sched;
+    char *master_host;
+} xfer_worker_t;
+
 /* Global variables */
 memzone_ctx_t *Memzone = NULL;  /* In-memory zone storage */
 static int running = 1;
+static volatile sig_atomic_t reload_requested = 0;
 static int daemon_mode = 0;
 static int foreground = 0;
 static int specific_zone = 0;
 static char *config_file = "/etc/mydns.conf";
+static int max_jobs = XFER_DEFAULT_JOBS;
+static int max_master_jobs = XFER_DEFAULT_MASTER_JOBS;
+
+static xfer_sched_t *scheds = NULL;       /* Every configured zone */
+static int sched_count = 0, sched_size = 0;
+static int *due_heap = NULL;              /* Min-heap of sched indices by due time */
+static int due_len = 0;
+
+static xfer_job_t *queue = NULL;          /* Binary heap, NOTIFY zones first */
+static int queue_len = 0, queue_size = 0;
+static unsigned long queue_seq = 0;
+
+static xfer_worker_t *workers = NULL;     /* max_jobs slots; pid 0 is free */
+static int active_workers = 0;
+
+/* Totals for a one-shot run */
+static int run_transferred = 0, run_failed = 0, run_current = 0;
 
 /* Signal handler */
 static void signal_handler(int sig) {
@@ -41,9 +113,10 @@ static void signal_handler(int sig) {
         Warnx(_("Received signal %d, shutting down..."), sig);
         running = 0;
     } else if (sig == SIGHUP) {
-        Warnx(_("Received SIGHUP, reloading configuration..."));
-        /* TODO: Reload configuration */
+        Warnx(_("Received SIGHUP, reloading zone list..."));
+        reload_requested = 1;
     }
+    /* SIGCHLD only needs to wake select() so finished jobs are reaped */
 }
 
 /* Daemonize process */
@@ -102,7 +175,12 @@ static int transfer_zone(SQL *db, axfr_zone_t *zone) {
     Notice(_("Starting zone transfer: %s from %s:%d"),
            zone->zone_name, zone->master_host, zone->master_port);
 
-    ret = axfr_transfer_zone(db, zone, &result);
+    /* A zone already held is brought forward by IXFR, which falls back to AXFR itself */
+    if (zone->current_serial) {
+        ret = axfr_ixfr_transfer_zone(db, zone, &result);
+    } else {
+        ret = axfr_transfer_zone(db, zone, &result);
+    }
 
     if (ret == 0 && result.status == AXFR_SUCCESS) {
         Notice(_("Zone transfer completed: %s - %d records in %ld seconds"),
@@ -122,13 +200,13 @@ static int transfer_zone(SQL *db, axfr_zone_t *zone) {
         snprintf(query, sizeof(query),
             "UPDATE zone_masters SET last_transfer = NOW(), transfer_failures = 0 "
             "WHERE zone_id = %d", zone->zone_id);
-        sql_query(db, query, strlen(query));
+        sql_nrquery(db, query, strlen(query));
     } else {
         char query[256];
         snprintf(query, sizeof(query),
             "UPDATE zone_masters SET transfer_failures = transfer_failures + 1 "
             "WHERE zone_id = %d", zone->zone_id);
-        sql_query(db, query, strlen(query));
+        sql_nrquery(db, query, strlen(query));
     }
 
     /* Free error message */
@@ -139,70 +217,617 @@ static int transfer_zone(SQL *db, axfr_zone_t *zone) {
     return ret;
 }
 
-/* Transfer all configured zones */
-static int transfer_all_zones(SQL *db) {
-    axfr_zone_t *zones = NULL;
-    int zone_count = 0;
-    int success_count = 0;
+/* Spread a refresh/retry interval by +/-10% so zones drift apart */
+static time_t jitter(uint32_t interval, uint32_t fallback) {
+    if (!interval) {
+        interval = fallback;
+    }
+    if (interval < XFER_MIN_INTERVAL) {
+        interval = XFER_MIN_INTERVAL;
+    }
+    return interval - interval / 10 + random() % (interval / 5 + 1);
+}
+
+/*
+ * Due heap
+ */
+static void due_swap(int a, int b) {
+    int tmp = due_heap[a];
+
+    due_heap[a] = due_heap[b];
+    due_heap[b] = tmp;
+    scheds[due_heap[a]].heap_pos = a;
+    scheds[due_heap[b]].heap_pos = b;
+}
+
+static int due_sift_up(int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (scheds[due_heap[parent]].due <= scheds[due_heap[i]].due) {
+            break;
+        }
+        due_swap(i, parent);
+        i = parent;
+    }
+    return i;
+}
+
+static void due_sift_down(int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, best = i;
+
+        if (l < due_len && scheds[due_heap[l]].due < scheds[due_heap[best]].due) best = l;
+        if (r < due_len && scheds[due_heap[r]].due < scheds[due_heap[best]].due) best = r;
+        if (best == i) {
+            break;
+        }
+        due_swap(i, best);
+        i = best;
+    }
+}
+
+/* Schedule a zone's next check */
+static void due_push(int idx, time_t due) {
+    scheds[idx].due = due;
+    if (scheds[idx].heap_pos >= 0) {
+        due_sift_down(due_sift_up(scheds[idx].heap_pos));
+        return;
+    }
+    due_heap[due_len] = idx;
+    scheds[idx].heap_pos = due_len++;
+    due_sift_up(due_len - 1);
+}
+
+/* Take a zone off the schedule */
+static void due_remove(int idx) {
+    int pos = scheds[idx].heap_pos;
+
+    if (pos < 0) {
+        return;
+    }
+    due_swap(pos, --due_len);
+    scheds[idx].heap_pos = -1;
+    if (pos < due_len) {
+        due_sift_down(due_sift_up(pos));
+    }
+}
+
+/* Find a zone by ID */
+static int sched_find(int zone_id) {
     int i;
 
+    for (i = 0; i < sched_count; i++) {
+        if (scheds[i].zone.zone_id == zone_id && !scheds[i].removed) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Compare zone names, ignoring case and a trailing dot */
+static int zone_name_eq(const char *a, const char *b) {
+    size_t la = strlen(a), lb = strlen(b);
+
+    if (la && a[la - 1] == '.') la--;
+    if (lb && b[lb - 1] == '.') lb--;
+    return la == lb && !strncasecmp(a, b, la);
+}
+
+/* Release a removed zone once nothing refers to it */
+static void sched_drop(int idx) {
+    due_remove(idx);
+    if (!scheds[idx].busy) {
+        axfr_free_zone(&scheds[idx].zone);
+        memset(&scheds[idx].zone, 0, sizeof(axfr_zone_t));
+    }
+}
+
+/* Read the zone list, adding new zones (due now) and dropping removed ones */
+static int sched_reload(SQL *db) {
+    axfr_zone_t *zones = NULL;
+    int zone_count = 0, added = 0, i;
+    time_t now = time(NULL);
+
     /* Load zone configurations (tries config file first, then database) */
     if (axfr_load_zones_auto(db, specific_zone, &zones, &zone_count) < 0) {
         Warnx(_("Failed to load zone configurations"));
         return -1;
     }
 
-    if (zone_count == 0) {
-        Notice(_("No zones configured for transfer"));
-        return 0;
+    if (sched_count + zone_count > sched_size) {
+        sched_size = sched_count + zone_count + 64;
+        scheds = (xfer_sched_t *)realloc(scheds, sched_size * sizeof(xfer_sched_t));
+        due_heap = (int *)realloc(due_heap, sched_size * sizeof(int));
+        if (!scheds || !due_heap) {
+            Err(_("out of memory"));
+        }
     }
 
-    Notice(_("Found %d zone(s) to transfer"), zone_count);
+    for (i = 0; i < sched_count; i++) {
+        scheds[i].removed = 1;
+    }
 
-    /* Transfer each zone */
     for (i = 0; i < zone_count; i++) {
-        /* Check if we should still be running */
-        if (!running) {
+        int idx, j;
+
+        for (idx = -1, j = 0; j < sched_count; j++) {
+            if (scheds[j].zone.zone_id == zones[i].zone_id) {
+                idx = j;
+                break;
+            }
+        }
+
+        if (idx >= 0) {
+            /* Known zone: take the new settings but keep what the master told us */
+            axfr_zone_t old = scheds[idx].zone;
+
+            scheds[idx].zone = zones[i];
+            scheds[idx].zone.master_serial = old.master_serial;
+            scheds[idx].zone.refresh = old.refresh;
+            scheds[idx].zone.retry = old.retry;
+            scheds[idx].zone.expire = old.expire;
+            axfr_free_zone(&old);
+            scheds[idx].removed = 0;
+            if (scheds[idx].heap_pos < 0 && !scheds[idx].busy) {
+                due_push(idx, now);
+            }
+            continue;
+        }
+
+        idx = sched_count++;
+        memset(&scheds[idx], 0, sizeof(xfer_sched_t));
+        scheds[idx].zone = zones[i];
+        scheds[idx].last_ok = now;
+        scheds[idx].heap_pos = -1;
+        due_push(idx, now);
+        added++;
+    }
+    free(zones);
+
+    for (i = 0; i < sched_count; i++) {
+        if (scheds[i].removed && scheds[i].zone.zone_name) {
+            Notice(_("Zone %s is no longer configured for transfer"), scheds[i].zone.zone_name);
+            sched_drop(i);
+        }
+    }
+
+    if (added) {
+        Notice(_("Found %d new zone(s) to transfer, %d scheduled"), added, due_len);
+    }
+    return 0;
+}
+
+/* Does job a belong ahead of job b? */
+static int job_before(const xfer_job_t *a, const xfer_job_t *b) {
+    if (a->notify != b->notify) {
+        return a->notify > b->notify;
+    }
+    return a->seq < b->seq;
+}
+
+static void queue_sift_up(int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        xfer_job_t tmp;
+
+        if (!job_before(&queue[i], &queue[parent])) {
+            break;
+        }
+        tmp = queue[i];
+        queue[i] = queue[parent];
+        queue[parent] = tmp;
+        i = parent;
+    }
+}
+
+static void queue_sift_down(int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, best = i;
+        xfer_job_t tmp;
+
+        if (l < queue_len && job_before(&queue[l], &queue[best])) best = l;
+        if (r < queue_len && job_before(&queue[r], &queue[best])) best = r;
+        if (best == i) {
             break;
         }
+        tmp = queue[i];
+        queue[i] = queue[best];
+        queue[best] = tmp;
+        i = best;
+    }
+}
+
+/* Queue a zone for transfer */
+static void queue_push(int idx, int notify, unsigned long seq) {
+    if (queue_len == queue_size) {
+        queue_size = queue_size ? queue_size * 2 : 64;
+        queue = (xfer_job_t *)realloc(queue, queue_size * sizeof(xfer_job_t));
+        if (!queue) {
+            Err(_("out of memory"));
+        }
+    }
+    queue[queue_len].sched = idx;
+    queue[queue_len].notify = notify;
+    queue[queue_len].seq = seq;
+    queue_sift_up(queue_len++);
+    scheds[idx].busy = 1;
+}
+
+static void queue_pop(xfer_job_t *job) {
+    *job = queue[0];
+    queue[0] = queue[--queue_len];
+    queue_sift_down(0);
+}
 
-        /* Check if zone needs transfer (based on SOA serial) */
-        if (axfr_check_serial(&zones[i]) < 0) {
-            Warnx(_("Failed to check serial for zone: %s"), zones[i].zone_name);
+/* Count running transfers against a master */
+static int master_jobs(const char *master_host) {
+    int i, count = 0;
+
+    for (i = 0; i < max_jobs; i++) {
+        if (workers[i].pid && !strcmp(workers[i].master_host, master_host)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/* Transfer a zone; runs in the child */
+static int xfer_child(axfr_zone_t *zone) {
+    SQL *db;
+    int status;
+
+    /* The parent's connection cannot be shared; open another as the same user */
+    db = sql_connect(conf_get(&Conf, "db-host", NULL));
+    if (!db) {
+        Warnx(_("Failed to connect to database"));
+        return XFER_EXIT_FAILED;
+    }
+
+    status = transfer_zone(db, zone) == 0 ? XFER_EXIT_TRANSFERRED : XFER_EXIT_FAILED;
+
+    /* The child leaves with _exit(), so write the queued audit rows first */
+    auditlog_close();
+    sql_close(db);
+    return status;
+}
+
+/* Start queued jobs while there are free slots */
+static void start_jobs(int notify_sockfd) {
+    xfer_job_t *deferred = NULL;
+    int deferred_len = 0, i;
+
+    while (queue_len && active_workers < max_jobs && running) {
+        xfer_job_t job;
+        xfer_sched_t *sc;
+        pid_t pid;
+        int slot;
+
+        queue_pop(&job);
+        sc = &scheds[job.sched];
+
+        if (sc->removed) {
+            sc->busy = 0;
+            sched_drop(job.sched);
             continue;
         }
 
-        /* Perform transfer */
-        if (transfer_zone(db, &zones[i]) == 0) {
-            success_count++;
+        /* Leave zones on busy masters for later */
+        if (master_jobs(sc->zone.master_host) >= max_master_jobs) {
+            deferred = (xfer_job_t *)realloc(deferred, (deferred_len + 1) * sizeof(xfer_job_t));
+            if (!deferred) {
+                Err(_("out of memory"));
+            }
+            deferred[deferred_len++] = job;
+            continue;
         }
 
-        /* Update last_check timestamp */
-        char query[256];
-        snprintf(query, sizeof(query),
-            "UPDATE zone_masters SET last_check = NOW() WHERE zone_id = %d",
-            zones[i].zone_id);
-        sql_query(db, query, strlen(query));
+        for (slot = 0; slot < max_jobs && workers[slot].pid; slot++)
+            ;
+
+        pid = fork();
+        if (pid < 0) {
+            Warn(_("fork() failed"));
+            deferred = (xfer_job_t *)realloc(deferred, (deferred_len + 1) * sizeof(xfer_job_t));
+            if (!deferred) {
+                Err(_("out of memory"));
+            }
+            deferred[deferred_len++] = job;
+            break;
+        }
+        if (pid == 0) {
+            if (notify_sockfd >= 0) {
+                close(notify_sockfd);
+            }
+            /* _exit() so the parent's database connection is left alone */
+            _exit(xfer_child(&sc->zone));
+        }
 
-        /* Free zone data */
-        axfr_free_zone(&zones[i]);
+        workers[slot].pid = pid;
+        workers[slot].sched = job.sched;
+        workers[slot].master_host = strdup(sc->zone.master_host);
+        active_workers++;
     }
 
+    /* Put deferred jobs back, keeping their place in line */
+    for (i = 0; i < deferred_len; i++) {
+        queue_push(deferred[i].sched, deferred[i].notify, deferred[i].seq);
+    }
+    free(deferred);
+}
+
+/* Serve a zone again after it had expired */
+static void zone_revive(SQL *db, int idx) {
+    char query[256];
+
+    Notice(_("Zone %s refreshed after expiring; serving it again"), scheds[idx].zone.zone_name);
+    snprintf(query, sizeof(query), "UPDATE soa SET active = 'Y' WHERE id = %d", scheds[idx].zone.zone_id);
+    sql_nrquery(db, query, strlen(query));
+    scheds[idx].expired = 0;
+}
+
+/* Stop serving a zone that has not been refreshed for longer than EXPIRE */
+static void zone_expire(SQL *db, int idx) {
+    xfer_sched_t *sc = &scheds[idx];
+    char query[256];
+
+    Warnx(_("Zone %s expired: not refreshed from master %s for %ld seconds; no longer serving it"),
+          sc->zone.zone_name, sc->zone.master_host, (long)(time(NULL) - sc->last_ok));
+    if (Memzone && memzone_zone_exists(Memzone, sc->zone.zone_id) == 1) {
+        memzone_delete_zone(Memzone, sc->zone.zone_id);
+    }
+    snprintf(query, sizeof(query), "UPDATE soa SET active = 'N' WHERE id = %d", sc->zone.zone_id);
+    sql_nrquery(db, query, strlen(query));
+    sc->expired = 1;
+}
+
+/* Expire the zone once nothing has confirmed it current for longer than EXPIRE */
+static void zone_check_expire(SQL *db, int idx, time_t now) {
+    xfer_sched_t *sc = &scheds[idx];
+
+    if (!sc->expired && now - sc->last_ok >= (time_t)(sc->zone.expire ? sc->zone.expire : XFER_DEFAULT_EXPIRE)) {
+        zone_expire(db, idx);
+    }
+}
+
+/* Collect finished children and schedule their zones' next check */
+static void reap_jobs(SQL *db) {
+    pid_t pid;
+    int status, i;
+    time_t now = time(NULL);
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (i = 0; i < max_jobs; i++) {
+            xfer_sched_t *sc;
+
+            if (workers[i].pid != pid) {
+                continue;
+            }
+            sc = &scheds[workers[i].sched];
+            sc->busy = 0;
+
+            if (sc->removed) {
+                sched_drop(workers[i].sched);
+            } else if (WIFEXITED(status) && WEXITSTATUS(status) == XFER_EXIT_TRANSFERRED) {
+                run_transferred++;
+                sc->zone.current_serial = sc->zone.master_serial;
+                sc->last_ok = now;
+                if (sc->expired) {
+                    zone_revive(db, workers[i].sched);
+                }
+                due_push(workers[i].sched, sc->notified ? now : now + jitter(sc->zone.refresh, XFER_DEFAULT_REFRESH));
+            } else {
+                run_failed++;
+                zone_check_expire(db, workers[i].sched, now);
+                due_push(workers[i].sched, sc->notified ? now : now + jitter(sc->zone.retry, XFER_DEFAULT_RETRY));
+            }
+
+            free(workers[i].master_host);
+            memset(&workers[i], 0, sizeof(xfer_worker_t));
+            active_workers--;
+            break;
+        }
+    }
+}
+
+/* Record the check time for zones whose master answered */
+static void update_last_check(SQL *db, axfr_zone_t *zones, int *results, int zone_count) {
+    char query[8192];
+    int i, len = 0, ids = 0;
+
+    for (i = 0; i <= zone_count; i++) {
+        if (i < zone_count && results[i] < 0) {
+            continue;
+        }
+        if (ids && (i == zone_count || len > (int)sizeof(query) - 32)) {
+            snprintf(query + len, sizeof(query) - len, ")");
+            sql_nrquery(db, query, strlen(query));
+            len = ids = 0;
+        }
+        if (i == zone_count) {
+            break;
+        }
+        if (!ids) {
+            len = snprintf(query, sizeof(query),
+                "UPDATE zone_masters SET last_check = NOW() WHERE zone_id IN (%d", zones[i].zone_id);
+        } else {
+            len += snprintf(query + len, sizeof(query) - len, ",%d", zones[i].zone_id);
+        }
+        ids++;
+    }
+}
+
+/* Check every zone that is due, in one batch, and queue those behind their master */
+static void check_due(SQL *db) {
+    axfr_zone_t *zones;
+    int *batch, *results;
+    int count = 0, answered, queued = 0, failed = 0, i;
+    time_t now = time(NULL), start = now;
+
+    if (!due_len || scheds[due_heap[0]].due > now) {
+        return;
+    }
+
+    batch = (int *)malloc(due_len * sizeof(int));
+    zones = (axfr_zone_t *)malloc(due_len * sizeof(axfr_zone_t));
+    results = (int *)malloc(due_len * sizeof(int));
+    if (!batch || !zones || !results) {
+        Err(_("out of memory"));
+    }
+
+    while (due_len && scheds[due_heap[0]].due <= now) {
+        int idx = due_heap[0];
+
+        due_remove(idx);
+        batch[count] = idx;
+        zones[count] = scheds[idx].zone;
+        count++;
+    }
+
+    answered = axfr_check_serials(zones, count, results);
+    update_last_check(db, zones, results, count);
+
+    now = time(NULL);
+    for (i = 0; i < count; i++) {
+        int idx = batch[i];
+        xfer_sched_t *sc = &scheds[idx];
+        int notified = sc->notified;
+
+        sc->zone.master_serial = zones[i].master_serial;
+        if (zones[i].refresh) {
+            sc->zone.refresh = zones[i].refresh;
+            sc->zone.retry = zones[i].retry;
+            sc->zone.expire = zones[i].expire;
+        }
+        sc->notified = 0;
+
+        if (results[i] < 0) {
+            failed++;
+            zone_check_expire(db, idx, now);
+            due_push(idx, now + jitter(sc->zone.retry, XFER_DEFAULT_RETRY));
+            continue;
+        }
+
+        if (results[i] == 0 || sc->expired) {
+            /* Behind the master, or needs reloading after expiring */
+            queue_push(idx, notified, queue_seq++);
+            queued++;
+            continue;
+        }
+        /* Only a current serial counts as a refresh; a zone behind waits for its transfer */
+        sc->last_ok = now;
+        run_current++;
+        due_push(idx, now + jitter(sc->zone.refresh, XFER_DEFAULT_REFRESH));
+    }
+
+    if (count > 1 || failed || queued) {
+        Notice(_("Serial check: %d/%d zones answered in %ld seconds, %d need transfer, %d failed"),
+               answered < 0 ? 0 : answered, count, (long)(now - start), queued, failed);
+    }
+
+    free(batch);
     free(zones);
+    free(results);
+}
 
-    Notice(_("Zone transfer cycle completed: %d/%d successful"), success_count, zone_count);
+/* Move a zone named in a NOTIFY to the front */
+static void notify_zone(int idx) {
+    xfer_sched_t *sc = &scheds[idx];
+    int i;
 
-    return 0;
+    sc->notified = 1;
+    if (!sc->busy) {
+        due_push(idx, time(NULL));
+        return;
+    }
+
+    /* Already waiting for a transfer slot: move it ahead; if running, it is checked again after */
+    for (i = 0; i < queue_len; i++) {
+        if (queue[i].sched == idx) {
+            if (!queue[i].notify) {
+                queue[i].notify = 1;
+                queue_sift_up(i);
+            }
+            break;
+        }
+    }
+}
+
+/* Read every pending NOTIFY without blocking */
+static void read_notifies(SQL *db, int notify_sockfd) {
+    unsigned char notify_buf[512];
+    int n;
+
+    for (n = 0; n < XFER_NOTIFY_BURST; n++) {
+        struct sockaddr_storage notify_addr;
+        socklen_t notify_addrlen = sizeof(notify_addr);
+        char zone_name[256];
+        char source_ip[INET6_ADDRSTRLEN];
+        uint16_t query_id;
+        ssize_t recv_len;
+        int zone_id, idx, i;
+
+        recv_len = recvfrom(notify_sockfd, notify_buf, sizeof(notify_buf), 0,
+                            (struct sockaddr *)&notify_addr, &notify_addrlen);
+        if (recv_len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                Warnx(_("recvfrom() error: %s"), strerror(errno));
+            }
+            break;
+        }
+
+        /* Get source IP, showing IPv4 senders on a dual-stack socket as plain IPv4 */
+        if (notify_addr.ss_family == AF_INET6) {
+            struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&notify_addr;
+            if (IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr)) {
+                inet_ntop(AF_INET, &sin6->sin6_addr.s6_addr[12], source_ip, sizeof(source_ip));
+            } else {
+                inet_ntop(AF_INET6, &sin6->sin6_addr, source_ip, sizeof(source_ip));
+            }
+        } else {
+            inet_ntop(AF_INET, &((struct sockaddr_in *)&notify_addr)->sin_addr, source_ip, sizeof(source_ip));
+        }
+
+        /* Parse NOTIFY message */
+        if (axfr_notify_parse(notify_buf, recv_len, zone_name, sizeof(zone_name), &query_id) != 0) {
+            continue;
+        }
+
+        /* Send NOTIFY response */
+        axfr_notify_respond(notify_sockfd, query_id, zone_name,
+                            (struct sockaddr *)&notify_addr, notify_addrlen);
+
+        /* A repeat from the zone's master before the check has run changes nothing */
+        for (i = 0; i < sched_count; i++) {
+            xfer_sched_t *sc = &scheds[i];
+            if (sc->notified && !sc->removed && !strcmp(sc->zone.master_host, source_ip)
+                && zone_name_eq(sc->zone.zone_name, zone_name)) {
+                break;
+            }
+        }
+        if (i < sched_count) {
+            continue;
+        }
+
+        /* Authorize and trigger a check */
+        zone_id = axfr_notify_process(db, zone_name, source_ip);
+        if (zone_id <= 0) {
+            continue;
+        }
+        if ((idx = sched_find(zone_id)) < 0) {
+            sched_reload(db);
+            idx = sched_find(zone_id);
+        }
+        if (idx >= 0) {
+            Notice(_("Triggering immediate check for zone %s due to NOTIFY"), zone_name);
+            notify_zone(idx);
+        }
+    }
 }
 
 /* Main transfer loop with NOTIFY support */
 static int transfer_loop(SQL *db) {
-    int check_interval = 300;  /* 5 minutes default */
     int notify_sockfd = -1;
-    time_t last_check = 0;
-    unsigned char notify_buf[512];
-    struct sockaddr_in notify_addr;
-    socklen_t notify_addrlen;
+    time_t last_reload, start = time(NULL);
 
     /* Create NOTIFY listener socket (UDP port 5300 - using alternate port to avoid conflicts) */
     notify_sockfd = axfr_notify_listen(5300);
@@ -213,89 +838,81 @@ static int transfer_loop(SQL *db) {
         Notice(_("NOTIFY support enabled on UDP port 5300"));
     }
 
+    workers = (xfer_worker_t *)calloc(max_jobs, sizeof(xfer_worker_t));
+    if (!workers) {
+        Err(_("out of memory"));
+    }
+
+    sched_reload(db);
+    last_reload = time(NULL);
+
     while (running) {
         time_t now = time(NULL);
+        fd_set readfds;
+        struct timeval tv;
+        int select_ret;
 
-        /* Check if it's time for scheduled transfer check */
-        if (now - last_check >= check_interval) {
-            /* Perform scheduled transfers */
-            transfer_all_zones(db);
-            last_check = now;
+        reap_jobs(db);
 
-            /* If not in daemon mode, exit after one cycle */
-            if (!daemon_mode) {
-                break;
-            }
+        /* Pick up added and removed zones */
+        if (reload_requested || (daemon_mode && now - last_reload >= XFER_RELOAD_INTERVAL)) {
+            reload_requested = 0;
+            sched_reload(db);
+            last_reload = now;
         }
 
-        /* Check for NOTIFY messages (if NOTIFY is enabled) */
-        if (notify_sockfd >= 0) {
-            fd_set readfds;
-            struct timeval tv;
-            int select_ret;
+        check_due(db);
+        start_jobs(notify_sockfd);
 
-            FD_ZERO(&readfds);
+        /* If not in daemon mode, exit once every zone has been checked and transferred */
+        if (!daemon_mode && !queue_len && !active_workers) {
+            Notice(_("Zone transfer run completed: %d transferred, %d up to date, %d failed in %ld seconds"),
+                   run_transferred, run_current, run_failed, (long)(time(NULL) - start));
+            break;
+        }
+
+        /* Wait until the next zone is due, a NOTIFY arrives or a child exits (at most 1 second) */
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+        if (due_len && scheds[due_heap[0]].due <= now + 1) {
+            tv.tv_sec = scheds[due_heap[0]].due > now ? 1 : 0;
+        }
+
+        FD_ZERO(&readfds);
+        if (notify_sockfd >= 0) {
             FD_SET(notify_sockfd, &readfds);
+        }
+        select_ret = select(notify_sockfd + 1, notify_sockfd >= 0 ? &readfds : NULL, NULL, NULL, &tv);
 
-            /* Wait for 1 second or until NOTIFY arrives */
-            tv.tv_sec = 1;
-            tv.tv_usec = 0;
-
-            select_ret = select(notify_sockfd + 1, &readfds, NULL, NULL, &tv);
-
-            if (select_ret > 0 && FD_ISSET(notify_sockfd, &readfds)) {
-                /* Receive NOTIFY message */
-                notify_addrlen = sizeof(notify_addr);
-                ssize_t recv_len = recvfrom(notify_sockfd, notify_buf, sizeof(notify_buf), 0,
-                                            (struct sockaddr *)&notify_addr, &notify_addrlen);
-
-                if (recv_len > 0) {
-                    char zone_name[256];
-                    uint16_t query_id;
-                    char source_ip[INET_ADDRSTRLEN];
-
-                    /* Get source IP */
-                    inet_ntop(AF_INET, &notify_addr.sin_addr, source_ip, sizeof(source_ip));
-
-                    /* Parse NOTIFY message */
-                    if (axfr_notify_parse(notify_buf, recv_len, zone_name, sizeof(zone_name), &query_id) == 0) {
-                        /* Send NOTIFY response */
-                        axfr_notify_respond(notify_sockfd, query_id, zone_name,
-                                          (struct sockaddr *)&notify_addr, notify_addrlen);
-
-                        /* Process NOTIFY and trigger transfer */
-                        int zone_id = axfr_notify_process(db, zone_name, source_ip);
-                        if (zone_id > 0) {
-                            /* Load zone configuration */
-                            axfr_zone_t *zones = NULL;
-                            int zone_count = 0;
-
-                            if (axfr_load_zones_auto(db, zone_id, &zones, &zone_count) == 0 && zone_count > 0) {
-                                Notice(_("Triggering immediate transfer for zone %s due to NOTIFY"), zone_name);
-
-                                /* Check serial and perform transfer */
-                                if (axfr_check_serial(&zones[0]) == 0) {
-                                    transfer_zone(db, &zones[0]);
-                                } else {
-                                    Notice(_("Zone %s is already up-to-date"), zone_name);
-                                }
-
-                                axfr_free_zone(&zones[0]);
-                                free(zones);
-                            }
-                        }
-                    }
-                }
-            } else if (select_ret < 0 && errno != EINTR) {
-                Warnx(_("select() error: %s"), strerror(errno));
-            }
-        } else {
-            /* No NOTIFY support, just sleep */
-            sleep(1);
+        if (select_ret > 0 && FD_ISSET(notify_sockfd, &readfds)) {
+            read_notifies(db, notify_sockfd);
+        } else if (select_ret < 0 && errno != EINTR) {
+            Warnx(_("select() error: %s"), strerror(errno));
         }
     }
 
-    /* Cleanup */
+    /* Cleanup: let running transfers finish so none is left half-written */
+    while (active_workers > 0) {
+        if (waitpid(-1, NULL, 0) < 0 && errno != EINTR) {
+            break;
+        }
+        active_workers--;
+    }
+    for (int i = 0; i < sched_count; i++) {
+        axfr_free_zone(&scheds[i].zone);
+    }
+    free(scheds);
+    scheds = NULL;
+    free(due_heap);
+    due_heap = NULL;
+    free(queue);
+    queue = NULL;
+    for (int i = 0; i < max_jobs; i++) {
+        free(workers[i].master_host);
+    }
+    free(workers);
+    workers = NULL;
+
     if (notify_sockfd >= 0) {
         close(notify_sockfd);
     }
@@ -311,6 +928,9 @@ static void usage(void) {
     printf("  -c FILE     Configuration file (default: /etc/mydns.conf)\n");
     printf("  -d          Daemon mode (run continuously)\n");
     printf("  -f          Foreground mode (don't daemonize)\n");
+    printf("  -j JOBS     Zones checked/transferred at once (default: %d)\n", XFER_DEFAULT_JOBS);
+    printf("  -m JOBS     Zones checked/transferred at once per master (default: %d)\n",
+           XFER_DEFAULT_MASTER_JOBS);
     printf("  -z ZONE_ID  Transfer only specific zone\n");
     printf("  -h          Show this help\n");
     printf("  -v          Show version\n");
@@ -328,7 +948,7 @@ int main(int argc, char **argv) {
     int opt;
 
     /* Parse command line options */
-    while ((opt = getopt(argc, argv, "c:dfz:hv")) != -1) {
+    while ((opt = getopt(argc, argv, "c:dfj:m:z:hv")) != -1) {
         switch (opt) {
             case 'c':
                 config_file = optarg;
@@ -339,6 +959,14 @@ int main(int argc, char **argv) {
             case 'f':
                 foreground = 1;
                 break;
+            case 'j':
+                max_jobs = atoi(optarg);
+                if (max_jobs < 1) max_jobs = 1;
+                break;
+            case 'm':
+                max_master_jobs = atoi(optarg);
+                if (max_master_jobs < 1) max_master_jobs = 1;
+                break;
             case 'z':
                 specific_zone = atoi(optarg);
                 break;
@@ -355,14 +983,14 @@ int main(int argc, char **argv) {
     }
 
     /* Load configuration */
-    if (load_config() < 0) {
-        Err(_("Failed to load configuration from %s"), config_file);
-    }
+    opt_conf = config_file;
+    load_config();
 
     /* Set up signal handlers */
     signal(SIGTERM, signal_handler);
     signal(SIGINT, signal_handler);
     signal(SIGHUP, signal_handler);
+    signal(SIGCHLD, signal_handler);
 
     /* Initialize AXFR module */
     if (axfr_init() < 0) {
@@ -377,11 +1005,14 @@ int main(int argc, char **argv) {
     }
     Notice(_("Memzone initialized successfully"));
 
-    /* Connect to database */
-    db = sql_open(SQL_ZERO_IS_NULL);
+    /* Connect to database; sql_open() also saves the login for the children's connections */
+    sql_open(conf_get(&Conf, "db-user", NULL), conf_get(&Conf, "db-password", NULL),
+             conf_get(&Conf, "db-host", NULL), conf_get(&Conf, "database", NULL));
+    db = sql;
     if (!db) {
         Err(_("Failed to connect to database"));
     }
+    db_check_optional();
 
     /* Load ACL rules from database into memzone */
     int acl_count = memzone_load_acl_from_db(Memzone, db);
@@ -415,7 +1046,8 @@ int main(int argc, char **argv) {
     }
 
     axfr_free();
-    sql_close(db);
+    auditlog_close();
+    sql_close(sql);
 
     return 0;
 }